@@ -1,8 +1,14 @@
 #include <string.h>
+#include <math.h>
 
 #include <a2blocked.h>
+#include "assert.h"
 #include "uarray2b.h"
+#include "uarray2bext.h"
 #include "uarray2.h"
+#include "a2prefetch.h"
+#include "a2compressed.h"
+#include "a2parallel.h"
 
 
 typedef A2Methods_UArray2 A2;   
@@ -17,6 +23,36 @@ static A2 new_with_blocksize(int width, int height, int size, int blocksize)
         return UArray2b_new(width, height, size, blocksize);
 }
 
+/* blocks kept decoded by arrays from the compressed table */
+static int cache_blocks = A2COMPRESSED_DEFAULT_CACHE;
+
+void A2Compressed_set_cache_blocks(int blocks)
+{
+        assert(blocks >= 2);
+        cache_blocks = blocks;
+}
+
+int A2Compressed_cache_blocks(void)
+{
+        return cache_blocks;
+}
+
+static A2 new_compressed(int width, int height, int size)
+{
+        assert(size > 0);
+        int blocksize = size > 1024 * 64 ? 1
+                                         : (int)floor(sqrt(1024 * 64 / size));
+        return UArray2b_new_compressed(width, height, size, blocksize,
+                                       cache_blocks);
+}
+
+static A2 new_compressed_with_blocksize(int width, int height, int size,
+                                        int blocksize)
+{
+        return UArray2b_new_compressed(width, height, size, blocksize,
+                                       cache_blocks);
+}
+
 static void a2free(A2 * array2p)
 {
         UArray2b_free((UArray2b_T *) array2p);
@@ -51,6 +87,27 @@ static void map_block_major(A2 array2, A2Methods_applyfun apply, void *cl)
         UArray2b_map(array2, (applyfun *) apply, cl);
 }
 
+/* blocks ahead prefetched by the prefetch table's block-major map */
+static int block_distance = A2PREFETCH_DEFAULT_BLOCKS;
+
+void A2Prefetch_set_block_distance(int distance)
+{
+        assert(distance >= 0);
+        block_distance = distance;
+}
+
+int A2Prefetch_block_distance(void)
+{
+        return block_distance;
+}
+
+static void map_block_major_prefetch(A2 array2, A2Methods_applyfun apply,
+                                     void *cl)
+{
+        UArray2b_map_prefetch(array2, (applyfun *) apply, cl,
+                              block_distance);
+}
+
 struct small_closure {
         A2Methods_smallapplyfun *apply;
         void *cl;
@@ -94,3 +151,92 @@ static struct A2Methods_T uarray2_methods_blocked_struct = {
 // finally the payoff: here is the exported pointer to the struct
 
 A2Methods_T uarray2_methods_blocked = &uarray2_methods_blocked_struct;
+
+// same as above, but block-major maps prefetch upcoming blocks
+
+static struct A2Methods_T uarray2_methods_blocked_prefetch_struct = {
+        new,
+        new_with_blocksize,
+        a2free,
+        width,
+        height,
+        size,
+        blocksize,
+        at,
+        NULL,                   // map_row_major
+        NULL,                   // map_col_major
+        map_block_major_prefetch,
+        map_block_major_prefetch, // map_default
+        NULL,                   // small_map_row_major
+        NULL,                   // small_map_col_major
+        small_map_block_major,
+        small_map_block_major,  // small_map_default
+};
+
+A2Methods_T uarray2_methods_blocked_prefetch =
+        &uarray2_methods_blocked_prefetch_struct;
+
+// same as uarray2_methods_blocked, but blocks are kept compressed
+
+static struct A2Methods_T uarray2_methods_blocked_compressed_struct = {
+        new_compressed,
+        new_compressed_with_blocksize,
+        a2free,
+        width,
+        height,
+        size,
+        blocksize,
+        at,
+        NULL,                   // map_row_major
+        NULL,                   // map_col_major
+        map_block_major,
+        map_block_major,        // map_default
+        NULL,                   // small_map_row_major
+        NULL,                   // small_map_col_major
+        small_map_block_major,
+        small_map_block_major,  // small_map_default
+};
+
+A2Methods_T uarray2_methods_blocked_compressed =
+        &uarray2_methods_blocked_compressed_struct;
+
+// parallel maps: each thread maps a range of whole blocks (see
+// a2parallel.h for the contract on apply)
+
+struct prange_closure {
+        UArray2b_T array;
+        applyfun *apply;
+        void *cl;
+};
+
+static void blocks_range(int first, int last, void *vcl)
+{
+        struct prange_closure *p = vcl;
+        UArray2b_map_range(p->array, p->apply, p->cl, first, last);
+}
+
+static void pmap_block_major(A2 array2, A2Methods_applyfun apply, void *cl)
+{
+        struct prange_closure p = { array2, (applyfun *) apply, cl };
+        A2Parallel_for(UArray2b_num_blocks(array2), blocks_range, &p);
+}
+
+static void small_pmap_block_major(A2 a2, A2Methods_smallapplyfun apply,
+                                   void *cl)
+{
+        struct small_closure mycl = { apply, cl };
+        pmap_block_major(a2, (A2Methods_applyfun *) apply_small, &mycl);
+}
+
+static struct A2PMethods_T uarray2_pmethods_blocked_struct = {
+        NULL,                   // pmap_row_major
+        NULL,                   // pmap_col_major
+        pmap_block_major,
+        pmap_block_major,       // pmap_default
+        NULL,                   // small_pmap_row_major
+        NULL,                   // small_pmap_col_major
+        small_pmap_block_major,
+        small_pmap_block_major, // small_pmap_default
+};
+
+A2PMethods_T uarray2_pmethods_blocked = &uarray2_pmethods_blocked_struct;
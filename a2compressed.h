@@ -0,0 +1,32 @@
+#ifndef A2COMPRESSED_INCLUDED
+#define A2COMPRESSED_INCLUDED
+/**************************************************************
+ *
+ *      a2compressed.h
+ *
+ *      Xiaoyan Xie (xxie05)
+ *      Diwei Chen (dchen22)
+ *
+ *      CS 40 HW03 - locality
+ *
+ *      uarray2_methods_blocked_compressed is uarray2_methods_blocked
+ *      over arrays made by UArray2b_new_compressed: blocks are held
+ *      run-length encoded and decoded into a small LRU cache when
+ *      they are used, trading CPU time for resident memory.
+ *
+ *      The cache size of newly created arrays is a process-wide
+ *      setting, like the prefetch distances in a2prefetch.h.
+ *      Arrays from this table must only be used by one thread.
+ *
+ **************************************************************/
+
+#include "a2methods.h"
+
+#define A2COMPRESSED_DEFAULT_CACHE 8
+
+extern A2Methods_T uarray2_methods_blocked_compressed;
+
+extern void A2Compressed_set_cache_blocks(int blocks);
+extern int  A2Compressed_cache_blocks(void);
+
+#endif
@@ -0,0 +1,211 @@
+/**************************************************************
+ *
+ *      a2parallel.c
+ *
+ *      Xiaoyan Xie (xxie05)
+ *      Diwei Chen (dchen22)
+ *
+ *      CS 40 HW03 - locality
+ *
+ *      This file holds the executor behind the parallel maps
+ *      (see a2parallel.h) and the partitioning they share.  The
+ *      maps themselves are in a2plain.c and a2blocked.c, next to
+ *      the sequential ones.
+ *
+ **************************************************************/
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "assert.h"
+#include "a2methods.h"
+#include "a2plain.h"
+#include "a2blocked.h"
+#include "a2prefetch.h"
+#include "a2parallel.h"
+#include "threadpool.h"
+
+/* ranges per thread: a little slack so uneven ranges balance */
+#define RANGES_PER_THREAD 4
+
+/* the executor; run == NULL means the default pool */
+static A2Parallel_executor *executor_run = NULL;
+static void *executor_self = NULL;
+static int executor_threads = 0;
+
+/* the default pool and the maps running on it; a pool replaced
+ * while in use is freed by the last of them */
+struct shared_pool {
+        ThreadPool_T pool;
+        int users;
+};
+
+static struct shared_pool *default_pool = NULL;
+static int pool_threads = 0;            /* 0: one per online cpu */
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void free_shared_pool(struct shared_pool *shared)
+{
+        ThreadPool_free(&shared->pool);
+        free(shared);
+}
+
+static int online_cpus(void)
+{
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        return cpus > 0 ? (int)cpus : 1;
+}
+
+static void pool_run(void *self, int tasks, void task(int k, void *cl),
+                     void *cl)
+{
+        ThreadPool_run(self, tasks, task, cl);
+}
+
+/****************** A2Parallel_set_executor ***************
+ * Makes run (with self) the executor of later parallel
+ * maps, which split their work for `threads` threads; a NULL
+ * run restores the default pool.
+ *********************************************************/
+void A2Parallel_set_executor(A2Parallel_executor *run, void *self,
+                             int threads)
+{
+        assert(run == NULL || threads >= 1);
+        pthread_mutex_lock(&pool_lock);
+        executor_run = run;
+        executor_self = self;
+        executor_threads = run != NULL ? threads : 0;
+        pthread_mutex_unlock(&pool_lock);
+}
+
+/****************** A2Parallel_set_threads ****************
+ * Sets the size of the default pool (0: one thread per
+ * online cpu).  An existing pool of another size is replaced
+ * on next use (and freed once maps running on it finish);
+ * one of this size is kept.
+ *********************************************************/
+void A2Parallel_set_threads(int threads)
+{
+        assert(threads >= 0);
+        pthread_mutex_lock(&pool_lock);
+        if (default_pool != NULL && threads != pool_threads) {
+                if (default_pool->users == 0) {
+                        free_shared_pool(default_pool);
+                }
+                default_pool = NULL;
+        }
+        pool_threads = threads;
+        pthread_mutex_unlock(&pool_lock);
+}
+
+/******************** A2Parallel_threads ******************
+ * Returns the number of threads parallel maps split for.
+ *********************************************************/
+int A2Parallel_threads(void)
+{
+        pthread_mutex_lock(&pool_lock);
+        int threads = executor_run != NULL ? executor_threads
+                    : default_pool != NULL
+                            ? ThreadPool_size(default_pool->pool)
+                    : pool_threads;
+        pthread_mutex_unlock(&pool_lock);
+        return threads > 0 ? threads : online_cpus();
+}
+
+struct ranges {
+        int items, count;
+        void (*range)(int first, int last, void *cl);
+        void *cl;
+};
+
+static void run_range(int k, void *vcl)
+{
+        struct ranges *r = vcl;
+        int first = (long)r->items * k / r->count;
+        int last = (long)r->items * (k + 1) / r->count;
+        if (first < last) {
+                r->range(first, last, r->cl);
+        }
+}
+
+/********************* A2Parallel_for *********************
+ * Splits 0 .. items-1 into contiguous ranges and runs
+ * range(first, last, cl) for each on the executor.
+ *
+ * Parameters:
+ *      int items: Number of items (rows, columns, blocks).
+ *      void range(int first, int last, void *cl): Handles
+ *              items [first, last); called concurrently.
+ *      void *cl: Closure for range.
+ *
+ * Expects:
+ *      items must be non-negative and range not NULL.
+ *
+ * Notes:
+ *      With one thread, range is called once, directly.  The
+ *      default pool is held for the whole dispatch, so
+ *      A2Parallel_set_threads may run meanwhile.
+ *********************************************************/
+void A2Parallel_for(int items, void range(int first, int last, void *cl),
+                    void *cl)
+{
+        assert(items >= 0 && range != NULL);
+        int threads = A2Parallel_threads();
+        if (threads == 1 || items <= 1) {
+                if (items > 0) {
+                        range(0, items, cl);
+                }
+                return;
+        }
+
+        pthread_mutex_lock(&pool_lock);
+        A2Parallel_executor *run = executor_run;
+        void *self = executor_self;
+        struct shared_pool *shared = NULL;
+        if (run == NULL) {
+                if (default_pool == NULL) {
+                        default_pool = malloc(sizeof(*default_pool));
+                        assert(default_pool != NULL);
+                        default_pool->pool = ThreadPool_new(threads);
+                        default_pool->users = 0;
+                }
+                shared = default_pool;
+                shared->users++;
+                run = pool_run;
+                self = shared->pool;
+        }
+        pthread_mutex_unlock(&pool_lock);
+
+        struct ranges r = { items, threads * RANGES_PER_THREAD, range, cl };
+        if (r.count > items) {
+                r.count = items;
+        }
+        run(self, r.count, run_range, &r);
+
+        if (shared != NULL) {
+                pthread_mutex_lock(&pool_lock);
+                shared->users--;
+                if (shared->users == 0 && shared != default_pool) {
+                        free_shared_pool(shared);
+                }
+                pthread_mutex_unlock(&pool_lock);
+        }
+}
+
+/******************* A2Parallel_methods *******************
+ * Returns the parallel maps that go with methods: the plain
+ * ones for UArray2 tables and the blocked ones for UArray2b
+ * tables with ordinary block storage.  Others (compressed
+ * blocks, views) copy cells on access and get NULL.
+ *********************************************************/
+A2PMethods_T A2Parallel_methods(A2Methods_T methods)
+{
+        if (methods == uarray2_methods_plain ||
+            methods == uarray2_methods_plain_prefetch) {
+                return uarray2_pmethods_plain;
+        }
+        if (methods == uarray2_methods_blocked ||
+            methods == uarray2_methods_blocked_prefetch) {
+                return uarray2_pmethods_blocked;
+        }
+        return NULL;
+}
@@ -0,0 +1,73 @@
+#ifndef A2PARALLEL_INCLUDED
+#define A2PARALLEL_INCLUDED
+/**************************************************************
+ *
+ *      a2parallel.h
+ *
+ *      Xiaoyan Xie (xxie05)
+ *      Diwei Chen (dchen22)
+ *
+ *      CS 40 HW03 - locality
+ *
+ *      Parallel counterparts of the A2Methods maps.  An
+ *      A2PMethods_T holds, for one A2Methods_T, maps with the same
+ *      types as its map functions that split the rows, columns or
+ *      blocks of the array into contiguous ranges and run the
+ *      ranges at once on an executor.  Within a range cells are
+ *      visited in the sequential map's order; ranges run in no
+ *      particular order.
+ *
+ *      Contract for apply functions passed to a parallel map:
+ *        - apply is called concurrently from several threads, each
+ *          time for a different cell, with the same closure; it
+ *          must be reentrant, and anything it writes outside its
+ *          cell (counters in cl, another array) must either be
+ *          disjoint per cell or synchronized by apply;
+ *        - apply must not itself start a parallel map.
+ *      A map returns only after every apply call has returned.
+ *
+ *      The executor is pluggable.  By default it is a persistent
+ *      thread pool (threadpool.h) with one thread per online CPU,
+ *      started on first use; A2Parallel_set_threads resizes it and
+ *      A2Parallel_set_executor replaces it, for example with a
+ *      caller's own pool.
+ *
+ **************************************************************/
+
+#include "a2methods.h"
+
+typedef const struct A2PMethods_T {
+        A2Methods_mapfun *pmap_row_major;
+        A2Methods_mapfun *pmap_col_major;
+        A2Methods_mapfun *pmap_block_major;
+        A2Methods_mapfun *pmap_default;
+        A2Methods_smallmapfun *small_pmap_row_major;
+        A2Methods_smallmapfun *small_pmap_col_major;
+        A2Methods_smallmapfun *small_pmap_block_major;
+        A2Methods_smallmapfun *small_pmap_default;
+} *A2PMethods_T;
+
+extern A2PMethods_T uarray2_pmethods_plain;
+extern A2PMethods_T uarray2_pmethods_blocked;
+
+/* the parallel maps for methods, or NULL if it has none (arrays
+ * that are not safe to reach from several threads) */
+extern A2PMethods_T A2Parallel_methods(A2Methods_T methods);
+
+/* an executor runs task(k, cl) for k in 0 .. tasks-1, possibly at
+ * once, and returns when all have finished */
+typedef void A2Parallel_executor(void *self, int tasks,
+                                 void task(int k, void *cl), void *cl);
+
+extern void A2Parallel_set_executor(A2Parallel_executor *run, void *self,
+                                    int threads);
+extern void A2Parallel_set_threads(int threads);
+extern int  A2Parallel_threads(void);
+
+/* runs range(first, last, cl) over a partition of 0 .. items-1 on
+ * the executor; the building block of the maps above */
+extern void A2Parallel_for(int items,
+                           void range(int first, int last, void *cl),
+                           void *cl);
+
+#endif
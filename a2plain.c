@@ -11,8 +11,12 @@
  */
 
 #include <string.h>
+#include "assert.h"
 #include <a2plain.h>
 #include "uarray2.h"
+#include "uarray2ext.h"
+#include "a2prefetch.h"
+#include "a2parallel.h"
 
 
 typedef A2Methods_UArray2 A2; /* private abbreviation */
@@ -254,6 +258,44 @@ static void map_col_major(A2Methods_UArray2 uarray2,
         UArray2_map_col_major(uarray2, (UArray2_applyfun*)apply, cl);
 }
 
+/* rows ahead prefetched by the col-major map of the prefetch table */
+static int row_distance = A2PREFETCH_DEFAULT_ROWS;
+
+/********** A2Prefetch_set_row_distance() ********
+ *
+ * Sets how many rows ahead map_col_major of
+ * uarray2_methods_plain_prefetch prefetches; 0 disables it
+ *
+ * Parameters:
+ *      int distance: rows ahead, non-negative
+ *
+ * Return: none
+ ************************/
+void A2Prefetch_set_row_distance(int distance)
+{
+        assert(distance >= 0);
+        row_distance = distance;
+}
+
+int A2Prefetch_row_distance(void)
+{
+        return row_distance;
+}
+
+/********** map_col_major_prefetch() ********
+ *
+ * Iterate through the A2 in column major order, prefetching the
+ * cell row_distance rows further down the column before each visit
+ * 
+ * Parameters and Notes: as for map_col_major
+ ************************/
+static void map_col_major_prefetch(A2Methods_UArray2 uarray2,
+                                   A2Methods_applyfun apply, void *cl)
+{
+        UArray2_map_col_major_prefetch(uarray2, (UArray2_applyfun*)apply,
+                                       cl, row_distance);
+}
+
 
 struct small_closure {
         A2Methods_smallapplyfun *apply; 
@@ -318,3 +360,109 @@ static struct A2Methods_T uarray2_methods_plain_struct = {
         small_map_row_major,/*small_map_default*/
 };
 A2Methods_T uarray2_methods_plain = &uarray2_methods_plain_struct;
+
+/********** uarray2_methods_plain_prefetch_struct ********
+ *
+ * Same as uarray2_methods_plain, except that map_col_major issues
+ * software prefetches (see A2Prefetch_set_row_distance).  Row-major
+ * traversal is sequential and left to the hardware prefetcher.
+ */
+static struct A2Methods_T uarray2_methods_plain_prefetch_struct = {
+        new,/*new*/
+        new_with_blocksize,/*new_with_blocksize*/
+        a2free,/*free*/
+        width,/*width*/
+        height,/*height*/
+        size,/*size*/
+        blocksize,/*blocksize*/
+        at,/*at*/
+        map_row_major,
+        map_col_major_prefetch,
+        NULL,/*map_block_major*/
+        map_row_major,/*map_default*/
+        small_map_row_major,
+        small_map_col_major,
+        NULL,/*small_map_block_major*/
+        small_map_row_major,/*small_map_default*/
+};
+A2Methods_T uarray2_methods_plain_prefetch =
+        &uarray2_methods_plain_prefetch_struct;
+
+/********** parallel maps ********
+ *
+ * pmap_row_major hands each thread a band of rows and pmap_col_major
+ * a band of columns (see a2parallel.h for the contract on apply).
+ * Rows are walked through UArray2_row, columns through UArray2_at.
+ */
+struct prange_closure {
+        UArray2_T array;
+        A2Methods_applyfun *apply;
+        void *cl;
+};
+
+static void rows_range(int first, int last, void *vcl)
+{
+        struct prange_closure *p = vcl;
+        int w = UArray2_width(p->array);
+        int size = UArray2_size(p->array);
+        for (int j = first; j < last; j++) {
+                char *row = UArray2_row(p->array, j);
+                for (int i = 0; i < w; i++) {
+                        p->apply(i, j, p->array, row + (long)i * size, p->cl);
+                }
+        }
+}
+
+static void cols_range(int first, int last, void *vcl)
+{
+        struct prange_closure *p = vcl;
+        int h = UArray2_height(p->array);
+        for (int i = first; i < last; i++) {
+                for (int j = 0; j < h; j++) {
+                        p->apply(i, j, p->array, UArray2_at(p->array, i, j),
+                                 p->cl);
+                }
+        }
+}
+
+static void pmap_row_major(A2Methods_UArray2 uarray2,
+                           A2Methods_applyfun apply, void *cl)
+{
+        struct prange_closure p = { uarray2, apply, cl };
+        A2Parallel_for(UArray2_height(uarray2), rows_range, &p);
+}
+
+static void pmap_col_major(A2Methods_UArray2 uarray2,
+                           A2Methods_applyfun apply, void *cl)
+{
+        struct prange_closure p = { uarray2, apply, cl };
+        A2Parallel_for(UArray2_width(uarray2), cols_range, &p);
+}
+
+static void small_pmap_row_major(A2Methods_UArray2        a2,
+                                 A2Methods_smallapplyfun  apply,
+                                 void *cl)
+{
+        struct small_closure mycl = { apply, cl };
+        pmap_row_major(a2, (A2Methods_applyfun *)apply_small, &mycl);
+}
+
+static void small_pmap_col_major(A2Methods_UArray2        a2,
+                                 A2Methods_smallapplyfun  apply,
+                                 void *cl)
+{
+        struct small_closure mycl = { apply, cl };
+        pmap_col_major(a2, (A2Methods_applyfun *)apply_small, &mycl);
+}
+
+static struct A2PMethods_T uarray2_pmethods_plain_struct = {
+        pmap_row_major,
+        pmap_col_major,
+        NULL,/*pmap_block_major*/
+        pmap_row_major,/*pmap_default*/
+        small_pmap_row_major,
+        small_pmap_col_major,
+        NULL,/*small_pmap_block_major*/
+        small_pmap_row_major,/*small_pmap_default*/
+};
+A2PMethods_T uarray2_pmethods_plain = &uarray2_pmethods_plain_struct;
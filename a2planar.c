@@ -0,0 +1,581 @@
+/**************************************************************
+ *
+ *      a2planar.c
+ *
+ *      Xiaoyan Xie (xxie05)
+ *      Diwei Chen (dchen22)
+ *
+ *      CS 40 HW03 - locality
+ *
+ *      This file implements planar images (see a2planar.h).  Both
+ *      geometries are described by two tables: the sample (col,
+ *      row) of every plane is at row_offset[row] + col_offset[col].
+ *      For rows these are row * width and col; for blocks of side
+ *      B they add the block's start to the offset inside it.  Edge
+ *      blocks are padded, and the padding samples stay zero.
+ *
+ **************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "assert.h"
+#include "a2methods.h"
+#include "a2planar.h"
+
+#define TILE 64                 /* destination tile side for rows */
+#define ALIGN 64                /* plane alignment in bytes */
+
+typedef A2Methods_UArray2 A2;
+
+/* a cell handed out by at(); col < 0 when the slot is free */
+struct slot {
+        int col, row;
+        unsigned long used;     /* clock of the last at() */
+        struct Pnm_rgb cell;
+};
+
+/********************** struct planar *********************
+ * A planar array: its geometry, the three planes (one
+ * allocation) and the staging slots used by at().
+ *********************************************************/
+struct planar {
+        int width, height;
+        int blocksize;          /* 1 for rows */
+        long plane_cells;       /* samples per plane, with padding */
+        long *row_offset;
+        long *col_offset;
+        uint16_t *planes[3];
+        void *storage;
+        struct slot slots[A2PLANAR_STAGED];
+        unsigned long clock;
+};
+
+static inline long offset(const struct planar *p, int col, int row)
+{
+        return p->row_offset[row] + p->col_offset[col];
+}
+
+static struct planar *planar_new(int width, int height, int size,
+                                 int blocksize)
+{
+        assert(width >= 0 && height >= 0 && blocksize >= 1);
+        assert(size == sizeof(struct Pnm_rgb));
+
+        struct planar *p = malloc(sizeof(*p));
+        assert(p != NULL);
+        p->width = width;
+        p->height = height;
+        p->blocksize = blocksize;
+        int bs = blocksize;
+        long blocks_wide = (width + bs - 1) / bs;
+        long blocks_high = (height + bs - 1) / bs;
+        p->plane_cells = blocks_wide * blocks_high * bs * bs;
+
+        p->row_offset = malloc((height + 1) * sizeof(long));
+        p->col_offset = malloc((width + 1) * sizeof(long));
+        assert(p->row_offset != NULL && p->col_offset != NULL);
+        for (int j = 0; j < height; j++) {
+                p->row_offset[j] = (j / bs) * blocks_wide * bs * bs +
+                                   (long)(j % bs) * bs;
+        }
+        for (int i = 0; i < width; i++) {
+                p->col_offset[i] = (long)(i / bs) * bs * bs + i % bs;
+        }
+
+        /* each plane starts on an ALIGN boundary */
+        long plane_bytes = (p->plane_cells * sizeof(uint16_t) + ALIGN - 1)
+                           / ALIGN * ALIGN;
+        int failed = posix_memalign(&p->storage, ALIGN, 3 * plane_bytes);
+        assert(failed == 0);
+        memset(p->storage, 0, 3 * plane_bytes);
+        for (int c = 0; c < 3; c++) {
+                p->planes[c] = (uint16_t *)((char *)p->storage +
+                                            c * plane_bytes);
+        }
+
+        for (int k = 0; k < A2PLANAR_STAGED; k++) {
+                p->slots[k].col = -1;
+                p->slots[k].used = 0;
+        }
+        p->clock = 0;
+        return p;
+}
+
+static inline void load(const struct planar *p, int col, int row,
+                        struct Pnm_rgb *cell)
+{
+        long o = offset(p, col, row);
+        cell->red = p->planes[0][o];
+        cell->green = p->planes[1][o];
+        cell->blue = p->planes[2][o];
+}
+
+static inline void store(struct planar *p, int col, int row,
+                         const struct Pnm_rgb *cell)
+{
+        long o = offset(p, col, row);
+        p->planes[0][o] = cell->red;
+        p->planes[1][o] = cell->green;
+        p->planes[2][o] = cell->blue;
+}
+
+/* writes back and frees every slot in use */
+static void flush(struct planar *p)
+{
+        for (int k = 0; k < A2PLANAR_STAGED; k++) {
+                struct slot *s = &p->slots[k];
+                if (s->col >= 0) {
+                        store(p, s->col, s->row, &s->cell);
+                        s->col = -1;
+                        s->used = 0;
+                }
+        }
+}
+
+/* rows: blocksize is meaningless and ignored */
+static A2 new(int width, int height, int size)
+{
+        return planar_new(width, height, size, 1);
+}
+
+static A2 new_with_blocksize(int width, int height, int size, int blocksize)
+{
+        (void)blocksize;
+        return planar_new(width, height, size, 1);
+}
+
+/* blocks: by default the three planes' blocks together fill
+ * 64KB, as for uarray2_methods_blocked, with a side that is a
+ * multiple of 8 */
+static A2 new_blocked(int width, int height, int size)
+{
+        int bs = (int)floor(sqrt(1024 * 64 / (3 * sizeof(uint16_t))));
+        return planar_new(width, height, size, bs / 8 * 8);
+}
+
+static A2 new_blocked_with_blocksize(int width, int height, int size,
+                                     int blocksize)
+{
+        return planar_new(width, height, size, blocksize);
+}
+
+static void a2free(A2 *array2p)
+{
+        assert(array2p != NULL && *array2p != NULL);
+        struct planar *p = *array2p;
+        free(p->storage);
+        free(p->row_offset);
+        free(p->col_offset);
+        free(p);
+        *array2p = NULL;
+}
+
+static int width(A2 array2)
+{
+        struct planar *p = array2;
+        assert(p != NULL);
+        return p->width;
+}
+
+static int height(A2 array2)
+{
+        struct planar *p = array2;
+        assert(p != NULL);
+        return p->height;
+}
+
+static int size(A2 array2)
+{
+        (void)array2;
+        return sizeof(struct Pnm_rgb);
+}
+
+static int blocksize(A2 array2)
+{
+        struct planar *p = array2;
+        assert(p != NULL);
+        return p->blocksize;
+}
+
+/************************* at *****************************
+ * Returns the staging cell for (i, j): the slot that
+ * already holds it, or the least recently used slot,
+ * written back and then loaded from the planes.
+ *********************************************************/
+static A2Methods_Object *at(A2 array2, int i, int j)
+{
+        struct planar *p = array2;
+        assert(p != NULL);
+        assert(i >= 0 && i < p->width && j >= 0 && j < p->height);
+        struct slot *s = &p->slots[0];
+        for (int k = 0; k < A2PLANAR_STAGED; k++) {
+                struct slot *t = &p->slots[k];
+                if (t->col == i && t->row == j) {
+                        t->used = ++p->clock;
+                        return &t->cell;
+                }
+                if (t->used < s->used) {
+                        s = t;
+                }
+        }
+        if (s->col >= 0) {
+                store(p, s->col, s->row, &s->cell);
+        }
+        s->col = i;
+        s->row = j;
+        s->used = ++p->clock;
+        load(p, i, j, &s->cell);
+        return &s->cell;
+}
+
+static void map_row_major(A2 array2, A2Methods_applyfun apply, void *cl)
+{
+        struct planar *p = array2;
+        assert(p != NULL && apply != NULL);
+        for (int j = 0; j < p->height; j++) {
+                for (int i = 0; i < p->width; i++) {
+                        apply(i, j, array2, at(array2, i, j), cl);
+                }
+        }
+        flush(p);
+}
+
+static void map_col_major(A2 array2, A2Methods_applyfun apply, void *cl)
+{
+        struct planar *p = array2;
+        assert(p != NULL && apply != NULL);
+        for (int i = 0; i < p->width; i++) {
+                for (int j = 0; j < p->height; j++) {
+                        apply(i, j, array2, at(array2, i, j), cl);
+                }
+        }
+        flush(p);
+}
+
+static void map_block_major(A2 array2, A2Methods_applyfun apply, void *cl)
+{
+        struct planar *p = array2;
+        assert(p != NULL && apply != NULL);
+        int bs = p->blocksize;
+        for (int by = 0; by < p->height; by += bs) {
+                for (int bx = 0; bx < p->width; bx += bs) {
+                        int ey = by + bs < p->height ? by + bs : p->height;
+                        int ex = bx + bs < p->width ? bx + bs : p->width;
+                        for (int j = by; j < ey; j++) {
+                                for (int i = bx; i < ex; i++) {
+                                        apply(i, j, array2,
+                                              at(array2, i, j), cl);
+                                }
+                        }
+                }
+        }
+        flush(p);
+}
+
+struct small_closure {
+        A2Methods_smallapplyfun *apply;
+        void *cl;
+};
+
+static void apply_small(int i, int j, A2 array2, void *elem, void *vcl)
+{
+        struct small_closure *cl = vcl;
+        (void)i;
+        (void)j;
+        (void)array2;
+        cl->apply(elem, cl->cl);
+}
+
+static void small_map_row_major(A2 a2, A2Methods_smallapplyfun apply,
+                                void *cl)
+{
+        struct small_closure mycl = { apply, cl };
+        map_row_major(a2, apply_small, &mycl);
+}
+
+static void small_map_col_major(A2 a2, A2Methods_smallapplyfun apply,
+                                void *cl)
+{
+        struct small_closure mycl = { apply, cl };
+        map_col_major(a2, apply_small, &mycl);
+}
+
+static void small_map_block_major(A2 a2, A2Methods_smallapplyfun apply,
+                                  void *cl)
+{
+        struct small_closure mycl = { apply, cl };
+        map_block_major(a2, apply_small, &mycl);
+}
+
+static struct A2Methods_T uarray2_methods_planar_struct = {
+        new,
+        new_with_blocksize,
+        a2free,
+        width,
+        height,
+        size,
+        blocksize,
+        at,
+        map_row_major,
+        map_col_major,
+        NULL,                   // map_block_major
+        map_row_major,          // map_default
+        small_map_row_major,
+        small_map_col_major,
+        NULL,                   // small_map_block_major
+        small_map_row_major,    // small_map_default
+};
+
+A2Methods_T uarray2_methods_planar = &uarray2_methods_planar_struct;
+
+static struct A2Methods_T uarray2_methods_planar_blocked_struct = {
+        new_blocked,
+        new_blocked_with_blocksize,
+        a2free,
+        width,
+        height,
+        size,
+        blocksize,
+        at,
+        NULL,                   // map_row_major
+        NULL,                   // map_col_major
+        map_block_major,
+        map_block_major,        // map_default
+        NULL,                   // small_map_row_major
+        NULL,                   // small_map_col_major
+        small_map_block_major,
+        small_map_block_major,  // small_map_default
+};
+
+A2Methods_T uarray2_methods_planar_blocked =
+        &uarray2_methods_planar_blocked_struct;
+
+bool A2Planar_is(A2Methods_T methods)
+{
+        return methods == uarray2_methods_planar ||
+               methods == uarray2_methods_planar_blocked;
+}
+
+/********************* A2Planar_flush *********************
+ * Writes the cells staged by at() back to the planes.
+ *
+ * Parameters:
+ *      A2 array: A planar array.
+ *
+ * Returns:
+ *      None
+ *
+ * Notes:
+ *      Pointers handed out by at() are no longer valid.
+ *********************************************************/
+void A2Planar_flush(A2 array)
+{
+        assert(array != NULL);
+        flush(array);
+}
+
+/******************** A2Planar_get_row ********************
+ * Copies count cells of a row, from column first on, out
+ * of the planes as interleaved struct Pnm_rgb.
+ *
+ * Parameters:
+ *      A2 array: A planar array.
+ *      int row, first, count: The cells to copy.
+ *      struct Pnm_rgb *cells: Room for count cells.
+ *
+ * Returns:
+ *      None
+ *
+ * Expects:
+ *      The cells are inside the array.
+ *********************************************************/
+void A2Planar_get_row(A2 array, int row, int first, int count,
+                      struct Pnm_rgb *cells)
+{
+        struct planar *p = array;
+        assert(p != NULL && cells != NULL);
+        assert(row >= 0 && row < p->height && first >= 0 && count >= 0 &&
+               first + count <= p->width);
+        flush(p);
+        const uint16_t *r = p->planes[0] + p->row_offset[row];
+        const uint16_t *g = p->planes[1] + p->row_offset[row];
+        const uint16_t *b = p->planes[2] + p->row_offset[row];
+        for (int i = 0; i < count; i++) {
+                long o = p->col_offset[first + i];
+                cells[i].red = r[o];
+                cells[i].green = g[o];
+                cells[i].blue = b[o];
+        }
+}
+
+/******************** A2Planar_put_row ********************
+ * Copies count interleaved cells into a row of the planes,
+ * from column first on.
+ *
+ * Parameters:
+ *      A2 array: A planar array.
+ *      int row, first, count: The cells to replace.
+ *      const struct Pnm_rgb *cells: The new cells.
+ *
+ * Returns:
+ *      None
+ *
+ * Expects:
+ *      The cells are inside the array.  Samples are stored in
+ *      16 bits.
+ *********************************************************/
+void A2Planar_put_row(A2 array, int row, int first, int count,
+                      const struct Pnm_rgb *cells)
+{
+        struct planar *p = array;
+        assert(p != NULL && cells != NULL);
+        assert(row >= 0 && row < p->height && first >= 0 && count >= 0 &&
+               first + count <= p->width);
+        flush(p);
+        uint16_t *r = p->planes[0] + p->row_offset[row];
+        uint16_t *g = p->planes[1] + p->row_offset[row];
+        uint16_t *b = p->planes[2] + p->row_offset[row];
+        for (int i = 0; i < count; i++) {
+                long o = p->col_offset[first + i];
+                r[o] = cells[i].red;
+                g[o] = cells[i].green;
+                b[o] = cells[i].blue;
+        }
+}
+
+/****************** A2Planar_map_planes *******************
+ * Calls apply once per channel (0 red, 1 green, 2 blue)
+ * with all of that channel's samples.
+ *
+ * Parameters:
+ *      A2 array: A planar array.
+ *      void apply(...): Called with the plane, its length
+ *                       and the channel; may change samples.
+ *      void *cl: Passed to apply.
+ *
+ * Returns:
+ *      None
+ *
+ * Notes:
+ *      The samples are in storage order, which is not row
+ *      order for blocked arrays, and include the padding of
+ *      edge blocks; this suits operations that treat every
+ *      sample alike.  Planes start on 64-byte boundaries.
+ *********************************************************/
+void A2Planar_map_planes(A2 array,
+                         void apply(uint16_t *samples, long count,
+                                    int channel, void *cl),
+                         void *cl)
+{
+        struct planar *p = array;
+        assert(p != NULL && apply != NULL);
+        flush(p);
+        for (int c = 0; c < 3; c++) {
+                apply(p->planes[c], p->plane_cells, c, cl);
+        }
+}
+
+/********************** turn_rows *************************
+ * Rotates one plane of rows into one plane of rows, a TILE
+ * x TILE destination tile at a time.  Half turns reverse
+ * whole rows, which the compiler vectorizes.
+ *********************************************************/
+static void turn_rows(const uint16_t *s, uint16_t *d, int sw, int sh,
+                      int degree)
+{
+        if (degree == 180) {
+                for (int y = 0; y < sh; y++) {
+                        const uint16_t *sr = s + (long)(sh - 1 - y) * sw;
+                        uint16_t *dr = d + (long)y * sw;
+                        for (int x = 0; x < sw; x++) {
+                                dr[x] = sr[sw - 1 - x];
+                        }
+                }
+                return;
+        }
+        int dw = sh, dh = sw;
+        for (int y0 = 0; y0 < dh; y0 += TILE) {
+                int y1 = y0 + TILE < dh ? y0 + TILE : dh;
+                for (int x0 = 0; x0 < dw; x0 += TILE) {
+                        int x1 = x0 + TILE < dw ? x0 + TILE : dw;
+                        for (int y = y0; y < y1; y++) {
+                                uint16_t *dr = d + (long)y * dw;
+                                for (int x = x0; x < x1; x++) {
+                                        dr[x] = degree == 90
+                                              ? s[(long)(sh - 1 - x) * sw + y]
+                                              : s[(long)x * sw + sw - 1 - y];
+                                }
+                        }
+                }
+        }
+}
+
+/********************* turn_tables ************************
+ * Rotates one plane of any geometry into another, through
+ * the offset tables.  The destination is walked a tile at a
+ * time (its blocks when blocked), so each tile row is a run
+ * of contiguous samples.
+ *********************************************************/
+static void turn_tables(const struct planar *src, const uint16_t *s,
+                        const struct planar *dst, uint16_t *d, int degree)
+{
+        int sw = src->width, sh = src->height;
+        int tile = dst->blocksize > 1 ? dst->blocksize : TILE;
+        for (int y0 = 0; y0 < dst->height; y0 += tile) {
+                int y1 = y0 + tile < dst->height ? y0 + tile : dst->height;
+                for (int x0 = 0; x0 < dst->width; x0 += tile) {
+                        int x1 = x0 + tile < dst->width ? x0 + tile
+                                                        : dst->width;
+                        for (int y = y0; y < y1; y++) {
+                                uint16_t *dr = d + offset(dst, x0, y) - x0;
+                                for (int x = x0; x < x1; x++) {
+                                        long o = degree == 90
+                                               ? offset(src, y, sh - 1 - x)
+                                               : degree == 180
+                                               ? offset(src, sw - 1 - x,
+                                                        sh - 1 - y)
+                                               : offset(src, sw - 1 - y, x);
+                                        dr[x] = s[o];
+                                }
+                        }
+                }
+        }
+}
+
+/******************** A2Planar_rotate *********************
+ * Rotates src clockwise by degree into dst, one plane at a
+ * time.
+ *
+ * Parameters:
+ *      A2 src: Source planar array.
+ *      A2 dst: Destination planar array, already sized for
+ *              the rotation; any geometry.
+ *      int degree: 90, 180 or 270.
+ *
+ * Returns:
+ *      None
+ *
+ * Notes:
+ *      Each plane moves 2-byte samples, so a tile covers twice
+ *      the image area per cache line of an interleaved array.
+ *********************************************************/
+void A2Planar_rotate(A2 src, A2 dst, int degree)
+{
+        struct planar *s = src, *d = dst;
+        assert(s != NULL && d != NULL);
+        assert(degree == 90 || degree == 180 || degree == 270);
+        bool turned = degree != 180;
+        assert(d->width == (turned ? s->height : s->width) &&
+               d->height == (turned ? s->width : s->height));
+        flush(s);
+        flush(d);
+        for (int c = 0; c < 3; c++) {
+                if (s->blocksize == 1 && d->blocksize == 1) {
+                        turn_rows(s->planes[c], d->planes[c], s->width,
+                                  s->height, degree);
+                } else {
+                        turn_tables(s, s->planes[c], d, d->planes[c],
+                                    degree);
+                }
+        }
+}
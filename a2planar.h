@@ -0,0 +1,65 @@
+#ifndef A2PLANAR_INCLUDED
+#define A2PLANAR_INCLUDED
+/**************************************************************
+ *
+ *      a2planar.h
+ *
+ *      Xiaoyan Xie (xxie05)
+ *      Diwei Chen (dchen22)
+ *
+ *      CS 40 HW03 - locality
+ *
+ *      Planar (structure-of-arrays) images of struct Pnm_rgb.  The
+ *      red, green and blue samples are kept in three separate
+ *      planes of uint16_t that share one geometry: rows, one after
+ *      another (uarray2_methods_planar), or square blocks in
+ *      row-major block order (uarray2_methods_planar_blocked).
+ *      A cell takes 6 bytes instead of 12, and code that works on
+ *      one channel at a time streams through contiguous samples at
+ *      full vector width.
+ *
+ *      Because a cell is not stored anywhere as a struct Pnm_rgb,
+ *      at() returns a staging cell: the cell's samples are copied
+ *      into one of A2PLANAR_STAGED slots, and written back to the
+ *      planes when the slot is reused, by the maps, the functions
+ *      below and free.  A pointer from at() therefore stays valid
+ *      only until A2PLANAR_STAGED other cells of the same array
+ *      have been reached; reaching the same cell again returns the
+ *      same slot.  Samples are 16 bits, enough for any PPM maxval.
+ *
+ *      The plane functions work on whole planes (or rows) instead
+ *      of cells and are what the rotation and I/O fast paths use.
+ *      They write back the staged cells first.  Arrays with no
+ *      staged cells (just made, or after A2Planar_flush) may be
+ *      used by several threads at once through A2Planar_get_row
+ *      and A2Planar_put_row on distinct rows; nothing else here is
+ *      thread-safe.
+ *
+ **************************************************************/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "a2methods.h"
+#include "pnm.h"
+
+#define A2PLANAR_STAGED 4       /* cells at() can hand out at once */
+
+extern A2Methods_T uarray2_methods_planar;
+extern A2Methods_T uarray2_methods_planar_blocked;
+
+/* true for the two planar tables */
+extern bool A2Planar_is(A2Methods_T methods);
+
+extern void A2Planar_flush(A2Methods_UArray2 array);
+extern void A2Planar_get_row(A2Methods_UArray2 array, int row, int first,
+                             int count, struct Pnm_rgb *cells);
+extern void A2Planar_put_row(A2Methods_UArray2 array, int row, int first,
+                             int count, const struct Pnm_rgb *cells);
+extern void A2Planar_map_planes(A2Methods_UArray2 array,
+                                void apply(uint16_t *samples, long count,
+                                           int channel, void *cl),
+                                void *cl);
+extern void A2Planar_rotate(A2Methods_UArray2 src, A2Methods_UArray2 dst,
+                            int degree);
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef A2PREFETCH_INCLUDED
+#define A2PREFETCH_INCLUDED
+/**************************************************************
+ *
+ *      a2prefetch.h
+ *
+ *      Xiaoyan Xie (xxie05)
+ *      Diwei Chen (dchen22)
+ *
+ *      CS 40 HW03 - locality
+ *
+ *      Method tables whose maps issue software prefetches.
+ *
+ *      uarray2_methods_plain_prefetch is uarray2_methods_plain with
+ *      a map_col_major that prefetches the cell a set number of
+ *      rows further down the column.
+ *
+ *      uarray2_methods_blocked_prefetch is uarray2_methods_blocked
+ *      with a map_block_major that prefetches the block a set
+ *      number of blocks further along while visiting the current
+ *      one.
+ *
+ *      The distances are process-wide settings so that callers
+ *      such as the benchmark harness can sweep them; a distance of
+ *      0 makes the maps behave like the plain ones.
+ *
+ **************************************************************/
+
+#include "a2methods.h"
+
+#define A2PREFETCH_DEFAULT_ROWS   8
+#define A2PREFETCH_DEFAULT_BLOCKS 1
+
+extern A2Methods_T uarray2_methods_plain_prefetch;
+extern A2Methods_T uarray2_methods_blocked_prefetch;
+
+extern void A2Prefetch_set_row_distance(int distance);
+extern int  A2Prefetch_row_distance(void);
+extern void A2Prefetch_set_block_distance(int distance);
+extern int  A2Prefetch_block_distance(void);
+
+#endif
@@ -1,9 +1,24 @@
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
 #include "assert.h"
 #include "a2methods.h"
 #include "a2plain.h"
 #include "a2blocked.h"
+#include "a2compressed.h"
+#include "a2parallel.h"
+#include "a2planar.h"
+#include "a2view.h"
+#include "layout.h"
+#include "uarray2bext.h"
+#include "shmimage.h"
+#include "pnm.h"
 
 
 #define W 13
@@ -161,11 +176,371 @@ static void test_methods(A2Methods_T methods_under_test)
         methods->free(&array);
 }
 
+static void store_position(int i, int j, A2 a, void *elem, void *cl)
+{
+        (void)a;
+        (void)cl;
+        *(unsigned *)elem = 1000 * i + j;
+}
+
+static void increment_cell(void *elem, void *cl)
+{
+        (void)cl;
+        *(unsigned *)elem += 1;
+}
+
+/* every cell is visited exactly once by each parallel map that
+ * the table has, with the pool resized between maps */
+static void test_pmethods(A2Methods_T methods_under_test, int threads)
+{
+        A2PMethods_T pmethods = A2Parallel_methods(methods_under_test);
+        assert(pmethods != NULL);
+        A2Methods_mapfun *maps[] = {
+                pmethods->pmap_row_major, pmethods->pmap_col_major,
+                pmethods->pmap_block_major, pmethods->pmap_default
+        };
+        A2Methods_smallmapfun *small_maps[] = {
+                pmethods->small_pmap_row_major,
+                pmethods->small_pmap_col_major,
+                pmethods->small_pmap_block_major,
+                pmethods->small_pmap_default
+        };
+        A2 array = methods_under_test->new_with_blocksize(W, H,
+                                                          sizeof(unsigned),
+                                                          BS);
+        for (int m = 0; m < 4; m++) {
+                A2Parallel_set_threads(threads + m % 2);
+                if (maps[m] != NULL) {
+                        for (int i = 0; i < W; i++) {
+                                for (int j = 0; j < H; j++) {
+                                        copy_unsigned(methods_under_test,
+                                                      array, i, j, 0);
+                                }
+                        }
+                        maps[m](array, store_position, NULL);
+                        for (int i = 0; i < W; i++) {
+                                for (int j = 0; j < H; j++) {
+                                        unsigned *p = methods_under_test->at(
+                                                array, i, j);
+                                        assert(*p == 1000u * i + j);
+                                }
+                        }
+                }
+                if (small_maps[m] != NULL) {
+                        methods_under_test->map_default(array,
+                                                        store_position,
+                                                        NULL);
+                        small_maps[m](array, increment_cell, NULL);
+                        for (int i = 0; i < W; i++) {
+                                for (int j = 0; j < H; j++) {
+                                        unsigned *p = methods_under_test->at(
+                                                array, i, j);
+                                        assert(*p == 1000u * i + j + 1);
+                                }
+                        }
+                }
+        }
+        A2Parallel_set_threads(threads);
+        methods_under_test->free(&array);
+}
+
+static struct Pnm_rgb rgb_at(int i, int j)
+{
+        return (struct Pnm_rgb){ 1000 * i + j, 2 * i, 60000 - j };
+}
+
+static void check_rgb(int i, int j, A2 a, void *elem, void *cl)
+{
+        (void)a;
+        (void)cl;
+        struct Pnm_rgb *p = elem, want = rgb_at(i, j);
+        assert(p->red == want.red && p->green == want.green &&
+               p->blue == want.blue);
+}
+
+/* cells written through the staging slots, the row copies and
+ * the plane rotation all agree */
+static void test_planar(A2Methods_T planar)
+{
+        A2 array = planar->new_with_blocksize(W, H, sizeof(struct Pnm_rgb),
+                                              BS);
+        for (int j = 0; j < H; j++) {
+                for (int i = 0; i < W; i++) {
+                        *(struct Pnm_rgb *)planar->at(array, i, j) =
+                                rgb_at(i, j);
+                }
+        }
+        planar->map_default(array, check_rgb, NULL);
+
+        struct Pnm_rgb row[W];
+        A2Planar_get_row(array, 3, 0, W, row);
+        for (int i = 0; i < W; i++) {
+                check_rgb(i, 3, array, &row[i], NULL);
+        }
+        A2Planar_put_row(array, 3, 0, W, row);
+
+        A2 turned = planar->new_with_blocksize(H, W, sizeof(struct Pnm_rgb),
+                                               BS);
+        A2Planar_rotate(array, turned, 90);
+        for (int j = 0; j < H; j++) {
+                for (int i = 0; i < W; i++) {
+                        check_rgb(i, j, array,
+                                  planar->at(turned, H - 1 - j, i), NULL);
+                }
+        }
+        planar->free(&turned);
+        planar->free(&array);
+}
+
+/* source cell shown at (col, row) of a view of a W x H source */
+static unsigned view_source(enum A2View_orientation o, int col, int row)
+{
+        int x = col, y = row;
+        switch (o) {
+        case A2VIEW_ROTATE_90:
+                x = row;        y = H - 1 - col;        break;
+        case A2VIEW_ROTATE_180:
+                x = W - 1 - col; y = H - 1 - row;       break;
+        case A2VIEW_ROTATE_270:
+                x = W - 1 - row; y = col;               break;
+        case A2VIEW_FLIP_HORIZONTAL:
+                x = W - 1 - col;                        break;
+        case A2VIEW_FLIP_VERTICAL:
+                y = H - 1 - row;                        break;
+        case A2VIEW_TRANSPOSE:
+                x = row;        y = col;                break;
+        default:
+                break;
+        }
+        return 1000u * x + y;
+}
+
+struct view_check {
+        enum A2View_orientation orientation;
+        int visited;
+};
+
+static void check_view_cell(int i, int j, A2 a, void *elem, void *cl)
+{
+        (void)a;
+        struct view_check *c = cl;
+        assert(*(unsigned *)elem == view_source(c->orientation, i, j));
+        c->visited++;
+}
+
+static void count_view_cell(void *elem, void *cl)
+{
+        (void)elem;
+        ((struct view_check *)cl)->visited++;
+}
+
+/* every orientation of a view, over plain and blocked sources,
+ * shows the right source cell through peek, at() and the maps,
+ * and leaves the source as it was */
+static void test_view(void)
+{
+        A2Methods_T sources[] = { uarray2_methods_plain,
+                                  uarray2_methods_blocked };
+        A2Methods_T view = uarray2_methods_view;
+        for (int s = 0; s < 2; s++) {
+                A2 src = sources[s]->new_with_blocksize(W, H,
+                                                        sizeof(unsigned), BS);
+                sources[s]->map_default(src, store_position, NULL);
+                for (int o = A2VIEW_IDENTITY; o <= A2VIEW_TRANSPOSE; o++) {
+                        struct view_check c = { o, 0 };
+                        A2 v = A2View_new(sources[s], src, o, false);
+                        bool turned = o == A2VIEW_ROTATE_90 ||
+                                      o == A2VIEW_ROTATE_270 ||
+                                      o == A2VIEW_TRANSPOSE;
+                        int w = view->width(v), h = view->height(v);
+                        assert(w == (turned ? H : W));
+                        assert(h == (turned ? W : H));
+                        for (int i = 0; i < w; i++) {
+                                for (int j = 0; j < h; j++) {
+                                        const unsigned *p =
+                                                A2View_peek(v, i, j);
+                                        assert(*p == view_source(o, i, j));
+                                }
+                        }
+                        view->map_row_major(v, check_view_cell, &c);
+                        view->map_col_major(v, check_view_cell, &c);
+                        for (int i = 0; i < w; i++) {
+                                for (int j = 0; j < h; j++) {
+                                        check_view_cell(i, j, v,
+                                                        view->at(v, i, j),
+                                                        &c);
+                                }
+                        }
+                        view->small_map_row_major(v, count_view_cell, &c);
+                        view->small_map_col_major(v, count_view_cell, &c);
+                        assert(c.visited == 5 * W * H);
+                        view->free(&v);
+                }
+                for (int i = 0; i < W; i++) {
+                        for (int j = 0; j < H; j++) {
+                                unsigned *p = sources[s]->at(src, i, j);
+                                assert(*p == 1000u * i + j);
+                        }
+                }
+                sources[s]->free(&src);
+        }
+}
+
+/* blocks read while the array is not writable leave the cache
+ * without being stored and still hold their cells; writes made
+ * once it is writable again are kept */
+static void test_compressed(void)
+{
+        methods = uarray2_methods_blocked_compressed;
+        int cache = A2Compressed_cache_blocks();
+        A2Compressed_set_cache_blocks(2);
+        A2 array = methods->new_with_blocksize(W, H, sizeof(unsigned), BS);
+        A2Compressed_set_cache_blocks(cache);
+        methods->map_default(array, store_position, NULL);
+
+        UArray2b_set_writable(array, false);
+        for (int pass = 0; pass < 2; pass++) {
+                for (int i = 0; i < W; i++) {
+                        for (int j = 0; j < H; j++) {
+                                check(array, i, j, 1000 * i + j);
+                        }
+                }
+        }
+        UArray2b_set_writable(array, true);
+        for (int i = 0; i < W; i++) {
+                for (int j = 0; j < H; j++) {
+                        copy_unsigned(methods, array, i, j, i + 1000 * j);
+                }
+        }
+        for (int i = 0; i < W; i++) {
+                for (int j = 0; j < H; j++) {
+                        check(array, i, j, i + 1000 * j);
+                }
+        }
+        methods->free(&array);
+}
+
+/* true if reading the segment at path raises Pnm_Badformat,
+ * which aborts the child process it is read in (the exception
+ * is not caught) after naming it on stderr */
+static bool shm_read_rejected(const char *path)
+{
+        char err[] = "/tmp/a2test-err-XXXXXX";
+        int fd = mkstemp(err);
+        assert(fd >= 0);
+        pid_t child = fork();
+        assert(child >= 0);
+        if (child == 0) {
+                dup2(fd, STDERR_FILENO);
+                FILE *fp = fopen(path, "r");
+                Pnm_ppm ppm = ShmImage_read(fp);
+                Pnm_ppmfree(&ppm);
+                _exit(0);
+        }
+        int status;
+        pid_t waited = waitpid(child, &status, 0);
+        assert(waited == child);
+
+        char message[256] = "";
+        ssize_t got = pread(fd, message, sizeof(message) - 1, 0);
+        message[got > 0 ? got : 0] = '\0';
+        close(fd);
+        unlink(err);
+        return WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT &&
+               strstr(message, Pnm_Badformat.reason) != NULL;
+}
+
+/* a shared segment whose header gives a width * height * cell
+ * size that wraps around 64 bits (to fewer bytes than the
+ * segment holds) is rejected rather than mapped */
+static void test_shm_header(void)
+{
+        char path[] = "/tmp/a2test-shm-XXXXXX";
+        int fd = mkstemp(path);
+        assert(fd >= 0);
+        close(fd);
+        A2 pixels = ShmImage_new(path, uarray2_methods_plain, 20, 20, 255);
+        assert(pixels != NULL);
+        uarray2_methods_plain->free(&pixels);
+        assert(!shm_read_rejected(path));
+
+        uint32_t size[2] = { 2139423913u, 718524582u };
+        uint64_t wrapped = (uint64_t)size[0] * size[1] *
+                           sizeof(struct Pnm_rgb);
+        assert(wrapped <= 20 * 20 * sizeof(struct Pnm_rgb));
+        fd = open(path, O_WRONLY);
+        assert(fd >= 0);
+        ssize_t put = pwrite(fd, size, sizeof(size), 16);     /* width */
+        put += pwrite(fd, &wrapped, sizeof(wrapped), 48);     /* bytes */
+        assert(put == sizeof(size) + sizeof(wrapped));
+        close(fd);
+        assert(shm_read_rejected(path));
+        unlink(path);
+}
+
+/* every layout converts to every other (and to other block
+ * sizes), whole or from an offset rectangle */
+static void test_layout(void)
+{
+        A2Methods_T tables[] = {
+                uarray2_methods_plain, uarray2_methods_blocked,
+                uarray2_methods_blocked_compressed, uarray2_methods_planar,
+                uarray2_methods_planar_blocked
+        };
+        int n = sizeof(tables) / sizeof(tables[0]);
+        for (int f = 0; f < n; f++) {
+                A2Methods_T from = tables[f];
+                A2 src = from->new_with_blocksize(W, H,
+                                                  sizeof(struct Pnm_rgb), BS);
+                for (int j = 0; j < H; j++) {
+                        for (int i = 0; i < W; i++) {
+                                *(struct Pnm_rgb *)from->at(src, i, j) =
+                                        rgb_at(i, j);
+                        }
+                }
+                for (int t = 0; t < n; t++) {
+                        A2Methods_T to = tables[t];
+                        A2 dst = Layout_convert(from, src, to, BS - 1);
+                        assert(to->width(dst) == W && to->height(dst) == H);
+                        for (int j = 0; j < H; j++) {
+                                for (int i = 0; i < W; i++) {
+                                        check_rgb(i, j, dst,
+                                                  to->at(dst, i, j), NULL);
+                                }
+                        }
+                        to->free(&dst);
+
+                        dst = to->new_with_blocksize(W - 2, H - 5,
+                                                     sizeof(struct Pnm_rgb),
+                                                     BS + 1);
+                        Layout_copy(from, src, 2, 5, to, dst);
+                        for (int j = 0; j < H - 5; j++) {
+                                for (int i = 0; i < W - 2; i++) {
+                                        check_rgb(i + 2, j + 5, dst,
+                                                  to->at(dst, i, j), NULL);
+                                }
+                        }
+                        to->free(&dst);
+                }
+                from->free(&src);
+        }
+}
+
 int main(int argc, char *argv[])
 {
         assert(argc == 1);
         (void)argv;
         test_methods(uarray2_methods_blocked);
+        test_methods(uarray2_methods_blocked_compressed);
+        test_methods(uarray2_methods_view);
+        test_pmethods(uarray2_methods_plain, 3);
+        test_pmethods(uarray2_methods_blocked, 3);
+        test_planar(uarray2_methods_planar);
+        test_planar(uarray2_methods_planar_blocked);
+        test_compressed();
+        test_view();
+        test_shm_header();
+        test_layout();
         /*  test_methods(uarray2_methods_blocked); */
         printf("Passed.\n");  /* only if we reach this point without
                                * assertion failure
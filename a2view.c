@@ -0,0 +1,363 @@
+/**************************************************************
+ *
+ *      a2view.c
+ *
+ *      Xiaoyan Xie (xxie05)
+ *      Diwei Chen (dchen22)
+ *
+ *      CS 40 HW03 - locality
+ *
+ *      This file implements lazy rotated/flipped views (see
+ *      a2view.h).  A view maps its cell (col, row) to the source
+ *      cell (x0 + col * dx_col + row * dx_row,
+ *            y0 + col * dy_col + row * dy_row),
+ *      which covers all eight orientations with one formula.
+ *      Copied tiles live in a table indexed by tile position.
+ *
+ **************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include "assert.h"
+#include "a2methods.h"
+#include "a2plain.h"
+#include "a2view.h"
+
+#define TILE 32                 /* cells per side of a copied tile */
+
+typedef A2Methods_UArray2 A2;
+
+/********************** struct view ***********************
+ * A view: the source and its methods, the coordinate map
+ * and the tiles copied so far (NULL until reached by at).
+ *********************************************************/
+struct view {
+        A2Methods_T methods;
+        A2 source;
+        bool owns_source;
+        int width, height, size;
+        int x0, dx_col, dx_row;
+        int y0, dy_col, dy_row;
+        int tiles_wide, tiles_high;
+        int materialized;
+        char **tiles;
+};
+
+/********************** source_xy *************************
+ * Source position of view cell (col, row).
+ *********************************************************/
+static inline void source_xy(struct view *v, int col, int row,
+                             int *x, int *y)
+{
+        *x = v->x0 + col * v->dx_col + row * v->dx_row;
+        *y = v->y0 + col * v->dy_col + row * v->dy_row;
+}
+
+/*********************** A2View_new ***********************
+ * Creates a view of source in the given orientation.
+ *
+ * Parameters:
+ *      A2Methods_T methods: Methods for source.
+ *      A2 source: The array viewed.
+ *      enum A2View_orientation orientation: How the view is
+ *              turned or flipped relative to source.
+ *      bool owns_source: Free source (with methods->free) when
+ *              the view is freed.
+ *
+ * Returns:
+ *      A2: The view, to be used with uarray2_methods_view.
+ *
+ * Expects:
+ *      methods and source must not be NULL.
+ *
+ * Notes:
+ *      Nothing is copied here.  Source cells written after
+ *      their tile has been copied are not seen by the view.
+ *      Will CRE if memory allocation fails.
+ *********************************************************/
+A2 A2View_new(A2Methods_T methods, A2 source,
+              enum A2View_orientation orientation, bool owns_source)
+{
+        assert(methods != NULL && source != NULL);
+        int w = methods->width(source);
+        int h = methods->height(source);
+
+        struct view *v = malloc(sizeof(*v));
+        assert(v != NULL);
+        v->methods = methods;
+        v->source = source;
+        v->owns_source = owns_source;
+        v->size = methods->size(source);
+        v->x0 = v->y0 = 0;
+        v->dx_col = v->dy_row = 1;
+        v->dx_row = v->dy_col = 0;
+        v->width = w;
+        v->height = h;
+
+        switch (orientation) {
+        case A2VIEW_IDENTITY:
+                break;
+        case A2VIEW_ROTATE_90:          /* x = row, y = h - 1 - col */
+                v->dx_col = 0;  v->dx_row = 1;
+                v->y0 = h - 1;  v->dy_col = -1;  v->dy_row = 0;
+                break;
+        case A2VIEW_ROTATE_180:         /* x = w - 1 - col, y = h - 1 - row */
+                v->x0 = w - 1;  v->dx_col = -1;
+                v->y0 = h - 1;  v->dy_row = -1;
+                break;
+        case A2VIEW_ROTATE_270:         /* x = w - 1 - row, y = col */
+                v->x0 = w - 1;  v->dx_col = 0;   v->dx_row = -1;
+                v->dy_col = 1;  v->dy_row = 0;
+                break;
+        case A2VIEW_FLIP_HORIZONTAL:    /* x = w - 1 - col */
+                v->x0 = w - 1;  v->dx_col = -1;
+                break;
+        case A2VIEW_FLIP_VERTICAL:      /* y = h - 1 - row */
+                v->y0 = h - 1;  v->dy_row = -1;
+                break;
+        case A2VIEW_TRANSPOSE:          /* x = row, y = col */
+                v->dx_col = 0;  v->dx_row = 1;
+                v->dy_col = 1;  v->dy_row = 0;
+                break;
+        default:
+                assert(0);
+        }
+        if (v->dx_col == 0) {           /* quarter turns swap sides */
+                v->width = h;
+                v->height = w;
+        }
+
+        v->tiles_wide = (v->width + TILE - 1) / TILE;
+        v->tiles_high = (v->height + TILE - 1) / TILE;
+        v->materialized = 0;
+        v->tiles = calloc((size_t)v->tiles_wide * v->tiles_high + 1,
+                          sizeof(*v->tiles));
+        assert(v->tiles != NULL);
+        return v;
+}
+
+/********************** materialize ***********************
+ * Copies tile (t_col, t_row) of the view from the source
+ * and returns it.
+ *********************************************************/
+static char *materialize(struct view *v, int t_col, int t_row)
+{
+        char **slot = &v->tiles[t_row * v->tiles_wide + t_col];
+        if (*slot != NULL) {
+                return *slot;
+        }
+        char *tile = calloc(TILE * TILE, v->size > 0 ? v->size : 1);
+        assert(tile != NULL);
+        for (int r = 0; r < TILE && t_row * TILE + r < v->height; r++) {
+                for (int c = 0; c < TILE && t_col * TILE + c < v->width;
+                     c++) {
+                        int x, y;
+                        source_xy(v, t_col * TILE + c, t_row * TILE + r,
+                                  &x, &y);
+                        memcpy(tile + (r * TILE + c) * v->size,
+                               v->methods->at(v->source, x, y), v->size);
+                }
+        }
+        *slot = tile;
+        v->materialized++;
+        return tile;
+}
+
+/*********************** A2View_peek **********************
+ * Returns a read-only pointer to view cell (col, row): into
+ * its tile if the tile has been copied, otherwise straight
+ * into the source.  Copies nothing.
+ *
+ * Parameters:
+ *      A2 view: A view from A2View_new.
+ *      int col, row: Cell position in the view.
+ *
+ * Returns:
+ *      const void *: The cell.
+ *
+ * Expects:
+ *      view must not be NULL; col and row must be in bounds.
+ *
+ * Notes:
+ *      Will CRE if the position is out of bounds.
+ *********************************************************/
+const void *A2View_peek(A2 view, int col, int row)
+{
+        struct view *v = view;
+        assert(v != NULL);
+        assert(col >= 0 && col < v->width && row >= 0 && row < v->height);
+        char *tile = v->tiles[(row / TILE) * v->tiles_wide + col / TILE];
+        if (tile != NULL) {
+                return tile + ((row % TILE) * TILE + col % TILE) * v->size;
+        }
+        int x, y;
+        source_xy(v, col, row, &x, &y);
+        return v->methods->at(v->source, x, y);
+}
+
+/******************* A2View_materialize *******************
+ * Copies every tile of a view that has not been copied, so
+ * that the view no longer reads its source.
+ *********************************************************/
+void A2View_materialize(A2 view)
+{
+        struct view *v = view;
+        assert(v != NULL);
+        for (int t_row = 0; t_row < v->tiles_high; t_row++) {
+                for (int t_col = 0; t_col < v->tiles_wide; t_col++) {
+                        materialize(v, t_col, t_row);
+                }
+        }
+}
+
+/**************** A2View_materialized_tiles ***************
+ * Returns how many tiles of a view have been copied.
+ *********************************************************/
+int A2View_materialized_tiles(A2 view)
+{
+        struct view *v = view;
+        assert(v != NULL);
+        return v->materialized;
+}
+
+/* new arrays are views of a fresh plain array that they own */
+static A2 new(int width, int height, int size)
+{
+        return A2View_new(uarray2_methods_plain,
+                          uarray2_methods_plain->new(width, height, size),
+                          A2VIEW_IDENTITY, true);
+}
+
+static A2 new_with_blocksize(int width, int height, int size, int blocksize)
+{
+        (void)blocksize;
+        return new(width, height, size);
+}
+
+static void a2free(A2 *array2p)
+{
+        assert(array2p != NULL && *array2p != NULL);
+        struct view *v = *array2p;
+        for (int k = 0; k < v->tiles_wide * v->tiles_high; k++) {
+                free(v->tiles[k]);
+        }
+        free(v->tiles);
+        if (v->owns_source) {
+                v->methods->free(&v->source);
+        }
+        free(v);
+        *array2p = NULL;
+}
+
+static int width(A2 array2)
+{
+        struct view *v = array2;
+        assert(v != NULL);
+        return v->width;
+}
+
+static int height(A2 array2)
+{
+        struct view *v = array2;
+        assert(v != NULL);
+        return v->height;
+}
+
+static int size(A2 array2)
+{
+        struct view *v = array2;
+        assert(v != NULL);
+        return v->size;
+}
+
+static int blocksize(A2 array2)
+{
+        (void)array2;
+        return 1;
+}
+
+/************************* at *****************************
+ * Returns a writable pointer to view cell (i, j), copying
+ * its tile from the source first if necessary.
+ *********************************************************/
+static A2Methods_Object *at(A2 array2, int i, int j)
+{
+        struct view *v = array2;
+        assert(v != NULL);
+        assert(i >= 0 && i < v->width && j >= 0 && j < v->height);
+        char *tile = materialize(v, i / TILE, j / TILE);
+        return tile + ((j % TILE) * TILE + i % TILE) * v->size;
+}
+
+/* row-major visits copy one row of tiles at a time, each
+ * from a compact region of the source, whatever the
+ * orientation; it is therefore the default */
+static void map_row_major(A2 array2, A2Methods_applyfun apply, void *cl)
+{
+        struct view *v = array2;
+        assert(v != NULL && apply != NULL);
+        for (int j = 0; j < v->height; j++) {
+                for (int i = 0; i < v->width; i++) {
+                        apply(i, j, array2, at(array2, i, j), cl);
+                }
+        }
+}
+
+static void map_col_major(A2 array2, A2Methods_applyfun apply, void *cl)
+{
+        struct view *v = array2;
+        assert(v != NULL && apply != NULL);
+        for (int i = 0; i < v->width; i++) {
+                for (int j = 0; j < v->height; j++) {
+                        apply(i, j, array2, at(array2, i, j), cl);
+                }
+        }
+}
+
+struct small_closure {
+        A2Methods_smallapplyfun *apply;
+        void *cl;
+};
+
+static void apply_small(int i, int j, A2 array2, void *elem, void *vcl)
+{
+        struct small_closure *cl = vcl;
+        (void)i;
+        (void)j;
+        (void)array2;
+        cl->apply(elem, cl->cl);
+}
+
+static void small_map_row_major(A2 a2, A2Methods_smallapplyfun apply,
+                                void *cl)
+{
+        struct small_closure mycl = { apply, cl };
+        map_row_major(a2, apply_small, &mycl);
+}
+
+static void small_map_col_major(A2 a2, A2Methods_smallapplyfun apply,
+                                void *cl)
+{
+        struct small_closure mycl = { apply, cl };
+        map_col_major(a2, apply_small, &mycl);
+}
+
+static struct A2Methods_T uarray2_methods_view_struct = {
+        new,
+        new_with_blocksize,
+        a2free,
+        width,
+        height,
+        size,
+        blocksize,
+        at,
+        map_row_major,
+        map_col_major,
+        NULL,                   // map_block_major
+        map_row_major,          // map_default
+        small_map_row_major,
+        small_map_col_major,
+        NULL,                   // small_map_block_major
+        small_map_row_major,    // small_map_default
+};
+
+A2Methods_T uarray2_methods_view = &uarray2_methods_view_struct;
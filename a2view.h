@@ -0,0 +1,56 @@
+#ifndef A2VIEW_INCLUDED
+#define A2VIEW_INCLUDED
+/**************************************************************
+ *
+ *      a2view.h
+ *
+ *      Xiaoyan Xie (xxie05)
+ *      Diwei Chen (dchen22)
+ *
+ *      CS 40 HW03 - locality
+ *
+ *      Lazy rotated and flipped views.  A view is an A2 (used
+ *      through uarray2_methods_view) that presents another A2 in a
+ *      new orientation without copying it: width, height and cell
+ *      positions are remapped onto the source.
+ *
+ *      The source is never written through a view.  Because at()
+ *      hands out writable pointers, the view copies a 32x32 tile of
+ *      cells from the source the first time at() (or a map) reaches
+ *      it, and that tile is used from then on.  A2View_peek reads a
+ *      cell without copying anything, so a consumer that only reads
+ *      a region of a rotated image touches only that region of the
+ *      source.
+ *
+ *      Views are not thread-safe while tiles are being copied;
+ *      A2View_peek calls may run concurrently if the source's at
+ *      may.
+ *
+ **************************************************************/
+
+#include <stdbool.h>
+#include "a2methods.h"
+
+/* orientation of a view relative to its source; rotations are
+ * clockwise, as in ppmtrans */
+enum A2View_orientation {
+        A2VIEW_IDENTITY,
+        A2VIEW_ROTATE_90,
+        A2VIEW_ROTATE_180,
+        A2VIEW_ROTATE_270,
+        A2VIEW_FLIP_HORIZONTAL,
+        A2VIEW_FLIP_VERTICAL,
+        A2VIEW_TRANSPOSE
+};
+
+extern A2Methods_T uarray2_methods_view;
+
+extern A2Methods_UArray2 A2View_new(A2Methods_T methods,
+                                    A2Methods_UArray2 source,
+                                    enum A2View_orientation orientation,
+                                    bool owns_source);
+extern const void *A2View_peek(A2Methods_UArray2 view, int col, int row);
+extern void A2View_materialize(A2Methods_UArray2 view);
+extern int A2View_materialized_tiles(A2Methods_UArray2 view);
+
+#endif
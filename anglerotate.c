@@ -0,0 +1,323 @@
+/**************************************************************
+ *
+ *      anglerotate.c
+ *
+ *      Xiaoyan Xie (xxie05)
+ *      Diwei Chen (dchen22)
+ *
+ *      CS 40 HW03 - locality
+ *
+ *      This file implements rotation by any angle (see
+ *      anglerotate.h).  Destination pixel (i, j) is sampled at the
+ *      source position
+ *
+ *          u = cos * dx + sin * dy + cx,   v = -sin * dx + cos * dy + cy
+ *
+ *      where (dx, dy) is the pixel centre relative to the centre of
+ *      the destination and (cx, cy) the centre of the source, so
+ *      one step right in the destination is (cos, -sin) in the
+ *      source.  Both arrays are reached through row pointers
+ *      (plain) or block pointers (blocked) when their method table
+ *      allows it, and through at() otherwise.
+ *
+ **************************************************************/
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include "assert.h"
+#include "a2methods.h"
+#include "a2plain.h"
+#include "a2blocked.h"
+#include "a2prefetch.h"
+#include "a2parallel.h"
+#include "uarray2ext.h"
+#include "uarray2bext.h"
+#include "pnm.h"
+#include "anglerotate.h"
+
+typedef A2Methods_UArray2 A2;
+typedef A2Methods_T A;
+
+/* side of the square destination tiles */
+#define TILE 64
+
+/* source positions are 16.16 fixed point */
+#define FRAC 16
+#define ONE ((int64_t)1 << FRAC)
+
+/* the channels of one pixel, blended four taps at a time */
+typedef uint32_t v4u __attribute__((vector_size(16)));
+
+enum layout { ROWS, BLOCKS, CELLS };
+
+/* direct access to the cells of one array */
+struct access {
+        A methods;
+        A2 array;
+        enum layout layout;
+        int width, height;
+        int bs, blocks_wide;            /* BLOCKS only */
+        struct Pnm_rgb **base;          /* a row or block pointer each */
+};
+
+struct job {
+        struct access src, dst;
+        enum AngleRotate_filter filter;
+        struct Pnm_rgb background;
+        double cos_t, sin_t;
+        double src_cx, src_cy, dst_cx, dst_cy;
+        int tiles_wide;
+};
+
+/********************** access_init ***********************
+ * Sets up access to array: a pointer per row for plain
+ * tables, per block for blocked ones, none for the rest.
+ *********************************************************/
+static void access_init(struct access *a, A methods, A2 array)
+{
+        a->methods = methods;
+        a->array = array;
+        a->width = methods->width(array);
+        a->height = methods->height(array);
+        a->base = NULL;
+        a->layout = CELLS;
+        if (a->width == 0 || a->height == 0) {
+                return;
+        }
+
+        if (methods == uarray2_methods_plain ||
+            methods == uarray2_methods_plain_prefetch) {
+                a->layout = ROWS;
+                a->base = malloc(a->height * sizeof(*a->base));
+                assert(a->base != NULL);
+                for (int j = 0; j < a->height; j++) {
+                        a->base[j] = UArray2_row(array, j);
+                }
+        } else if (methods == uarray2_methods_blocked ||
+                   methods == uarray2_methods_blocked_prefetch) {
+                a->layout = BLOCKS;
+                a->bs = methods->blocksize(array);
+                a->blocks_wide = (a->width + a->bs - 1) / a->bs;
+                int blocks_high = (a->height + a->bs - 1) / a->bs;
+                a->base = malloc((long)a->blocks_wide * blocks_high *
+                                 sizeof(*a->base));
+                assert(a->base != NULL);
+                for (int r = 0; r < blocks_high; r++) {
+                        for (int c = 0; c < a->blocks_wide; c++) {
+                                a->base[r * a->blocks_wide + c] =
+                                        UArray2b_block(array, c, r);
+                        }
+                }
+        }
+}
+
+static inline struct Pnm_rgb *cell(const struct access *a, int x, int y)
+{
+        switch (a->layout) {
+        case ROWS:
+                return a->base[y] + x;
+        case BLOCKS: {
+                int bs = a->bs;
+                return a->base[(y / bs) * a->blocks_wide + x / bs] +
+                       (y % bs) * bs + x % bs;
+        }
+        default:
+                return a->methods->at(a->array, x, y);
+        }
+}
+
+static inline bool inside(const struct access *a, int x, int y)
+{
+        return x >= 0 && x < a->width && y >= 0 && y < a->height;
+}
+
+static inline v4u load(const struct Pnm_rgb *p)
+{
+        return (v4u){ p->red, p->green, p->blue, 0 };
+}
+
+/* a source pixel as a vector, or the background outside */
+static inline v4u tap(const struct job *job, int x, int y)
+{
+        if (inside(&job->src, x, y)) {
+                return load(cell(&job->src, x, y));
+        }
+        return load(&job->background);
+}
+
+/*********************** bilinear *************************
+ * Blends the four source pixels around (u, v) with 8-bit
+ * weights.  The weights sum to 1 << 16, so with 16-bit
+ * channels the sums fit in 32 bits.
+ *********************************************************/
+static inline struct Pnm_rgb bilinear(const struct job *job, int64_t u,
+                                      int64_t v)
+{
+        int x = (int)(u >> FRAC);
+        int y = (int)(v >> FRAC);
+        uint32_t fx = (uint32_t)(u >> (FRAC - 8)) & 0xff;
+        uint32_t fy = (uint32_t)(v >> (FRAC - 8)) & 0xff;
+        const struct access *src = &job->src;
+        v4u p00, p10, p01, p11;
+
+        if (x >= 0 && x + 1 < src->width && y >= 0 && y + 1 < src->height) {
+                const struct Pnm_rgb *top = cell(src, x, y);
+                const struct Pnm_rgb *bottom = cell(src, x, y + 1);
+                if (src->layout == ROWS) {
+                        p00 = load(top);
+                        p10 = load(top + 1);
+                        p01 = load(bottom);
+                        p11 = load(bottom + 1);
+                } else {
+                        p00 = load(top);
+                        p10 = load(cell(src, x + 1, y));
+                        p01 = load(bottom);
+                        p11 = load(cell(src, x + 1, y + 1));
+                }
+        } else {
+                p00 = tap(job, x, y);
+                p10 = tap(job, x + 1, y);
+                p01 = tap(job, x, y + 1);
+                p11 = tap(job, x + 1, y + 1);
+        }
+
+        uint32_t w00 = (256 - fx) * (256 - fy), w10 = fx * (256 - fy);
+        uint32_t w01 = (256 - fx) * fy, w11 = fx * fy;
+        v4u sum = (p00 * w00 + p10 * w10 + p01 * w01 + p11 * w11 +
+                   (1u << 15)) >> 16;
+        return (struct Pnm_rgb){ sum[0], sum[1], sum[2] };
+}
+
+static inline struct Pnm_rgb nearest(const struct job *job, int64_t u,
+                                     int64_t v)
+{
+        int x = (int)((u + ONE / 2) >> FRAC);
+        int y = (int)((v + ONE / 2) >> FRAC);
+        if (inside(&job->src, x, y)) {
+                return *cell(&job->src, x, y);
+        }
+        return job->background;
+}
+
+/*********************** tile_rows ************************
+ * Fills the destination tiles in tile rows [first, last).
+ * Each row of a tile starts from an exact source position
+ * and steps across the tile in fixed point, so rounding
+ * never builds up over more than TILE pixels.
+ *********************************************************/
+static void tile_rows(int first, int last, void *cl)
+{
+        const struct job *job = cl;
+        const struct access *dst = &job->dst;
+        int64_t du = llround(job->cos_t * ONE);
+        int64_t dv = llround(-job->sin_t * ONE);
+
+        for (int ty = first; ty < last; ty++) {
+                int y0 = ty * TILE;
+                int y1 = y0 + TILE < dst->height ? y0 + TILE : dst->height;
+                for (int tx = 0; tx < job->tiles_wide; tx++) {
+                        int x0 = tx * TILE;
+                        int x1 = x0 + TILE < dst->width ? x0 + TILE
+                                                        : dst->width;
+                        for (int j = y0; j < y1; j++) {
+                                double dx = x0 + 0.5 - job->dst_cx;
+                                double dy = j + 0.5 - job->dst_cy;
+                                double su = job->cos_t * dx +
+                                            job->sin_t * dy + job->src_cx;
+                                double sv = -job->sin_t * dx +
+                                            job->cos_t * dy + job->src_cy;
+                                int64_t u = llround(su * ONE);
+                                int64_t v = llround(sv * ONE);
+                                for (int i = x0; i < x1; i++) {
+                                        *cell(dst, i, j) =
+                                            job->filter == ANGLEROTATE_NEAREST
+                                            ? nearest(job, u, v)
+                                            : bilinear(job, u, v);
+                                        u += du;
+                                        v += dv;
+                                }
+                        }
+                }
+        }
+}
+
+/**************** AngleRotate_dimensions ******************
+ * Computes the size of the bounding box of a width x height
+ * image rotated by degrees.
+ *
+ * Parameters:
+ *      int width, int height: Source dimensions.
+ *      double degrees: Clockwise rotation, any value.
+ *      int *out_width, int *out_height: Set to the size of
+ *              the destination.
+ *
+ * Notes:
+ *      A small tolerance keeps right angles from growing by
+ *      a pixel through rounding of sin and cos.
+ *********************************************************/
+void AngleRotate_dimensions(int width, int height, double degrees,
+                            int *out_width, int *out_height)
+{
+        assert(width >= 0 && height >= 0);
+        assert(out_width != NULL && out_height != NULL);
+        double radians = degrees * M_PI / 180;
+        double c = fabs(cos(radians)), s = fabs(sin(radians));
+        *out_width = (int)ceil(width * c + height * s - 1e-6);
+        *out_height = (int)ceil(width * s + height * c - 1e-6);
+}
+
+/******************** AngleRotate_run *********************
+ * Rotates src by degrees clockwise into dst.
+ *
+ * Parameters:
+ *      A methods: Methods for both src and dst.
+ *      A2 src: Source image pixels.
+ *      A2 dst: Destination, sized by AngleRotate_dimensions.
+ *      double degrees: Clockwise rotation.
+ *      enum AngleRotate_filter filter: Nearest or bilinear.
+ *      struct Pnm_rgb background: Colour of destination
+ *              pixels that fall outside the source.
+ *      bool parallel: Split the tile rows over the
+ *              A2Parallel executor, when methods allows it.
+ *
+ * Expects:
+ *      methods, src and dst must not be NULL, and both arrays
+ *      must hold struct Pnm_rgb.
+ *
+ * Notes:
+ *      Tables that copy cells on access (compressed, views)
+ *      are read and written through at(), in one thread.
+ *      Will CRE if memory allocation fails.
+ *********************************************************/
+void AngleRotate_run(A methods, A2 src, A2 dst, double degrees,
+                     enum AngleRotate_filter filter,
+                     struct Pnm_rgb background, bool parallel)
+{
+        assert(methods != NULL && src != NULL && dst != NULL);
+        assert(methods->size(src) == sizeof(struct Pnm_rgb));
+        assert(methods->size(dst) == sizeof(struct Pnm_rgb));
+
+        struct job job;
+        access_init(&job.src, methods, src);
+        access_init(&job.dst, methods, dst);
+        double radians = degrees * M_PI / 180;
+        job.filter = filter;
+        job.background = background;
+        job.cos_t = cos(radians);
+        job.sin_t = sin(radians);
+        /* centres in cell coordinates, where cell x is at x + 0.5 */
+        job.src_cx = job.src.width / 2.0 - 0.5;
+        job.src_cy = job.src.height / 2.0 - 0.5;
+        job.dst_cx = job.dst.width / 2.0;
+        job.dst_cy = job.dst.height / 2.0;
+        job.tiles_wide = (job.dst.width + TILE - 1) / TILE;
+        int tiles_high = (job.dst.height + TILE - 1) / TILE;
+
+        if (parallel && A2Parallel_methods(methods) != NULL) {
+                A2Parallel_for(tiles_high, tile_rows, &job);
+        } else {
+                tile_rows(0, tiles_high, &job);
+        }
+        free(job.src.base);
+        free(job.dst.base);
+}
@@ -0,0 +1,48 @@
+#ifndef ANGLEROTATE_INCLUDED
+#define ANGLEROTATE_INCLUDED
+/**************************************************************
+ *
+ *      anglerotate.h
+ *
+ *      Xiaoyan Xie (xxie05)
+ *      Diwei Chen (dchen22)
+ *
+ *      CS 40 HW03 - locality
+ *
+ *      Rotation by any angle, such as the small corrections that
+ *      deskew a scanned page.  The destination is the bounding box
+ *      of the rotated image; every destination pixel is gathered
+ *      from the source position that rotates onto it, with nearest
+ *      neighbour or bilinear sampling, and pixels that come from
+ *      outside the source get the background colour.
+ *
+ *      The destination is produced in 64x64 tiles, so that the
+ *      source pixels read for one tile are a compact patch that
+ *      stays in cache.  Across a tile row the source position is
+ *      stepped in 16.16 fixed point (one add per pixel, no trig),
+ *      restarted exactly at every tile, and the four bilinear taps
+ *      are blended as one vector of channels.
+ *
+ *      Angles are in degrees, clockwise like ppmtrans -rotate, and
+ *      the result of 90 with nearest sampling matches the exact
+ *      90 degree rotation.
+ *
+ **************************************************************/
+
+#include <stdbool.h>
+#include "a2methods.h"
+#include "pnm.h"
+
+enum AngleRotate_filter {
+        ANGLEROTATE_NEAREST,
+        ANGLEROTATE_BILINEAR
+};
+
+extern void AngleRotate_dimensions(int width, int height, double degrees,
+                                   int *out_width, int *out_height);
+extern void AngleRotate_run(A2Methods_T methods, A2Methods_UArray2 src,
+                            A2Methods_UArray2 dst, double degrees,
+                            enum AngleRotate_filter filter,
+                            struct Pnm_rgb background, bool parallel);
+
+#endif
@@ -0,0 +1,346 @@
+/**************************************************************
+ *
+ *      bench.c
+ *
+ *      Xiaoyan Xie (xxie05)
+ *      Diwei Chen (dchen22)
+ *
+ *      CS 40 HW03 - locality
+ *
+ *      Benchmark harness for the rotation traversal strategies.
+ *      Synthetic square images are generated for a sweep of sizes
+ *      (from L1-resident up to a configurable maximum, multi-GB if
+ *      asked), and every combination of rotation, traversal and
+ *      block size is run with warmup and repeated timed runs while
+ *      the process is pinned to one core.  One CSV row per
+ *      combination is written to stdout with the median and 95th
+ *      percentile nanoseconds per pixel and the effective
+ *      bandwidth (one read and one write of every pixel).
+ *
+ **************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "assert.h"
+#include "a2methods.h"
+#include "a2plain.h"
+#include "a2blocked.h"
+#include "pnm.h"
+#include "rotate.h"
+#include "cputiming.h"
+#include "benchutil.h"
+#include "a2prefetch.h"
+#include "a2planar.h"
+
+typedef A2Methods_UArray2 A2;
+typedef A2Methods_T A;
+
+#define MAX_LIST 32
+
+/******************** struct traversal ********************
+ * One traversal strategy: the methods and map to use,
+ * for blocked arrays the block size (0 means the 64KB
+ * default chosen by methods->new), and for the prefetching
+ * tables the prefetch distance (rows or blocks ahead).
+ * Bulk traversals have no map and run Rotate_bulk with
+ * streaming stores on or off.  Gather traversals map over
+ * the destination (Rotate_gather).
+ *********************************************************/
+struct traversal {
+        const char *name;
+        A methods;
+        A2Methods_mapfun *map;
+        int blocksize;
+        int prefetch;
+        enum Rotate_stream stream;
+        bool gather;
+};
+
+struct settings {
+        int sides[MAX_LIST];            /* image side lengths */
+        int num_sides;
+        int blocksizes[MAX_LIST];
+        int num_blocksizes;
+        int prefetches[MAX_LIST];       /* distances to sweep */
+        int num_prefetches;
+        int rotations[3];
+        int num_rotations;
+        int warmup;
+        int reps;
+        int cpu;                        /* -1: current cpu */
+        bool bulk;                      /* add the bulk kernels */
+        bool gather;                    /* add the gather maps */
+        double max_mb;                  /* cap on source image size */
+};
+
+static void usage(const char *progname)
+{
+        fprintf(stderr, "Usage: %s [-sizes s1,s2,...] [-max-mb n] "
+                        "[-blocksizes b1,b2,...] [-rotations r1,r2,...] "
+                        "[-prefetch d1,d2,...] [-bulk] [-gather] "
+                        "[-warmup n] [-reps n] [-cpu n]\n", progname);
+        exit(1);
+}
+
+/********************** fill_pixel ************************
+ * Small-map apply that writes a cheap, non-constant pattern
+ * so that every page of the synthetic image is touched.
+ *********************************************************/
+static void fill_pixel(void *elem, void *cl)
+{
+        unsigned *counter = cl;
+        struct Pnm_rgb *px = elem;
+        px->red = *counter & 0xff;
+        px->green = (*counter >> 8) & 0xff;
+        px->blue = (*counter >> 16) & 0xff;
+        (*counter)++;
+}
+
+/********************** rotate ****************************
+ * Runs one rotation with the traversal's map or, for bulk
+ * traversals, Rotate_bulk.
+ *********************************************************/
+static void rotate(struct traversal *t, A2 src, A2 dst, int degree)
+{
+        if (t->gather) {
+                Rotate_gather(t->map, t->methods, src, dst, degree);
+        } else if (t->map != NULL) {
+                Rotate_map(t->map, t->methods, src, dst, degree);
+        } else {
+                Rotate_bulk(t->methods, src, dst, degree, t->stream);
+        }
+}
+
+/********************* run_case ***************************
+ * Times one (size, rotation, traversal) combination and
+ * prints its CSV row.
+ *
+ * Notes:
+ *      The destination is allocated once and reused, so the
+ *      warmup runs take the page faults and the timed runs
+ *      measure the traversal alone.
+ *********************************************************/
+static void run_case(struct settings *s, int side, int degree,
+                     struct traversal *t, double *samples)
+{
+        A methods = t->methods;
+        int size = sizeof(struct Pnm_rgb);
+        A2Prefetch_set_row_distance(t->prefetch);
+        A2Prefetch_set_block_distance(t->prefetch);
+        A2 src = t->blocksize > 0
+                ? methods->new_with_blocksize(side, side, size, t->blocksize)
+                : methods->new(side, side, size);
+        unsigned counter = 0;
+        methods->small_map_default(src, fill_pixel, &counter);
+
+        int width, height;
+        Rotate_dimensions(methods, src, degree, &width, &height);
+        A2 dst = t->blocksize > 0
+                ? methods->new_with_blocksize(width, height, size,
+                                              t->blocksize)
+                : methods->new(width, height, size);
+
+        for (int i = 0; i < s->warmup; i++) {
+                rotate(t, src, dst, degree);
+        }
+        for (int i = 0; i < s->reps; i++) {
+                CPUTime_Fast timer;
+                CPUTime_FastStart(&timer);
+                rotate(t, src, dst, degree);
+                samples[i] = CPUTime_FastStop(&timer);
+        }
+        qsort(samples, s->reps, sizeof(double),
+              BenchUtil_compare_doubles);
+
+        double pixels = (double)side * side;
+        double median = BenchUtil_percentile(samples, s->reps, 50);
+        double p95 = BenchUtil_percentile(samples, s->reps, 95);
+        double bytes = 2.0 * pixels * size;
+
+        printf("%d,%d,%.0f,%.0f,%d,%s,%d,%d,%d,%.3f,%.3f,%.3f,%.3f\n",
+               side, side, pixels, pixels * size, degree, t->name,
+               methods->blocksize(src), t->prefetch, s->reps,
+               median / pixels,
+               p95 / pixels, samples[0] / pixels, bytes / median);
+        fflush(stdout);
+
+        methods->free(&dst);
+        methods->free(&src);
+}
+
+/************************ main ****************************
+ * Parses the sweep settings, pins the process and runs
+ * every combination.
+ *********************************************************/
+int main(int argc, char *argv[])
+{
+        struct settings s = {
+                .sides = { 16, 32, 64, 128, 256, 512, 1024, 2048, 4096,
+                           8192, 16384 },
+                .num_sides = 11,
+                .blocksizes = { 8, 16, 32, 64 },
+                .num_blocksizes = 4,
+                .num_prefetches = 0,
+                .rotations = { 90, 180, 270 },
+                .num_rotations = 3,
+                .warmup = 1,
+                .reps = 5,
+                .cpu = -1,
+                .max_mb = 512,
+                .bulk = false,
+                .gather = false,
+        };
+
+        for (int i = 1; i < argc; i++) {
+                if (strcmp(argv[i], "-bulk") == 0) {
+                        s.bulk = true;
+                        continue;
+                }
+                if (strcmp(argv[i], "-gather") == 0) {
+                        s.gather = true;
+                        continue;
+                }
+                if (i + 1 >= argc) {
+                        usage(argv[0]);
+                }
+                const char *arg = argv[i + 1];
+                if (strcmp(argv[i], "-sizes") == 0) {
+                        s.num_sides = BenchUtil_parse_list(arg, s.sides,
+                                                           MAX_LIST);
+                } else if (strcmp(argv[i], "-blocksizes") == 0) {
+                        s.num_blocksizes = BenchUtil_parse_list(
+                                arg, s.blocksizes, MAX_LIST);
+                } else if (strcmp(argv[i], "-prefetch") == 0) {
+                        s.num_prefetches = BenchUtil_parse_list(
+                                arg, s.prefetches, MAX_LIST);
+                } else if (strcmp(argv[i], "-rotations") == 0) {
+                        s.num_rotations = BenchUtil_parse_list(arg,
+                                                               s.rotations,
+                                                               3);
+                        for (int r = 0; r < s.num_rotations; r++) {
+                                if (s.rotations[r] != 90 &&
+                                    s.rotations[r] != 180 &&
+                                    s.rotations[r] != 270) {
+                                        usage(argv[0]);
+                                }
+                        }
+                } else if (strcmp(argv[i], "-max-mb") == 0) {
+                        s.max_mb = atof(arg);
+                } else if (strcmp(argv[i], "-warmup") == 0) {
+                        s.warmup = atoi(arg);
+                } else if (strcmp(argv[i], "-reps") == 0) {
+                        s.reps = atoi(arg);
+                } else if (strcmp(argv[i], "-cpu") == 0) {
+                        s.cpu = atoi(arg);
+                } else {
+                        usage(argv[0]);
+                }
+                if (s.num_sides < 0 || s.num_blocksizes < 0 ||
+                    s.num_prefetches < 0 ||
+                    s.num_rotations < 0 || s.warmup < 0 || s.reps < 1) {
+                        usage(argv[0]);
+                }
+                i++;
+        }
+
+        /* row-major, col-major, then one block-major per block size
+         * plus the 64KB default, then the prefetching col-major and
+         * block-major (64KB blocks) for each -prefetch distance,
+         * then with -bulk the plain and blocked bulk kernels with
+         * normal and streaming stores, and the planar arrays (one
+         * plane per channel, rows or 64KB blocks), then with -gather
+         * the three maps run over the destination */
+        struct traversal traversals[3 * MAX_LIST + 12];
+        int num_traversals = 0;
+        traversals[num_traversals++] = (struct traversal){
+                "row-major", uarray2_methods_plain,
+                uarray2_methods_plain->map_row_major, 0, 0,
+                ROTATE_STREAM_AUTO, false };
+        traversals[num_traversals++] = (struct traversal){
+                "col-major", uarray2_methods_plain,
+                uarray2_methods_plain->map_col_major, 0, 0,
+                ROTATE_STREAM_AUTO, false };
+        traversals[num_traversals++] = (struct traversal){
+                "block-major", uarray2_methods_blocked,
+                uarray2_methods_blocked->map_block_major, 0, 0,
+                ROTATE_STREAM_AUTO, false };
+        for (int b = 0; b < s.num_blocksizes; b++) {
+                traversals[num_traversals++] = (struct traversal){
+                        "block-major", uarray2_methods_blocked,
+                        uarray2_methods_blocked->map_block_major,
+                        s.blocksizes[b], 0, ROTATE_STREAM_AUTO, false };
+        }
+        for (int p = 0; p < s.num_prefetches; p++) {
+                traversals[num_traversals++] = (struct traversal){
+                        "col-major", uarray2_methods_plain_prefetch,
+                        uarray2_methods_plain_prefetch->map_col_major,
+                        0, s.prefetches[p], ROTATE_STREAM_AUTO, false };
+                traversals[num_traversals++] = (struct traversal){
+                        "block-major", uarray2_methods_blocked_prefetch,
+                        uarray2_methods_blocked_prefetch->map_block_major,
+                        0, s.prefetches[p], ROTATE_STREAM_AUTO, false };
+        }
+        for (int k = 0; s.bulk && k < 2; k++) {
+                enum Rotate_stream stream = k == 0 ? ROTATE_STREAM_OFF
+                                                   : ROTATE_STREAM_ON;
+                traversals[num_traversals++] = (struct traversal){
+                        k == 0 ? "plain-bulk" : "plain-bulk-stream",
+                        uarray2_methods_plain, NULL, 0, 0, stream, false };
+                traversals[num_traversals++] = (struct traversal){
+                        k == 0 ? "blocked-bulk" : "blocked-bulk-stream",
+                        uarray2_methods_blocked, NULL, 0, 0, stream, false };
+        }
+        if (s.bulk) {
+                traversals[num_traversals++] = (struct traversal){
+                        "planar-bulk", uarray2_methods_planar, NULL, 0, 0,
+                        ROTATE_STREAM_OFF, false };
+                traversals[num_traversals++] = (struct traversal){
+                        "planar-blocked-bulk", uarray2_methods_planar_blocked,
+                        NULL, 0, 0, ROTATE_STREAM_OFF, false };
+        }
+        for (int k = 0; s.gather && k < 3; k++) {
+                traversals[num_traversals++] = traversals[k];
+                traversals[num_traversals - 1].name =
+                        k == 0 ? "row-major-gather"
+                      : k == 1 ? "col-major-gather" : "block-major-gather";
+                traversals[num_traversals - 1].gather = true;
+        }
+
+        int cpu = BenchUtil_pin_cpu(s.cpu);
+        if (cpu < 0) {
+                fprintf(stderr, "%s: warning: could not pin to a cpu\n",
+                        argv[0]);
+        }
+        CPUTime_FastInit();
+        fprintf(stderr, "%s: cpu %d, warmup %d, reps %d, timer %s\n",
+                argv[0], cpu, s.warmup, s.reps, CPUTime_FastBackend());
+
+        double *samples = malloc(s.reps * sizeof(double));
+        assert(samples != NULL);
+
+        printf("width,height,pixels,bytes,rotation,method,blocksize,"
+               "prefetch,reps,"
+               "median_ns_per_pixel,p95_ns_per_pixel,min_ns_per_pixel,"
+               "bandwidth_gb_per_s\n");
+        for (int i = 0; i < s.num_sides; i++) {
+                int side = s.sides[i];
+                double mb = (double)side * side * sizeof(struct Pnm_rgb)
+                            / (1024 * 1024);
+                if (mb > s.max_mb) {
+                        fprintf(stderr, "%s: skipping %dx%d (%.0f MB > "
+                                "-max-mb %.0f)\n", argv[0], side, side, mb,
+                                s.max_mb);
+                        continue;
+                }
+                for (int r = 0; r < s.num_rotations; r++) {
+                        for (int t = 0; t < num_traversals; t++) {
+                                run_case(&s, side, s.rotations[r],
+                                         &traversals[t], samples);
+                        }
+                }
+        }
+
+        free(samples);
+        return EXIT_SUCCESS;
+}
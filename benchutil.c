@@ -0,0 +1,107 @@
+/**************************************************************
+ *
+ *      benchutil.c
+ *
+ *      Xiaoyan Xie (xxie05)
+ *      Diwei Chen (dchen22)
+ *
+ *      CS 40 HW03 - locality
+ *
+ *      This file implements the helpers shared by the benchmark
+ *      programs.
+ *
+ **************************************************************/
+#define _GNU_SOURCE             /* sched_setaffinity, sched_getcpu */
+#include <sched.h>
+#include <stdlib.h>
+#include <limits.h>
+#include "benchutil.h"
+
+/***************** BenchUtil_parse_list *******************
+ * Parses a comma-separated list of positive integers.
+ *
+ * Parameters:
+ *      const char *s: The list, e.g. "4,16,64".
+ *      int *out: Where to store the values.
+ *      int max: Capacity of out.
+ *
+ * Returns:
+ *      int: Number of values stored, or -1 if the list is
+ *           malformed, too long, or holds a value above
+ *           INT_MAX.
+ *********************************************************/
+int BenchUtil_parse_list(const char *s, int *out, int max)
+{
+        int n = 0;
+        while (*s != '\0') {
+                char *end;
+                long v = strtol(s, &end, 10);
+                if (end == s || v <= 0 || v > INT_MAX || n == max ||
+                    (*end != ',' && *end != '\0')) {
+                        return -1;
+                }
+                out[n++] = (int)v;
+                s = *end == ',' ? end + 1 : end;
+        }
+        return n;
+}
+
+/* qsort comparison for an array of doubles, ascending */
+int BenchUtil_compare_doubles(const void *a, const void *b)
+{
+        double x = *(const double *)a, y = *(const double *)b;
+        return (x > y) - (x < y);
+}
+
+/****************** BenchUtil_percentile ******************
+ * Returns the p-th percentile (0..100) of n sorted values,
+ * using the nearest-rank method.
+ *
+ * Parameters:
+ *      const double *sorted: Values in ascending order.
+ *      int n: Number of values (at least 1).
+ *      double p: Percentile to return, 0 to 100.
+ *
+ * Returns:
+ *      double: The value of rank ceil(p / 100 * n), clamped to
+ *              1..n.
+ *********************************************************/
+double BenchUtil_percentile(const double *sorted, int n, double p)
+{
+        int rank = (int)(p / 100.0 * n + 0.999999);
+        if (rank < 1) {
+                rank = 1;
+        }
+        if (rank > n) {
+                rank = n;
+        }
+        return sorted[rank - 1];
+}
+
+/******************** BenchUtil_pin_cpu *******************
+ * Pins the process to one cpu so that runs are not
+ * disturbed by migrations.
+ *
+ * Parameters:
+ *      int cpu: The cpu to use, or -1 for the one the process
+ *               is running on.
+ *
+ * Returns:
+ *      int: The cpu used, or -1 if pinning failed.
+ *********************************************************/
+int BenchUtil_pin_cpu(int cpu)
+{
+        if (cpu < 0) {
+                cpu = sched_getcpu();
+        }
+        if (cpu < 0) {
+                return -1;
+        }
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+                return -1;
+        }
+        return cpu;
+}
@@ -0,0 +1,24 @@
+#ifndef BENCHUTIL_INCLUDED
+#define BENCHUTIL_INCLUDED
+/**************************************************************
+ *
+ *      benchutil.h
+ *
+ *      Xiaoyan Xie (xxie05)
+ *      Diwei Chen (dchen22)
+ *
+ *      CS 40 HW03 - locality
+ *
+ *      Helpers shared by the benchmark programs (bench.c and
+ *      microbench.c): parsing of comma-separated list options,
+ *      percentiles of the timed samples, and pinning the process
+ *      to one cpu.
+ *
+ **************************************************************/
+
+extern int BenchUtil_parse_list(const char *s, int *out, int max);
+extern int BenchUtil_compare_doubles(const void *a, const void *b);
+extern double BenchUtil_percentile(const double *sorted, int n, double p);
+extern int BenchUtil_pin_cpu(int cpu);
+
+#endif
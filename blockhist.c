@@ -0,0 +1,206 @@
+/**************************************************************
+ *
+ *      blockhist.c
+ *
+ *      Xiaoyan Xie (xxie05)
+ *      Diwei Chen (dchen22)
+ *
+ *      CS 40 HW03 - locality
+ *
+ *      This file implements BlockHist_T.  Recording is a bucket
+ *      index computation and a few increments, so it adds little
+ *      to the block it measures.
+ *
+ **************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "assert.h"
+#include "blockhist.h"
+
+struct slow_block {
+        double ns;
+        int b_col, b_row;
+        int is_edge;
+};
+
+struct BlockHist {
+        uint64_t buckets[BLOCKHIST_BUCKETS];
+        uint64_t edge_buckets[BLOCKHIST_BUCKETS];
+        uint64_t count, edge_count;
+        double total_ns, min_ns, max_ns;
+        struct slow_block slowest[BLOCKHIST_SLOWEST];  /* descending */
+        int num_slowest;
+};
+
+/********************** BlockHist_New *********************
+ * Creates an empty histogram.
+ *
+ * Notes:
+ *      Will CRE if memory allocation fails.
+ *********************************************************/
+BlockHist_T BlockHist_New(void)
+{
+        BlockHist_T hist = calloc(1, sizeof(*hist));
+        assert(hist != NULL);
+        return hist;
+}
+
+/********************* BlockHist_Free *********************
+ * Frees a histogram and sets *histp to NULL.
+ *********************************************************/
+void BlockHist_Free(BlockHist_T *histp)
+{
+        assert(histp != NULL && *histp != NULL);
+        free(*histp);
+        *histp = NULL;
+}
+
+static int bucket_of(double ns)
+{
+        int bucket = 0;
+        uint64_t t = ns < 1 ? 0 : (uint64_t)ns;
+        while (t > 1 && bucket < BLOCKHIST_BUCKETS - 1) {
+                t >>= 1;
+                bucket++;
+        }
+        return bucket;
+}
+
+/******************** BlockHist_record ********************
+ * Adds one block's processing time.
+ *
+ * Parameters:
+ *      BlockHist_T hist: The histogram.
+ *      double ns: Time spent on the block in nanoseconds.
+ *      int b_col, b_row: Position of the block in the block grid.
+ *      int is_edge: Nonzero if the block is partly outside the
+ *                   array (right or bottom edge).
+ *********************************************************/
+void BlockHist_record(BlockHist_T hist, double ns, int b_col, int b_row,
+                      int is_edge)
+{
+        assert(hist != NULL);
+        int bucket = bucket_of(ns);
+
+        hist->buckets[bucket]++;
+        if (is_edge) {
+                hist->edge_buckets[bucket]++;
+                hist->edge_count++;
+        }
+        if (hist->count == 0 || ns < hist->min_ns) {
+                hist->min_ns = ns;
+        }
+        if (hist->count == 0 || ns > hist->max_ns) {
+                hist->max_ns = ns;
+        }
+        hist->count++;
+        hist->total_ns += ns;
+
+        /* insertion into the short list of slowest blocks */
+        int n = hist->num_slowest;
+        if (n == BLOCKHIST_SLOWEST && ns <= hist->slowest[n - 1].ns) {
+                return;
+        }
+        int i = n < BLOCKHIST_SLOWEST ? n : n - 1;
+        while (i > 0 && hist->slowest[i - 1].ns < ns) {
+                hist->slowest[i] = hist->slowest[i - 1];
+                i--;
+        }
+        hist->slowest[i] = (struct slow_block){ ns, b_col, b_row, is_edge };
+        if (n < BLOCKHIST_SLOWEST) {
+                hist->num_slowest++;
+        }
+}
+
+/********************* BlockHist_count ********************
+ * Returns the number of blocks recorded.
+ *********************************************************/
+uint64_t BlockHist_count(BlockHist_T hist)
+{
+        assert(hist != NULL);
+        return hist->count;
+}
+
+/******************** BlockHist_bucket ********************
+ * Returns the number of blocks in one bucket.
+ *********************************************************/
+uint64_t BlockHist_bucket(BlockHist_T hist, int bucket)
+{
+        assert(hist != NULL);
+        assert(bucket >= 0 && bucket < BLOCKHIST_BUCKETS);
+        return hist->buckets[bucket];
+}
+
+/****************** BlockHist_percentile ******************
+ * Returns an upper bound on the p-th percentile (0..100):
+ * the upper edge of the bucket holding that rank.  Returns
+ * 0 for an empty histogram.
+ *********************************************************/
+double BlockHist_percentile(BlockHist_T hist, double p)
+{
+        assert(hist != NULL);
+        assert(p >= 0 && p <= 100);
+        if (hist->count == 0) {
+                return 0;
+        }
+        uint64_t rank = (uint64_t)ceil(p / 100.0 * hist->count);
+        if (rank == 0) {
+                rank = 1;
+        }
+        uint64_t seen = 0;
+        for (int b = 0; b < BLOCKHIST_BUCKETS; b++) {
+                seen += hist->buckets[b];
+                if (seen >= rank) {
+                        return ldexp(1.0, b + 1);
+                }
+        }
+        return hist->max_ns;
+}
+
+/********************* BlockHist_print ********************
+ * Prints a summary, the non-empty buckets with a bar for
+ * each, and the slowest blocks.
+ *********************************************************/
+void BlockHist_print(FILE *fp, BlockHist_T hist)
+{
+        assert(fp != NULL && hist != NULL);
+
+        fprintf(fp, "blocks %llu (edge %llu), total %.0f ns, "
+                "mean %.1f ns, min %.0f ns, max %.0f ns\n",
+                (unsigned long long)hist->count,
+                (unsigned long long)hist->edge_count, hist->total_ns,
+                hist->count > 0 ? hist->total_ns / hist->count : 0.0,
+                hist->min_ns, hist->max_ns);
+        fprintf(fp, "p50 < %.0f ns, p95 < %.0f ns, p99 < %.0f ns\n",
+                BlockHist_percentile(hist, 50),
+                BlockHist_percentile(hist, 95),
+                BlockHist_percentile(hist, 99));
+
+        uint64_t most = 0;
+        for (int b = 0; b < BLOCKHIST_BUCKETS; b++) {
+                if (hist->buckets[b] > most) {
+                        most = hist->buckets[b];
+                }
+        }
+        fprintf(fp, "%24s %12s %12s\n", "ns", "blocks", "edge");
+        for (int b = 0; b < BLOCKHIST_BUCKETS; b++) {
+                if (hist->buckets[b] == 0) {
+                        continue;
+                }
+                char bar[41];
+                int len = (int)(40 * hist->buckets[b] / most);
+                memset(bar, '#', len);
+                bar[len] = '\0';
+                fprintf(fp, "[%10.0f, %10.0f) %12llu %12llu %s\n",
+                        b == 0 ? 0.0 : ldexp(1.0, b), ldexp(1.0, b + 1),
+                        (unsigned long long)hist->buckets[b],
+                        (unsigned long long)hist->edge_buckets[b], bar);
+        }
+        fprintf(fp, "slowest blocks (col, row):\n");
+        for (int i = 0; i < hist->num_slowest; i++) {
+                fprintf(fp, "  (%d, %d) %.0f ns%s\n", hist->slowest[i].b_col,
+                        hist->slowest[i].b_row, hist->slowest[i].ns,
+                        hist->slowest[i].is_edge ? " edge" : "");
+        }
+}
@@ -0,0 +1,55 @@
+#ifndef BLOCKHIST_INCLUDED
+#define BLOCKHIST_INCLUDED
+/**************************************************************
+ *
+ *      blockhist.h
+ *
+ *      Xiaoyan Xie (xxie05)
+ *      Diwei Chen (dchen22)
+ *
+ *      CS 40 HW03 - locality
+ *
+ *      Interface to BlockHist_T, a log2-bucketed histogram of
+ *      per-block processing times, and to the UArray2b_map hook
+ *      that fills one in.
+ *
+ *      Bucket i counts blocks that took [2^i, 2^(i+1)) nanoseconds
+ *      (bucket 0 also holds times under 1ns).  Blocks on the right
+ *      or bottom edge of the array, which are only partly inside
+ *      the image, are counted separately as well, and the slowest
+ *      few blocks are remembered by position, so a report shows
+ *      whether a slow map is a few outliers or every block.
+ *
+ *      The hook exists only when uarray2b.c is compiled with
+ *      -DUARRAY2B_HISTOGRAM (make HISTOGRAM=1).  Otherwise
+ *      UArray2b_map has no instrumentation at all.
+ *
+ **************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define BLOCKHIST_BUCKETS 48
+#define BLOCKHIST_SLOWEST 8
+
+typedef struct BlockHist *BlockHist_T;
+
+extern BlockHist_T BlockHist_New(void);
+extern void BlockHist_Free(BlockHist_T *histp);
+
+extern void BlockHist_record(BlockHist_T hist, double ns, int b_col,
+                             int b_row, int is_edge);
+extern uint64_t BlockHist_count(BlockHist_T hist);
+extern uint64_t BlockHist_bucket(BlockHist_T hist, int bucket);
+extern double BlockHist_percentile(BlockHist_T hist, double p);
+extern void BlockHist_print(FILE *fp, BlockHist_T hist);
+
+#ifdef UARRAY2B_HISTOGRAM
+#include "uarray2b.h"
+
+/* Every later UArray2b_map records each block's time into hist;
+ * NULL turns recording off.  Not thread-safe. */
+extern void UArray2b_set_histogram(BlockHist_T hist);
+#endif
+
+#endif
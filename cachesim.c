@@ -0,0 +1,311 @@
+/**************************************************************
+ *
+ *      cachesim.c
+ *
+ *      Xiaoyan Xie (xxie05)
+ *      Diwei Chen (dchen22)
+ *
+ *      CS 40 HW03 - locality
+ *
+ *      This file implements CacheSim_T.  Each level and the TLB
+ *      is an array of sets; each set holds `ways` tags with the
+ *      time of their last use, and a miss replaces the least
+ *      recently used way.  Set counts need not be powers of two
+ *      (an 11-way 16.5MB L3 has 24576 sets), so the set index is
+ *      taken modulo the number of sets.
+ *
+ **************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "assert.h"
+#include "cachesim.h"
+
+CacheSim_T CacheSim_current = NULL;
+
+struct level {
+        char name[8];
+        uint64_t line;          /* bytes per line (or page) */
+        int ways;
+        uint64_t sets;
+        uint64_t *tags;         /* sets * ways, tag+1 (0 = empty) */
+        uint64_t *stamps;       /* sets * ways, time of last use */
+        struct CacheSim_stats stats;
+};
+
+struct CacheSim {
+        struct level levels[CACHESIM_MAX_LEVELS];
+        int num_levels;
+        struct level tlb;
+        uint64_t clock;         /* advances on every lookup */
+        uint64_t references;    /* calls to CacheSim_access */
+};
+
+/******************** parse_size **************************
+ * Parses a byte count with an optional K, M or G suffix.
+ * Returns 0 on a malformed value and advances *sp past it.
+ *********************************************************/
+static uint64_t parse_size(const char **sp)
+{
+        char *end;
+        unsigned long long v = strtoull(*sp, &end, 10);
+        if (end == *sp) {
+                return 0;
+        }
+        switch (toupper((unsigned char)*end)) {
+        case 'K': v <<= 10; end++; break;
+        case 'M': v <<= 20; end++; break;
+        case 'G': v <<= 30; end++; break;
+        default: break;
+        }
+        *sp = end;
+        return v;
+}
+
+/********************** init_level ************************
+ * Allocates the sets of one level.  Returns 0 when the
+ * geometry is inconsistent.
+ *********************************************************/
+static int init_level(struct level *lv, const char *name, uint64_t bytes,
+                      uint64_t line, int ways)
+{
+        if (line == 0 || ways <= 0 || bytes < line * ways ||
+            bytes % (line * ways) != 0) {
+                return 0;
+        }
+        strncpy(lv->name, name, sizeof(lv->name) - 1);
+        lv->name[sizeof(lv->name) - 1] = '\0';
+        lv->line = line;
+        lv->ways = ways;
+        lv->sets = bytes / (line * ways);
+        lv->tags = calloc(lv->sets * ways, sizeof(uint64_t));
+        lv->stamps = calloc(lv->sets * ways, sizeof(uint64_t));
+        assert(lv->tags != NULL && lv->stamps != NULL);
+        memset(&lv->stats, 0, sizeof(lv->stats));
+        lv->stats.name = lv->name;
+        return 1;
+}
+
+/********************** CacheSim_new **********************
+ * Creates a simulator from a cache spec and a TLB spec (see
+ * cachesim.h); NULL specs select the defaults.
+ *
+ * Returns:
+ *      CacheSim_T: The simulator, or NULL if a spec is
+ *                  malformed.
+ *
+ * Notes:
+ *      Will CRE if memory allocation fails.
+ *********************************************************/
+CacheSim_T CacheSim_new(const char *caches, const char *tlb)
+{
+        if (caches == NULL) {
+                caches = CACHESIM_DEFAULT_CACHES;
+        }
+        if (tlb == NULL) {
+                tlb = CACHESIM_DEFAULT_TLB;
+        }
+
+        CacheSim_T sim = calloc(1, sizeof(*sim));
+        assert(sim != NULL);
+
+        const char *s = caches;
+        while (*s != '\0') {
+                char name[8];
+                int n = 0;
+                while (*s != '=' && *s != '\0' && n < 7) {
+                        name[n++] = *s++;
+                }
+                name[n] = '\0';
+                if (*s++ != '=' || sim->num_levels == CACHESIM_MAX_LEVELS) {
+                        CacheSim_free(&sim);
+                        return NULL;
+                }
+                uint64_t bytes = parse_size(&s);
+                uint64_t line = *s == '/' ? (s++, parse_size(&s)) : 0;
+                int ways = *s == '/' ? (s++, (int)parse_size(&s)) : 0;
+                if (!init_level(&sim->levels[sim->num_levels], name, bytes,
+                                line, ways)) {
+                        CacheSim_free(&sim);
+                        return NULL;
+                }
+                sim->num_levels++;
+                if (*s == ',') {
+                        s++;
+                } else if (*s != '\0') {
+                        CacheSim_free(&sim);
+                        return NULL;
+                }
+        }
+
+        s = tlb;
+        uint64_t entries = parse_size(&s);
+        int ways = *s == '/' ? (s++, (int)parse_size(&s)) : 0;
+        uint64_t page = *s == '/' ? (s++, parse_size(&s)) : 0;
+        if (*s != '\0' || sim->num_levels == 0 ||
+            !init_level(&sim->tlb, "dTLB", entries * page, page, ways)) {
+                CacheSim_free(&sim);
+                return NULL;
+        }
+        return sim;
+}
+
+/********************* CacheSim_free **********************
+ * Frees a simulator and sets *simp to NULL.  Clears
+ * CacheSim_current if it pointed at this simulator.
+ *********************************************************/
+void CacheSim_free(CacheSim_T *simp)
+{
+        assert(simp != NULL && *simp != NULL);
+        CacheSim_T sim = *simp;
+        for (int i = 0; i < sim->num_levels; i++) {
+                free(sim->levels[i].tags);
+                free(sim->levels[i].stamps);
+        }
+        free(sim->tlb.tags);
+        free(sim->tlb.stamps);
+        if (CacheSim_current == sim) {
+                CacheSim_current = NULL;
+        }
+        free(sim);
+        *simp = NULL;
+}
+
+/*********************** lookup ***************************
+ * Looks one line (or page) number up in a level, filling
+ * it on a miss.  Returns 1 on a hit.
+ *********************************************************/
+static int lookup(struct level *lv, uint64_t number, uint64_t now)
+{
+        uint64_t set = number % lv->sets;
+        uint64_t *tags = lv->tags + set * lv->ways;
+        uint64_t *stamps = lv->stamps + set * lv->ways;
+        uint64_t tag = number + 1;
+        int victim = 0;
+
+        lv->stats.accesses++;
+        for (int w = 0; w < lv->ways; w++) {
+                if (tags[w] == tag) {
+                        stamps[w] = now;
+                        lv->stats.hits++;
+                        return 1;
+                }
+                if (stamps[w] < stamps[victim]) {
+                        victim = w;
+                }
+        }
+        tags[victim] = tag;
+        stamps[victim] = now;
+        lv->stats.misses++;
+        return 0;
+}
+
+/******************** CacheSim_access *********************
+ * Simulates a data access of `bytes` bytes at addr.  Every
+ * page touched is looked up in the TLB, and every line
+ * touched goes down the hierarchy until some level hits.
+ *********************************************************/
+void CacheSim_access(CacheSim_T sim, const void *addr, int bytes)
+{
+        assert(sim != NULL);
+        assert(bytes > 0);
+        sim->references++;
+
+        uint64_t first = (uintptr_t)addr;
+        uint64_t last = first + bytes - 1;
+
+        for (uint64_t page = first / sim->tlb.line;
+             page <= last / sim->tlb.line; page++) {
+                lookup(&sim->tlb, page, ++sim->clock);
+        }
+
+        uint64_t line_size = sim->levels[0].line;
+        for (uint64_t line = first / line_size; line <= last / line_size;
+             line++) {
+                uint64_t now = ++sim->clock;
+                uint64_t byte = line * line_size;
+                for (int i = 0; i < sim->num_levels; i++) {
+                        struct level *lv = &sim->levels[i];
+                        if (lookup(lv, byte / lv->line, now)) {
+                                break;
+                        }
+                }
+        }
+}
+
+/******************** CacheSim_reset **********************
+ * Empties every level and the TLB and clears all counts.
+ *********************************************************/
+void CacheSim_reset(CacheSim_T sim)
+{
+        assert(sim != NULL);
+        for (int i = 0; i < sim->num_levels; i++) {
+                struct level *lv = &sim->levels[i];
+                memset(lv->tags, 0, lv->sets * lv->ways * sizeof(uint64_t));
+                memset(lv->stamps, 0,
+                       lv->sets * lv->ways * sizeof(uint64_t));
+                memset(&lv->stats, 0, sizeof(lv->stats));
+                lv->stats.name = lv->name;
+        }
+        struct level *tlb = &sim->tlb;
+        memset(tlb->tags, 0, tlb->sets * tlb->ways * sizeof(uint64_t));
+        memset(tlb->stamps, 0, tlb->sets * tlb->ways * sizeof(uint64_t));
+        memset(&tlb->stats, 0, sizeof(tlb->stats));
+        tlb->stats.name = tlb->name;
+        sim->clock = 0;
+        sim->references = 0;
+}
+
+int CacheSim_levels(CacheSim_T sim)
+{
+        assert(sim != NULL);
+        return sim->num_levels;
+}
+
+struct CacheSim_stats CacheSim_level(CacheSim_T sim, int level)
+{
+        assert(sim != NULL);
+        assert(level >= 0 && level < sim->num_levels);
+        return sim->levels[level].stats;
+}
+
+struct CacheSim_stats CacheSim_tlb(CacheSim_T sim)
+{
+        assert(sim != NULL);
+        return sim->tlb.stats;
+}
+
+uint64_t CacheSim_references(CacheSim_T sim)
+{
+        assert(sim != NULL);
+        return sim->references;
+}
+
+static void print_stats(FILE *fp, struct CacheSim_stats *st, double pixels)
+{
+        fprintf(fp, "%-6s %14llu %14llu %14llu %8.3f%%",
+                st->name, (unsigned long long)st->accesses,
+                (unsigned long long)st->hits,
+                (unsigned long long)st->misses,
+                st->accesses > 0 ? 100.0 * st->misses / st->accesses : 0.0);
+        if (pixels > 0) {
+                fprintf(fp, " %10.4f", st->misses / pixels);
+        }
+        fprintf(fp, "\n");
+}
+
+/******************** CacheSim_print **********************
+ * Prints accesses, hits, misses and miss rate for every
+ * level and the TLB, and misses per pixel when pixels > 0.
+ *********************************************************/
+void CacheSim_print(FILE *fp, CacheSim_T sim, double pixels)
+{
+        assert(fp != NULL && sim != NULL);
+        fprintf(fp, "%-6s %14s %14s %14s %9s%s\n", "level", "accesses",
+                "hits", "misses", "miss rate",
+                pixels > 0 ? "  miss/pixel" : "");
+        for (int i = 0; i < sim->num_levels; i++) {
+                print_stats(fp, &sim->levels[i].stats, pixels);
+        }
+        print_stats(fp, &sim->tlb.stats, pixels);
+}
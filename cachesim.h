@@ -0,0 +1,78 @@
+#ifndef CACHESIM_INCLUDED
+#define CACHESIM_INCLUDED
+/**************************************************************
+ *
+ *      cachesim.h
+ *
+ *      Xiaoyan Xie (xxie05)
+ *      Diwei Chen (dchen22)
+ *
+ *      CS 40 HW03 - locality
+ *
+ *      Interface to CacheSim_T, a deterministic model of a
+ *      multi-level set-associative data cache hierarchy (LRU
+ *      replacement, every level filled on a miss) plus a
+ *      set-associative data TLB.
+ *
+ *      When uarray2.c and uarray2b.c are compiled with -DCACHESIM
+ *      (the *_sim.o objects in the Makefile), every cell returned
+ *      by an at function or visited by a map function, and every
+ *      row or block index lookup made on the way, is fed to
+ *      CacheSim_current.  With CacheSim_current NULL, or in a
+ *      normal build, nothing is recorded.
+ *
+ *      Geometry specs are strings such as
+ *
+ *          "L1=32K/64/8,L2=1M/64/16,L3=16896K/64/11"
+ *
+ *      (name=size/line/ways per level, innermost first) and, for
+ *      the TLB, "64/4/4K" (entries/ways/page size).
+ *
+ **************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define CACHESIM_MAX_LEVELS 4
+
+typedef struct CacheSim *CacheSim_T;
+
+/* counts for one cache level or the TLB */
+struct CacheSim_stats {
+        const char *name;
+        uint64_t accesses;
+        uint64_t hits;
+        uint64_t misses;
+};
+
+/* default geometry: the Xeon Silver 4214Y used for the report */
+#define CACHESIM_DEFAULT_CACHES "L1=32K/64/8,L2=1M/64/16,L3=16896K/64/11"
+#define CACHESIM_DEFAULT_TLB    "64/4/4K"
+
+extern CacheSim_T CacheSim_new(const char *caches, const char *tlb);
+extern void CacheSim_free(CacheSim_T *simp);
+
+extern void CacheSim_access(CacheSim_T sim, const void *addr, int bytes);
+extern void CacheSim_reset(CacheSim_T sim);
+
+extern int  CacheSim_levels(CacheSim_T sim);
+extern struct CacheSim_stats CacheSim_level(CacheSim_T sim, int level);
+extern struct CacheSim_stats CacheSim_tlb(CacheSim_T sim);
+extern uint64_t CacheSim_references(CacheSim_T sim);
+
+extern void CacheSim_print(FILE *fp, CacheSim_T sim, double pixels);
+
+/* simulator that instrumented A2 code reports to, or NULL */
+extern CacheSim_T CacheSim_current;
+
+#ifdef CACHESIM
+#define CACHESIM_TOUCH(ptr, bytes) do {                                 \
+        if (CacheSim_current != NULL) {                                 \
+                CacheSim_access(CacheSim_current, (ptr), (bytes));      \
+        }                                                               \
+} while (0)
+#else
+#define CACHESIM_TOUCH(ptr, bytes) ((void)0)
+#endif
+
+#endif
@@ -32,6 +32,9 @@
 #include <time.h>
 #include "assert.h"
 #include "cputiming_impl.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - 
  *              Forward declaration of functions/
@@ -78,6 +81,98 @@ double CPUTime_Stop(CPUTime_T startTimep)
         return timespec_to_double(&time_used);
 }
 
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - 
+ *              Fast timer backend selection and calibration
+ * - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+int CPUTime_fast_backend = -1;
+
+static double ns_per_tick = 1.0;
+
+/*
+ *  has_invariant_tsc
+ *
+ *  True when the CPU advertises rdtscp and a TSC that ticks at a
+ *  constant rate across P-states and C-states (CPUID 0x80000007,
+ *  EDX bit 8), so tick counts can be converted to time.
+ */
+static int has_invariant_tsc(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+        unsigned eax, ebx, ecx, edx;
+        if (__get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx) == 0 ||
+            (edx & (1u << 27)) == 0) {                  /* rdtscp */
+                return 0;
+        }
+        if (__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) == 0) {
+                return 0;
+        }
+        return (edx & (1u << 8)) != 0;
+#else
+        return 0;
+#endif
+}
+
+/*
+ *  CPUTime_FastInit
+ *
+ *  Chooses the fast timer backend and, for the TSC, measures its
+ *  frequency by spinning for about 20 milliseconds of
+ *  CLOCK_MONOTONIC_RAW.  Called automatically by the first
+ *  CPUTime_FastStart; call it up front to keep the calibration
+ *  out of the first measurement.
+ */
+void CPUTime_FastInit(void)
+{
+        if (CPUTime_fast_backend >= 0) {
+                return;
+        }
+        if (!has_invariant_tsc()) {
+                ns_per_tick = 1.0;
+                CPUTime_fast_backend = 0;
+                return;
+        }
+
+        CPUTime_fast_backend = 1;
+        CPUTime_Fast t;
+        uint64_t clock_start = CPUTime_FastClock();
+        CPUTime_FastStart(&t);
+        uint64_t clock_elapsed;
+        do {
+                clock_elapsed = CPUTime_FastClock() - clock_start;
+        } while (clock_elapsed < 20000000);
+        uint64_t ticks = CPUTime_FastStopTicks(&t);
+
+        if (ticks == 0) {
+                CPUTime_fast_backend = 0;
+                ns_per_tick = 1.0;
+        } else {
+                ns_per_tick = (double)clock_elapsed / ticks;
+        }
+}
+
+/*
+ *  CPUTime_FastBackend
+ *
+ *  Names the backend in use, for reports.
+ */
+const char *CPUTime_FastBackend(void)
+{
+        CPUTime_FastInit();
+        return CPUTime_fast_backend == 1 ? "rdtscp" : "CLOCK_MONOTONIC_RAW";
+}
+
+/*
+ *  CPUTime_FastTicksToNs
+ *
+ *  Converts a tick count from CPUTime_FastStopTicks to nanoseconds.
+ */
+double CPUTime_FastTicksToNs(uint64_t ticks)
+{
+        CPUTime_FastInit();
+        return ticks * ns_per_tick;
+}
+
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - 
  *     Utility functions called internally
  * - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
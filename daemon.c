@@ -0,0 +1,415 @@
+/**************************************************************
+ *
+ *      daemon.c
+ *
+ *      Xiaoyan Xie (xxie05)
+ *      Diwei Chen (dchen22)
+ *
+ *      CS 40 HW03 - locality
+ *
+ *      This file implements the request server and its client
+ *      (see daemon.h).  The listening socket belongs to a small
+ *      supervisor that forks one worker and forks another
+ *      whenever the worker exits.  The worker accepts connections,
+ *      points its stdout, stderr and working directory at the
+ *      client's for the length of one request, and puts them back
+ *      afterwards.
+ *
+ **************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include "assert.h"
+#include "daemon.h"
+
+#define NFDS 4                  /* input, output, error, cwd */
+#define MAX_ARGS_BYTES (64 * 1024)
+#define MAX_ARGS 1024
+
+/* what the worker keeps across requests */
+#define HEAP_KEEP (1L << 30)    /* freed memory kept for reuse */
+#define MMAP_LIMIT (32 << 20)   /* largest block taken from the heap */
+
+struct request {
+        int fds[NFDS];
+        int argc;
+        char **argv;            /* argv[0] is the server's name */
+        char *args;
+};
+
+static bool fill_address(struct sockaddr_un *addr, const char *path)
+{
+        memset(addr, 0, sizeof(*addr));
+        addr->sun_family = AF_UNIX;
+        if (strlen(path) >= sizeof(addr->sun_path)) {
+                errno = ENAMETOOLONG;
+                return false;
+        }
+        strcpy(addr->sun_path, path);
+        return true;
+}
+
+static bool read_all(int fd, void *buf, size_t len)
+{
+        char *p = buf;
+        while (len > 0) {
+                ssize_t n = read(fd, p, len);
+                if (n < 0 && errno == EINTR) {
+                        continue;
+                }
+                if (n <= 0) {
+                        return false;
+                }
+                p += n;
+                len -= n;
+        }
+        return true;
+}
+
+static bool write_all(int fd, const void *buf, size_t len)
+{
+        const char *p = buf;
+        while (len > 0) {
+                ssize_t n = write(fd, p, len);
+                if (n < 0 && errno == EINTR) {
+                        continue;
+                }
+                if (n <= 0) {
+                        return false;
+                }
+                p += n;
+                len -= n;
+        }
+        return true;
+}
+
+static void close_fds(int *fds, int n)
+{
+        for (int k = 0; k < n; k++) {
+                if (fds[k] >= 0) {
+                        close(fds[k]);
+                        fds[k] = -1;
+                }
+        }
+}
+
+/********************* receive_request ********************
+ * Reads one request from conn: the counts and descriptors
+ * with recvmsg, then the argument bytes.  Returns false on
+ * a malformed request, with nothing left open.
+ *********************************************************/
+static bool receive_request(int conn, const char *name,
+                            struct request *req)
+{
+        uint32_t counts[2];
+        union {
+                char buf[CMSG_SPACE(NFDS * sizeof(int))];
+                struct cmsghdr align;
+        } control;
+        struct iovec iov = { counts, sizeof(counts) };
+        struct msghdr msg = {
+                .msg_iov = &iov, .msg_iovlen = 1,
+                .msg_control = control.buf,
+                .msg_controllen = sizeof(control.buf),
+        };
+        for (int k = 0; k < NFDS; k++) {
+                req->fds[k] = -1;
+        }
+        req->argv = NULL;
+        req->args = NULL;
+
+        ssize_t n;
+        do {
+                n = recvmsg(conn, &msg, 0);
+        } while (n < 0 && errno == EINTR);
+        struct cmsghdr *cmsg = n > 0 ? CMSG_FIRSTHDR(&msg) : NULL;
+        if (cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET &&
+            cmsg->cmsg_type == SCM_RIGHTS) {
+                int got = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                memcpy(req->fds, CMSG_DATA(cmsg),
+                       (got < NFDS ? got : NFDS) * sizeof(int));
+                if (got != NFDS) {
+                        close_fds(req->fds, got < NFDS ? got : NFDS);
+                        return false;
+                }
+        } else {
+                return false;
+        }
+        if (n < (ssize_t)sizeof(counts) && !read_all(conn,
+            (char *)counts + n, sizeof(counts) - n)) {
+                close_fds(req->fds, NFDS);
+                return false;
+        }
+
+        uint32_t argc = counts[0], bytes = counts[1];
+        if (argc > MAX_ARGS || bytes > MAX_ARGS_BYTES) {
+                close_fds(req->fds, NFDS);
+                return false;
+        }
+        req->args = malloc(bytes + 1);
+        req->argv = malloc((argc + 2) * sizeof(*req->argv));
+        assert(req->args != NULL && req->argv != NULL);
+        if (!read_all(conn, req->args, bytes)) {
+                bytes = 0;
+                argc = 1;               /* fails the check below */
+        }
+        req->args[bytes] = '\0';
+
+        /* split at the NULs; there must be exactly argc of them */
+        req->argv[0] = (char *)name;
+        char *p = req->args, *end = req->args + bytes;
+        uint32_t k;
+        for (k = 0; k < argc && p < end; k++) {
+                req->argv[k + 1] = p;
+                p += strlen(p) + 1;
+        }
+        if (k != argc || p != end) {
+                close_fds(req->fds, NFDS);
+                free(req->args);
+                free(req->argv);
+                return false;
+        }
+        req->argv[argc + 1] = NULL;
+        req->argc = argc + 1;
+        return true;
+}
+
+/********************** run_request ***********************
+ * Runs the handler on req in the client's environment and
+ * restores the worker's own afterwards.  Returns the
+ * handler's status.
+ *********************************************************/
+static int run_request(struct request *req, Daemon_handler *handler,
+                       int home)
+{
+        int saved_out = dup(STDOUT_FILENO);
+        int saved_err = dup(STDERR_FILENO);
+        assert(saved_out >= 0 && saved_err >= 0);
+
+        int status = 1;
+        FILE *in = fdopen(req->fds[0], "r");
+        if (in != NULL && fchdir(req->fds[3]) == 0 &&
+            dup2(req->fds[1], STDOUT_FILENO) >= 0 &&
+            dup2(req->fds[2], STDERR_FILENO) >= 0) {
+                status = handler(req->argc, req->argv, in);
+        }
+        fflush(stdout);
+        fflush(stderr);
+        clearerr(stdout);               /* a closed pipe is the client's */
+
+        dup2(saved_out, STDOUT_FILENO);
+        dup2(saved_err, STDERR_FILENO);
+        close(saved_out);
+        close(saved_err);
+        if (fchdir(home) != 0) {
+                exit(1);                /* let the supervisor restart */
+        }
+        if (in != NULL) {
+                fclose(in);
+                req->fds[0] = -1;
+        }
+        close_fds(req->fds, NFDS);
+        free(req->args);
+        free(req->argv);
+        return status;
+}
+
+/************************* serve **************************
+ * The worker: serves requests on listener until killed.
+ * Large blocks are kept in the heap after free, so later
+ * requests reuse pages that are already mapped.
+ *********************************************************/
+static void serve(int listener, const char *name, Daemon_handler *handler)
+{
+#ifdef M_MMAP_THRESHOLD
+        mallopt(M_MMAP_THRESHOLD, MMAP_LIMIT);
+        mallopt(M_TRIM_THRESHOLD, HEAP_KEEP);
+#endif
+        int home = open(".", O_RDONLY | O_DIRECTORY);
+        assert(home >= 0);
+
+        for (;;) {
+                int conn = accept(listener, NULL, NULL);
+                if (conn < 0) {
+                        continue;
+                }
+                struct request req;
+                if (receive_request(conn, name, &req)) {
+                        int32_t status = run_request(&req, handler, home);
+                        write_all(conn, &status, sizeof(status));
+                }
+                close(conn);
+        }
+}
+
+/********************** send_request **********************
+ * Sends the counts with fds attached, then the arguments.
+ *********************************************************/
+static bool send_request(int conn, int argc, const char *args,
+                         size_t bytes, int fds[NFDS])
+{
+        uint32_t counts[2] = { argc, bytes };
+        union {
+                char buf[CMSG_SPACE(NFDS * sizeof(int))];
+                struct cmsghdr align;
+        } control;
+        memset(&control, 0, sizeof(control));
+        struct iovec iov = { counts, sizeof(counts) };
+        struct msghdr msg = {
+                .msg_iov = &iov, .msg_iovlen = 1,
+                .msg_control = control.buf,
+                .msg_controllen = sizeof(control.buf),
+        };
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(NFDS * sizeof(int));
+        memcpy(CMSG_DATA(cmsg), fds, NFDS * sizeof(int));
+
+        ssize_t n;
+        do {
+                n = sendmsg(conn, &msg, MSG_NOSIGNAL);
+        } while (n < 0 && errno == EINTR);
+        return n >= 0 &&
+               write_all(conn, (char *)counts + n, sizeof(counts) - n) &&
+               write_all(conn, args, bytes);
+}
+
+/********************** Daemon_serve **********************
+ * Listens on the Unix socket path and serves requests with
+ * handler until the process is killed.
+ *
+ * Parameters:
+ *      const char *path: Socket path; an old socket there is
+ *                        replaced.
+ *      const char *name: Passed to handler as argv[0].
+ *      Daemon_handler *handler: Serves one request.
+ *
+ * Returns:
+ *      int: -1, with errno set, if the socket cannot be set
+ *           up; otherwise it does not return.
+ *
+ * Expects:
+ *      path, name and handler must not be NULL.  No threads
+ *      have been started yet (the worker is forked).
+ *
+ * Notes:
+ *      SIGPIPE is ignored, so a client that goes away only
+ *      fails its own writes.
+ *********************************************************/
+int Daemon_serve(const char *path, const char *name,
+                 Daemon_handler *handler)
+{
+        assert(path != NULL && name != NULL && handler != NULL);
+        struct sockaddr_un addr;
+        if (!fill_address(&addr, path)) {
+                return -1;
+        }
+        struct stat st;
+        if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+                unlink(path);
+        }
+        int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listener < 0) {
+                return -1;
+        }
+        if (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+            listen(listener, SOMAXCONN) < 0) {
+                int saved = errno;
+                close(listener);
+                errno = saved;
+                return -1;
+        }
+        signal(SIGPIPE, SIG_IGN);
+
+        for (;;) {
+                pid_t worker = fork();
+                if (worker == 0) {
+                        serve(listener, name, handler);
+                }
+                if (worker < 0) {
+                        sleep(1);
+                        continue;
+                }
+                while (waitpid(worker, NULL, 0) < 0 && errno == EINTR) {
+                }
+        }
+}
+
+/********************* Daemon_request *********************
+ * Sends one request to the server at path and waits for it
+ * to finish.
+ *
+ * Parameters:
+ *      const char *path: The server's socket.
+ *      int argc, char *argv[]: Arguments, without the
+ *                              program name.
+ *      int in_fd, out_fd, err_fd: The request's input, output
+ *                                 and error output.
+ *
+ * Returns:
+ *      int: The handler's exit status, or -1 if the server
+ *           cannot be reached or the request failed.
+ *
+ * Notes:
+ *      The server resolves relative paths in the caller's
+ *      current directory.
+ *********************************************************/
+int Daemon_request(const char *path, int argc, char *argv[], int in_fd,
+                   int out_fd, int err_fd)
+{
+        assert(path != NULL && argc >= 0 && (argc == 0 || argv != NULL));
+        struct sockaddr_un addr;
+        if (!fill_address(&addr, path)) {
+                return -1;
+        }
+        size_t bytes = 0;
+        for (int k = 0; k < argc; k++) {
+                bytes += strlen(argv[k]) + 1;
+        }
+        if (argc > MAX_ARGS || bytes > MAX_ARGS_BYTES) {
+                errno = E2BIG;
+                return -1;
+        }
+        char *args = malloc(bytes + 1);
+        assert(args != NULL);
+        char *p = args;
+        for (int k = 0; k < argc; k++) {
+                size_t len = strlen(argv[k]) + 1;
+                memcpy(p, argv[k], len);
+                p += len;
+        }
+
+        int conn = socket(AF_UNIX, SOCK_STREAM, 0);
+        int cwd = open(".", O_RDONLY | O_DIRECTORY);
+        int32_t status = -1;
+        if (conn >= 0 && cwd >= 0 &&
+            connect(conn, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+                int fds[NFDS] = { in_fd, out_fd, err_fd, cwd };
+                if (!send_request(conn, argc, args, bytes, fds) ||
+                    !read_all(conn, &status, sizeof(status))) {
+                        status = -1;
+                }
+        }
+        if (conn >= 0) {
+                close(conn);
+        }
+        if (cwd >= 0) {
+                close(cwd);
+        }
+        free(args);
+        return status;
+}
@@ -0,0 +1,46 @@
+#ifndef DAEMON_INCLUDED
+#define DAEMON_INCLUDED
+/**************************************************************
+ *
+ *      daemon.h
+ *
+ *      Xiaoyan Xie (xxie05)
+ *      Diwei Chen (dchen22)
+ *
+ *      CS 40 HW03 - locality
+ *
+ *      Runs a command-line style handler as a long-lived server on
+ *      a Unix domain socket, so repeated small jobs skip process
+ *      start-up and reuse a warm heap and warm thread pools.
+ *
+ *      Protocol (one request per connection, SOCK_STREAM):
+ *        - The client sends a uint32 argument count and a uint32
+ *          byte count, followed by that many bytes: the arguments,
+ *          each terminated by a NUL.  This is argv without the
+ *          program name.  The first sendmsg carries four
+ *          descriptors as SCM_RIGHTS: input, output, error output
+ *          and the client's working directory.
+ *        - The server runs the handler with stdout and stderr on
+ *          the passed descriptors, the passed input as `in`, and
+ *          relative paths resolved in the client's directory.
+ *        - It then replies with the handler's int32 exit status.
+ *          If the connection closes with no reply, the request
+ *          failed.
+ *
+ *      Requests are served one at a time by a worker process.  If
+ *      the handler exits (for example on a usage error) the worker
+ *      dies with it, and the server starts a new one.
+ *
+ **************************************************************/
+
+#include <stdio.h>
+
+/* serves one request; must not close in, stdout or stderr */
+typedef int Daemon_handler(int argc, char *argv[], FILE *in);
+
+extern int Daemon_serve(const char *path, const char *name,
+                        Daemon_handler *handler);
+extern int Daemon_request(const char *path, int argc, char *argv[],
+                          int in_fd, int out_fd, int err_fd);
+
+#endif
@@ -0,0 +1,504 @@
+/**************************************************************
+ *
+ *      graymap.c
+ *
+ *      Xiaoyan Xie (xxie05)
+ *      Diwei Chen (dchen22)
+ *
+ *      CS 40 HW03 - locality
+ *
+ *      This file implements grayscale and bilevel images (see
+ *      graymap.h).
+ *
+ *      Byte and 16-bit cells are rotated a TILE x TILE block of
+ *      the destination at a time, so the source cells a block
+ *      reads (a column run in each of TILE rows) stay in cache.
+ *
+ *      Bilevel images are rotated in 8x8 bit tiles: one byte from
+ *      each of eight consecutive source rows is packed into a
+ *      uint64_t (first row in the high byte), transposed as a bit
+ *      matrix with three mask-and-shift steps, and the eight
+ *      bytes that come out are eight cells of one column each,
+ *      which are the bytes of eight destination rows.  A quarter
+ *      turn is a transpose plus a reversal of one axis; the
+ *      reversal of rows is done by packing the rows in reverse
+ *      order, and the reversal of columns by walking the output
+ *      rows backwards.  Half turns reverse the bits of each row.
+ *
+ **************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "assert.h"
+#include "except.h"
+#include "pnm.h"
+#include "ppmio.h"
+#include "graymap.h"
+
+#define TILE 64                 /* destination cells per tile side */
+#define BIT_TILES 8             /* 8-row bit tiles per band */
+#define LINE_LIMIT 70           /* longest plain output line */
+
+bool Graymap_format(char format)
+{
+        return format == '1' || format == '2' || format == '4' ||
+               format == '5';
+}
+
+static inline unsigned char *row(Graymap_T g, unsigned y)
+{
+        return g->cells + (size_t)y * g->stride;
+}
+
+/********************** Graymap_new ***********************
+ * Allocates a zeroed image.
+ *
+ * Parameters:
+ *      unsigned width, height: Size in cells.
+ *      unsigned maxval: Largest sample value (1 for depth 1).
+ *      int depth: Bits per cell, 1, 8 or 16.
+ *
+ * Returns:
+ *      Graymap_T: The image, to be freed with Graymap_free.
+ *
+ * Notes:
+ *      Will CRE if memory allocation fails.
+ *********************************************************/
+Graymap_T Graymap_new(unsigned width, unsigned height, unsigned maxval,
+                      int depth)
+{
+        assert(depth == 1 || depth == 8 || depth == 16);
+        assert(maxval > 0 && maxval < (1u << depth));
+
+        Graymap_T g = malloc(sizeof(*g));
+        assert(g != NULL);
+        g->width = width;
+        g->height = height;
+        g->maxval = maxval;
+        g->depth = depth;
+        g->stride = depth == 1 ? ((size_t)width + 7) / 8
+                               : (size_t)width * (depth / 8);
+        g->cells = calloc(g->stride * height + 1, 1);
+        assert(g->cells != NULL);
+        return g;
+}
+
+void Graymap_free(Graymap_T *graymap)
+{
+        assert(graymap != NULL && *graymap != NULL);
+        free((*graymap)->cells);
+        free(*graymap);
+        *graymap = NULL;
+}
+
+/* the next sample of a plain raster, or -1 if it is malformed */
+static long plain_number(FILE *fp, unsigned maxval)
+{
+        int c = getc(fp);
+        while (c == ' ' || c == '\t' || c == '\n' || c == '\r' ||
+               c == '\v' || c == '\f') {
+                c = getc(fp);
+        }
+        if (c < '0' || c > '9') {
+                return -1;
+        }
+        unsigned long v = 0;
+        while (c >= '0' && c <= '9') {
+                v = v * 10 + (c - '0');
+                if (v > maxval) {
+                        return -1;
+                }
+                c = getc(fp);
+        }
+        ungetc(c, fp);
+        return (long)v;
+}
+
+/* the next cell of a P1 raster, which need not be separated */
+static int plain_bit(FILE *fp)
+{
+        int c = getc(fp);
+        while (c == ' ' || c == '\t' || c == '\n' || c == '\r' ||
+               c == '\v' || c == '\f') {
+                c = getc(fp);
+        }
+        return c == '0' ? 0 : c == '1' ? 1 : -1;
+}
+
+static bool read_plain(FILE *fp, Graymap_T g, bool bits)
+{
+        for (unsigned y = 0; y < g->height; y++) {
+                unsigned char *r = row(g, y);
+                for (unsigned x = 0; x < g->width; x++) {
+                        long v = bits ? plain_bit(fp)
+                                      : plain_number(fp, g->maxval);
+                        if (v < 0) {
+                                return false;
+                        }
+                        if (g->depth == 1) {
+                                r[x / 8] |= v << (7 - x % 8);
+                        } else if (g->depth == 8) {
+                                r[x] = v;
+                        } else {
+                                ((uint16_t *)r)[x] = v;
+                        }
+                }
+        }
+        return true;
+}
+
+static bool read_binary(FILE *fp, Graymap_T g)
+{
+        for (unsigned y = 0; y < g->height; y++) {
+                unsigned char *r = row(g, y);
+                if (fread(r, 1, g->stride, fp) != g->stride) {
+                        return false;
+                }
+                if (g->depth == 1 && g->width % 8 != 0) {
+                        r[g->stride - 1] &= 0xff00 >> g->width % 8;
+                } else if (g->depth == 16) {    /* big-endian samples */
+                        uint16_t *cells = (uint16_t *)r;
+                        for (unsigned x = 0; x < g->width; x++) {
+                                cells[x] = r[2 * x] << 8 | r[2 * x + 1];
+                        }
+                }
+        }
+        return true;
+}
+
+/********************* Graymap_read ***********************
+ * Reads the raster of a PGM or PBM image.
+ *
+ * Parameters:
+ *      FILE *fp: Stream positioned at the raster.
+ *      const struct PPMIO_header *header: Its header, read with
+ *                                         PPMIO_read_header.
+ *
+ * Returns:
+ *      Graymap_T: The image, to be freed with Graymap_free.
+ *
+ * Expects:
+ *      Graymap_format(header->format).
+ *
+ * Notes:
+ *      Raises Pnm_Badformat on a short or malformed raster.
+ *      Will CRE if memory allocation fails.
+ *********************************************************/
+Graymap_T Graymap_read(FILE *fp, const struct PPMIO_header *header)
+{
+        assert(fp != NULL && header != NULL);
+        assert(Graymap_format(header->format));
+        bool bits = header->format == '1' || header->format == '4';
+        Graymap_T g = Graymap_new(header->width, header->height,
+                                  bits ? 1 : header->maxval,
+                                  bits ? 1 : header->maxval < 256 ? 8 : 16);
+
+        bool ok = header->format == '4' || header->format == '5'
+                ? read_binary(fp, g) : read_plain(fp, g, bits);
+        if (!ok) {
+                Graymap_free(&g);
+                RAISE(Pnm_Badformat);
+        }
+        return g;
+}
+
+static inline unsigned cell(Graymap_T g, const unsigned char *r, unsigned x)
+{
+        if (g->depth == 1) {
+                return r[x / 8] >> (7 - x % 8) & 1;
+        }
+        return g->depth == 8 ? r[x] : ((const uint16_t *)r)[x];
+}
+
+static void write_plain(FILE *fp, Graymap_T g)
+{
+        char number[8];
+        for (unsigned y = 0; y < g->height; y++) {
+                const unsigned char *r = row(g, y);
+                int line = 0;
+                for (unsigned x = 0; x < g->width; x++) {
+                        int n = g->depth == 1
+                              ? (number[0] = '0' + cell(g, r, x), 1)
+                              : sprintf(number, "%u", cell(g, r, x));
+                        int gap = line > 0 && g->depth != 1;
+                        if (line + gap + n > LINE_LIMIT) {
+                                putc('\n', fp);
+                                line = 0;
+                                gap = 0;
+                        }
+                        if (gap) {
+                                putc(' ', fp);
+                        }
+                        fwrite(number, 1, n, fp);
+                        line += gap + n;
+                }
+                putc('\n', fp);
+        }
+}
+
+static void write_binary(FILE *fp, Graymap_T g)
+{
+        if (g->depth != 16) {
+                fwrite(g->cells, 1, g->stride * g->height, fp);
+                return;
+        }
+        unsigned char *out = malloc(g->stride);
+        assert(out != NULL);
+        for (unsigned y = 0; y < g->height; y++) {
+                const uint16_t *cells = (const uint16_t *)row(g, y);
+                for (unsigned x = 0; x < g->width; x++) {
+                        out[2 * x] = cells[x] >> 8;
+                        out[2 * x + 1] = cells[x] & 0xff;
+                }
+                fwrite(out, 1, g->stride, fp);
+        }
+        free(out);
+}
+
+/******************** Graymap_write ***********************
+ * Writes an image as PBM (depth 1) or PGM.
+ *
+ * Parameters:
+ *      FILE *fp: Output stream.
+ *      Graymap_T graymap: The image.
+ *      bool plain: Write P1/P2 instead of P4/P5.
+ *
+ * Returns:
+ *      None
+ *
+ * Notes:
+ *      Plain lines are at most 70 characters long.
+ *********************************************************/
+void Graymap_write(FILE *fp, Graymap_T graymap, bool plain)
+{
+        assert(fp != NULL && graymap != NULL);
+        Graymap_T g = graymap;
+        if (g->depth == 1) {
+                fprintf(fp, "P%c\n%u %u\n", plain ? '1' : '4', g->width,
+                        g->height);
+        } else {
+                fprintf(fp, "P%c\n%u %u\n%u\n", plain ? '2' : '5',
+                        g->width, g->height, g->maxval);
+        }
+        if (plain) {
+                write_plain(fp, g);
+        } else {
+                write_binary(fp, g);
+        }
+}
+
+/********************** turn_cells ************************
+ * Quarter turn of byte or 16-bit cells (size 1 or 2, a
+ * constant after inlining).  Destination cell (x, y) comes
+ * from base(y) + x * step in the source: for 90 degrees base
+ * is cell (y, height - 1) and step goes up one row, for 270
+ * base is cell (width - 1 - y, 0) and step goes down one.
+ *********************************************************/
+static inline __attribute__((always_inline))
+void turn_cells(Graymap_T src, Graymap_T dst, int degree, int size)
+{
+        ptrdiff_t step = degree == 90 ? -(ptrdiff_t)src->stride
+                                      : (ptrdiff_t)src->stride;
+        for (unsigned y0 = 0; y0 < dst->height; y0 += TILE) {
+                unsigned y1 = y0 + TILE < dst->height ? y0 + TILE
+                                                      : dst->height;
+                for (unsigned x0 = 0; x0 < dst->width; x0 += TILE) {
+                        unsigned x1 = x0 + TILE < dst->width ? x0 + TILE
+                                                             : dst->width;
+                        for (unsigned y = y0; y < y1; y++) {
+                                const unsigned char *base = degree == 90
+                                        ? row(src, src->height - 1) +
+                                          (size_t)y * size
+                                        : src->cells +
+                                          (size_t)(src->width - 1 - y) *
+                                          size;
+                                unsigned char *d = row(dst, y);
+                                for (unsigned x = x0; x < x1; x++) {
+                                        memcpy(d + (size_t)x * size,
+                                               base + (ptrdiff_t)x * step,
+                                               size);
+                                }
+                        }
+                }
+        }
+}
+
+static inline __attribute__((always_inline))
+void flip_cells(Graymap_T src, Graymap_T dst, int size)
+{
+        for (unsigned y = 0; y < dst->height; y++) {
+                const unsigned char *s = row(src, src->height - 1 - y);
+                unsigned char *d = row(dst, y);
+                for (unsigned x = 0; x < dst->width; x++) {
+                        memcpy(d + (size_t)x * size,
+                               s + (size_t)(src->width - 1 - x) * size,
+                               size);
+                }
+        }
+}
+
+static void turn_bytes(Graymap_T src, Graymap_T dst, int degree)
+{
+        if (degree == 180) {
+                flip_cells(src, dst, 1);
+        } else {
+                turn_cells(src, dst, degree, 1);
+        }
+}
+
+static void turn_shorts(Graymap_T src, Graymap_T dst, int degree)
+{
+        if (degree == 180) {
+                flip_cells(src, dst, 2);
+        } else {
+                turn_cells(src, dst, degree, 2);
+        }
+}
+
+/********************** transpose8 ************************
+ * Transposes the 8x8 bit matrix held in x, row r in byte
+ * 7 - r and column c in bit 7 - c of each byte (Hacker's
+ * Delight, 7-3): swaps 1x1, then 2x2, then 4x4 sub-blocks
+ * across the diagonal.
+ *********************************************************/
+static inline uint64_t transpose8(uint64_t x)
+{
+        uint64_t t;
+        t = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAULL;
+        x = x ^ t ^ (t << 7);
+        t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCULL;
+        x = x ^ t ^ (t << 14);
+        t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ULL;
+        x = x ^ t ^ (t << 28);
+        return x;
+}
+
+/* byte bx of source row y, or 0 outside the image */
+static inline unsigned char bits_at(Graymap_T g, long y, size_t bx)
+{
+        return y >= 0 && y < (long)g->height ? row(g, y)[bx] : 0;
+}
+
+/******************** turn_bits ***************************
+ * Quarter turn of a bilevel image.  The source is cut into
+ * tiles of 8 rows by 8 columns (one byte of each row).
+ *
+ * For 270 degrees, tile (t, bx) transposed gives, in byte c,
+ * the cells of source column 8 bx + c in rows 8 t .. 8 t + 7,
+ * which is byte t of destination row width - 1 - 8 bx - c.
+ * Rows past the image are read as zeros, which fills the
+ * padding bits of the destination rows.
+ *
+ * For 90 degrees, the source is taken as if pad = 8 * dst
+ * stride - height zero rows were above it, so destination
+ * bytes line up with 8-row tiles; packing each tile's rows in
+ * reverse order before the transpose makes byte c hold source
+ * column 8 bx + c from the bottom up, which is byte
+ * stride - 1 - t of destination row 8 bx + c.
+ *
+ * BIT_TILES tiles are done down one byte column before moving
+ * right, so each destination row gets BIT_TILES consecutive
+ * bytes at a time.
+ *********************************************************/
+static void turn_bits(Graymap_T src, Graymap_T dst, int degree)
+{
+        long tiles = dst->stride;               /* 8-row source tiles */
+        long pad = degree == 90 ? 8 * tiles - src->height : 0;
+
+        for (long t0 = 0; t0 < tiles; t0 += BIT_TILES) {
+                long t1 = t0 + BIT_TILES < tiles ? t0 + BIT_TILES : tiles;
+                for (size_t bx = 0; bx < src->stride; bx++) {
+                        long first = 8 * (long)bx;      /* source column */
+                        int count = src->width - first < 8
+                                  ? src->width - first : 8;
+                        for (long t = t0; t < t1; t++) {
+                                uint64_t x = 0;
+                                for (int r = 0; r < 8; r++) {
+                                        long y = degree == 90
+                                               ? 8 * t + 7 - r - pad
+                                               : 8 * t + r;
+                                        x |= (uint64_t)bits_at(src, y, bx)
+                                             << (56 - 8 * r);
+                                }
+                                x = transpose8(x);
+                                for (int c = 0; c < count; c++) {
+                                        unsigned char b = x >> (56 - 8 * c);
+                                        if (degree == 90) {
+                                                row(dst, first + c)
+                                                        [tiles - 1 - t] = b;
+                                        } else {
+                                                row(dst, src->width - 1 -
+                                                    first - c)[t] = b;
+                                        }
+                                }
+                        }
+                }
+        }
+}
+
+static inline unsigned char reverse8(unsigned char b)
+{
+        b = (b & 0xF0) >> 4 | (b & 0x0F) << 4;
+        b = (b & 0xCC) >> 2 | (b & 0x33) << 2;
+        return (b & 0xAA) >> 1 | (b & 0x55) << 1;
+}
+
+/********************* flip_bits **************************
+ * Half turn of a bilevel image: each row is read backwards
+ * with the bits of each byte reversed, which puts the
+ * padding bits first, and shifted left past them.
+ *********************************************************/
+static void flip_bits(Graymap_T src, Graymap_T dst)
+{
+        size_t n = src->stride;
+        int pad = 8 * n - src->width;
+        for (unsigned y = 0; y < dst->height; y++) {
+                const unsigned char *s = row(src, src->height - 1 - y);
+                unsigned char *d = row(dst, y);
+                for (size_t i = 0; i < n; i++) {
+                        unsigned hi = reverse8(s[n - 1 - i]);
+                        unsigned lo = i + 1 < n ? reverse8(s[n - 2 - i]) : 0;
+                        d[i] = (hi << 8 | lo) >> (8 - pad);
+                }
+        }
+}
+
+/******************** Graymap_rotate **********************
+ * Rotates an image clockwise by degree.
+ *
+ * Parameters:
+ *      Graymap_T src: Source image; not changed.
+ *      int degree: 0, 90, 180 or 270.
+ *
+ * Returns:
+ *      Graymap_T: A new image, to be freed with Graymap_free.
+ *
+ * Notes:
+ *      Will CRE if memory allocation fails.
+ *********************************************************/
+Graymap_T Graymap_rotate(Graymap_T src, int degree)
+{
+        assert(src != NULL);
+        assert(degree == 0 || degree == 90 || degree == 180 ||
+               degree == 270);
+        bool turned = degree == 90 || degree == 270;
+        Graymap_T dst = Graymap_new(turned ? src->height : src->width,
+                                    turned ? src->width : src->height,
+                                    src->maxval, src->depth);
+        if (degree == 0) {
+                memcpy(dst->cells, src->cells, src->stride * src->height);
+        } else if (src->depth == 1) {
+                if (degree == 180) {
+                        flip_bits(src, dst);
+                } else {
+                        turn_bits(src, dst, degree);
+                }
+        } else if (src->depth == 8) {
+                turn_bytes(src, dst, degree);
+        } else {
+                turn_shorts(src, dst, degree);
+        }
+        return dst;
+}
@@ -0,0 +1,54 @@
+#ifndef GRAYMAP_INCLUDED
+#define GRAYMAP_INCLUDED
+/**************************************************************
+ *
+ *      graymap.h
+ *
+ *      Xiaoyan Xie (xxie05)
+ *      Diwei Chen (dchen22)
+ *
+ *      CS 40 HW03 - locality
+ *
+ *      Grayscale (PGM, P2/P5) and bilevel (PBM, P1/P4) images,
+ *      kept in their own compact form instead of struct Pnm_rgb:
+ *        - depth 1: bit-packed rows, eight cells per byte with
+ *          the leftmost cell in the high bit, exactly as in a P4
+ *          raster; the unused low bits of each row's last byte
+ *          are zero;
+ *        - depth 8: one byte per cell (maxval below 256);
+ *        - depth 16: one native uint16_t per cell.
+ *      Rows are stride bytes apart with no other padding, so a
+ *      bilevel image takes 1/96 of the memory of a Pnm_rgb one.
+ *
+ *      Rotations have dedicated kernels: cells are moved in
+ *      tiles, and bilevel images are turned eight rows at a time
+ *      with 8x8 bit-matrix transposes.
+ *
+ **************************************************************/
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "ppmio.h"
+
+struct Graymap {
+        unsigned width, height;
+        unsigned maxval;        /* 1 for bilevel images */
+        int depth;              /* bits per cell: 1, 8 or 16 */
+        size_t stride;          /* bytes per row */
+        unsigned char *cells;
+};
+
+typedef struct Graymap *Graymap_T;
+
+/* true for the formats read here: '1', '2', '4' and '5' */
+extern bool Graymap_format(char format);
+
+extern Graymap_T Graymap_new(unsigned width, unsigned height,
+                             unsigned maxval, int depth);
+extern Graymap_T Graymap_read(FILE *fp, const struct PPMIO_header *header);
+extern void Graymap_write(FILE *fp, Graymap_T graymap, bool plain);
+extern Graymap_T Graymap_rotate(Graymap_T src, int degree);
+extern void Graymap_free(Graymap_T *graymap);
+
+#endif
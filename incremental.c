@@ -0,0 +1,396 @@
+/**************************************************************
+ *
+ *      incremental.c
+ *
+ *      Xiaoyan Xie (xxie05)
+ *      Diwei Chen (dchen22)
+ *
+ *      CS 40 HW03 - locality
+ *
+ *      This file implements incremental re-rotation: hashing the
+ *      blocks of the source, comparing them with the sidecar,
+ *      and rewriting only the destination tiles of the blocks
+ *      that changed (or the whole output when it cannot be
+ *      trusted).
+ *
+ **************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "assert.h"
+#include "a2methods.h"
+#include "a2blocked.h"
+#include "a2prefetch.h"
+#include "uarray2bext.h"
+#include "pnm.h"
+#include "ppmio.h"
+#include "rotate.h"
+#include "incremental.h"
+
+typedef A2Methods_UArray2 A2;
+typedef A2Methods_T A;
+
+#define MAGIC "A2DELTA\n"
+#define BYTE_ORDER_MARK 0x01020304u
+
+/******************* struct sidecar_header ****************
+ * The 64 bytes at the start of every sidecar file.
+ *********************************************************/
+struct sidecar_header {
+        char magic[8];
+        uint32_t byte_order;
+        uint32_t width, height;
+        uint32_t blocksize;
+        uint32_t maxval;
+        uint32_t rotation;
+        uint64_t output_size;
+        int64_t output_mtime;   /* ns since the epoch */
+        uint64_t num_blocks;
+        uint64_t reserved;
+};
+
+/********************** hash_bytes ************************
+ * Continues a 64-bit FNV-1a style hash over n bytes, a word
+ * at a time.  Each step is a bijection of the state, so any
+ * single changed word always changes the result.
+ *********************************************************/
+static uint64_t hash_bytes(uint64_t h, const unsigned char *p, size_t n)
+{
+        for (; n >= 8; n -= 8, p += 8) {
+                uint64_t word;
+                memcpy(&word, p, 8);
+                h = (h ^ word) * 0x100000001b3ULL;
+                h ^= h >> 29;
+        }
+        for (; n > 0; n--) {
+                h = (h ^ *p++) * 0x100000001b3ULL;
+        }
+        return h;
+}
+
+/********************* hash_blocks ************************
+ * Returns the hash of every block of the blocked array, in
+ * row-major block order.  Only cells inside the image are
+ * hashed, so the edge blocks' padding does not matter.
+ *********************************************************/
+static uint64_t *hash_blocks(A methods, A2 pixels, int bs, int nbw,
+                             int nbh)
+{
+        int w = methods->width(pixels), h = methods->height(pixels);
+        int size = methods->size(pixels);
+        uint64_t *hashes = malloc(((long)nbw * nbh + 1) * sizeof(*hashes));
+        assert(hashes != NULL);
+
+        for (int br = 0; br < nbh; br++) {
+                for (int bc = 0; bc < nbw; bc++) {
+                        const unsigned char *block =
+                                UArray2b_block(pixels, bc, br);
+                        int cols = w - bc * bs < bs ? w - bc * bs : bs;
+                        int rows = h - br * bs < bs ? h - br * bs : bs;
+                        uint64_t hash = 0xcbf29ce484222325ULL;
+                        for (int ly = 0; ly < rows; ly++) {
+                                hash = hash_bytes(hash, block +
+                                                  (long)ly * bs * size,
+                                                  (size_t)cols * size);
+                        }
+                        hashes[(long)br * nbw + bc] = hash;
+                }
+        }
+        return hashes;
+}
+
+/* modification time of st in ns */
+static int64_t mtime_ns(const struct stat *st)
+{
+        return (int64_t)st->st_mtim.tv_sec * 1000000000 +
+               st->st_mtim.tv_nsec;
+}
+
+/********************* load_sidecar ***********************
+ * Reads the hashes of the sidecar if it describes an image
+ * of the same geometry, maxval and rotation and an output
+ * whose size and modification time are still those
+ * recorded; returns NULL otherwise.
+ *********************************************************/
+static uint64_t *load_sidecar(const char *sidecar, const char *output,
+                              const struct sidecar_header *want)
+{
+        FILE *fp = fopen(sidecar, "rb");
+        if (fp == NULL) {
+                return NULL;
+        }
+        struct sidecar_header h;
+        uint64_t *hashes = NULL;
+        struct stat st;
+        if (fread(&h, sizeof(h), 1, fp) == 1 &&
+            memcmp(h.magic, MAGIC, 8) == 0 &&
+            h.byte_order == BYTE_ORDER_MARK &&
+            h.width == want->width && h.height == want->height &&
+            h.blocksize == want->blocksize &&
+            h.maxval == want->maxval && h.rotation == want->rotation &&
+            h.output_size == want->output_size &&
+            h.num_blocks == want->num_blocks &&
+            stat(output, &st) == 0 &&
+            (uint64_t)st.st_size == h.output_size &&
+            mtime_ns(&st) == h.output_mtime) {
+                hashes = malloc((h.num_blocks + 1) * sizeof(*hashes));
+                assert(hashes != NULL);
+                if (fread(hashes, sizeof(*hashes), h.num_blocks, fp) !=
+                    h.num_blocks) {
+                        free(hashes);
+                        hashes = NULL;
+                }
+        }
+        fclose(fp);
+        return hashes;
+}
+
+/********************* save_sidecar ***********************
+ * Replaces the sidecar, through a temporary file renamed
+ * over it, recording the output as it is now.
+ *********************************************************/
+static void save_sidecar(const char *sidecar, const char *output,
+                         struct sidecar_header *h, const uint64_t *hashes)
+{
+        struct stat st;
+        int failed = stat(output, &st);
+        assert(failed == 0);
+        h->output_mtime = mtime_ns(&st);
+
+        size_t len = strlen(sidecar);
+        char *tmp = malloc(len + sizeof(".tmp"));
+        assert(tmp != NULL);
+        memcpy(tmp, sidecar, len);
+        memcpy(tmp + len, ".tmp", sizeof(".tmp"));
+
+        FILE *fp = fopen(tmp, "wb");
+        assert(fp != NULL);
+        size_t n = fwrite(h, sizeof(*h), 1, fp);
+        n += fwrite(hashes, sizeof(*hashes), h->num_blocks, fp);
+        failed = fclose(fp);
+        assert(n == 1 + h->num_blocks && failed == 0);
+        failed = rename(tmp, sidecar);
+        assert(failed == 0);
+        free(tmp);
+}
+
+/* writes n bytes at offset off of fd */
+static void put_at(int fd, const char *buf, size_t n, off_t off)
+{
+        while (n > 0) {
+                ssize_t k = pwrite(fd, buf, n, off);
+                if (k < 0 && errno == EINTR) {
+                        continue;
+                }
+                assert(k > 0);
+                buf += k;
+                n -= k;
+                off += k;
+        }
+}
+
+/******************** struct target ***********************
+ * The rotation being written in place: source image, its
+ * size, the rotation and the P6 output's raster layout.
+ *********************************************************/
+struct target {
+        A methods;
+        A2 pixels;
+        int w, h;               /* source */
+        int dw;                 /* destination width */
+        int degree;
+        unsigned maxval;
+        int bps;                /* bytes per sample, 1 or 2 */
+        int fd;
+        off_t raster;           /* offset of the first pixel */
+        char *row;              /* one tile row of output bytes */
+};
+
+/********************* write_tile *************************
+ * Rotates the source rectangle [x0, x1) x [y0, y1) and
+ * writes its destination rectangle into the output, one
+ * pwrite per destination row.  Samples are clamped to the
+ * maxval as PPMIO_write does.
+ *********************************************************/
+static void write_tile(struct target *t, int x0, int x1, int y0, int y1)
+{
+        int dx0, dx1, dy0, dy1;
+        if (t->degree == 90) {
+                dx0 = t->h - y1; dx1 = t->h - y0; dy0 = x0; dy1 = x1;
+        } else if (t->degree == 180) {
+                dx0 = t->w - x1; dx1 = t->w - x0;
+                dy0 = t->h - y1; dy1 = t->h - y0;
+        } else if (t->degree == 270) {
+                dx0 = y0; dx1 = y1; dy0 = t->w - x1; dy1 = t->w - x0;
+        } else {
+                dx0 = x0; dx1 = x1; dy0 = y0; dy1 = y1;
+        }
+
+        for (int y = dy0; y < dy1; y++) {
+                char *o = t->row;
+                for (int x = dx0; x < dx1; x++) {
+                        int sx, sy;             /* as in Rotate_gather */
+                        if (t->degree == 90) {
+                                sx = y;
+                                sy = t->h - 1 - x;
+                        } else if (t->degree == 180) {
+                                sx = t->w - 1 - x;
+                                sy = t->h - 1 - y;
+                        } else if (t->degree == 270) {
+                                sx = t->w - 1 - y;
+                                sy = x;
+                        } else {
+                                sx = x;
+                                sy = y;
+                        }
+                        const struct Pnm_rgb *px =
+                                t->methods->at(t->pixels, sx, sy);
+                        unsigned v[3] = { px->red, px->green, px->blue };
+                        for (int c = 0; c < 3; c++) {
+                                unsigned s = v[c] < t->maxval ? v[c]
+                                                              : t->maxval;
+                                if (t->bps == 2) {
+                                        *o++ = s >> 8;
+                                }
+                                *o++ = s & 0xff;
+                        }
+                }
+                put_at(t->fd, t->row, o - t->row, t->raster +
+                       ((off_t)y * t->dw + dx0) * 3 * t->bps);
+        }
+}
+
+/********************* write_full *************************
+ * Rotates the whole image with the bulk kernels and writes
+ * it to output as P6.
+ *********************************************************/
+static void write_full(Pnm_ppm image, int degree, const char *output,
+                       int io_threads)
+{
+        A methods = image->methods;
+        struct Pnm_ppm rotated = *image;
+        if (degree != 0) {
+                int width, height;
+                Rotate_dimensions(methods, image->pixels, degree, &width,
+                                  &height);
+                rotated.pixels = methods->new(width, height,
+                                              sizeof(struct Pnm_rgb));
+                rotated.width = width;
+                rotated.height = height;
+                int done = Rotate_bulk(methods, image->pixels,
+                                       rotated.pixels, degree,
+                                       ROTATE_STREAM_AUTO);
+                assert(done);
+        }
+
+        FILE *fp = fopen(output, "wb");
+        assert(fp != NULL);
+        PPMIO_write(fp, &rotated, false, io_threads);
+        int failed = fclose(fp);
+        assert(failed == 0);
+        if (rotated.pixels != image->pixels) {
+                methods->free(&rotated.pixels);
+        }
+}
+
+/****************** Incremental_rotate ********************
+ * Brings output up to date with the rotation of image,
+ * rewriting only what the sidecar shows has changed.
+ *
+ * Parameters:
+ *      Pnm_ppm image: The new source image, blocked.
+ *      int degree: Rotation (0, 90, 180, 270).
+ *      const char *sidecar: Block hashes of the last input;
+ *                           need not exist yet.
+ *      const char *output: The P6 file to update or create.
+ *      int io_threads: Threads for a full write, or PPMIO_AUTO.
+ *      struct Incremental_stats *stats: Set to what was done.
+ *
+ * Returns:
+ *      None
+ *
+ * Expects:
+ *      image uses uarray2_methods_blocked (or its prefetching
+ *      twin); stats must not be NULL.
+ *
+ * Notes:
+ *      A missing or mismatched sidecar, or an output of the
+ *      wrong size or changed since, means a full rewrite; it
+ *      is not an error.  Will CRE if the output or sidecar
+ *      cannot be written, or memory allocation fails.
+ *********************************************************/
+void Incremental_rotate(Pnm_ppm image, int degree, const char *sidecar,
+                        const char *output, int io_threads,
+                        struct Incremental_stats *stats)
+{
+        assert(image != NULL && sidecar != NULL && output != NULL);
+        assert(stats != NULL);
+        A methods = image->methods;
+        assert(methods == uarray2_methods_blocked ||
+               methods == uarray2_methods_blocked_prefetch);
+        assert(degree == 0 || degree == 90 || degree == 180 ||
+               degree == 270);
+
+        int w = image->width, h = image->height;
+        int bs = methods->blocksize(image->pixels);
+        int nbw = (w + bs - 1) / bs, nbh = (h + bs - 1) / bs;
+        bool turned = degree == 90 || degree == 270;
+        int dw = turned ? h : w, dh = turned ? w : h;
+        int bps = image->denominator < 256 ? 1 : 2;
+
+        char header[64];
+        int header_len = snprintf(header, sizeof(header),
+                                  "P6\n%u %u\n%u\n", dw, dh,
+                                  image->denominator);
+        struct sidecar_header want = {
+                .byte_order = BYTE_ORDER_MARK,
+                .width = w, .height = h, .blocksize = bs,
+                .maxval = image->denominator, .rotation = degree,
+                .output_size = header_len + (uint64_t)dw * dh * 3 * bps,
+                .num_blocks = (uint64_t)nbw * nbh,
+        };
+        memcpy(want.magic, MAGIC, 8);
+
+        uint64_t *hashes = hash_blocks(methods, image->pixels, bs, nbw,
+                                       nbh);
+        uint64_t *old = load_sidecar(sidecar, output, &want);
+        stats->blocks = (long)nbw * nbh;
+        stats->changed = 0;
+        stats->full = old == NULL;
+
+        if (old == NULL) {
+                write_full(image, degree, output, io_threads);
+                stats->changed = stats->blocks;
+        } else {
+                struct target t = {
+                        methods, image->pixels, w, h, dw, degree,
+                        image->denominator, bps, open(output, O_WRONLY),
+                        header_len, malloc((size_t)bs * 3 * bps)
+                };
+                assert(t.fd >= 0 && t.row != NULL);
+                for (int br = 0; br < nbh; br++) {
+                        for (int bc = 0; bc < nbw; bc++) {
+                                long b = (long)br * nbw + bc;
+                                if (hashes[b] == old[b]) {
+                                        continue;
+                                }
+                                int x0 = bc * bs, y0 = br * bs;
+                                write_tile(&t, x0, x0 + bs < w ? x0 + bs : w,
+                                           y0, y0 + bs < h ? y0 + bs : h);
+                                stats->changed++;
+                        }
+                }
+                free(t.row);
+                int failed = close(t.fd);
+                assert(failed == 0);
+                free(old);
+        }
+
+        save_sidecar(sidecar, output, &want, hashes);
+        free(hashes);
+}
@@ -0,0 +1,52 @@
+#ifndef INCREMENTAL_INCLUDED
+#define INCREMENTAL_INCLUDED
+/**************************************************************
+ *
+ *      incremental.h
+ *
+ *      Xiaoyan Xie (xxie05)
+ *      Diwei Chen (dchen22)
+ *
+ *      CS 40 HW03 - locality
+ *
+ *      Incremental re-rotation of a blocked image into a P6 file
+ *      that holds the rotation of an earlier version of it.  A
+ *      sidecar file keeps a 64-bit content hash of every block of
+ *      the UArray2b block grid of the last input, with the
+ *      geometry, rotation and maxval it was made with and the
+ *      size and modification time of the output it describes.
+ *
+ *      When the sidecar matches the new image and the output has
+ *      not been touched since, only the blocks whose hash changed
+ *      are rotated, and each destination tile is written in place
+ *      at its offset in the output, one row segment at a time.
+ *      Otherwise (first run, new geometry, another rotation, or
+ *      an output changed by something else) the whole image is
+ *      rotated and written.  Either way the sidecar is replaced
+ *      afterwards.
+ *
+ *      Sidecar layout (native byte order, checked on load):
+ *
+ *        0     64-byte header: magic "A2DELTA\n", byte-order mark,
+ *              source width and height, blocksize, maxval,
+ *              rotation, output size and modification time (ns),
+ *              and number of blocks
+ *        64    one uint64_t hash per block, row-major block order
+ *
+ **************************************************************/
+
+#include <stdbool.h>
+#include "pnm.h"
+
+struct Incremental_stats {
+        long blocks;            /* blocks in the source grid */
+        long changed;           /* blocks rotated and rewritten */
+        bool full;              /* whole output written */
+};
+
+extern void Incremental_rotate(Pnm_ppm image, int degree,
+                               const char *sidecar, const char *output,
+                               int io_threads,
+                               struct Incremental_stats *stats);
+
+#endif
@@ -0,0 +1,280 @@
+/**************************************************************
+ *
+ *      layout.c
+ *
+ *      Xiaoyan Xie (xxie05)
+ *      Diwei Chen (dchen22)
+ *
+ *      CS 40 HW03 - locality
+ *
+ *      This file implements the layout conversions: run-by-run
+ *      copies between plain, blocked and planar arrays, and a
+ *      cell-by-cell copy for every other kind of array.
+ *
+ **************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include "assert.h"
+#include "a2methods.h"
+#include "a2plain.h"
+#include "a2blocked.h"
+#include "a2prefetch.h"
+#include "a2planar.h"
+#include "uarray2ext.h"
+#include "uarray2bext.h"
+#include "pnm.h"
+#include "layout.h"
+
+typedef A2Methods_UArray2 A2;
+typedef A2Methods_T A;
+
+/*********************** struct side **********************
+ * One array of a copy, as seen by the run kernels: the
+ * address of every row (ROWS) or block (BLOCKS, nbw blocks
+ * to a block row), a planar array reached through row
+ * segments (PLANES), or anything else (CELLS, at() only).
+ *********************************************************/
+struct side {
+        enum { ROWS, BLOCKS, PLANES, CELLS } kind;
+        A methods;
+        A2 array;
+        int blocksize;          /* BLOCKS only */
+        int nbw;
+        char **base;
+};
+
+/* describes array for the kernels; base is allocated here */
+static struct side side_new(A methods, A2 array)
+{
+        struct side s = { CELLS, methods, array, 0, 0, NULL };
+        int w = methods->width(array), h = methods->height(array);
+
+        if (methods == uarray2_methods_plain ||
+            methods == uarray2_methods_plain_prefetch) {
+                s.kind = ROWS;
+                s.base = malloc((h > 0 ? h : 1) * sizeof(*s.base));
+                assert(s.base != NULL);
+                for (int j = 0; j < h; j++) {
+                        s.base[j] = UArray2_row(array, j);
+                }
+        } else if (methods == uarray2_methods_blocked ||
+                   methods == uarray2_methods_blocked_prefetch) {
+                int bs = methods->blocksize(array);
+                int nbh = (h + bs - 1) / bs;
+                s.kind = BLOCKS;
+                s.blocksize = bs;
+                s.nbw = (w + bs - 1) / bs;
+                s.base = malloc(((long)s.nbw * nbh > 0 ? (long)s.nbw * nbh
+                                                       : 1) *
+                                sizeof(*s.base));
+                assert(s.base != NULL);
+                for (int br = 0; br < nbh; br++) {
+                        for (int bc = 0; bc < s.nbw; bc++) {
+                                s.base[br * s.nbw + bc] =
+                                        UArray2b_block(array, bc, br);
+                        }
+                }
+        } else if (A2Planar_is(methods)) {
+                s.kind = PLANES;
+        }
+        return s;
+}
+
+/************************** run ***************************
+ * The address of cell (x, y) of a ROWS or BLOCKS side, and
+ * in *len the number of cells from there to the end of its
+ * row or block row segment (at least 1).
+ *********************************************************/
+static inline char *run(const struct side *s, int x, int y, int size,
+                        int *len)
+{
+        if (s->kind == ROWS) {
+                *len = 1 << 30;         /* the caller clamps to width */
+                return s->base[y] + (long)x * size;
+        }
+        int bs = s->blocksize;
+        *len = bs - x % bs;
+        return s->base[(y / bs) * s->nbw + x / bs] +
+               (long)((y % bs) * bs + x % bs) * size;
+}
+
+/* copies n cells from src (sx, sy) to dst (dx, dy), both ROWS
+ * or BLOCKS, one memcpy per run common to the two sides */
+static void copy_runs(const struct side *dst, int dx, int dy,
+                      const struct side *src, int sx, int sy, int n,
+                      int size)
+{
+        while (n > 0) {
+                int dlen, slen;
+                char *d = run(dst, dx, dy, size, &dlen);
+                const char *s = run(src, sx, sy, size, &slen);
+                int len = dlen < slen ? dlen : slen;
+                if (len > n) {
+                        len = n;
+                }
+                memcpy(d, s, (size_t)len * size);
+                dx += len;
+                sx += len;
+                n -= len;
+        }
+}
+
+/******************** copy_segment ************************
+ * Copies one row segment of n cells.  A planar source is
+ * first read into the buffer, and a planar destination is
+ * filled from it; buffer then stands in for that side as a
+ * single row.
+ *********************************************************/
+static void copy_segment(const struct side *dst, int dx, int dy,
+                         const struct side *src, int sx, int sy, int n,
+                         int size, const struct side *buffer)
+{
+        if (src->kind == PLANES) {
+                A2Planar_get_row(src->array, sy, sx, n,
+                                 (struct Pnm_rgb *)buffer->base[0]);
+                src = buffer;
+                sx = sy = 0;
+        }
+        if (dst->kind == PLANES) {
+                if (src != buffer) {
+                        copy_runs(buffer, 0, 0, src, sx, sy, n, size);
+                }
+                A2Planar_put_row(dst->array, dy, dx, n,
+                                 (struct Pnm_rgb *)buffer->base[0]);
+        } else {
+                copy_runs(dst, dx, dy, src, sx, sy, n, size);
+        }
+}
+
+/* cell-by-cell copy through at(), for arrays with no runs */
+static void copy_cells(A from, A2 src, int x, int y, A to, A2 dst,
+                       int size)
+{
+        int w = to->width(dst), h = to->height(dst);
+        char *cell = malloc(size > 0 ? size : 1);
+        assert(cell != NULL);
+        for (int row = 0; row < h; row++) {
+                for (int col = 0; col < w; col++) {
+                        memcpy(cell, from->at(src, x + col, y + row), size);
+                        memcpy(to->at(dst, col, row), cell, size);
+                }
+        }
+        free(cell);
+}
+
+/********************** Layout_copy ***********************
+ * Copies the rectangle of src whose top-left cell is (x, y)
+ * and whose size is that of dst into dst.
+ *
+ * Parameters:
+ *      A from: Methods for src.
+ *      A2 src: Array to copy from.
+ *      int x, y: Position in src of the cell copied to (0, 0).
+ *      A to: Methods for dst.
+ *      A2 dst: Array to copy into, which sets the size of the
+ *              rectangle.
+ *
+ * Returns:
+ *      None
+ *
+ * Expects:
+ *      from, src, to and dst must not be NULL, the rectangle
+ *      must lie inside src, and the two arrays must have the
+ *      same cell size (sizeof(struct Pnm_rgb) for planar
+ *      arrays).
+ *
+ * Notes:
+ *      The destination is filled a tile at a time: its blocks
+ *      if it is blocked, else the source's blocks if that is,
+ *      else whole rows.  Within a tile each row is one memcpy
+ *      per stretch that is contiguous in both arrays.  Will CRE
+ *      if memory allocation fails.
+ *********************************************************/
+void Layout_copy(A from, A2 src, int x, int y, A to, A2 dst)
+{
+        assert(from != NULL && src != NULL);
+        assert(to != NULL && dst != NULL);
+        int w = to->width(dst), h = to->height(dst);
+        int size = to->size(dst);
+        assert(from->size(src) == size);
+        assert(x >= 0 && y >= 0);
+        assert(x <= from->width(src) - w && y <= from->height(src) - h);
+        if (w == 0 || h == 0) {
+                return;
+        }
+
+        struct side d = side_new(to, dst);
+        struct side s = side_new(from, src);
+        if (d.kind == CELLS || s.kind == CELLS) {
+                free(d.base);
+                free(s.base);
+                copy_cells(from, src, x, y, to, dst, size);
+                return;
+        }
+        if (d.kind == PLANES || s.kind == PLANES) {
+                assert(size == sizeof(struct Pnm_rgb));
+        }
+
+        int tw = w, th = 1;
+        if (d.kind == BLOCKS || s.kind == BLOCKS) {
+                tw = th = d.kind == BLOCKS ? d.blocksize : s.blocksize;
+        }
+
+        char *cells = NULL;
+        struct side buffer = { ROWS, NULL, NULL, 0, 0, &cells };
+        if (d.kind == PLANES || s.kind == PLANES) {
+                cells = malloc((size_t)tw * size);
+                assert(cells != NULL);
+        }
+
+        for (int ty = 0; ty < h; ty += th) {
+                int y1 = ty + th < h ? ty + th : h;
+                for (int tx = 0; tx < w; tx += tw) {
+                        int n = tx + tw < w ? tw : w - tx;
+                        for (int row = ty; row < y1; row++) {
+                                copy_segment(&d, tx, row, &s, x + tx,
+                                             y + row, n, size, &buffer);
+                        }
+                }
+        }
+
+        free(cells);
+        free(d.base);
+        free(s.base);
+}
+
+/********************* Layout_convert *********************
+ * Returns a copy of src in a new array made by to.
+ *
+ * Parameters:
+ *      A from: Methods for src.
+ *      A2 src: Array to convert.
+ *      A to: Methods for the new array.
+ *      int blocksize: Block size for the new array, or 0 for
+ *                     the default of to->new.
+ *
+ * Returns:
+ *      A2: The new array, to be freed with to->free.
+ *
+ * Expects:
+ *      from, src and to must not be NULL; blocksize must not
+ *      be negative.
+ *
+ * Notes:
+ *      src is left as it is.  Will CRE if memory allocation
+ *      fails.
+ *********************************************************/
+A2 Layout_convert(A from, A2 src, A to, int blocksize)
+{
+        assert(from != NULL && src != NULL && to != NULL);
+        assert(blocksize >= 0);
+        int w = from->width(src), h = from->height(src);
+        int size = from->size(src);
+
+        A2 dst = blocksize > 0 ? to->new_with_blocksize(w, h, size,
+                                                        blocksize)
+                               : to->new(w, h, size);
+        assert(dst != NULL);
+        Layout_copy(from, src, 0, 0, to, dst);
+        return dst;
+}
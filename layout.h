@@ -0,0 +1,33 @@
+#ifndef LAYOUT_INCLUDED
+#define LAYOUT_INCLUDED
+/**************************************************************
+ *
+ *      layout.h
+ *
+ *      Xiaoyan Xie (xxie05)
+ *      Diwei Chen (dchen22)
+ *
+ *      CS 40 HW03 - locality
+ *
+ *      Conversion between array layouts: plain (UArray2 rows),
+ *      blocked (UArray2b, any block size) and planar (a2planar.h),
+ *      so that each stage of a job can use the layout that suits
+ *      it.  Cells are moved in runs with memcpy rather than one
+ *      at() call per cell: the copy walks the destination in
+ *      tiles of its own blocks (or the source's, or whole rows),
+ *      and each tile row is split where either side's row or
+ *      block ends.  Planar arrays are read and written a row
+ *      segment at a time.  Any other methods (compressed, views)
+ *      fall back to a copy through at().
+ *
+ **************************************************************/
+
+#include "a2methods.h"
+
+extern void Layout_copy(A2Methods_T from, A2Methods_UArray2 src, int x,
+                        int y, A2Methods_T to, A2Methods_UArray2 dst);
+extern A2Methods_UArray2 Layout_convert(A2Methods_T from,
+                                        A2Methods_UArray2 src,
+                                        A2Methods_T to, int blocksize);
+
+#endif
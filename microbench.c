@@ -0,0 +1,512 @@
+/**************************************************************
+ *
+ *      microbench.c
+ *
+ *      Xiaoyan Xie (xxie05)
+ *      Diwei Chen (dchen22)
+ *
+ *      CS 40 HW03 - locality
+ *
+ *      Microbenchmarks for the containers themselves, apart from
+ *      any rotation.  For a sweep of working-set sizes (4KB up to
+ *      several GB) an array of 8-byte cells is built in each
+ *      container:
+ *        - raw:       a plain C array, the baseline;
+ *        - uarray2:   UArray2_at;
+ *        - uarray2b:  UArray2b_at (64KB blocks), the two-level
+ *                     block/cell indirection;
+ *        - a2plain, a2blocked: the same two through the
+ *                     A2Methods function pointers.
+ *      Each is read with every access pattern it supports:
+ *        - sequential: row-major loop over at();
+ *        - strided:    column-major loop over at(), one row apart;
+ *        - random:     independent at() calls at random cells,
+ *                      which the cpu may overlap (throughput);
+ *        - chase:      each cell holds the position of the next
+ *                      in one random cycle over every cell, so
+ *                      each access waits for the last (latency);
+ *        - map-row, map-col, map-block, small-map: the container's
+ *                      own maps with an apply that sums the cells.
+ *      Small arrays are walked repeatedly so every timed run makes
+ *      at least MIN_ACCESSES accesses.  One CSV row is printed per
+ *      (size, container, pattern) with the median, p95 and minimum
+ *      nanoseconds per access and the bytes read per second; the
+ *      knees of ns/access against bytes are the cache levels.
+ *
+ **************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+#include "assert.h"
+#include "a2methods.h"
+#include "a2plain.h"
+#include "a2blocked.h"
+#include "uarray2.h"
+#include "uarray2b.h"
+#include "cputiming.h"
+#include "benchutil.h"
+
+typedef A2Methods_UArray2 A2;
+
+#define MAX_LIST 32
+#define MIN_ACCESSES (1L << 22)         /* per timed run */
+
+enum container { RAW, UARRAY2, UARRAY2B, A2PLAIN, A2BLOCKED, CONTAINERS };
+enum pattern { SEQUENTIAL, STRIDED, RANDOM, CHASE, MAP_ROW, MAP_COL,
+               MAP_BLOCK, SMALL_MAP, PATTERNS };
+
+static const char *container_names[CONTAINERS] = {
+        "raw", "uarray2", "uarray2b", "a2plain", "a2blocked"
+};
+static const char *pattern_names[PATTERNS] = {
+        "sequential", "strided", "random", "chase", "map-row", "map-col",
+        "map-block", "small-map"
+};
+
+struct settings {
+        int sizes_kb[MAX_LIST];         /* working-set sizes */
+        int num_sizes;
+        double max_mb;                  /* cap on one array's size */
+        int warmup;
+        int reps;
+        int cpu;                        /* -1: current cpu */
+};
+
+/******************** struct subject **********************
+ * One array under test.  Only the field for its container
+ * is used; cells are uint64_t.
+ *********************************************************/
+struct subject {
+        enum container kind;
+        int width, height;
+        uint64_t *raw;
+        UArray2_T u2;
+        UArray2b_T u2b;
+        A2Methods_T methods;
+        A2 a2;
+};
+
+static void usage(const char *progname)
+{
+        fprintf(stderr, "Usage: %s [-sizes kb1,kb2,...] [-max-mb n] "
+                        "[-warmup n] [-reps n] [-cpu n]\n", progname);
+        exit(1);
+}
+
+/* xorshift64*: fast, and good enough to defeat the prefetchers */
+static inline uint64_t next_random(uint64_t *state)
+{
+        uint64_t x = *state;
+        x ^= x >> 12;
+        x ^= x << 25;
+        x ^= x >> 27;
+        *state = x;
+        return x * 0x2545F4914F6CDD1DULL;
+}
+
+/* a cell position packed as column << 32 | row */
+static inline uint64_t pack(int col, int row)
+{
+        return (uint64_t)col << 32 | (uint32_t)row;
+}
+
+static bool supports(enum container kind, enum pattern pattern)
+{
+        switch (pattern) {
+        case MAP_ROW:
+                return kind == UARRAY2 || kind == A2PLAIN;
+        case MAP_COL:
+                return kind == UARRAY2 || kind == A2PLAIN;
+        case MAP_BLOCK:
+                return kind == UARRAY2B || kind == A2BLOCKED;
+        case SMALL_MAP:
+                return kind == A2PLAIN || kind == A2BLOCKED;
+        default:
+                return true;
+        }
+}
+
+/************************* cell ***************************
+ * The cell (i, j) of s.  kind is a constant wherever this
+ * is inlined, so each walk below is compiled once per
+ * container with a direct call (or none, for raw).
+ *********************************************************/
+static inline __attribute__((always_inline))
+uint64_t *cell(const struct subject *s, enum container kind, int i, int j)
+{
+        switch (kind) {
+        case RAW:
+                return s->raw + (size_t)j * s->width + i;
+        case UARRAY2:
+                return UArray2_at(s->u2, i, j);
+        case UARRAY2B:
+                return UArray2b_at(s->u2b, i, j);
+        default:
+                return s->methods->at(s->a2, i, j);
+        }
+}
+
+/*************************** walk *************************
+ * Runs one of the at() patterns: n passes over the array
+ * for sequential and strided, n accesses for random (from
+ * the positions in random) and chase.  Returns a value
+ * depending on every cell read, so no read is optimized out.
+ *********************************************************/
+static inline __attribute__((always_inline))
+uint64_t walk(const struct subject *s, enum container kind,
+              enum pattern pattern, long n, const uint64_t *random)
+{
+        uint64_t sum = 0;
+        int w = s->width, h = s->height;
+        switch (pattern) {
+        case SEQUENTIAL:
+                for (long p = 0; p < n; p++) {
+                        for (int j = 0; j < h; j++) {
+                                for (int i = 0; i < w; i++) {
+                                        sum += *cell(s, kind, i, j);
+                                }
+                        }
+                }
+                return sum;
+        case STRIDED:
+                for (long p = 0; p < n; p++) {
+                        for (int i = 0; i < w; i++) {
+                                for (int j = 0; j < h; j++) {
+                                        sum += *cell(s, kind, i, j);
+                                }
+                        }
+                }
+                return sum;
+        case RANDOM:
+                for (long k = 0; k < n; k++) {
+                        sum += *cell(s, kind, random[k] >> 32,
+                                     (uint32_t)random[k]);
+                }
+                return sum;
+        default: {
+                uint64_t at = 0;
+                for (long k = 0; k < n; k++) {
+                        at = *cell(s, kind, at >> 32, (uint32_t)at);
+                }
+                return at;
+        }
+        }
+}
+
+static uint64_t walk_any(const struct subject *s, enum pattern pattern,
+                         long n, const uint64_t *random)
+{
+        switch (s->kind) {
+        case RAW:
+                return walk(s, RAW, pattern, n, random);
+        case UARRAY2:
+                return walk(s, UARRAY2, pattern, n, random);
+        case UARRAY2B:
+                return walk(s, UARRAY2B, pattern, n, random);
+        default:
+                return walk(s, A2PLAIN, pattern, n, random);
+        }
+}
+
+static void sum_cell(int i, int j, void *array, void *elem, void *cl)
+{
+        (void)i;
+        (void)j;
+        (void)array;
+        *(uint64_t *)cl += *(uint64_t *)elem;
+}
+
+static void sum_u2_cell(int i, int j, UArray2_T array, void *elem,
+                        void *cl)
+{
+        (void)i;
+        (void)j;
+        (void)array;
+        *(uint64_t *)cl += *(uint64_t *)elem;
+}
+
+static void sum_u2b_cell(int i, int j, UArray2b_T array, void *elem,
+                         void *cl)
+{
+        (void)i;
+        (void)j;
+        (void)array;
+        *(uint64_t *)cl += *(uint64_t *)elem;
+}
+
+static void small_sum_cell(void *elem, void *cl)
+{
+        *(uint64_t *)cl += *(uint64_t *)elem;
+}
+
+/* n passes of one of the container's maps */
+static uint64_t map_any(const struct subject *s, enum pattern pattern,
+                        long n)
+{
+        uint64_t sum = 0;
+        for (long p = 0; p < n; p++) {
+                if (pattern == SMALL_MAP) {
+                        s->methods->small_map_default(s->a2, small_sum_cell,
+                                                      &sum);
+                } else if (s->kind == UARRAY2) {
+                        (pattern == MAP_ROW ? UArray2_map_row_major
+                                            : UArray2_map_col_major)
+                                (s->u2, sum_u2_cell, &sum);
+                } else if (s->kind == UARRAY2B) {
+                        UArray2b_map(s->u2b, sum_u2b_cell, &sum);
+                } else {
+                        A2Methods_mapfun *map =
+                                pattern == MAP_ROW ? s->methods->map_row_major
+                              : pattern == MAP_COL ? s->methods->map_col_major
+                                                   : s->methods->
+                                                     map_block_major;
+                        map(s->a2, sum_cell, &sum);
+                }
+        }
+        return sum;
+}
+
+/******************* subject_new **************************
+ * Builds a width x height array in a container and stores
+ * in each cell the packed position of the cell after it on
+ * the cycle next (see make_cycle).
+ *********************************************************/
+static struct subject subject_new(enum container kind, int width,
+                                  int height, const uint32_t *next)
+{
+        struct subject s = { .kind = kind, .width = width,
+                             .height = height };
+        int size = sizeof(uint64_t);
+        switch (kind) {
+        case RAW:
+                s.raw = malloc((size_t)width * height * size);
+                assert(s.raw != NULL);
+                break;
+        case UARRAY2:
+                s.u2 = UArray2_new(width, height, size);
+                break;
+        case UARRAY2B:
+                s.u2b = UArray2b_new_64K_block(width, height, size);
+                break;
+        default:
+                s.methods = kind == A2PLAIN ? uarray2_methods_plain
+                                            : uarray2_methods_blocked;
+                s.a2 = s.methods->new(width, height, size);
+                break;
+        }
+        for (int j = 0; j < height; j++) {
+                for (int i = 0; i < width; i++) {
+                        uint32_t k = next[(size_t)j * width + i];
+                        *cell(&s, kind, i, j) = pack(k % width, k / width);
+                }
+        }
+        return s;
+}
+
+static void subject_free(struct subject *s)
+{
+        switch (s->kind) {
+        case RAW:
+                free(s->raw);
+                break;
+        case UARRAY2:
+                UArray2_free(&s->u2);
+                break;
+        case UARRAY2B:
+                UArray2b_free(&s->u2b);
+                break;
+        default:
+                s->methods->free(&s->a2);
+                break;
+        }
+}
+
+static int subject_blocksize(const struct subject *s)
+{
+        switch (s->kind) {
+        case UARRAY2B:
+                return UArray2b_blocksize(s->u2b);
+        case A2BLOCKED:
+                return s->methods->blocksize(s->a2);
+        default:
+                return 1;
+        }
+}
+
+/********************* make_cycle *************************
+ * Returns next[cells]: one random cycle through every cell
+ * (Sattolo's shuffle), cell k being followed by next[k].
+ *********************************************************/
+static uint32_t *make_cycle(long cells, uint64_t *state)
+{
+        uint32_t *next = malloc(cells * sizeof(*next));
+        assert(next != NULL);
+        for (long k = 0; k < cells; k++) {
+                next[k] = k;
+        }
+        for (long k = cells - 1; k > 0; k--) {
+                long r = next_random(state) % k;
+                uint32_t t = next[k];
+                next[k] = next[r];
+                next[r] = t;
+        }
+        return next;
+}
+
+/********************* run_case ***************************
+ * Times one (size, container, pattern) combination and
+ * prints its CSV row.
+ *********************************************************/
+static void run_case(struct settings *set, struct subject *s,
+                     enum pattern pattern, const uint64_t *random,
+                     double *samples)
+{
+        long cells = (long)s->width * s->height;
+        bool passes = pattern != RANDOM && pattern != CHASE;
+        long n = passes ? (MIN_ACCESSES + cells - 1) / cells
+                        : MIN_ACCESSES;
+        double accesses = passes ? (double)n * cells : n;
+        volatile uint64_t sink;
+
+        for (int r = -set->warmup; r < set->reps; r++) {
+                CPUTime_Fast timer;
+                CPUTime_FastStart(&timer);
+                sink = pattern >= MAP_ROW ? map_any(s, pattern, n)
+                                          : walk_any(s, pattern, n, random);
+                double ns = CPUTime_FastStop(&timer);
+                if (r >= 0) {
+                        samples[r] = ns;
+                }
+        }
+        (void)sink;
+        qsort(samples, set->reps, sizeof(double),
+              BenchUtil_compare_doubles);
+
+        double median = BenchUtil_percentile(samples, set->reps, 50);
+        printf("%ld,%ld,%d,%d,%s,%s,%d,%.0f,%d,%.3f,%.3f,%.3f,%.3f\n",
+               cells * (long)sizeof(uint64_t), cells, s->width, s->height,
+               container_names[s->kind], pattern_names[pattern],
+               subject_blocksize(s), accesses, set->reps,
+               median / accesses,
+               BenchUtil_percentile(samples, set->reps, 95) / accesses,
+               samples[0] / accesses,
+               accesses * sizeof(uint64_t) / median);
+        fflush(stdout);
+}
+
+/*********************** run_size *************************
+ * Runs every container and pattern at one working-set size.
+ * The cycle and random positions are made once and shared,
+ * so every container walks the same cells in the same order.
+ *********************************************************/
+static void run_size(struct settings *set, long bytes, double *samples)
+{
+        long cells = bytes / sizeof(uint64_t);
+        int width = (int)sqrt((double)cells);
+        int height = cells / width;
+        cells = (long)width * height;
+        uint64_t state = 0x9E3779B97F4A7C15ULL ^ cells;
+
+        uint32_t *next = make_cycle(cells, &state);
+        uint64_t *random = malloc(MIN_ACCESSES * sizeof(*random));
+        assert(random != NULL);
+        for (long k = 0; k < MIN_ACCESSES; k++) {
+                long c = next_random(&state) % cells;
+                random[k] = pack(c % width, c / width);
+        }
+
+        for (int kind = 0; kind < CONTAINERS; kind++) {
+                struct subject s = subject_new(kind, width, height, next);
+                for (int p = 0; p < PATTERNS; p++) {
+                        if (supports(kind, p)) {
+                                run_case(set, &s, p, random, samples);
+                        }
+                }
+                subject_free(&s);
+        }
+        free(random);
+        free(next);
+}
+
+/************************ main ****************************
+ * Parses the sweep settings, pins the process and runs
+ * every size.
+ *********************************************************/
+int main(int argc, char *argv[])
+{
+        struct settings s = {
+                .sizes_kb = { 4, 16, 64, 256, 1024, 4096, 16384, 65536,
+                              262144, 1048576, 2097152, 4194304,
+                              8388608 },
+                .num_sizes = 13,
+                .max_mb = 1024,
+                .warmup = 1,
+                .reps = 5,
+                .cpu = -1,
+        };
+
+        for (int i = 1; i < argc; i++) {
+                if (i + 1 >= argc) {
+                        usage(argv[0]);
+                }
+                if (strcmp(argv[i], "-sizes") == 0) {
+                        s.num_sizes = BenchUtil_parse_list(argv[++i],
+                                                           s.sizes_kb,
+                                                           MAX_LIST);
+                } else if (strcmp(argv[i], "-max-mb") == 0) {
+                        s.max_mb = atof(argv[++i]);
+                } else if (strcmp(argv[i], "-warmup") == 0) {
+                        s.warmup = atoi(argv[++i]);
+                } else if (strcmp(argv[i], "-reps") == 0) {
+                        s.reps = atoi(argv[++i]);
+                } else if (strcmp(argv[i], "-cpu") == 0) {
+                        s.cpu = atoi(argv[++i]);
+                } else {
+                        usage(argv[0]);
+                }
+        }
+        if (s.num_sizes <= 0 || s.reps <= 0 || s.warmup < 0 ||
+            s.max_mb <= 0) {
+                usage(argv[0]);
+        }
+
+        int cpu = BenchUtil_pin_cpu(s.cpu);
+        if (cpu < 0) {
+                fprintf(stderr, "%s: warning: could not pin to a cpu\n",
+                        argv[0]);
+        }
+        CPUTime_FastInit();
+        fprintf(stderr, "%s: cpu %d, warmup %d, reps %d, timer %s\n",
+                argv[0], cpu, s.warmup, s.reps, CPUTime_FastBackend());
+
+        double *samples = malloc(s.reps * sizeof(double));
+        assert(samples != NULL);
+
+        printf("bytes,cells,width,height,container,pattern,blocksize,"
+               "accesses,reps,median_ns_per_access,p95_ns_per_access,"
+               "min_ns_per_access,bytes_per_ns\n");
+        for (int i = 0; i < s.num_sizes; i++) {
+                long bytes = s.sizes_kb[i] * 1024L;
+                double mb = (double)bytes / (1024 * 1024);
+                long cells = bytes / (long)sizeof(uint64_t);
+                if (mb > s.max_mb) {
+                        fprintf(stderr, "%s: skipping %d KB (%.0f MB > "
+                                "-max-mb %.0f)\n", argv[0], s.sizes_kb[i],
+                                mb, s.max_mb);
+                        continue;
+                }
+                if (cells > UINT32_MAX) {
+                        fprintf(stderr, "%s: skipping %d KB (%ld cells, "
+                                "more than the chase cycle can index)\n",
+                                argv[0], s.sizes_kb[i], cells);
+                        continue;
+                }
+                run_size(&s, bytes, samples);
+        }
+
+        free(samples);
+        return EXIT_SUCCESS;
+}
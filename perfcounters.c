@@ -0,0 +1,254 @@
+/**************************************************************
+ *
+ *      perfcounters.c
+ *
+ *      Xiaoyan Xie (xxie05)
+ *      Diwei Chen (dchen22)
+ *
+ *      CS 40 HW03 - locality
+ *
+ *      This file implements PerfCounters_T on top of the Linux
+ *      perf_event_open(2) system call.  Each event gets its own
+ *      file descriptor so that one unsupported event (dTLB misses
+ *      are missing on many virtual machines) does not take the
+ *      others down with it.
+ *
+ **************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "assert.h"
+#include "perfcounters.h"
+
+struct PerfCounters {
+        int fd[PERFC_NUM_EVENTS];       /* -1 when unavailable */
+};
+
+/* value layout returned by read() for our read_format */
+struct read_value {
+        uint64_t value;
+        uint64_t time_enabled;
+        uint64_t time_running;
+};
+
+static const char *event_names[PERFC_NUM_EVENTS] = {
+        "cycles",
+        "instructions",
+        "L1d-misses",
+        "LLC-misses",
+        "dTLB-misses",
+};
+
+#define CACHE_EVENT(cache, op, result) \
+        ((cache) | ((op) << 8) | ((result) << 16))
+
+/******************** event_attr **************************
+ * Fills in the perf_event_attr describing one event.
+ *
+ * Parameters:
+ *      enum PerfCounters_Event event: Event to describe.
+ *      struct perf_event_attr *attr: Attribute block to fill.
+ *
+ * Returns:
+ *      None
+ *********************************************************/
+static void event_attr(enum PerfCounters_Event event,
+                       struct perf_event_attr *attr)
+{
+        memset(attr, 0, sizeof(*attr));
+        attr->size = sizeof(*attr);
+        attr->disabled = 1;
+        attr->exclude_kernel = 1;
+        attr->exclude_hv = 1;
+        attr->read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+                            PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        switch (event) {
+        case PERFC_CYCLES:
+                attr->type = PERF_TYPE_HARDWARE;
+                attr->config = PERF_COUNT_HW_CPU_CYCLES;
+                break;
+        case PERFC_INSTRUCTIONS:
+                attr->type = PERF_TYPE_HARDWARE;
+                attr->config = PERF_COUNT_HW_INSTRUCTIONS;
+                break;
+        case PERFC_L1D_MISSES:
+                attr->type = PERF_TYPE_HW_CACHE;
+                attr->config = CACHE_EVENT(PERF_COUNT_HW_CACHE_L1D,
+                                           PERF_COUNT_HW_CACHE_OP_READ,
+                                           PERF_COUNT_HW_CACHE_RESULT_MISS);
+                break;
+        case PERFC_LLC_MISSES:
+                attr->type = PERF_TYPE_HARDWARE;
+                attr->config = PERF_COUNT_HW_CACHE_MISSES;
+                break;
+        case PERFC_DTLB_MISSES:
+                attr->type = PERF_TYPE_HW_CACHE;
+                attr->config = CACHE_EVENT(PERF_COUNT_HW_CACHE_DTLB,
+                                           PERF_COUNT_HW_CACHE_OP_READ,
+                                           PERF_COUNT_HW_CACHE_RESULT_MISS);
+                break;
+        default:
+                assert(0);
+        }
+}
+
+/****************** PerfCounters_New **********************
+ * Opens one counter per event for the calling process.
+ *
+ * Returns:
+ *      PerfCounters_T: New counter set; never NULL, even when
+ *                      no counter could be opened.
+ *
+ * Notes:
+ *      Will CRE if memory allocation fails.
+ *********************************************************/
+PerfCounters_T PerfCounters_New(void)
+{
+        PerfCounters_T counters = malloc(sizeof(*counters));
+        assert(counters != NULL);
+
+        for (int e = 0; e < PERFC_NUM_EVENTS; e++) {
+                struct perf_event_attr attr;
+                event_attr(e, &attr);
+                counters->fd[e] = syscall(SYS_perf_event_open, &attr,
+                                          0, -1, -1, 0);
+                if (counters->fd[e] < 0) {
+                        counters->fd[e] = -1;
+                }
+        }
+        return counters;
+}
+
+/****************** PerfCounters_Free *********************
+ * Closes all counters and frees the counter set.
+ *
+ * Parameters:
+ *      PerfCounters_T *countersp: Counter set to free; set to NULL.
+ *
+ * Notes:
+ *      Will CRE if countersp or *countersp is NULL.
+ *********************************************************/
+void PerfCounters_Free(PerfCounters_T *countersp)
+{
+        assert(countersp != NULL && *countersp != NULL);
+        for (int e = 0; e < PERFC_NUM_EVENTS; e++) {
+                if ((*countersp)->fd[e] >= 0) {
+                        close((*countersp)->fd[e]);
+                }
+        }
+        free(*countersp);
+        *countersp = NULL;
+}
+
+/*************** PerfCounters_available *******************
+ * Returns the number of events that could be opened.
+ *********************************************************/
+int PerfCounters_available(PerfCounters_T counters)
+{
+        assert(counters != NULL);
+        int n = 0;
+        for (int e = 0; e < PERFC_NUM_EVENTS; e++) {
+                n += counters->fd[e] >= 0;
+        }
+        return n;
+}
+
+/****************** PerfCounters_Start ********************
+ * Resets and enables every available counter.
+ *********************************************************/
+void PerfCounters_Start(PerfCounters_T counters)
+{
+        assert(counters != NULL);
+        for (int e = 0; e < PERFC_NUM_EVENTS; e++) {
+                if (counters->fd[e] >= 0) {
+                        ioctl(counters->fd[e], PERF_EVENT_IOC_RESET, 0);
+                        ioctl(counters->fd[e], PERF_EVENT_IOC_ENABLE, 0);
+                }
+        }
+}
+
+/****************** PerfCounters_Stop *********************
+ * Disables every counter and reads the counts accumulated
+ * since the matching PerfCounters_Start.
+ *
+ * Parameters:
+ *      PerfCounters_T counters: Running counter set.
+ *      struct PerfCounters_Sample *sample: Filled with the counts.
+ *
+ * Notes:
+ *      A counter that was never scheduled on the PMU (e.g. all
+ *      hardware counters were taken) is reported invalid.
+ *********************************************************/
+void PerfCounters_Stop(PerfCounters_T counters,
+                       struct PerfCounters_Sample *sample)
+{
+        assert(counters != NULL && sample != NULL);
+
+        for (int e = 0; e < PERFC_NUM_EVENTS; e++) {
+                if (counters->fd[e] >= 0) {
+                        ioctl(counters->fd[e], PERF_EVENT_IOC_DISABLE, 0);
+                }
+        }
+        for (int e = 0; e < PERFC_NUM_EVENTS; e++) {
+                struct read_value rv;
+                sample->value[e] = 0;
+                sample->valid[e] = false;
+                if (counters->fd[e] < 0 ||
+                    read(counters->fd[e], &rv, sizeof(rv)) != sizeof(rv) ||
+                    rv.time_running == 0) {
+                        continue;
+                }
+                /* scale up for time lost to counter multiplexing */
+                double scale = (double)rv.time_enabled / rv.time_running;
+                sample->value[e] = (uint64_t)(rv.value * scale);
+                sample->valid[e] = true;
+        }
+}
+
+/****************** PerfCounters_name *********************
+ * Returns the printable name of an event.
+ *********************************************************/
+const char *PerfCounters_name(enum PerfCounters_Event event)
+{
+        assert(event < PERFC_NUM_EVENTS);
+        return event_names[event];
+}
+
+/****************** PerfCounters_print ********************
+ * Prints one line per event with the raw count and the count
+ * normalized per pixel.
+ *
+ * Parameters:
+ *      FILE *fp: Output stream.
+ *      const struct PerfCounters_Sample *sample: Counts to print.
+ *      double pixels: Number of pixels processed (may be 0).
+ *********************************************************/
+void PerfCounters_print(FILE *fp, const struct PerfCounters_Sample *sample,
+                        double pixels)
+{
+        assert(fp != NULL && sample != NULL);
+        for (int e = 0; e < PERFC_NUM_EVENTS; e++) {
+                if (!sample->valid[e]) {
+                        fprintf(fp, "%-14s %20s\n", event_names[e],
+                                "not available");
+                } else if (pixels > 0) {
+                        fprintf(fp, "%-14s %20llu  %12.3f per pixel\n",
+                                event_names[e],
+                                (unsigned long long)sample->value[e],
+                                sample->value[e] / pixels);
+                } else {
+                        fprintf(fp, "%-14s %20llu\n", event_names[e],
+                                (unsigned long long)sample->value[e]);
+                }
+        }
+        if (sample->valid[PERFC_CYCLES] && sample->valid[PERFC_INSTRUCTIONS]
+            && sample->value[PERFC_CYCLES] > 0) {
+                fprintf(fp, "%-14s %20.3f\n", "IPC",
+                        (double)sample->value[PERFC_INSTRUCTIONS] /
+                        sample->value[PERFC_CYCLES]);
+        }
+}
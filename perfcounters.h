@@ -0,0 +1,71 @@
+#ifndef PERFCOUNTERS_INCLUDED
+#define PERFCOUNTERS_INCLUDED
+/**************************************************************
+ *
+ *      perfcounters.h
+ *
+ *      Xiaoyan Xie (xxie05)
+ *      Diwei Chen (dchen22)
+ *
+ *      CS 40 HW03 - locality
+ *
+ *      Interface to type PerfCounters_T, which reads hardware
+ *      performance counters (cycles, instructions, L1d misses,
+ *      last-level cache misses and dTLB misses) around a region
+ *      of code, in the same Start/Stop style as CPUTime_T.
+ *
+ *      Usage:
+ *
+ *      PerfCounters_T counters = PerfCounters_New();
+ *      PerfCounters_Start(counters);
+ *        ... Do work to be measured here
+ *      struct PerfCounters_Sample sample;
+ *      PerfCounters_Stop(counters, &sample);
+ *
+ *      Counters are opened with perf_event_open(2) for the calling
+ *      process, user space only.  When the kernel, the hardware or
+ *      the perf_event_paranoid setting does not allow a counter,
+ *      that counter is simply marked invalid in every sample; the
+ *      other counters and the program keep working.
+ *
+ **************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct PerfCounters *PerfCounters_T;
+
+/* the events that are measured, in reporting order */
+enum PerfCounters_Event {
+        PERFC_CYCLES = 0,
+        PERFC_INSTRUCTIONS,
+        PERFC_L1D_MISSES,
+        PERFC_LLC_MISSES,
+        PERFC_DTLB_MISSES,
+        PERFC_NUM_EVENTS
+};
+
+/* counts of one Start/Stop interval; value[e] is meaningful
+ * only when valid[e] is true.  Values are scaled up when the
+ * kernel had to multiplex the counter.
+ */
+struct PerfCounters_Sample {
+        uint64_t value[PERFC_NUM_EVENTS];
+        bool     valid[PERFC_NUM_EVENTS];
+};
+
+extern PerfCounters_T PerfCounters_New(void);
+extern void PerfCounters_Free(PerfCounters_T *countersp);
+
+extern int  PerfCounters_available(PerfCounters_T counters);
+extern void PerfCounters_Start(PerfCounters_T counters);
+extern void PerfCounters_Stop(PerfCounters_T counters,
+                              struct PerfCounters_Sample *sample);
+
+extern const char *PerfCounters_name(enum PerfCounters_Event event);
+extern void PerfCounters_print(FILE *fp,
+                               const struct PerfCounters_Sample *sample,
+                               double pixels);
+
+#endif
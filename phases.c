@@ -0,0 +1,355 @@
+/**************************************************************
+ *
+ *      phases.c
+ *
+ *      Xiaoyan Xie (xxie05)
+ *      Diwei Chen (dchen22)
+ *
+ *      CS 40 HW03 - locality
+ *
+ *      This file implements Phases_T.  Phases and fields are kept
+ *      in small fixed-size tables: a ppmtrans run has a handful of
+ *      each, and a fixed table keeps the recorder itself out of
+ *      the measurements.
+ *
+ **************************************************************/
+#define _GNU_SOURCE             /* fopencookie */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "assert.h"
+#include "phases.h"
+
+#define MAX_PHASES 16
+#define MAX_FIELDS 16
+
+struct phase {
+        const char *name;
+        double wall_ns;
+        double cpu_ns;
+};
+
+struct field {
+        const char *key;
+        const char *string;     /* NULL for numeric fields */
+        double number;
+};
+
+struct Phases {
+        struct phase phases[MAX_PHASES];
+        int num_phases;
+        struct field fields[MAX_FIELDS];
+        int num_fields;
+
+        int running;            /* index of the open phase, or -1 */
+        struct timespec wall_start, cpu_start;
+
+        long long bytes_read;
+        long long bytes_written;
+};
+
+/* cookie handed to fopencookie for counting streams */
+struct counted {
+        FILE *fp;
+        long long *count;
+};
+
+static double now_ns(clockid_t clock)
+{
+        struct timespec ts;
+        clock_gettime(clock, &ts);
+        return (double)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static double elapsed_ns(clockid_t clock, struct timespec *start)
+{
+        return now_ns(clock) -
+               ((double)start->tv_sec * 1000000000 + start->tv_nsec);
+}
+
+/********************** Phases_New ************************
+ * Creates an empty phase recorder.
+ *
+ * Notes:
+ *      Will CRE if memory allocation fails.
+ *********************************************************/
+Phases_T Phases_New(void)
+{
+        Phases_T phases = calloc(1, sizeof(*phases));
+        assert(phases != NULL);
+        phases->running = -1;
+        return phases;
+}
+
+/********************** Phases_Free ***********************
+ * Frees a phase recorder and sets *phasesp to NULL.
+ *********************************************************/
+void Phases_Free(Phases_T *phasesp)
+{
+        assert(phasesp != NULL && *phasesp != NULL);
+        free(*phasesp);
+        *phasesp = NULL;
+}
+
+/********************** Phases_begin **********************
+ * Starts timing a phase.  A phase with a name already
+ * recorded accumulates into the existing entry.
+ *
+ * Parameters:
+ *      Phases_T phases: The recorder.
+ *      const char *name: Phase name; must outlive the recorder.
+ *
+ * Expects:
+ *      No phase is currently running.
+ *
+ * Notes:
+ *      Will CRE if a phase is running or the table is full.
+ *********************************************************/
+void Phases_begin(Phases_T phases, const char *name)
+{
+        assert(phases != NULL && name != NULL);
+        assert(phases->running == -1);
+
+        int i;
+        for (i = 0; i < phases->num_phases; i++) {
+                if (strcmp(phases->phases[i].name, name) == 0) {
+                        break;
+                }
+        }
+        if (i == phases->num_phases) {
+                assert(phases->num_phases < MAX_PHASES);
+                phases->phases[i].name = name;
+                phases->phases[i].wall_ns = 0;
+                phases->phases[i].cpu_ns = 0;
+                phases->num_phases++;
+        }
+        phases->running = i;
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &phases->cpu_start);
+        clock_gettime(CLOCK_MONOTONIC, &phases->wall_start);
+}
+
+/*********************** Phases_end ***********************
+ * Stops timing the running phase.
+ *
+ * Notes:
+ *      Will CRE if no phase is running.
+ *********************************************************/
+void Phases_end(Phases_T phases)
+{
+        assert(phases != NULL);
+        assert(phases->running >= 0);
+
+        struct phase *p = &phases->phases[phases->running];
+        p->wall_ns += elapsed_ns(CLOCK_MONOTONIC, &phases->wall_start);
+        p->cpu_ns += elapsed_ns(CLOCK_PROCESS_CPUTIME_ID,
+                                &phases->cpu_start);
+        phases->running = -1;
+}
+
+static struct field *add_field(Phases_T phases, const char *key)
+{
+        assert(phases != NULL && key != NULL);
+        assert(phases->num_fields < MAX_FIELDS);
+        return &phases->fields[phases->num_fields++];
+}
+
+/******************* Phases_set_string ********************
+ * Adds a descriptive string field to the record.  key and
+ * value are not copied and must outlive the recorder.
+ *********************************************************/
+void Phases_set_string(Phases_T phases, const char *key, const char *value)
+{
+        struct field *f = add_field(phases, key);
+        f->key = key;
+        f->string = value == NULL ? "" : value;
+}
+
+/******************* Phases_set_number ********************
+ * Adds a numeric field to the record.
+ *********************************************************/
+void Phases_set_number(Phases_T phases, const char *key, double value)
+{
+        struct field *f = add_field(phases, key);
+        f->key = key;
+        f->string = NULL;
+        f->number = value;
+}
+
+/* - - - - - - - - - - - byte-counting streams - - - - - - - - - - - */
+
+static ssize_t counted_read(void *cookie, char *buf, size_t size)
+{
+        struct counted *c = cookie;
+        size_t n = fread(buf, 1, size, c->fp);
+        *c->count += n;
+        return n;
+}
+
+static ssize_t counted_write(void *cookie, const char *buf, size_t size)
+{
+        struct counted *c = cookie;
+        size_t n = fwrite(buf, 1, size, c->fp);
+        *c->count += n;
+        return n == 0 && size > 0 ? -1 : (ssize_t)n;
+}
+
+static int counted_close(void *cookie)
+{
+        struct counted *c = cookie;
+        int rc = fflush(c->fp);
+        free(c);
+        return rc;
+}
+
+static FILE *counting_stream(FILE *fp, long long *count, const char *mode)
+{
+        assert(fp != NULL);
+        struct counted *c = malloc(sizeof(*c));
+        assert(c != NULL);
+        c->fp = fp;
+        c->count = count;
+
+        cookie_io_functions_t io = {
+                .read = counted_read,
+                .write = counted_write,
+                .seek = NULL,
+                .close = counted_close,
+        };
+        FILE *wrapped = fopencookie(c, mode, io);
+        assert(wrapped != NULL);
+        return wrapped;
+}
+
+/****************** Phases_count_input ********************
+ * Returns a read stream over fp that adds every byte read
+ * to the record's "bytes_read" total.  fclose the returned
+ * stream when done; fp itself stays open.
+ *********************************************************/
+FILE *Phases_count_input(Phases_T phases, FILE *fp)
+{
+        assert(phases != NULL);
+        return counting_stream(fp, &phases->bytes_read, "r");
+}
+
+/****************** Phases_count_output *******************
+ * Returns a write stream over fp that adds every byte
+ * written to the record's "bytes_written" total.
+ *********************************************************/
+FILE *Phases_count_output(Phases_T phases, FILE *fp)
+{
+        assert(phases != NULL);
+        return counting_stream(fp, &phases->bytes_written, "w");
+}
+
+/* - - - - - - - - - - - - - - output - - - - - - - - - - - - - - - */
+
+static long peak_rss_kb(void)
+{
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) != 0) {
+                return -1;
+        }
+        return usage.ru_maxrss;        /* kilobytes on Linux */
+}
+
+static void write_json_string(FILE *fp, const char *s)
+{
+        putc('"', fp);
+        for (; *s != '\0'; s++) {
+                if (*s == '"' || *s == '\\') {
+                        putc('\\', fp);
+                }
+                if ((unsigned char)*s < 0x20) {
+                        fprintf(fp, "\\u%04x", (unsigned char)*s);
+                } else {
+                        putc(*s, fp);
+                }
+        }
+        putc('"', fp);
+}
+
+static void write_json(Phases_T phases, FILE *fp)
+{
+        double total_wall = 0, total_cpu = 0;
+
+        putc('{', fp);
+        for (int i = 0; i < phases->num_fields; i++) {
+                struct field *f = &phases->fields[i];
+                write_json_string(fp, f->key);
+                putc(':', fp);
+                if (f->string != NULL) {
+                        write_json_string(fp, f->string);
+                } else {
+                        fprintf(fp, "%.0f", f->number);
+                }
+                putc(',', fp);
+        }
+        fprintf(fp, "\"phases\":[");
+        for (int i = 0; i < phases->num_phases; i++) {
+                struct phase *p = &phases->phases[i];
+                fprintf(fp, "%s{\"name\":", i > 0 ? "," : "");
+                write_json_string(fp, p->name);
+                fprintf(fp, ",\"wall_ns\":%.0f,\"cpu_ns\":%.0f}",
+                        p->wall_ns, p->cpu_ns);
+                total_wall += p->wall_ns;
+                total_cpu += p->cpu_ns;
+        }
+        fprintf(fp, "],\"total_wall_ns\":%.0f,\"total_cpu_ns\":%.0f,"
+                "\"peak_rss_kb\":%ld,\"bytes_read\":%lld,"
+                "\"bytes_written\":%lld}\n",
+                total_wall, total_cpu, peak_rss_kb(),
+                phases->bytes_read, phases->bytes_written);
+}
+
+static void write_csv(Phases_T phases, FILE *fp)
+{
+        /* header only at the start of the file, so runs accumulate */
+        if (ftell(fp) <= 0) {
+                for (int i = 0; i < phases->num_fields; i++) {
+                        fprintf(fp, "%s,", phases->fields[i].key);
+                }
+                for (int i = 0; i < phases->num_phases; i++) {
+                        fprintf(fp, "%s_wall_ns,%s_cpu_ns,",
+                                phases->phases[i].name,
+                                phases->phases[i].name);
+                }
+                fprintf(fp, "peak_rss_kb,bytes_read,bytes_written\n");
+        }
+        for (int i = 0; i < phases->num_fields; i++) {
+                struct field *f = &phases->fields[i];
+                if (f->string != NULL) {
+                        fprintf(fp, "%s,", f->string);
+                } else {
+                        fprintf(fp, "%.0f,", f->number);
+                }
+        }
+        for (int i = 0; i < phases->num_phases; i++) {
+                fprintf(fp, "%.0f,%.0f,", phases->phases[i].wall_ns,
+                        phases->phases[i].cpu_ns);
+        }
+        fprintf(fp, "%ld,%lld,%lld\n", peak_rss_kb(),
+                phases->bytes_read, phases->bytes_written);
+}
+
+/********************** Phases_write **********************
+ * Writes the record as one line of JSON (JSON Lines) or as
+ * a CSV row, preceded by a header row when fp is at the
+ * start of the file.  Open fp in append mode to collect many
+ * runs in one file.
+ *
+ * Expects:
+ *      No phase is running.
+ *********************************************************/
+void Phases_write(Phases_T phases, FILE *fp, enum Phases_format format)
+{
+        assert(phases != NULL && fp != NULL);
+        assert(phases->running == -1);
+
+        if (format == PHASES_CSV) {
+                write_csv(phases, fp);
+        } else {
+                write_json(phases, fp);
+        }
+}
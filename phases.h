@@ -0,0 +1,58 @@
+#ifndef PHASES_INCLUDED
+#define PHASES_INCLUDED
+/**************************************************************
+ *
+ *      phases.h
+ *
+ *      Xiaoyan Xie (xxie05)
+ *      Diwei Chen (dchen22)
+ *
+ *      CS 40 HW03 - locality
+ *
+ *      Interface to type Phases_T, which records wall-clock
+ *      (CLOCK_MONOTONIC) and CPU (CLOCK_PROCESS_CPUTIME_ID) time
+ *      for a sequence of named program phases, together with
+ *      peak resident set size and I/O byte counts, and emits the
+ *      result as a single machine-readable record.
+ *
+ *      Usage:
+ *
+ *      Phases_T phases = Phases_New();
+ *      Phases_begin(phases, "read");
+ *        ... work of the phase
+ *      Phases_end(phases);
+ *        ... more phases
+ *      Phases_write(phases, fp, PHASES_JSON);
+ *      Phases_Free(&phases);
+ *
+ *      Phases_count_input/Phases_count_output wrap a stream so
+ *      that every byte passing through it is counted; closing the
+ *      wrapper does not close the underlying stream.
+ *
+ **************************************************************/
+
+#include <stdio.h>
+
+typedef struct Phases *Phases_T;
+
+enum Phases_format { PHASES_JSON, PHASES_CSV };
+
+extern Phases_T Phases_New(void);
+extern void Phases_Free(Phases_T *phasesp);
+
+extern void Phases_begin(Phases_T phases, const char *name);
+extern void Phases_end(Phases_T phases);
+
+/* descriptive key/value fields written ahead of the timings */
+extern void Phases_set_string(Phases_T phases, const char *key,
+                              const char *value);
+extern void Phases_set_number(Phases_T phases, const char *key,
+                              double value);
+
+extern FILE *Phases_count_input(Phases_T phases, FILE *fp);
+extern FILE *Phases_count_output(Phases_T phases, FILE *fp);
+
+extern void Phases_write(Phases_T phases, FILE *fp,
+                         enum Phases_format format);
+
+#endif
@@ -0,0 +1,781 @@
+/**************************************************************
+ *
+ *      pipeline.c
+ *
+ *      Xiaoyan Xie (xxie05)
+ *      Diwei Chen (dchen22)
+ *
+ *      CS 40 HW03 - locality
+ *
+ *      This file implements Pipeline_rotate.  Three stages run
+ *      concurrently:
+ *        - the source loads bands of raw rows into a ring of
+ *          NBUF buffers, either with io_uring reads (issued and
+ *          reaped by the rotating thread, no extra thread) or on
+ *          a reader thread using stdio;
+ *        - the calling thread decodes each band straight into
+ *          the rotated destination and hands the buffer back;
+ *        - the sink, a writer thread, formats and writes ranges
+ *          of destination rows as they are reported complete.
+ *
+ *      io_uring is driven through its system calls directly, so
+ *      no liburing is needed; if the ring cannot be set up (old
+ *      kernel, seccomp, io_uring_disabled) the reader thread is
+ *      used instead.
+ *
+ **************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "assert.h"
+#include "except.h"
+#include "a2methods.h"
+#include "pnm.h"
+#include "ppmio.h"
+#include "pipeline.h"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define PIPELINE_URING 1
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+#endif
+
+typedef A2Methods_UArray2 A2;
+
+#define BAND_BYTES (1 << 20)    /* raw bytes per band, about */
+#define NBUF 4                  /* bands in flight */
+#define WRITE_BYTES (1 << 20)   /* formatted bytes per write */
+
+static double now_ns(void)
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+#ifdef PIPELINE_URING
+/********************* struct uring ***********************
+ * The mapped submission and completion rings of one
+ * io_uring instance.
+ *********************************************************/
+struct uring {
+        int fd;
+        unsigned *sq_tail, *sq_mask, *sq_array;
+        unsigned *cq_head, *cq_tail, *cq_mask;
+        struct io_uring_sqe *sqes;
+        struct io_uring_cqe *cqes;
+        void *sq_ring, *cq_ring;
+        size_t sq_size, cq_size, sqes_size;
+};
+
+/********************** uring_init ************************
+ * Sets up a ring with room for `entries` requests.
+ * Returns false if io_uring is unavailable.
+ *********************************************************/
+static bool uring_init(struct uring *r, unsigned entries)
+{
+        struct io_uring_params p;
+        memset(&p, 0, sizeof(p));
+        r->fd = syscall(__NR_io_uring_setup, entries, &p);
+        if (r->fd < 0) {
+                return false;
+        }
+
+        r->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        r->cq_size = p.cq_off.cqes +
+                     p.cq_entries * sizeof(struct io_uring_cqe);
+        if (p.features & IORING_FEAT_SINGLE_MMAP) {
+                if (r->cq_size > r->sq_size) {
+                        r->sq_size = r->cq_size;
+                }
+                r->cq_size = r->sq_size;
+        }
+        r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+
+        r->sq_ring = mmap(NULL, r->sq_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, r->fd,
+                          IORING_OFF_SQ_RING);
+        r->cq_ring = (p.features & IORING_FEAT_SINGLE_MMAP)
+                ? r->sq_ring
+                : mmap(NULL, r->cq_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, r->fd,
+                       IORING_OFF_CQ_RING);
+        r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+        if (r->sq_ring == MAP_FAILED || r->cq_ring == MAP_FAILED ||
+            r->sqes == MAP_FAILED) {
+                close(r->fd);
+                return false;
+        }
+
+        char *sq = r->sq_ring, *cq = r->cq_ring;
+        r->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+        r->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+        r->sq_array = (unsigned *)(sq + p.sq_off.array);
+        r->cq_head = (unsigned *)(cq + p.cq_off.head);
+        r->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+        r->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+        r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+        return true;
+}
+
+static void uring_free(struct uring *r)
+{
+        munmap(r->sqes, r->sqes_size);
+        if (r->cq_ring != r->sq_ring) {
+                munmap(r->cq_ring, r->cq_size);
+        }
+        munmap(r->sq_ring, r->sq_size);
+        close(r->fd);
+}
+
+/********************** uring_read ************************
+ * Queues and submits one readv of iov at offset, tagged
+ * with data.  Returns false if the submission failed.
+ *********************************************************/
+static bool uring_read(struct uring *r, int fd, struct iovec *iov,
+                       off_t offset, uint64_t data)
+{
+        unsigned tail = *r->sq_tail;
+        unsigned index = tail & *r->sq_mask;
+        struct io_uring_sqe *sqe = &r->sqes[index];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_READV;
+        sqe->fd = fd;
+        sqe->addr = (uintptr_t)iov;
+        sqe->len = 1;
+        sqe->off = offset;
+        sqe->user_data = data;
+        r->sq_array[index] = index;
+        __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+        return syscall(__NR_io_uring_enter, r->fd, 1, 0, 0, NULL, 0) == 1;
+}
+
+/********************** uring_wait ************************
+ * Waits for the next completion and copies it to *cqe.
+ *********************************************************/
+static bool uring_wait(struct uring *r, struct io_uring_cqe *cqe)
+{
+        for (;;) {
+                unsigned head = *r->cq_head;
+                if (head != __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) {
+                        *cqe = r->cqes[head & *r->cq_mask];
+                        __atomic_store_n(r->cq_head, head + 1,
+                                         __ATOMIC_RELEASE);
+                        return true;
+                }
+                if (syscall(__NR_io_uring_enter, r->fd, 0, 1,
+                            IORING_ENTER_GETEVENTS, NULL, 0) < 0 &&
+                    errno != EINTR) {
+                        return false;
+                }
+        }
+}
+#endif
+
+/******************** struct source ***********************
+ * The reading stage.  Band k is loaded into buffer
+ * k % NBUF; it may be loaded once band k - NBUF has been
+ * released by the rotator.
+ *********************************************************/
+struct source {
+        FILE *fp;
+        int fd;
+        off_t offset;                   /* raster offset in fd */
+        size_t row_bytes;
+        int height, rows_per_band, bands;
+        unsigned char *buffers[NBUF];
+
+        pthread_mutex_t lock;
+        pthread_cond_t changed;
+        int loaded;                     /* bands resident */
+        int released;                   /* bands rotated */
+        bool failed;                    /* short or unreadable */
+        bool stop;                      /* rotator gave up */
+        double busy_ns;
+        bool threaded;
+        pthread_t thread;
+
+#ifdef PIPELINE_URING
+        struct uring ring;
+        struct iovec iov[NBUF];
+        size_t got[NBUF];               /* bytes read so far */
+        bool done[NBUF];
+        int submitted;                  /* bands issued */
+        int in_flight;                  /* requests not reaped */
+        bool ring_ready;
+#endif
+};
+
+static size_t band_bytes(struct source *src, int k)
+{
+        int first = k * src->rows_per_band;
+        int last = first + src->rows_per_band;
+        if (last > src->height) {
+                last = src->height;
+        }
+        return (last - first) * src->row_bytes;
+}
+
+/********************* reader_main ************************
+ * Reader thread: fills bands in order with fread, waiting
+ * for a free buffer before each one.
+ *********************************************************/
+static void *reader_main(void *cl)
+{
+        struct source *src = cl;
+        for (int k = 0; k < src->bands; k++) {
+                pthread_mutex_lock(&src->lock);
+                while (k - src->released >= NBUF && !src->stop) {
+                        pthread_cond_wait(&src->changed, &src->lock);
+                }
+                bool stop = src->stop;
+                pthread_mutex_unlock(&src->lock);
+                if (stop) {
+                        break;
+                }
+
+                double start = now_ns();
+                size_t want = band_bytes(src, k);
+                bool ok = fread(src->buffers[k % NBUF], 1, want,
+                                src->fp) == want;
+                src->busy_ns += now_ns() - start;
+
+                pthread_mutex_lock(&src->lock);
+                if (ok) {
+                        src->loaded = k + 1;
+                } else {
+                        src->failed = true;
+                }
+                pthread_cond_broadcast(&src->changed);
+                pthread_mutex_unlock(&src->lock);
+                if (!ok) {
+                        break;
+                }
+        }
+        return NULL;
+}
+
+#ifdef PIPELINE_URING
+/********************* uring_submit ***********************
+ * Issues the read of band k (or of its unread remainder).
+ * Reads that cannot be queued are done synchronously.
+ *********************************************************/
+static void uring_submit(struct source *src, int k)
+{
+        int b = k % NBUF;
+        size_t want = band_bytes(src, k);
+        off_t offset = src->offset +
+                       (off_t)k * src->rows_per_band * src->row_bytes;
+        src->iov[b].iov_base = src->buffers[b] + src->got[b];
+        src->iov[b].iov_len = want - src->got[b];
+        if (uring_read(&src->ring, src->fd, &src->iov[b],
+                       offset + src->got[b], k)) {
+                src->in_flight++;
+                return;
+        }
+        ssize_t n = pread(src->fd, src->iov[b].iov_base,
+                          src->iov[b].iov_len, offset + src->got[b]);
+        src->failed |= n != (ssize_t)src->iov[b].iov_len;
+        src->done[b] = true;
+}
+
+/********************* uring_reap *************************
+ * Handles one completion: short reads are continued, errors
+ * other than interruptions mark the source failed.
+ *********************************************************/
+static void uring_reap(struct source *src)
+{
+        struct io_uring_cqe cqe;
+        if (!uring_wait(&src->ring, &cqe)) {
+                src->failed = true;
+                src->in_flight = 0;
+                return;
+        }
+        src->in_flight--;
+        int k = cqe.user_data;
+        int b = k % NBUF;
+        if (cqe.res == -EINTR || cqe.res == -EAGAIN) {
+                uring_submit(src, k);
+                return;
+        }
+        if (cqe.res <= 0) {
+                src->failed = true;
+                src->done[b] = true;
+                return;
+        }
+        src->got[b] += cqe.res;
+        if (src->got[b] < band_bytes(src, k)) {
+                uring_submit(src, k);
+        } else {
+                src->done[b] = true;
+        }
+}
+#endif
+
+/******************** source_start ************************
+ * Chooses the reading method and starts loading bands.
+ *********************************************************/
+static void source_start(struct source *src)
+{
+        src->threaded = true;
+#ifdef PIPELINE_URING
+        struct stat st;
+        src->offset = src->fd >= 0 ? ftello(src->fp) : -1;
+        if (src->offset >= 0 && fstat(src->fd, &st) == 0 &&
+            S_ISREG(st.st_mode) && uring_init(&src->ring, 2 * NBUF)) {
+                src->threaded = false;
+                src->ring_ready = true;
+                return;
+        }
+#endif
+        if (pthread_create(&src->thread, NULL, reader_main, src) != 0) {
+                src->threaded = false;
+                src->failed = true;
+        }
+}
+
+/********************* source_wait ************************
+ * Waits until band k is resident.  Returns false if the
+ * input ended early or could not be read.
+ *********************************************************/
+static bool source_wait(struct source *src, int k)
+{
+        if (src->threaded) {
+                pthread_mutex_lock(&src->lock);
+                while (src->loaded <= k && !src->failed) {
+                        pthread_cond_wait(&src->changed, &src->lock);
+                }
+                bool ok = src->loaded > k;
+                pthread_mutex_unlock(&src->lock);
+                return ok;
+        }
+#ifdef PIPELINE_URING
+        double start = now_ns();
+        while (src->submitted < src->bands &&
+               src->submitted - src->released < NBUF) {
+                int b = src->submitted % NBUF;
+                src->got[b] = 0;
+                src->done[b] = false;
+                uring_submit(src, src->submitted++);
+        }
+        while (!src->done[k % NBUF] && !src->failed) {
+                uring_reap(src);
+        }
+        src->busy_ns += now_ns() - start;
+#endif
+        return !src->failed;
+}
+
+static void source_release(struct source *src, int k)
+{
+        pthread_mutex_lock(&src->lock);
+        src->released = k + 1;
+        pthread_cond_broadcast(&src->changed);
+        pthread_mutex_unlock(&src->lock);
+}
+
+/********************* source_finish **********************
+ * Stops the reader and waits for it.  With io_uring, reads
+ * still in flight are reaped before the buffers go away.
+ *********************************************************/
+static void source_finish(struct source *src)
+{
+        pthread_mutex_lock(&src->lock);
+        src->stop = true;
+        pthread_cond_broadcast(&src->changed);
+        pthread_mutex_unlock(&src->lock);
+        if (src->threaded) {
+                pthread_join(src->thread, NULL);
+                return;
+        }
+#ifdef PIPELINE_URING
+        if (src->ring_ready) {
+                struct io_uring_cqe cqe;
+                while (src->in_flight > 0 &&
+                       uring_wait(&src->ring, &cqe)) {
+                        src->in_flight--;
+                }
+                uring_free(&src->ring);
+        }
+#endif
+}
+
+/********************** struct sink ***********************
+ * The writing stage.  The rotator reports ranges of
+ * finished destination rows; the writer thread writes them
+ * at their place in the file when positional, otherwise as
+ * soon as they extend the already written prefix.
+ *********************************************************/
+struct sink {
+        FILE *fp;
+        int fd;
+        bool positional;
+        off_t base;                     /* offset of the raster */
+        A2Methods_T methods;
+        A2 dst;
+        int width, height, bytes;
+        unsigned maxval;
+        size_t row_bytes;
+        unsigned char *buffer;
+        int buffer_rows;
+
+        pthread_mutex_t lock;
+        pthread_cond_t changed;
+        int (*ranges)[2];
+        int num_ranges, taken;
+        bool finished;
+        bool *row_done;
+        int next;                       /* first row not written */
+        bool failed;
+        double busy_ns;
+        pthread_t thread;
+};
+
+/********************** put_bytes *************************
+ * Writes len bytes at the sink's position for `first`.
+ *********************************************************/
+static bool put_bytes(struct sink *sink, const unsigned char *p, size_t len,
+                      int first)
+{
+        if (sink->fd < 0) {
+                return fwrite(p, 1, len, sink->fp) == len;
+        }
+        off_t offset = sink->base + (off_t)first * sink->row_bytes;
+        while (len > 0) {
+                ssize_t n = sink->positional ? pwrite(sink->fd, p, len, offset)
+                                             : write(sink->fd, p, len);
+                if (n < 0 && errno == EINTR) {
+                        continue;
+                }
+                if (n <= 0) {
+                        return false;
+                }
+                p += n;
+                len -= n;
+                offset += n;
+        }
+        return true;
+}
+
+/********************** write_rows ************************
+ * Formats destination rows [first, last) as P6 and writes
+ * them, WRITE_BYTES at a time.
+ *********************************************************/
+static void write_rows(struct sink *sink, int first, int last)
+{
+        A2Methods_T methods = sink->methods;
+        for (int j0 = first; j0 < last; j0 += sink->buffer_rows) {
+                int j1 = j0 + sink->buffer_rows < last
+                        ? j0 + sink->buffer_rows : last;
+                unsigned char *o = sink->buffer;
+                for (int j = j0; j < j1; j++) {
+                        for (int i = 0; i < sink->width; i++) {
+                                struct Pnm_rgb *px = methods->at(sink->dst,
+                                                                 i, j);
+                                unsigned v[3] = { px->red, px->green,
+                                                  px->blue };
+                                for (int c = 0; c < 3; c++) {
+                                        if (sink->bytes == 2) {
+                                                *o++ = v[c] >> 8;
+                                        }
+                                        *o++ = v[c];
+                                }
+                        }
+                }
+                if (!put_bytes(sink, sink->buffer, o - sink->buffer, j0)) {
+                        sink->failed = true;
+                        return;
+                }
+        }
+}
+
+static void *writer_main(void *cl)
+{
+        struct sink *sink = cl;
+        for (;;) {
+                pthread_mutex_lock(&sink->lock);
+                while (sink->taken == sink->num_ranges && !sink->finished) {
+                        pthread_cond_wait(&sink->changed, &sink->lock);
+                }
+                if (sink->taken == sink->num_ranges) {
+                        pthread_mutex_unlock(&sink->lock);
+                        break;
+                }
+                int first = sink->ranges[sink->taken][0];
+                int last = sink->ranges[sink->taken][1];
+                sink->taken++;
+                pthread_mutex_unlock(&sink->lock);
+
+                double start = now_ns();
+                if (sink->positional) {
+                        write_rows(sink, first, last);
+                } else {
+                        for (int j = first; j < last; j++) {
+                                sink->row_done[j] = true;
+                        }
+                        int end = sink->next;
+                        while (end < sink->height && sink->row_done[end]) {
+                                end++;
+                        }
+                        write_rows(sink, sink->next, end);
+                        sink->next = end;
+                }
+                sink->busy_ns += now_ns() - start;
+        }
+        return NULL;
+}
+
+static void sink_push(struct sink *sink, int first, int last)
+{
+        pthread_mutex_lock(&sink->lock);
+        sink->ranges[sink->num_ranges][0] = first;
+        sink->ranges[sink->num_ranges][1] = last;
+        sink->num_ranges++;
+        pthread_cond_signal(&sink->changed);
+        pthread_mutex_unlock(&sink->lock);
+}
+
+/********************** sink_start ************************
+ * Starts the writer thread.  Nothing reaches the output
+ * until sink_header is called.
+ *********************************************************/
+static void sink_start(struct sink *sink, int max_ranges)
+{
+        sink->buffer_rows = sink->row_bytes > 0
+                ? (int)(WRITE_BYTES / sink->row_bytes) : 1;
+        if (sink->buffer_rows < 1) {
+                sink->buffer_rows = 1;
+        }
+        sink->buffer = malloc(sink->buffer_rows * sink->row_bytes + 1);
+        sink->ranges = malloc((max_ranges + 1) * sizeof(*sink->ranges));
+        sink->row_done = calloc(sink->height + 1, sizeof(bool));
+        assert(sink->buffer != NULL && sink->ranges != NULL &&
+               sink->row_done != NULL);
+        int started = pthread_create(&sink->thread, NULL, writer_main, sink);
+        assert(started == 0);
+}
+
+/********************** sink_header ***********************
+ * Writes the header; called once the first band has been
+ * read, before any range is pushed.  Rows are written
+ * positionally only for 180 degree rotations to a regular,
+ * non-append output, where they finish bottom up.
+ *********************************************************/
+static void sink_header(struct sink *sink, int degree)
+{
+        fprintf(sink->fp, "P6\n%d %d\n%u\n", sink->width, sink->height,
+                sink->maxval);
+        fflush(sink->fp);
+
+        struct stat st;
+        int flags = sink->fd >= 0 ? fcntl(sink->fd, F_GETFL) : -1;
+        sink->positional = degree == 180 && flags >= 0 &&
+                           !(flags & O_APPEND) &&
+                           fstat(sink->fd, &st) == 0 && S_ISREG(st.st_mode);
+        if (sink->positional) {
+                sink->base = lseek(sink->fd, 0, SEEK_CUR);
+                sink->positional = sink->base >= 0;
+        }
+}
+
+static void sink_finish(struct sink *sink)
+{
+        pthread_mutex_lock(&sink->lock);
+        sink->finished = true;
+        pthread_cond_signal(&sink->changed);
+        pthread_mutex_unlock(&sink->lock);
+        pthread_join(sink->thread, NULL);
+        if (sink->positional) {
+                lseek(sink->fd, sink->base + (off_t)sink->height *
+                      sink->row_bytes, SEEK_SET);
+        }
+        free(sink->buffer);
+        free(sink->ranges);
+        free(sink->row_done);
+}
+
+/********************* rotate_band ************************
+ * Decodes raw rows [first, last) of the source straight
+ * into their rotated places in dst.  Returns the largest
+ * sample seen.
+ *********************************************************/
+static unsigned rotate_band(const unsigned char *raw, int first, int last,
+                            const struct PPMIO_header *header, int bytes,
+                            A2Methods_T methods, A2 dst, int degree)
+{
+        int w = header->width, h = header->height;
+        unsigned largest = 0;
+        for (int j = first; j < last; j++) {
+                for (int i = 0; i < w; i++) {
+                        int x = i, y = j;
+                        if (degree == 90) {
+                                x = h - 1 - j;
+                                y = i;
+                        } else if (degree == 180) {
+                                x = w - 1 - i;
+                                y = h - 1 - j;
+                        } else if (degree == 270) {
+                                x = j;
+                                y = w - 1 - i;
+                        }
+                        struct Pnm_rgb *px = methods->at(dst, x, y);
+                        unsigned v[3];
+                        for (int c = 0; c < 3; c++) {
+                                v[c] = bytes == 1 ? raw[0]
+                                                  : (unsigned)raw[0] << 8 |
+                                                    raw[1];
+                                raw += bytes;
+                                largest = v[c] > largest ? v[c] : largest;
+                        }
+                        px->red = v[0];
+                        px->green = v[1];
+                        px->blue = v[2];
+                }
+        }
+        return largest;
+}
+
+/******************** Pipeline_rotate *********************
+ * Reads the P6 raster that follows header, rotates it and
+ * writes the rotated image (header included) to out, with
+ * the three stages overlapped.
+ *
+ * Parameters:
+ *      FILE *in: Stream positioned at the raster (see
+ *                PPMIO_read_header).
+ *      const struct PPMIO_header *header: The P6 header.
+ *      FILE *out: Output stream.
+ *      A2Methods_T methods: Representation of the destination.
+ *      int degree: 0, 90, 180 or 270.
+ *      struct Pipeline_stats *stats: Filled in if not NULL.
+ *
+ * Expects:
+ *      in, header, out and methods must not be NULL, and
+ *      header->format must be '6'.
+ *
+ * Notes:
+ *      Raises Pnm_Badformat if the raster is short or holds a
+ *      sample over the maxval.  Nothing is written if the
+ *      first band is bad; after that the header and the rows
+ *      already written stay written.  With io_uring, read_ns
+ *      is the time the rotator spent waiting for reads, not
+ *      the time the kernel spent reading.  Will CRE if memory allocation,
+ *      starting the writer or writing fails.
+ *********************************************************/
+void Pipeline_rotate(FILE *in, const struct PPMIO_header *header,
+                     FILE *out, A2Methods_T methods, int degree,
+                     struct Pipeline_stats *stats)
+{
+        assert(in != NULL && header != NULL && out != NULL);
+        assert(methods != NULL && header->format == '6');
+        assert(degree == 0 || degree == 90 || degree == 180 ||
+               degree == 270);
+        double start = now_ns();
+        int w = header->width, h = header->height;
+        int bytes = header->maxval < 256 ? 1 : 2;
+        bool turned = degree == 90 || degree == 270;
+
+        struct source src = {
+                .fp = in, .fd = fileno(in),
+                .row_bytes = (size_t)w * 3 * bytes, .height = h,
+                .lock = PTHREAD_MUTEX_INITIALIZER,
+                .changed = PTHREAD_COND_INITIALIZER,
+        };
+        src.rows_per_band = src.row_bytes > 0
+                ? (int)(BAND_BYTES / src.row_bytes) : h;
+        if (src.rows_per_band < 1) {
+                src.rows_per_band = 1;
+        }
+        src.bands = h > 0 ? (h + src.rows_per_band - 1) / src.rows_per_band
+                          : 0;
+        for (int b = 0; b < NBUF; b++) {
+                src.buffers[b] = malloc(src.rows_per_band * src.row_bytes
+                                        + 1);
+                assert(src.buffers[b] != NULL);
+        }
+
+        struct sink sink = {
+                .fp = out, .fd = fileno(out),
+                .methods = methods,
+                .width = turned ? h : w, .height = turned ? w : h,
+                .bytes = bytes, .maxval = header->maxval,
+                .lock = PTHREAD_MUTEX_INITIALIZER,
+                .changed = PTHREAD_COND_INITIALIZER,
+        };
+        sink.row_bytes = (size_t)sink.width * 3 * bytes;
+        sink.dst = methods->new(sink.width, sink.height,
+                                sizeof(struct Pnm_rgb));
+
+        source_start(&src);
+        sink_start(&sink, src.bands);
+        if (src.bands == 0) {
+                sink_header(&sink, degree);
+        }
+
+        double rotate_ns = 0;
+        unsigned largest = 0;
+        bool ok = true;
+        for (int k = 0; k < src.bands && ok; k++) {
+                ok = source_wait(&src, k);
+                if (!ok) {
+                        break;
+                }
+                double t0 = now_ns();
+                int first = k * src.rows_per_band;
+                int last = first + src.rows_per_band < h
+                        ? first + src.rows_per_band : h;
+                unsigned top = rotate_band(src.buffers[k % NBUF], first,
+                                           last, header, bytes, methods,
+                                           sink.dst, degree);
+                largest = top > largest ? top : largest;
+                rotate_ns += now_ns() - t0;
+                source_release(&src, k);
+                if (k == 0) {
+                        ok = largest <= header->maxval;
+                        if (!ok) {
+                                break;
+                        }
+                        sink_header(&sink, degree);
+                }
+
+                if (degree == 0) {
+                        sink_push(&sink, first, last);
+                } else if (degree == 180) {
+                        sink_push(&sink, h - last, h - first);
+                }
+        }
+        if (ok && turned) {
+                sink_push(&sink, 0, sink.height);
+        }
+        source_finish(&src);
+        sink_finish(&sink);
+
+        for (int b = 0; b < NBUF; b++) {
+                free(src.buffers[b]);
+        }
+        methods->free(&sink.dst);
+        if (stats != NULL) {
+                stats->reader = src.threaded ? "thread" : "io_uring";
+                stats->read_ns = src.busy_ns;
+                stats->rotate_ns = rotate_ns;
+                stats->write_ns = sink.busy_ns;
+                stats->total_ns = now_ns() - start;
+        }
+        if (!ok || largest > header->maxval) {
+                RAISE(Pnm_Badformat);
+        }
+        assert(!sink.failed);
+}
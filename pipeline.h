@@ -0,0 +1,46 @@
+#ifndef PIPELINE_INCLUDED
+#define PIPELINE_INCLUDED
+/**************************************************************
+ *
+ *      pipeline.h
+ *
+ *      Xiaoyan Xie (xxie05)
+ *      Diwei Chen (dchen22)
+ *
+ *      CS 40 HW03 - locality
+ *
+ *      Overlapped read/rotate/write of a binary (P6) image.
+ *      Instead of reading the whole image, rotating it and then
+ *      writing it, the raster is read in bands of rows, each band
+ *      is rotated straight into the destination as soon as it is
+ *      resident, and destination rows are written by a writer
+ *      thread as soon as they are complete.
+ *
+ *      Bands are read with io_uring where the kernel allows it and
+ *      the input is a regular file, and by a reader thread
+ *      otherwise.  Destination rows complete in order for
+ *      rotation 0, in reverse order for 180 (written in place with
+ *      pwrite when the output is a regular file), and only at the
+ *      end for 90 and 270, where the overlap is between reading
+ *      and rotating.
+ *
+ **************************************************************/
+
+#include <stdio.h>
+#include "a2methods.h"
+#include "ppmio.h"
+
+/* busy time of each stage, and the whole run, in nanoseconds */
+struct Pipeline_stats {
+        const char *reader;             /* "io_uring" or "thread" */
+        double read_ns;
+        double rotate_ns;
+        double write_ns;
+        double total_ns;
+};
+
+extern void Pipeline_rotate(FILE *in, const struct PPMIO_header *header,
+                            FILE *out, A2Methods_T methods, int degree,
+                            struct Pipeline_stats *stats);
+
+#endif
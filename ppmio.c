@@ -0,0 +1,923 @@
+/**************************************************************
+ *
+ *      ppmio.c
+ *
+ *      Xiaoyan Xie (xxie05)
+ *      Diwei Chen (dchen22)
+ *
+ *      CS 40 HW03 - locality
+ *
+ *      This file implements the parallel PPM reader and writer.
+ *
+ *      Reading parses the header with stdio, slurps the rest of
+ *      the stream and then splits the raster:
+ *        - P6 rows are fixed-size, so each thread converts a band
+ *          of rows;
+ *        - P3 samples have no fixed position, so the text is cut
+ *          into chunks at whitespace, every thread counts the
+ *          numbers in its chunk, a prefix sum gives each chunk its
+ *          first sample index, and the threads then parse and
+ *          store their chunks.
+ *
+ *      Writing formats each band of rows into its own buffer in
+ *      parallel and sends the header plus all bands with writev.
+ *
+ **************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "assert.h"
+#include "except.h"
+#include "mem.h"
+#include "a2methods.h"
+#include "a2plain.h"
+#include "a2prefetch.h"
+#include "uarray2ext.h"
+#include "a2view.h"
+#include "a2planar.h"
+#include "pnm.h"
+#include "ppmio.h"
+#include "threadpool.h"
+
+#define READ_CHUNK (1 << 20)    /* first buffer size for pipes */
+#define PAD 8                   /* zero bytes after the data, so an
+                                 * 8-byte load at any offset is safe */
+#define MAX_THREADS 64
+#define MIN_CHUNK (64 * 1024)   /* smallest P3 chunk worth a thread */
+#define LINE_LIMIT 70           /* longest P3 output line */
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+static const char digit_pairs[] =
+        "0001020304050607080910111213141516171819"
+        "2021222324252627282930313233343536373839"
+        "4041424344454647484950515253545556575859"
+        "6061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+
+/******************** struct band *************************
+ * Work for one thread.  Row bands use [first, last); P3
+ * chunks use the text range [start, end) and first_sample.
+ * Writers leave their output in out/out_len.
+ *********************************************************/
+struct band {
+        Pnm_ppm ppm;
+        int first, last;
+        const unsigned char *raw;       /* P6 raster */
+        int bytes;                      /* bytes per P6 sample */
+        const char *start, *end;
+        size_t first_sample;
+        size_t tokens;
+        char *out;
+        size_t out_len;
+        bool plain;
+        bool bad;
+};
+
+static inline bool is_space(char c)
+{
+        return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+/********************** row_of ****************************
+ * Returns a pointer to row j of a plain image, or NULL for
+ * other representations (cells are then reached with at,
+ * except for planar images, whose rows are staged through a
+ * buffer of interleaved cells).
+ *********************************************************/
+static struct Pnm_rgb *row_of(Pnm_ppm ppm, int j)
+{
+        if (ppm->methods == uarray2_methods_plain ||
+            ppm->methods == uarray2_methods_plain_prefetch) {
+                return UArray2_row(ppm->pixels, j);
+        }
+        return NULL;
+}
+
+static inline struct Pnm_rgb *pixel(Pnm_ppm ppm, struct Pnm_rgb *row,
+                                    int i, int j)
+{
+        return row != NULL ? row + i : ppm->methods->at(ppm->pixels, i, j);
+}
+
+/* a cell to write out: views are read without copying tiles */
+static inline const struct Pnm_rgb *sample(Pnm_ppm ppm, struct Pnm_rgb *row,
+                                           int i, int j)
+{
+        if (ppm->methods == uarray2_methods_view) {
+                return A2View_peek(ppm->pixels, i, j);
+        }
+        return pixel(ppm, row, i, j);
+}
+
+/******************** band_count **************************
+ * Number of threads to use for `units` units of work, given
+ * the requested count (PPMIO_AUTO: one per online cpu).
+ *********************************************************/
+static int band_count(int threads, size_t units)
+{
+        if (threads == PPMIO_AUTO) {
+                long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+                threads = cpus > 0 ? (int)cpus : 1;
+        }
+        if (threads > MAX_THREADS) {
+                threads = MAX_THREADS;
+        }
+        if ((size_t)threads > units) {
+                threads = (int)units;
+        }
+        return threads < 1 ? 1 : threads;
+}
+
+/* band threads, kept between calls; grown when more are asked for */
+static ThreadPool_T band_pool = NULL;
+static pthread_mutex_t band_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+struct band_job {
+        void *(*fn)(void *);
+        struct band *bands;
+};
+
+static void band_task(int k, void *cl)
+{
+        struct band_job *job = cl;
+        job->fn(&job->bands[k]);
+}
+
+/********************** run_bands *************************
+ * Runs fn on every band, on the band pool and the calling
+ * thread, and waits for all of them.  The pool outlives the
+ * call, so repeated reads and writes (a -daemon serving many
+ * small images) do not start threads each time.  Calls from
+ * several threads take turns.
+ *********************************************************/
+static void run_bands(void *fn(void *), struct band *bands, int n)
+{
+        if (n == 1) {
+                fn(&bands[0]);
+                return;
+        }
+        pthread_mutex_lock(&band_pool_lock);
+        if (band_pool == NULL || ThreadPool_size(band_pool) < n) {
+                if (band_pool != NULL) {
+                        ThreadPool_free(&band_pool);
+                }
+                band_pool = ThreadPool_new(n);
+        }
+        struct band_job job = { fn, bands };
+        ThreadPool_run(band_pool, n, band_task, &job);
+        pthread_mutex_unlock(&band_pool_lock);
+}
+
+/************************ slurp ***************************
+ * Reads the rest of fp into a buffer followed by PAD zero
+ * bytes.  Regular files are read into a buffer of their
+ * size; other streams grow the buffer by doubling.
+ *********************************************************/
+static char *slurp(FILE *fp, size_t *lenp)
+{
+        size_t cap = READ_CHUNK;
+        struct stat st;
+        int fd = fileno(fp);
+        if (fd >= 0 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode) &&
+            st.st_size > 0) {
+                cap = (size_t)st.st_size + 1;   /* +1 finds EOF */
+        }
+
+        char *data = malloc(cap + PAD);
+        assert(data != NULL);
+        size_t len = 0;
+        for (;;) {
+                if (len == cap) {
+                        cap *= 2;
+                        data = realloc(data, cap + PAD);
+                        assert(data != NULL);
+                }
+                size_t n = fread(data + len, 1, cap - len, fp);
+                if (n == 0) {
+                        break;
+                }
+                len += n;
+        }
+        memset(data + len, 0, PAD);
+        *lenp = len;
+        return data;
+}
+
+/******************** header_number ***********************
+ * Reads one header number from fp, skipping whitespace and
+ * comments before it.
+ *********************************************************/
+static unsigned header_number(FILE *fp)
+{
+        int c = getc(fp);
+        while (is_space(c) || c == '#') {
+                if (c == '#') {
+                        while (c != '\n' && c != EOF) {
+                                c = getc(fp);
+                        }
+                } else {
+                        c = getc(fp);
+                }
+        }
+        if (c < '0' || c > '9') {
+                RAISE(Pnm_Badformat);
+        }
+        unsigned long v = 0;
+        while (c >= '0' && c <= '9') {
+                v = v * 10 + (c - '0');
+                if (v > (1UL << 30)) {
+                        RAISE(Pnm_Badformat);
+                }
+                c = getc(fp);
+        }
+        ungetc(c, fp);
+        return (unsigned)v;
+}
+
+/******************** parse_digits ************************
+ * Parses the run of decimal digits at p (at most eight) and
+ * returns its length, storing the value in *value.  On
+ * little-endian machines all eight bytes are classified and
+ * converted at once:
+ *   - a byte is a digit iff its high nibble is 3 and adding
+ *     6 does not carry out of the low nibble, which gives the
+ *     run length from the first non-digit byte;
+ *   - the digits are shifted to the top of the word (the
+ *     vacated bytes act as leading zeros) and combined in
+ *     pairs, quads and octets with three multiplies.
+ * Carries and borrows only move towards later bytes, so
+ * junk after the run never disturbs it.
+ *********************************************************/
+static inline int parse_digits(const char *p, unsigned *value)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        uint64_t chunk;
+        memcpy(&chunk, p, 8);
+        uint64_t high = chunk & 0xF0F0F0F0F0F0F0F0ULL;
+        uint64_t low = ((chunk + 0x0606060606060606ULL) &
+                        0xF0F0F0F0F0F0F0F0ULL) >> 4;
+        uint64_t non_digits = (high | low) ^ 0x3333333333333333ULL;
+        int n = non_digits == 0 ? 8 : __builtin_ctzll(non_digits) / 8;
+        if (n == 0) {
+                return 0;
+        }
+        uint64_t v = (chunk - 0x3030303030303030ULL) << (8 * (8 - n));
+        v = v * 10 + (v >> 8);
+        v = (((v & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32))) +
+             (((v >> 16) & 0x000000FF000000FFULL) *
+              (1 + (10000ULL << 32)))) >> 32;
+        *value = (unsigned)v;
+        return n;
+#else
+        int n = 0;
+        unsigned v = 0;
+        while (n < 8 && p[n] >= '0' && p[n] <= '9') {
+                v = v * 10 + (p[n++] - '0');
+        }
+        *value = v;
+        return n;
+#endif
+}
+
+/******************** read_p6_band ************************
+ * Converts rows [first, last) of a binary raster and flags
+ * the band bad if a sample exceeds the maxval.
+ *********************************************************/
+static void *read_p6_band(void *cl)
+{
+        struct band *b = cl;
+        Pnm_ppm ppm = b->ppm;
+        int w = ppm->width;
+        size_t row_bytes = (size_t)w * 3 * b->bytes;
+        unsigned largest = 0;
+        struct Pnm_rgb *stage = NULL;
+        if (A2Planar_is(ppm->methods)) {
+                stage = malloc((w + 1) * sizeof(*stage));
+                assert(stage != NULL);
+        }
+
+        for (int j = b->first; j < b->last; j++) {
+                const unsigned char *s = b->raw + j * row_bytes;
+                struct Pnm_rgb *row = stage != NULL ? stage : row_of(ppm, j);
+                for (int i = 0; i < w; i++) {
+                        struct Pnm_rgb *px = pixel(ppm, row, i, j);
+                        if (b->bytes == 1) {
+                                px->red = s[0];
+                                px->green = s[1];
+                                px->blue = s[2];
+                        } else {
+                                px->red = s[0] << 8 | s[1];
+                                px->green = s[2] << 8 | s[3];
+                                px->blue = s[4] << 8 | s[5];
+                        }
+                        s += 3 * b->bytes;
+                        largest = px->red > largest ? px->red : largest;
+                        largest = px->green > largest ? px->green
+                                                      : largest;
+                        largest = px->blue > largest ? px->blue : largest;
+                }
+                if (stage != NULL) {
+                        A2Planar_put_row(ppm->pixels, j, 0, w, stage);
+                }
+        }
+        free(stage);
+        b->bad = largest > ppm->denominator;
+        return NULL;
+}
+
+/******************** count_p3_chunk **********************
+ * Counts the numbers (maximal non-space runs) in a chunk.
+ *********************************************************/
+static void *count_p3_chunk(void *cl)
+{
+        struct band *b = cl;
+        size_t tokens = 0;
+        bool in_token = false;
+        for (const char *p = b->start; p < b->end; p++) {
+                bool space = is_space(*p);
+                tokens += !space && !in_token;
+                in_token = !space;
+        }
+        b->tokens = tokens;
+        return NULL;
+}
+
+/******************** parse_p3_chunk **********************
+ * Parses the numbers of a chunk into samples first_sample
+ * onward.  Anything that is not a number no greater than the
+ * maxval marks the band bad; samples past the last pixel are
+ * ignored.
+ *********************************************************/
+static void *parse_p3_chunk(void *cl)
+{
+        struct band *b = cl;
+        Pnm_ppm ppm = b->ppm;
+        size_t w = ppm->width;
+        size_t samples = 3 * w * ppm->height;
+        size_t sample = b->first_sample;
+        const char *p = b->start;
+        struct Pnm_rgb *row = NULL, *px = NULL;
+        long row_j = -1;
+
+        while (p < b->end && sample < samples) {
+                if (is_space(*p)) {
+                        p++;
+                        continue;
+                }
+                unsigned v;
+                int n = parse_digits(p, &v);
+                if (n == 0 || v > ppm->denominator ||
+                    (p + n < b->end && !is_space(p[n]))) {
+                        b->bad = true;
+                        return NULL;
+                }
+                p += n;
+
+                size_t index = sample / 3;
+                int i = index % w, j = index / w;
+                if (j != row_j) {
+                        row = row_of(ppm, j);
+                        row_j = j;
+                }
+                if (sample % 3 == 0 || px == NULL) {
+                        px = pixel(ppm, row, i, j);
+                }
+                switch (sample % 3) {
+                case 0: px->red = v; break;
+                case 1: px->green = v; break;
+                default: px->blue = v; break;
+                }
+                sample++;
+        }
+        return NULL;
+}
+
+/********************** read_p3 ***************************
+ * Parses an ASCII raster: chunks cut at whitespace are
+ * counted, then parsed, in parallel.  Returns false if the
+ * raster is malformed or short.
+ *********************************************************/
+static bool read_p3(Pnm_ppm ppm, const char *start, const char *end,
+                    int threads)
+{
+        struct band bands[MAX_THREADS];
+        size_t len = end - start;
+        int n = band_count(threads, len / MIN_CHUNK);
+        const char *cut = start;
+        for (int k = 0; k < n; k++) {
+                const char *next = k == n - 1 ? end : start + len / n * (k + 1);
+                if (next < cut) {
+                        next = cut;
+                }
+                while (next < end && !is_space(next[-1])) {
+                        next++;
+                }
+                bands[k] = (struct band){ .ppm = ppm, .start = cut,
+                                          .end = next };
+                cut = next;
+        }
+
+        run_bands(count_p3_chunk, bands, n);
+        size_t total = 0;
+        for (int k = 0; k < n; k++) {
+                bands[k].first_sample = total;
+                total += bands[k].tokens;
+        }
+        if (total < 3 * (size_t)ppm->width * ppm->height) {
+                return false;
+        }
+
+        run_bands(parse_p3_chunk, bands, n);
+        for (int k = 0; k < n; k++) {
+                if (bands[k].bad) {
+                        return false;
+                }
+        }
+        return true;
+}
+
+/********************** read_p6 ***************************
+ * Converts a binary raster in bands of rows.  Returns false
+ * if the raster is short or has a sample over the maxval.
+ *********************************************************/
+static bool read_p6(Pnm_ppm ppm, const char *start, const char *end,
+                    int threads)
+{
+        struct band bands[MAX_THREADS];
+        int bytes = ppm->denominator < 256 ? 1 : 2;
+        if ((size_t)(end - start) <
+            (size_t)ppm->width * ppm->height * 3 * bytes) {
+                return false;
+        }
+        int h = ppm->height;
+        int n = band_count(threads, h);
+        for (int k = 0; k < n; k++) {
+                bands[k] = (struct band){ .ppm = ppm,
+                                          .first = (long)h * k / n,
+                                          .last = (long)h * (k + 1) / n,
+                                          .raw = (const unsigned char *)
+                                                 start,
+                                          .bytes = bytes };
+        }
+        run_bands(read_p6_band, bands, n);
+        for (int k = 0; k < n; k++) {
+                if (bands[k].bad) {
+                        return false;
+                }
+        }
+        return true;
+}
+
+/******************* PPMIO_read_header ******************
+ * Reads a PPM, PGM or PBM header, leaving fp at the first
+ * byte of the raster.
+ *
+ * Parameters:
+ *      FILE *fp: Stream positioned at the start of the image.
+ *      struct PPMIO_header *header: Filled in with the format
+ *                                   ('1' to '6'), size and maxval
+ *                                   (1 for PBM).
+ *
+ * Notes:
+ *      Raises Pnm_Badformat on a malformed header.  Only P3 and
+ *      P6 rasters are read by this module; PGM and PBM rasters
+ *      are read with Graymap_read.
+ *********************************************************/
+void PPMIO_read_header(FILE *fp, struct PPMIO_header *header)
+{
+        assert(fp != NULL && header != NULL);
+        int p = getc(fp), format = getc(fp);
+        if (p != 'P' || format < '1' || format > '6') {
+                RAISE(Pnm_Badformat);
+        }
+        header->format = format;
+        header->width = header_number(fp);
+        header->height = header_number(fp);
+        bool bitmap = format == '1' || format == '4';
+        header->maxval = bitmap ? 1 : header_number(fp);
+        /* exactly one whitespace separates the header from a
+         * binary raster */
+        if (header->maxval == 0 || header->maxval > 65535 ||
+            !is_space(getc(fp))) {
+                RAISE(Pnm_Badformat);
+        }
+}
+
+static Pnm_ppm planar_p3(FILE *fp, const struct PPMIO_header *header,
+                         A2Methods_T methods, int threads);
+
+/******************* PPMIO_read_raster ********************
+ * Reads the raster that follows a header read with
+ * PPMIO_read_header.
+ *
+ * Parameters:
+ *      FILE *fp: Stream positioned at the raster.
+ *      const struct PPMIO_header *header: The image's header.
+ *      A2Methods_T methods: Representation for the pixels.
+ *      int threads: Threads to use, or PPMIO_AUTO.
+ *
+ * Returns:
+ *      Pnm_ppm: The image, to be freed with Pnm_ppmfree.
+ *
+ * Notes:
+ *      Raises Pnm_Badformat on a malformed raster.  The rest of
+ *      the stream is read into memory first; comments are not
+ *      allowed in the raster.  Will CRE if memory allocation
+ *      fails.
+ *********************************************************/
+Pnm_ppm PPMIO_read_raster(FILE *fp, const struct PPMIO_header *header,
+                          A2Methods_T methods, int threads)
+{
+        assert(fp != NULL && header != NULL && methods != NULL);
+        if (header->format != '3' && header->format != '6') {
+                RAISE(Pnm_Badformat);
+        }
+        if (A2Planar_is(methods) && header->format == '3') {
+                return planar_p3(fp, header, methods, threads);
+        }
+        Pnm_ppm ppm;
+        NEW(ppm);
+        assert(ppm != NULL);
+        ppm->width = header->width;
+        ppm->height = header->height;
+        ppm->denominator = header->maxval;
+        ppm->methods = methods;
+        ppm->pixels = methods->new(ppm->width, ppm->height,
+                                   sizeof(struct Pnm_rgb));
+
+        size_t len;
+        char *data = slurp(fp, &len);
+        bool ok = header->format == '6'
+                ? read_p6(ppm, data, data + len, threads)
+                : read_p3(ppm, data, data + len, threads);
+        free(data);
+        if (!ok) {
+                Pnm_ppmfree(&ppm);
+                RAISE(Pnm_Badformat);
+        }
+        return ppm;
+}
+
+/********************** planar_p3 ************************
+ * Reads a P3 raster into a planar image.  The samples of a
+ * pixel may be split between two parsing threads, so the
+ * raster is parsed into plain rows, which are then copied
+ * into the planes.
+ *********************************************************/
+static Pnm_ppm planar_p3(FILE *fp, const struct PPMIO_header *header,
+                         A2Methods_T methods, int threads)
+{
+        Pnm_ppm ppm = PPMIO_read_raster(fp, header, uarray2_methods_plain,
+                                        threads);
+        A2Methods_UArray2 planes = methods->new(ppm->width, ppm->height,
+                                                sizeof(struct Pnm_rgb));
+        for (unsigned j = 0; j < ppm->height; j++) {
+                A2Planar_put_row(planes, j, 0, ppm->width,
+                                 UArray2_row(ppm->pixels, j));
+        }
+        ppm->methods->free(&ppm->pixels);
+        ppm->methods = methods;
+        ppm->pixels = planes;
+        return ppm;
+}
+
+/******************** read_p6_rows ************************
+ * Reads the bytes [offset, offset + n) of each of rows
+ * [y, y + h) of a binary raster into raw, one after the
+ * other.  Regular files are read with pread at computed
+ * offsets, skipping everything else; other streams are read
+ * through, discarding what is not needed.  Returns false if
+ * the raster is short.
+ *********************************************************/
+static bool read_p6_rows(FILE *fp, size_t row_bytes, int y, int h,
+                         size_t offset, size_t n, unsigned char *raw)
+{
+        struct stat st;
+        int fd = fileno(fp);
+        off_t start = ftello(fp);
+        if (fd >= 0 && start >= 0 && fstat(fd, &st) == 0 &&
+            S_ISREG(st.st_mode)) {
+                for (int r = 0; r < h; r++) {
+                        off_t at = start + (off_t)(y + r) * row_bytes +
+                                   offset;
+                        size_t got = 0;
+                        while (got < n) {
+                                ssize_t k = pread(fd, raw + got, n - got,
+                                                  at + got);
+                                if (k < 0 && errno == EINTR) {
+                                        continue;
+                                }
+                                if (k <= 0) {
+                                        return false;
+                                }
+                                got += k;
+                        }
+                        raw += n;
+                }
+                return true;
+        }
+
+        unsigned char *row = malloc(row_bytes + 1);
+        assert(row != NULL);
+        bool ok = true;
+        for (int r = 0; r < y + h && ok; r++) {
+                ok = fread(row, 1, row_bytes, fp) == row_bytes;
+                if (ok && r >= y) {
+                        memcpy(raw, row + offset, n);
+                        raw += n;
+                }
+        }
+        free(row);
+        return ok;
+}
+
+/******************* PPMIO_read_region ********************
+ * Reads only a rectangle of the image whose header has just
+ * been read.
+ *
+ * Parameters:
+ *      FILE *fp: Stream positioned at the raster.
+ *      const struct PPMIO_header *header: The image's header.
+ *      A2Methods_T methods: Representation for the pixels.
+ *      int threads: Threads to use, or PPMIO_AUTO.
+ *      int x, y, w, h: The rectangle, in image coordinates.
+ *
+ * Returns:
+ *      Pnm_ppm: A w by h image of the rectangle's pixels.
+ *
+ * Expects:
+ *      The rectangle is non-empty and inside the image.
+ *
+ * Notes:
+ *      For P6 on a regular file only the rectangle's bytes are
+ *      read, row by row at their offsets; other P6 streams are
+ *      read up to the rectangle's last row.  P3 samples have no
+ *      fixed offsets, so the whole raster is parsed and the
+ *      rectangle copied out.  Raises Pnm_Badformat on a
+ *      malformed or short raster.
+ *********************************************************/
+Pnm_ppm PPMIO_read_region(FILE *fp, const struct PPMIO_header *header,
+                          A2Methods_T methods, int threads,
+                          int x, int y, int w, int h)
+{
+        assert(fp != NULL && header != NULL && methods != NULL);
+        assert(x >= 0 && y >= 0 && w > 0 && h > 0);
+        assert((unsigned)x + w <= header->width &&
+               (unsigned)y + h <= header->height);
+
+        if (header->format != '3' && header->format != '6') {
+                RAISE(Pnm_Badformat);
+        }
+
+        /* P3: parse everything (raising on bad input), then copy */
+        Pnm_ppm whole = NULL;
+        if (header->format == '3') {
+                whole = PPMIO_read_raster(fp, header, uarray2_methods_plain,
+                                          threads);
+        }
+
+        Pnm_ppm ppm;
+        NEW(ppm);
+        assert(ppm != NULL);
+        ppm->width = w;
+        ppm->height = h;
+        ppm->denominator = header->maxval;
+        ppm->methods = methods;
+        ppm->pixels = methods->new(w, h, sizeof(struct Pnm_rgb));
+
+        if (whole != NULL) {
+                for (int j = 0; j < h; j++) {
+                        const struct Pnm_rgb *src =
+                                UArray2_row(whole->pixels, y + j);
+                        for (int i = 0; i < w; i++) {
+                                *(struct Pnm_rgb *)methods->at(ppm->pixels,
+                                                               i, j) =
+                                        src[x + i];
+                        }
+                }
+                Pnm_ppmfree(&whole);
+                return ppm;
+        }
+
+        int bytes = header->maxval < 256 ? 1 : 2;
+        size_t n = (size_t)w * 3 * bytes;
+        unsigned char *raw = malloc(n * h + PAD);
+        assert(raw != NULL);
+        bool ok = read_p6_rows(fp, (size_t)header->width * 3 * bytes, y, h,
+                               (size_t)x * 3 * bytes, n, raw) &&
+                  read_p6(ppm, (char *)raw, (char *)raw + n * h, threads);
+        free(raw);
+        if (!ok) {
+                Pnm_ppmfree(&ppm);
+                RAISE(Pnm_Badformat);
+        }
+        return ppm;
+}
+
+/********************** PPMIO_read ************************
+ * Reads a P3 or P6 image with the given methods: the header
+ * and then the raster, as above.
+ *********************************************************/
+Pnm_ppm PPMIO_read(FILE *fp, A2Methods_T methods, int threads)
+{
+        struct PPMIO_header header;
+        PPMIO_read_header(fp, &header);
+        return PPMIO_read_raster(fp, &header, methods, threads);
+}
+
+/******************** format_number ***********************
+ * Writes v in decimal at out, two digits per table lookup,
+ * and returns the end of the digits.
+ *********************************************************/
+static inline char *format_number(char *out, unsigned v)
+{
+        char digits[10];
+        char *d = digits + sizeof(digits);
+        while (v >= 100) {
+                unsigned q = v / 100;
+                d -= 2;
+                memcpy(d, digit_pairs + 2 * (v - q * 100), 2);
+                v = q;
+        }
+        if (v >= 10) {
+                d -= 2;
+                memcpy(d, digit_pairs + 2 * v, 2);
+        } else {
+                *--d = '0' + v;
+        }
+        size_t n = digits + sizeof(digits) - d;
+        memcpy(out, d, n);
+        return out + n;
+}
+
+/******************* format_width *************************
+ * Number of decimal digits in v.
+ *********************************************************/
+static int format_width(unsigned v)
+{
+        int n = 1;
+        while (v >= 10) {
+                v /= 10;
+                n++;
+        }
+        return n;
+}
+
+/******************** write_band **************************
+ * Formats rows [first, last) into a new buffer.  P3 lines
+ * hold whole pixels and at most LINE_LIMIT characters, and
+ * every row starts a new line; samples are clamped to the
+ * maxval so the buffer size bound holds.
+ *********************************************************/
+static void *write_band(void *cl)
+{
+        struct band *b = cl;
+        Pnm_ppm ppm = b->ppm;
+        int w = ppm->width;
+        unsigned maxval = ppm->denominator;
+        size_t rows = b->last - b->first;
+        int digits = format_width(maxval);
+        size_t per_sample = b->plain ? digits + 1 : (maxval < 256 ? 1 : 2);
+        int per_line = LINE_LIMIT / (3 * (digits + 1));
+        if (per_line < 1) {
+                per_line = 1;
+        }
+
+        b->out = malloc(rows * w * 3 * per_sample + 1);
+        assert(b->out != NULL);
+        struct Pnm_rgb *stage = NULL;
+        if (A2Planar_is(ppm->methods)) {
+                stage = malloc((w + 1) * sizeof(*stage));
+                assert(stage != NULL);
+        }
+        char *o = b->out;
+        for (int j = b->first; j < b->last; j++) {
+                struct Pnm_rgb *row = row_of(ppm, j);
+                if (stage != NULL) {
+                        A2Planar_get_row(ppm->pixels, j, 0, w, stage);
+                        row = stage;
+                }
+                for (int i = 0; i < w; i++) {
+                        const struct Pnm_rgb *px = sample(ppm, row, i, j);
+                        unsigned v[3] = { px->red, px->green, px->blue };
+                        for (int c = 0; c < 3; c++) {
+                                unsigned x = v[c] < maxval ? v[c] : maxval;
+                                if (!b->plain && per_sample == 1) {
+                                        *o++ = x;
+                                } else if (!b->plain) {
+                                        *o++ = x >> 8;
+                                        *o++ = x & 0xff;
+                                } else {
+                                        o = format_number(o, x);
+                                        *o++ = ' ';
+                                }
+                        }
+                        if (b->plain && ((i + 1) % per_line == 0 ||
+                                         i == w - 1)) {
+                                o[-1] = '\n';
+                        }
+                }
+        }
+        free(stage);
+        b->out_len = o - b->out;
+        return NULL;
+}
+
+/********************** write_all *************************
+ * Writes every buffer in iov to fp: with writev on the
+ * underlying descriptor, or with fwrite for streams that
+ * have none (such as counting wrappers).
+ *********************************************************/
+static void write_all(FILE *fp, struct iovec *iov, int count)
+{
+        int fd = fileno(fp);
+        if (fd < 0) {
+                for (int k = 0; k < count; k++) {
+                        size_t n = fwrite(iov[k].iov_base, 1, iov[k].iov_len,
+                                          fp);
+                        assert(n == iov[k].iov_len);
+                }
+                return;
+        }
+
+        fflush(fp);
+        while (count > 0) {
+                ssize_t n = writev(fd, iov, count < IOV_MAX ? count
+                                                            : IOV_MAX);
+                if (n < 0 && errno == EINTR) {
+                        continue;
+                }
+                assert(n >= 0);
+                /* drop the buffers written and trim a partial one */
+                while (count > 0 && (size_t)n >= iov->iov_len) {
+                        n -= iov->iov_len;
+                        iov++;
+                        count--;
+                }
+                if (count > 0) {
+                        iov->iov_base = (char *)iov->iov_base + n;
+                        iov->iov_len -= n;
+                }
+        }
+}
+
+/********************** PPMIO_write ***********************
+ * Writes an image as P6, or as P3 if plain is set.
+ *
+ * Parameters:
+ *      FILE *fp: Output stream.
+ *      Pnm_ppm ppm: Image to write.
+ *      bool plain: Write ASCII (P3) instead of binary (P6).
+ *      int threads: Threads to use, or PPMIO_AUTO.
+ *
+ * Expects:
+ *      fp and ppm must not be NULL.
+ *
+ * Notes:
+ *      Anything already buffered in fp is flushed before the
+ *      image.  Will CRE if memory allocation or the write
+ *      fails.
+ *********************************************************/
+void PPMIO_write(FILE *fp, Pnm_ppm ppm, bool plain, int threads)
+{
+        assert(fp != NULL && ppm != NULL);
+        struct band bands[MAX_THREADS];
+        struct iovec iov[MAX_THREADS + 1];
+        char header[64];
+
+        int h = ppm->height;
+        int n = band_count(threads, h);
+        for (int k = 0; k < n; k++) {
+                bands[k] = (struct band){ .ppm = ppm,
+                                          .first = (long)h * k / n,
+                                          .last = (long)h * (k + 1) / n,
+                                          .plain = plain };
+        }
+        if (A2Planar_is(ppm->methods)) {
+                A2Planar_flush(ppm->pixels);    /* before the threads */
+        }
+        run_bands(write_band, bands, n);
+
+        int len = snprintf(header, sizeof(header), "P%c\n%u %u\n%u\n",
+                           plain ? '3' : '6', ppm->width, ppm->height,
+                           ppm->denominator);
+        iov[0] = (struct iovec){ header, len };
+        for (int k = 0; k < n; k++) {
+                iov[k + 1] = (struct iovec){ bands[k].out,
+                                             bands[k].out_len };
+        }
+        write_all(fp, iov, n + 1);
+        for (int k = 0; k < n; k++) {
+                free(bands[k].out);
+        }
+}
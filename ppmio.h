@@ -0,0 +1,56 @@
+#ifndef PPMIO_INCLUDED
+#define PPMIO_INCLUDED
+/**************************************************************
+ *
+ *      ppmio.h
+ *
+ *      Xiaoyan Xie (xxie05)
+ *      Diwei Chen (dchen22)
+ *
+ *      CS 40 HW03 - locality
+ *
+ *      Multithreaded replacements for Pnm_ppmread and
+ *      Pnm_ppmwrite.  The raster is split into bands that are
+ *      parsed or formatted by separate threads; ASCII (P3)
+ *      samples are converted eight digits at a time with SWAR
+ *      arithmetic, and the formatted bands are handed to the
+ *      kernel with a single writev.
+ *
+ *      Images read here are ordinary Pnm_ppm values: they are
+ *      freed with Pnm_ppmfree and may be written with either
+ *      writer.  Malformed input raises Pnm_Badformat, as
+ *      Pnm_ppmread does.
+ *
+ **************************************************************/
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "a2methods.h"
+#include "pnm.h"
+
+/* thread count meaning "one per online cpu" */
+#define PPMIO_AUTO 0
+
+/* a parsed header; format is the digit after the P: '3' (ASCII)
+ * or '6' (binary) for PPM, '1' or '4' for PBM, '2' or '5' for PGM */
+struct PPMIO_header {
+        char format;
+        unsigned width, height, maxval;
+};
+
+extern Pnm_ppm PPMIO_read(FILE *fp, A2Methods_T methods, int threads);
+
+/* PPMIO_read in two steps, for callers that look at the header
+ * before deciding how to read the raster */
+extern void PPMIO_read_header(FILE *fp, struct PPMIO_header *header);
+extern Pnm_ppm PPMIO_read_raster(FILE *fp,
+                                 const struct PPMIO_header *header,
+                                 A2Methods_T methods, int threads);
+/* reads only the rectangle (x, y, w, h) of the image */
+extern Pnm_ppm PPMIO_read_region(FILE *fp,
+                                 const struct PPMIO_header *header,
+                                 A2Methods_T methods, int threads,
+                                 int x, int y, int w, int h);
+extern void PPMIO_write(FILE *fp, Pnm_ppm ppm, bool plain, int threads);
+
+#endif
@@ -17,12 +17,37 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <limits.h>
+#include <errno.h>
+#include <unistd.h>
+#include <math.h>
+#include <sys/stat.h>
 #include "assert.h"
 #include "a2methods.h"
 #include "a2plain.h"
 #include "a2blocked.h"
 #include "pnm.h"
 #include "cputiming.h"
+#include "perfcounters.h"
+#include "phases.h"
+#include "rotate.h"
+#include "layout.h"
+#include "incremental.h"
+#include "blockhist.h"
+#include "a2prefetch.h"
+#include "a2compressed.h"
+#include "a2planar.h"
+#include "uarray2bext.h"
+#include "ppmio.h"
+#include "pipeline.h"
+#include "tiled.h"
+#include "a2view.h"
+#include "a2parallel.h"
+#include "anglerotate.h"
+#include "scale.h"
+#include "daemon.h"
+#include "shmimage.h"
+#include "graymap.h"
 #include <pnmrdr.h>
 
 
@@ -30,39 +55,102 @@ typedef A2Methods_UArray2 A2;
 typedef A2Methods_T A;
 typedef A2Methods_mapfun Am;
 
-/******************* struct closure *********************
- * Stores the rotated image and methods for mapping over
- * arrays during image rotation.
- * Used to pass necessary data during the rotation process.
+/* a rectangle of cells */
+struct rect {
+        int x, y, w, h;
+};
+
+/******************* struct options *********************
+ * Settings collected from the command line.
  *********************************************************/
-struct closure {
-        A2 rotated_img;
+struct options {
         A methods;
+        Am *map;
+        const char *method_name;
+        int rotation;
+        bool any_angle;                 /* rotate by angle instead */
+        double angle;                   /* degrees, in (0, 360) */
+        enum AngleRotate_filter filter; /* sampling for any_angle */
+        int scale_w, scale_h;           /* -scale size; w -1 if none */
+        enum Scale_filter scale_filter;
+        char *time_file;
+        char *counters_file;
+        char *phases_file;
+        enum Phases_format phases_format;
+        char *histogram_file;
+        int prefetch;                   /* distance, or -1 for none */
+        int compressed;                 /* cache blocks, or -1 for none */
+        int threads;                    /* parallel map, or 0 for none */
+        bool bulk;                      /* Rotate_bulk instead of map */
+        bool gather;                    /* map over the destination */
+        A io_methods;                   /* read/write layout, or NULL */
+        bool planar;                    /* one plane per channel */
+        enum Rotate_stream stream;      /* store kind for -bulk */
+        int io_threads;                 /* PPMIO thread count */
+        bool plain;                     /* write P3 instead of P6 */
+        bool pipeline;                  /* overlap read/rotate/write */
+        bool tiled_in, tiled_out;       /* tiled format instead of PPM */
+        bool shm_in;                    /* input is a shared segment */
+        char *shm_out;                  /* segment to write, or NULL */
+        A2 shm_pixels;                  /* pixels built in shm_out */
+        bool checksums;                 /* -tiled-out block checksums */
+        bool verify;                    /* -tiled-in checksum check */
+        bool view;                      /* rotate as a lazy view */
+        struct rect crop;               /* output window; w 0 if none */
+        char *sidecar;                  /* -incremental block hashes */
+        char *output;                   /* -incremental P6 file */
+        char *input_name;               /* NULL for stdin */
 };
 
 /********************* Function Declarations *********************
  ***************************************************************/
-void ppm_process(A methods, A2 src_array, 
-        Am *map, char *time_file, int degree);
+int ppm_process(struct options *opts, Phases_T phases);
+int pipeline_process(struct options *opts, struct PPMIO_header *header,
+                     FILE *in, Phases_T phases);
 
-void handle_rotate(A2 src_array, A2 rotated_img, A methods,
-        Am *map, FILE *time_file, int degree);
+int gray_process(struct options *opts, struct PPMIO_header *header,
+                 FILE *in, Phases_T phases, const char *progname);
+int incremental_process(struct options *opts, Phases_T phases);
 
-void rotate90(int col, int row, A2 src_array, void *el, void *cl);
-void rotate180(int col, int row, A2 src_array, void *el, void *cl);
-void rotate270(int col, int row, A2 src_array, void *el, void *cl);
+void handle_rotate(A2 src_array, A2 rotated_img, struct options *opts,
+        FILE *time_file, FILE *counters_file, FILE *histogram_file);
+
+static FILE *open_report(char *file_name, const char *mode);
+static int reports_failed(FILE *files[], char *names[], int n);
+static bool same_file(FILE *fp, const char *path);
+static int transform(int argc, char *argv[], FILE *input);
+static void use_prefetch(struct options *opts, const char *progname);
+static void use_compressed(struct options *opts, const char *progname);
+static void use_planar(struct options *opts, const char *progname);
+static void use_parallel(struct options *opts, const char *progname);
+static void phase_begin(Phases_T phases, const char *name);
+static void phase_end(Phases_T phases);
+static void use_methods(A methods);
+static void read_only(A methods, A2 pixels);
+static void copy_region(A methods, struct rect r);
+static struct rect crop_source(struct options *opts, int width, int height,
+                               const char *progname);
+static void write_image(FILE *out, struct options *opts);
+static A2 new_pixels(struct options *opts, int width, int height,
+                     bool final);
+static void view_rotate(struct options *opts, FILE *time_file);
+static void angle_rotate(struct options *opts, FILE *time_file,
+                         Phases_T phases);
+static void scale_image(struct options *opts, int degree, FILE *time_file,
+                        Phases_T phases);
 
 Pnm_ppm image;
 
 /********************** Method Setter Macro ******************
  ***************************************************************/
 #define SET_METHODS(METHODS, MAP, WHAT) do {                    \
-        methods = (METHODS);                                    \
-        assert(methods != NULL);                                \
-        map = methods->MAP;                                     \
-        if (map == NULL) {                                      \
+        opts.methods = (METHODS);                               \
+        assert(opts.methods != NULL);                           \
+        opts.map = opts.methods->MAP;                           \
+        opts.method_name = WHAT;                                \
+        if (opts.map == NULL) {                                 \
                 fprintf(stderr, "%s does not support "          \
-                                WHAT "mapping\n",               \
+                                WHAT " mapping\n",              \
                                 argv[0]);                       \
                 exit(1);                                        \
         }                                                       \
@@ -74,15 +162,33 @@ usage(const char *progname)
         fprintf(stderr, "Usage: %s [-rotate <angle>] "
                         "[-{row,col,block}-major] "
                         "[-time time_file] "
-                        "[filename]\n",
-                        progname);
+                        "[-counters counters_file] "
+                        "[-phases phases_file] "
+                        "[-phases-format {json,csv}] "
+                        "[-block-histogram histogram_file] "
+                        "[-prefetch distance] "
+                        "[-filter {nearest,bilinear}] "
+                        "[-scale w h] [-scale-filter {box,bilinear,lanczos}] "
+                        "[-compressed cache_blocks] [-threads n] "
+                        "[-bulk] [-gather] [-planar] "
+                        "[-stream {auto,on,off}] "
+                        "[-io-threads n] [-io-layout {row,block}] "
+                        "[-plain] [-pipeline] [-view] "
+                        "[-crop x y w h] "
+                        "[-tiled-in [-verify]] [-tiled-out [-checksums]] "
+                        "[-shm-in] [-shm-out segment] "
+                        "[-incremental sidecar output] "
+                        "[filename]\n"
+                        "       %s -daemon socket\n"
+                        "       %s -connect socket [options] [filename]\n",
+                        progname, progname, progname);
         exit(1);
 }
 
 /************************ main **************************
- * Entry point for the image rotation program. Processes
- * command-line arguments, reads a PPM image, applies the 
- * specified rotation, and writes the result.
+ * Entry point for the image rotation program.  Runs one
+ * transform, or with -daemon serves transforms on a Unix
+ * socket, or with -connect hands one to such a server.
  * 
  * Parameters:
  *      int argc: Number of command-line arguments.
@@ -91,25 +197,106 @@ usage(const char *progname)
  * Returns:
  *      int: Exit status of the program (0 on success).
  * 
+ * Notes:
+ *      A -connect request runs with this process's stdin,
+ *      stdout, stderr and working directory.
+ *********************************************************/
+int main(int argc, char *argv[])
+{
+        if (argc > 1 && strcmp(argv[1], "-daemon") == 0) {
+                if (argc != 3) {
+                        usage(argv[0]);
+                }
+                Daemon_serve(argv[2], argv[0], transform);
+                fprintf(stderr, "%s: cannot listen on %s: %s\n", argv[0],
+                        argv[2], strerror(errno));
+                return EXIT_FAILURE;
+        }
+        if (argc > 1 && strcmp(argv[1], "-connect") == 0) {
+                if (argc < 3) {
+                        usage(argv[0]);
+                }
+                int status = Daemon_request(argv[2], argc - 3, argv + 3,
+                                            STDIN_FILENO, STDOUT_FILENO,
+                                            STDERR_FILENO);
+                if (status < 0) {
+                        fprintf(stderr, "%s: request to %s failed\n",
+                                argv[0], argv[2]);
+                        return EXIT_FAILURE;
+                }
+                return status;
+        }
+        return transform(argc, argv, stdin);
+}
+
+/********************** transform *************************
+ * Processes command-line arguments, reads a PPM image,
+ * applies the specified rotation, and writes the result.
+ * 
+ * Parameters:
+ *      int argc: Number of command-line arguments.
+ *      char *argv[]: Array of command-line arguments.
+ *      FILE *input: Read when no file name is given; left
+ *                   open.
+ * 
+ * Returns:
+ *      int: Exit status (0 on success).
+ * 
  * Expects:
  *      argv contains valid arguments.
  * 
  * Notes:
  *      Will print usage and exit if arguments are invalid.
+ *      Run once per request by the -daemon server.
  *********************************************************/
-int main(int argc, char *argv[])
+static int transform(int argc, char *argv[], FILE *input)
 {
-        char *time_file_name = NULL;
-        int   rotation       = 0;
-        int   i;
+        struct options opts = {
+                /* default to UArray2 methods and the best map */
+                .methods = uarray2_methods_plain,
+                .map = NULL,
+                .method_name = "default",
+                .rotation = 0,
+                .any_angle = false,
+                .angle = 0,
+                .filter = ANGLEROTATE_BILINEAR,
+                .scale_w = -1,
+                .scale_h = -1,
+                .scale_filter = SCALE_BILINEAR,
+                .time_file = NULL,
+                .counters_file = NULL,
+                .phases_file = NULL,
+                .phases_format = PHASES_JSON,
+                .histogram_file = NULL,
+                .prefetch = -1,
+                .compressed = -1,
+                .threads = 0,
+                .bulk = false,
+                .gather = false,
+                .io_methods = NULL,
+                .planar = false,
+                .stream = ROTATE_STREAM_AUTO,
+                .io_threads = PPMIO_AUTO,
+                .plain = false,
+                .pipeline = false,
+                .tiled_in = false,
+                .tiled_out = false,
+                .shm_in = false,
+                .shm_out = NULL,
+                .shm_pixels = NULL,
+                .checksums = false,
+                .verify = false,
+                .view = false,
+                .crop = { 0, 0, 0, 0 },
+                .sidecar = NULL,
+                .output = NULL,
+                .input_name = NULL,
+        };
+        int i;
 
-        /* default to UArray2 methods */
-        A methods = uarray2_methods_plain; 
-        assert(methods != NULL);
-
-        /* default to best map */
-        Am *map = methods->map_default;
-        assert(map != NULL);
+        assert(opts.methods != NULL);
+        opts.map = opts.methods->map_default;
+        assert(opts.map != NULL);
 
         for (i = 1; i < argc; i++) {
                 if (strcmp(argv[i], "-row-major") == 0) {
@@ -126,21 +313,208 @@ int main(int argc, char *argv[])
                                 usage(argv[0]);
                         }
                         char *endptr;
-                        rotation = strtol(argv[++i], &endptr, 10);
-                        if (!(rotation == 0 || rotation == 90 ||
-                            rotation == 180 || rotation == 270)) {
-                                fprintf(stderr, 
-                                        "Rotation must be 0, 90 180 or 270\n");
+                        double angle = strtod(argv[++i], &endptr);
+                        if (!(*endptr == '\0') || !isfinite(angle)) {
+                                usage(argv[0]);         /* Not a number */
+                        }
+                        /* right angles keep the exact rotations */
+                        angle = fmod(angle, 360);
+                        if (angle < 0) {
+                                angle += 360;
+                        }
+                        opts.any_angle = fmod(angle, 90) != 0;
+                        opts.angle = opts.any_angle ? angle : 0;
+                        opts.rotation = opts.any_angle ? 0 : (int)angle;
+                } else if (strcmp(argv[i], "-filter") == 0) {
+                        if (!(i + 1 < argc)) {      /* no filter name */
                                 usage(argv[0]);
                         }
-                        if (!(*endptr == '\0')) {    /* Not a number */
+                        i++;
+                        if (strcmp(argv[i], "nearest") == 0) {
+                                opts.filter = ANGLEROTATE_NEAREST;
+                        } else if (strcmp(argv[i], "bilinear") == 0) {
+                                opts.filter = ANGLEROTATE_BILINEAR;
+                        } else {
                                 usage(argv[0]);
                         }
                 } else if (strcmp(argv[i], "-time") == 0) {
                         if (!(i + 1 < argc)) {      /* no time file */
                                 usage(argv[0]);
                         }
-                        time_file_name = argv[++i];
+                        opts.time_file = argv[++i];
+                } else if (strcmp(argv[i], "-counters") == 0) {
+                        if (!(i + 1 < argc)) {      /* no counters file */
+                                usage(argv[0]);
+                        }
+                        opts.counters_file = argv[++i];
+                } else if (strcmp(argv[i], "-phases") == 0) {
+                        if (!(i + 1 < argc)) {      /* no phases file */
+                                usage(argv[0]);
+                        }
+                        opts.phases_file = argv[++i];
+                } else if (strcmp(argv[i], "-phases-format") == 0) {
+                        if (!(i + 1 < argc)) {      /* no format */
+                                usage(argv[0]);
+                        }
+                        i++;
+                        if (strcmp(argv[i], "json") == 0) {
+                                opts.phases_format = PHASES_JSON;
+                        } else if (strcmp(argv[i], "csv") == 0) {
+                                opts.phases_format = PHASES_CSV;
+                        } else {
+                                usage(argv[0]);
+                        }
+                } else if (strcmp(argv[i], "-block-histogram") == 0) {
+                        if (!(i + 1 < argc)) {      /* no histogram file */
+                                usage(argv[0]);
+                        }
+                        opts.histogram_file = argv[++i];
+#ifndef UARRAY2B_HISTOGRAM
+                        fprintf(stderr, "%s: -block-histogram needs a "
+                                "build with HISTOGRAM=1\n", argv[0]);
+                        exit(1);
+#endif
+                } else if (strcmp(argv[i], "-prefetch") == 0) {
+                        if (!(i + 1 < argc)) {      /* no distance */
+                                usage(argv[0]);
+                        }
+                        char *endptr;
+                        opts.prefetch = strtol(argv[++i], &endptr, 10);
+                        if (*endptr != '\0' || opts.prefetch < 0) {
+                                usage(argv[0]);
+                        }
+                } else if (strcmp(argv[i], "-compressed") == 0) {
+                        if (!(i + 1 < argc)) {      /* no cache size */
+                                usage(argv[0]);
+                        }
+                        char *endptr;
+                        opts.compressed = strtol(argv[++i], &endptr, 10);
+                        if (*endptr != '\0' || opts.compressed < 2) {
+                                usage(argv[0]);
+                        }
+                } else if (strcmp(argv[i], "-threads") == 0) {
+                        if (!(i + 1 < argc)) {      /* no thread count */
+                                usage(argv[0]);
+                        }
+                        char *endptr;
+                        opts.threads = strtol(argv[++i], &endptr, 10);
+                        if (*endptr != '\0' || opts.threads < 1) {
+                                usage(argv[0]);
+                        }
+                } else if (strcmp(argv[i], "-bulk") == 0) {
+                        opts.bulk = true;
+                } else if (strcmp(argv[i], "-gather") == 0) {
+                        opts.gather = true;
+                } else if (strcmp(argv[i], "-planar") == 0) {
+                        opts.planar = true;
+                } else if (strcmp(argv[i], "-stream") == 0) {
+                        if (!(i + 1 < argc)) {      /* no mode */
+                                usage(argv[0]);
+                        }
+                        i++;
+                        if (strcmp(argv[i], "auto") == 0) {
+                                opts.stream = ROTATE_STREAM_AUTO;
+                        } else if (strcmp(argv[i], "on") == 0) {
+                                opts.stream = ROTATE_STREAM_ON;
+                        } else if (strcmp(argv[i], "off") == 0) {
+                                opts.stream = ROTATE_STREAM_OFF;
+                        } else {
+                                usage(argv[0]);
+                        }
+                        opts.bulk = true;   /* stores only matter there */
+                } else if (strcmp(argv[i], "-io-threads") == 0) {
+                        if (!(i + 1 < argc)) {      /* no thread count */
+                                usage(argv[0]);
+                        }
+                        char *endptr;
+                        opts.io_threads = strtol(argv[++i], &endptr, 10);
+                        if (*endptr != '\0' || opts.io_threads < 1) {
+                                usage(argv[0]);
+                        }
+                } else if (strcmp(argv[i], "-io-layout") == 0) {
+                        if (!(i + 1 < argc)) {      /* no layout */
+                                usage(argv[0]);
+                        }
+                        i++;
+                        if (strcmp(argv[i], "row") == 0) {
+                                opts.io_methods = uarray2_methods_plain;
+                        } else if (strcmp(argv[i], "block") == 0) {
+                                opts.io_methods = uarray2_methods_blocked;
+                        } else {
+                                usage(argv[0]);
+                        }
+                } else if (strcmp(argv[i], "-plain") == 0) {
+                        opts.plain = true;
+                } else if (strcmp(argv[i], "-pipeline") == 0) {
+                        opts.pipeline = true;
+                } else if (strcmp(argv[i], "-crop") == 0) {
+                        if (!(i + 4 < argc)) {      /* no window */
+                                usage(argv[0]);
+                        }
+                        int *field[4] = { &opts.crop.x, &opts.crop.y,
+                                          &opts.crop.w, &opts.crop.h };
+                        for (int k = 0; k < 4; k++) {
+                                char *endptr;
+                                long v = strtol(argv[++i], &endptr, 10);
+                                if (*endptr != '\0' || v < (k < 2 ? 0 : 1) ||
+                                    v > INT_MAX) {
+                                        usage(argv[0]);
+                                }
+                                *field[k] = v;
+                        }
+                } else if (strcmp(argv[i], "-scale") == 0) {
+                        if (!(i + 2 < argc)) {      /* no size */
+                                usage(argv[0]);
+                        }
+                        int *field[2] = { &opts.scale_w, &opts.scale_h };
+                        for (int k = 0; k < 2; k++) {
+                                char *endptr;
+                                long v = strtol(argv[++i], &endptr, 10);
+                                if (*endptr != '\0' || v < 0 || v > INT_MAX) {
+                                        usage(argv[0]);
+                                }
+                                *field[k] = v;
+                        }
+                        if (opts.scale_w == 0 && opts.scale_h == 0) {
+                                usage(argv[0]);
+                        }
+                } else if (strcmp(argv[i], "-scale-filter") == 0) {
+                        if (!(i + 1 < argc)) {      /* no filter name */
+                                usage(argv[0]);
+                        }
+                        i++;
+                        if (strcmp(argv[i], "box") == 0) {
+                                opts.scale_filter = SCALE_BOX;
+                        } else if (strcmp(argv[i], "bilinear") == 0) {
+                                opts.scale_filter = SCALE_BILINEAR;
+                        } else if (strcmp(argv[i], "lanczos") == 0) {
+                                opts.scale_filter = SCALE_LANCZOS;
+                        } else {
+                                usage(argv[0]);
+                        }
+                } else if (strcmp(argv[i], "-view") == 0) {
+                        opts.view = true;
+                } else if (strcmp(argv[i], "-tiled-in") == 0) {
+                        opts.tiled_in = true;
+                } else if (strcmp(argv[i], "-tiled-out") == 0) {
+                        opts.tiled_out = true;
+                } else if (strcmp(argv[i], "-shm-in") == 0) {
+                        opts.shm_in = true;
+                } else if (strcmp(argv[i], "-shm-out") == 0) {
+                        if (!(i + 1 < argc)) {      /* no segment path */
+                                usage(argv[0]);
+                        }
+                        opts.shm_out = argv[++i];
+                } else if (strcmp(argv[i], "-incremental") == 0) {
+                        if (!(i + 2 < argc)) {      /* no files */
+                                usage(argv[0]);
+                        }
+                        opts.sidecar = argv[++i];
+                        opts.output = argv[++i];
+                } else if (strcmp(argv[i], "-checksums") == 0) {
+                        opts.checksums = true;
+                } else if (strcmp(argv[i], "-verify") == 0) {
+                        opts.verify = true;
                 } else if (*argv[i] == '-') {
                         fprintf(stderr, "%s: unknown option '%s'\n", argv[0],
                                 argv[i]);
@@ -153,233 +527,1187 @@ int main(int argc, char *argv[])
                 }
         }
 
+        if (opts.any_angle && (opts.view || opts.crop.w > 0)) {
+                fprintf(stderr, "%s: -view and -crop need a rotation of "
+                        "0, 90, 180 or 270\n", argv[0]);
+                exit(1);
+        }
+        if (opts.scale_w >= 0 && (opts.view || opts.crop.w > 0)) {
+                fprintf(stderr, "%s: -scale cannot be combined with -view "
+                        "or -crop\n", argv[0]);
+                exit(1);
+        }
+        if ((opts.counters_file != NULL || opts.histogram_file != NULL) &&
+            (opts.view || opts.any_angle || opts.scale_w >= 0)) {
+                fprintf(stderr, "%s: -counters and -block-histogram "
+                        "measure a rotation of 0, 90, 180 or 270 (not "
+                        "-view or -scale)\n", argv[0]);
+                exit(1);
+        }
+        if (opts.gather && (opts.bulk || opts.planar || opts.view ||
+                            opts.any_angle || opts.scale_w >= 0)) {
+                fprintf(stderr, "%s: -gather needs a map rotation of 0, 90, "
+                        "180 or 270 (not -bulk, -stream, -planar, -view "
+                        "or -scale)\n", argv[0]);
+                exit(1);
+        }
+        if (opts.io_methods != NULL &&
+            (opts.view || opts.tiled_in || opts.shm_in ||
+             opts.shm_out != NULL)) {
+                fprintf(stderr, "%s: -io-layout cannot be combined with "
+                        "-view, -tiled-in, -shm-in or -shm-out\n", argv[0]);
+                exit(1);
+        }
+        if (opts.sidecar != NULL &&
+            (opts.any_angle || opts.scale_w >= 0 || opts.view ||
+             opts.crop.w > 0 || opts.plain || opts.tiled_out ||
+             opts.shm_out != NULL)) {
+                fprintf(stderr, "%s: -incremental needs a rotation of 0, "
+                        "90, 180 or 270 written as P6 (not -scale, -view, "
+                        "-crop, -plain, -tiled-out or -shm-out)\n",
+                        argv[0]);
+                exit(1);
+        }
+        if (opts.sidecar != NULL &&
+            (opts.counters_file != NULL || opts.histogram_file != NULL ||
+             opts.gather || opts.bulk || opts.io_methods != NULL ||
+             opts.threads > 0)) {
+                fprintf(stderr, "%s: -incremental rotates with its own "
+                        "kernel (not -counters, -block-histogram, -gather, "
+                        "-bulk, -stream, -io-layout or -threads)\n",
+                        argv[0]);
+                exit(1);
+        }
+        if (opts.gather || opts.io_methods != NULL || opts.sidecar != NULL) {
+                opts.pipeline = false;  /* it reads into the rotation */
+        }
+        if ((opts.shm_in && opts.tiled_in) ||
+            (opts.shm_out != NULL && (opts.tiled_out || opts.plain))) {
+                fprintf(stderr, "%s: a shared segment cannot also be "
+                        "tiled or plain\n", argv[0]);
+                exit(1);
+        }
+        if (opts.prefetch >= 0) {
+                use_prefetch(&opts, argv[0]);
+        }
+        if (opts.compressed >= 0) {
+                use_compressed(&opts, argv[0]);
+        }
+        if (opts.planar) {
+                use_planar(&opts, argv[0]);
+        }
+        if (opts.threads > 0) {
+                use_parallel(&opts, argv[0]);
+        }
+        if (opts.sidecar != NULL &&
+            opts.methods != uarray2_methods_blocked &&
+            opts.methods != uarray2_methods_blocked_prefetch) {
+                fprintf(stderr, "%s: -incremental needs -block-major "
+                        "(without -compressed or -planar)\n", argv[0]);
+                exit(1);
+        }
+
         FILE *fp;
         if (i < argc) {
+                opts.input_name = argv[i];
                 fp = fopen(argv[i], "r");
                 if (fp == NULL) {
                         fprintf(stderr, "Fail to open file.\n");
                         exit(0);
                 }
         } else {
-                fp = stdin;
+                fp = input;
+        }
+        if (opts.shm_in && opts.shm_out != NULL &&
+            same_file(fp, opts.shm_out)) {
+                fprintf(stderr, "%s: -shm-out %s is the input segment\n",
+                        argv[0], opts.shm_out);
+                exit(1);
         }
 
-        image = Pnm_ppmread(fp, methods);
-        assert(image != NULL);
-        ppm_process(methods, image->pixels, map, time_file_name, rotation);
+        Phases_T phases = NULL;
+        FILE *in = fp;
+        if (opts.phases_file != NULL) {
+                phases = Phases_New();
+                in = Phases_count_input(phases, fp);
+        }
 
-        fclose(fp);
-        Pnm_ppmfree(&image);
-        return EXIT_SUCCESS;
+        int status = EXIT_SUCCESS;
+        struct PPMIO_header header;
+        bool mapped_in = opts.tiled_in || opts.shm_in;
+        if (!mapped_in) {
+                PPMIO_read_header(in, &header);
+        }
+        if (!mapped_in && Graymap_format(header.format)) {
+                status = gray_process(&opts, &header, in, phases, argv[0]);
+        } else if (!mapped_in && opts.pipeline && header.format == '6' &&
+            !opts.plain && !opts.tiled_out && opts.crop.w == 0 &&
+            !opts.any_angle && opts.scale_w < 0 && opts.shm_out == NULL &&
+            !opts.view) {
+                status = pipeline_process(&opts, &header, in, phases);
+        } else {
+                A read_methods = opts.io_methods != NULL ? opts.io_methods
+                                                         : opts.methods;
+                phase_begin(phases, "read");
+                if (mapped_in && opts.crop.w > 0) {
+                        image = opts.shm_in ? ShmImage_read(in)
+                                            : Tiled_read(in, opts.verify);
+                        copy_region(opts.methods,
+                                    crop_source(&opts, image->width,
+                                                image->height, argv[0]));
+                } else if (mapped_in) {
+                        image = opts.shm_in ? ShmImage_read(in)
+                                            : Tiled_read(in, opts.verify);
+                        use_methods(opts.methods);
+                } else if (opts.crop.w > 0) {
+                        struct rect r = crop_source(&opts, header.width,
+                                                    header.height, argv[0]);
+                        image = PPMIO_read_region(in, &header, read_methods,
+                                                  opts.io_threads,
+                                                  r.x, r.y, r.w, r.h);
+                } else {
+                        image = PPMIO_read_raster(in, &header, read_methods,
+                                                  opts.io_threads);
+                }
+                assert(image != NULL);
+                phase_end(phases);
+
+                if (image->methods != opts.methods) {   /* -io-layout */
+                        phase_begin(phases, "convert");
+                        use_methods(opts.methods);
+                        phase_end(phases);
+                }
+
+                if (opts.sidecar != NULL) {
+                        status = incremental_process(&opts, phases);
+                } else {
+                        status = ppm_process(&opts, phases);
+                }
+                Pnm_ppmfree(&image);
+        }
+
+        if (in != fp) {
+                fclose(in);
+        }
+        if (fp != input) {
+                fclose(fp);
+        }
+        if (phases != NULL) {
+                Phases_Free(&phases);
+        }
+        return status;
 }
 
 /********************** ppm_process ***********************
  * Processes and rotates a PPM image by a given degree.
- * Driver function for rotations.
+ * Driver function for rotations: allocates the destination,
+ * rotates into it, frees the source and writes the result,
+ * recording each of those as a phase when phases is not NULL.
  * 
  * Parameters:
- *      A methods: 2D array handling methods.
- *      A2 src_array: Source image pixels.
- *      Am *map: Mapping function.
- *      char *time_file: Optional file for timing info.
- *      int degree: Rotation angle (0, 90, 180, 270).
+ *      struct options *opts: Methods, map, rotation and
+ *                            report files to use.
+ *      Phases_T phases: Phase recorder, or NULL.
  * 
  * Returns:
- *      None
+ *      int: EXIT_SUCCESS, or EXIT_FAILURE (with nothing
+ *           written) if a report file cannot be opened.
  * 
  * Expects:
- *      src_array must not be NULL.
+ *      The global image has been read.
  *********************************************************/
-void ppm_process(A methods, A2 src_array, Am *map, char *time_file, int degree)
+int ppm_process(struct options *opts, Phases_T phases)
 {       
-        FILE *fp = NULL;
-        if (!(time_file == NULL)) {
-                fp = fopen(time_file, "w");
-                if (fp == NULL) {
-                        fprintf(stderr, "Fail to open file.\n");
-                        return;
-                }
+        A methods = opts->methods;
+        A2 src_array = image->pixels;
+        int degree = opts->rotation;
+
+        FILE *fp = open_report(opts->time_file, "w");
+        FILE *counters_fp = open_report(opts->counters_file, "w");
+        FILE *phases_fp = open_report(opts->phases_file, "a");
+        FILE *histogram_fp = open_report(opts->histogram_file, "w");
+        if (reports_failed((FILE *[]){ fp, counters_fp, phases_fp,
+                                       histogram_fp },
+                           (char *[]){ opts->time_file,
+                                       opts->counters_file,
+                                       opts->phases_file,
+                                       opts->histogram_file }, 4)) {
+                return EXIT_FAILURE;
         }
 
-        int new_width;
-        int new_height;
+        if (opts->any_angle) {
+                angle_rotate(opts, fp, phases);
+                if (opts->scale_w >= 0) {
+                        scale_image(opts, 0, fp, phases);
+                }
+        } else if (opts->scale_w >= 0) {
+                scale_image(opts, degree, fp, phases);  /* fused */
+        } else if (opts->view && degree != 0) {
+                phase_begin(phases, "rotate");
+                view_rotate(opts, fp);
+                phase_end(phases);
+        } else {
+                int new_width;
+                int new_height;
 
-        /*get new dimention*/
-        if (degree == 90 || degree == 270) {
-                new_width = methods->height(src_array);
-                new_height = methods->width(src_array);
-        } else if (degree == 180 || degree == 0) {
-                new_width = methods->width(src_array);
-                new_height = methods->height(src_array);
-        } 
-        else {/*if no degree is provided*/
-                new_width = methods->width(src_array);
-                new_height = methods->height(src_array);
-        }
-
-        A2 rotated_img = methods->new(new_width, new_height,
-        methods->size(src_array));
-        assert(rotated_img != NULL);
+                /*get new dimention*/
+                Rotate_dimensions(methods, src_array, degree, &new_width,
+                                  &new_height);
+
+                phase_begin(phases, "allocate");
+                A2 rotated_img = new_pixels(opts, new_width, new_height,
+                                            degree != 0);
+                phase_end(phases);
         
-        if (degree == 90 || degree == 180 || degree == 270) {
-                handle_rotate(src_array, rotated_img, methods, map, fp, degree); 
-                
+                if (degree == 90 || degree == 180 || degree == 270) {
+                        phase_begin(phases, "rotate");
+                        handle_rotate(src_array, rotated_img, opts, fp, counters_fp,
+                                      histogram_fp);
+                        phase_end(phases);
+
+                        /*free old image pixels and assign new rotated image */
+                        phase_begin(phases, "free");
+                        methods->free(&image->pixels);
+                        image->pixels = rotated_img;
+                        phase_end(phases);
+                }
+                else {/*if there is no rotation, directly print*/
+                        CPUTime_T timer = CPUTime_New();
+                        CPUTime_Start(timer);
+                        double time_used = CPUTime_Stop(timer);
+                        if (fp != NULL) {
+                                fprintf(fp, "Rotation finished in %.0f nanoseconds\n",
+                                time_used); 
+                        }
+                        CPUTime_Free(&timer);
+                        if (counters_fp != NULL) {
+                                struct PerfCounters_Sample sample;
+                                PerfCounters_T counters = PerfCounters_New();
+                                PerfCounters_Start(counters);
+                                PerfCounters_Stop(counters, &sample);
+                                fprintf(counters_fp, "Rotation 0 counters\n");
+                                PerfCounters_print(counters_fp, &sample, 0);
+                                PerfCounters_Free(&counters);
+                        }
+
+                        phase_begin(phases, "free");
+                        methods->free(&rotated_img);
+                        phase_end(phases);
+                }
+        }
+
+        if (opts->io_methods != NULL && image->methods != opts->io_methods) {
+                phase_begin(phases, "convert");
+                use_methods(opts->io_methods);
+                phase_end(phases);
         }
-        else {/*if there is no rotation, directly print*/
+
+        phase_begin(phases, "write");
+        if (phases != NULL) {
+                FILE *out = Phases_count_output(phases, stdout);
+                write_image(out, opts);
+                fclose(out);
+        } else {
+                write_image(stdout, opts);
+        }
+        fflush(stdout);
+        phase_end(phases);
+
+        if (phases_fp != NULL) {
+                Phases_set_string(phases, "input", opts->input_name == NULL
+                                  ? "-" : opts->input_name);
+                Phases_set_string(phases, "method", opts->method_name);
+                Phases_set_number(phases, "rotation", opts->any_angle
+                                  ? opts->angle : degree);
+                Phases_set_number(phases, "width", image->width);
+                Phases_set_number(phases, "height", image->height);
+                Phases_write(phases, phases_fp, opts->phases_format);
+                fclose(phases_fp);
+        }
+        if (fp != NULL) {
+                fclose(fp);
+        }
+        if (counters_fp != NULL) {
+                fclose(counters_fp);
+        }
+        if (histogram_fp != NULL) {
+                fclose(histogram_fp);
+        }
+        return EXIT_SUCCESS;
+}       
+
+/******************* pipeline_process *********************
+ * Rotates a P6 image with the overlapped read/rotate/write
+ * pipeline (-pipeline), recording the whole run as a single
+ * "pipeline" phase.
+ * 
+ * Parameters:
+ *      struct options *opts: Methods, rotation and report
+ *                            files to use.
+ *      struct PPMIO_header *header: The image's header.
+ *      FILE *in: Input, positioned at the raster.
+ *      Phases_T phases: Phase recorder, or NULL.
+ * 
+ * Returns:
+ *      int: EXIT_SUCCESS, or EXIT_FAILURE (with nothing
+ *           written) if a report file cannot be opened.
+ * 
+ * Notes:
+ *      The map, -bulk, -counters and -block-histogram do not
+ *      apply: each band is decoded straight into the rotated
+ *      destination.  -time reports the busy time of each stage
+ *      as well as the total.
+ *********************************************************/
+int pipeline_process(struct options *opts, struct PPMIO_header *header,
+                     FILE *in, Phases_T phases)
+{
+        FILE *fp = open_report(opts->time_file, "w");
+        FILE *phases_fp = open_report(opts->phases_file, "a");
+        if (reports_failed((FILE *[]){ fp, phases_fp },
+                           (char *[]){ opts->time_file,
+                                       opts->phases_file }, 2)) {
+                return EXIT_FAILURE;
+        }
+
+        struct Pipeline_stats stats;
+        phase_begin(phases, "pipeline");
+        if (phases != NULL) {
+                FILE *out = Phases_count_output(phases, stdout);
+                Pipeline_rotate(in, header, out, opts->methods,
+                                opts->rotation, &stats);
+                fclose(out);
+        } else {
+                Pipeline_rotate(in, header, stdout, opts->methods,
+                                opts->rotation, &stats);
+        }
+        phase_end(phases);
+
+        if (fp != NULL) {
+                fprintf(fp, "Pipeline (%s reader) finished in %.0f "
+                        "nanoseconds: read %.0f, rotate %.0f, write %.0f\n",
+                        stats.reader, stats.total_ns, stats.read_ns,
+                        stats.rotate_ns, stats.write_ns);
+                fclose(fp);
+        }
+        if (phases_fp != NULL) {
+                bool turned = opts->rotation == 90 || opts->rotation == 270;
+                Phases_set_string(phases, "input", opts->input_name == NULL
+                                  ? "-" : opts->input_name);
+                Phases_set_string(phases, "method", opts->method_name);
+                Phases_set_string(phases, "reader", stats.reader);
+                Phases_set_number(phases, "rotation", opts->rotation);
+                Phases_set_number(phases, "width", turned ? header->height
+                                                          : header->width);
+                Phases_set_number(phases, "height", turned ? header->width
+                                                           : header->height);
+                Phases_set_number(phases, "read_busy_ns", stats.read_ns);
+                Phases_set_number(phases, "rotate_busy_ns",
+                                  stats.rotate_ns);
+                Phases_set_number(phases, "write_busy_ns", stats.write_ns);
+                Phases_write(phases, phases_fp, opts->phases_format);
+                fclose(phases_fp);
+        }
+        return EXIT_SUCCESS;
+}
+
+/********************* gray_process ***********************
+ * Rotates a PGM or PBM image in its own compact form (see
+ * graymap.h), recording read, rotate and write phases.
+ * 
+ * Parameters:
+ *      struct options *opts: Rotation, -plain and report
+ *                            files to use.
+ *      struct PPMIO_header *header: The image's header.
+ *      FILE *in: Input, positioned at the raster.
+ *      Phases_T phases: Phase recorder, or NULL.
+ *      const char *progname: For error messages.
+ * 
+ * Returns:
+ *      int: EXIT_SUCCESS, or EXIT_FAILURE (with nothing
+ *           written) if a report file cannot be opened.
+ * 
+ * Notes:
+ *      Exits with an error for options that need colour cells:
+ *      any angle, -scale, -view, -crop, -incremental and the
+ *      tiled and shared formats, and for -counters and
+ *      -block-histogram, which measure the A2 maps.  The layout
+ *      options do not apply.
+ *********************************************************/
+int gray_process(struct options *opts, struct PPMIO_header *header,
+                 FILE *in, Phases_T phases, const char *progname)
+{
+        if (opts->any_angle || opts->scale_w >= 0 || opts->view ||
+            opts->crop.w > 0 || opts->tiled_out || opts->shm_out != NULL ||
+            opts->sidecar != NULL) {
+                fprintf(stderr, "%s: PGM and PBM images support only "
+                        "-rotate 0, 90, 180 or 270\n", progname);
+                exit(1);
+        }
+        if (opts->counters_file != NULL || opts->histogram_file != NULL) {
+                fprintf(stderr, "%s: -counters and -block-histogram "
+                        "measure the A2 maps, which PGM and PBM images "
+                        "do not use\n", progname);
+                exit(1);
+        }
+        FILE *fp = open_report(opts->time_file, "w");
+        FILE *phases_fp = open_report(opts->phases_file, "a");
+        if (reports_failed((FILE *[]){ fp, phases_fp },
+                           (char *[]){ opts->time_file,
+                                       opts->phases_file }, 2)) {
+                return EXIT_FAILURE;
+        }
+
+        phase_begin(phases, "read");
+        Graymap_T graymap = Graymap_read(in, header);
+        phase_end(phases);
+
+        if (opts->rotation != 0) {
+                phase_begin(phases, "rotate");
                 CPUTime_T timer = CPUTime_New();
                 CPUTime_Start(timer);
+                Graymap_T rotated = Graymap_rotate(graymap,
+                                                   opts->rotation);
                 double time_used = CPUTime_Stop(timer);
-                if (time_file != NULL) {
-                        fprintf(fp, "Rotation finished in %.0f nanoseconds\n",
-                        time_used); 
-                }
                 CPUTime_Free(&timer);
+                Graymap_free(&graymap);
+                graymap = rotated;
+                phase_end(phases);
+
+                if (fp != NULL) {
+                        fprintf(fp, "Rotation finished in %.0f "
+                                "nanoseconds\n", time_used);
+                }
+        }
+
+        phase_begin(phases, "write");
+        if (phases != NULL) {
+                FILE *out = Phases_count_output(phases, stdout);
+                Graymap_write(out, graymap, opts->plain);
+                fclose(out);
+        } else {
+                Graymap_write(stdout, graymap, opts->plain);
         }
+        fflush(stdout);
+        phase_end(phases);
 
-        Pnm_ppmwrite(stdout, image);
+        if (phases_fp != NULL) {
+                Phases_set_string(phases, "input", opts->input_name == NULL
+                                  ? "-" : opts->input_name);
+                Phases_set_string(phases, "method", graymap->depth == 1
+                                  ? "bitmap" : "graymap");
+                Phases_set_number(phases, "rotation", opts->rotation);
+                Phases_set_number(phases, "width", graymap->width);
+                Phases_set_number(phases, "height", graymap->height);
+                Phases_write(phases, phases_fp, opts->phases_format);
+                fclose(phases_fp);
+        }
         if (fp != NULL) {
                 fclose(fp);
         }
-}       
+        Graymap_free(&graymap);
+        return EXIT_SUCCESS;
+}
 
-/******************** handle_rotate ***********************
- * Rotates the image and updates its dimensions.
+/****************** incremental_process *******************
+ * Brings the -incremental output up to date with the
+ * rotation of the global image (see incremental.h),
+ * recording it as an update phase.
  * 
  * Parameters:
- *      A2 src_array: Source image pixels.
- *      A2 rotated_img: Destination for rotated image.
- *      A methods: 2D array handling methods.
- *      Am *map: Mapping function.
+ *      struct options *opts: Rotation, sidecar, output and
+ *                            report files to use.
+ *      Phases_T phases: Phase recorder, or NULL.
+ * 
+ * Returns:
+ *      int: EXIT_SUCCESS, or EXIT_FAILURE (with nothing
+ *           written) if a report file cannot be opened.
+ * 
+ * Expects:
+ *      The global image has been read with blocked methods.
+ * 
+ * Notes:
+ *      Nothing is written to stdout.  -time reports the time
+ *      of the whole update and how many blocks were rewritten.
+ *********************************************************/
+int incremental_process(struct options *opts, Phases_T phases)
+{
+        FILE *fp = open_report(opts->time_file, "w");
+        FILE *phases_fp = open_report(opts->phases_file, "a");
+        if (reports_failed((FILE *[]){ fp, phases_fp },
+                           (char *[]){ opts->time_file,
+                                       opts->phases_file }, 2)) {
+                return EXIT_FAILURE;
+        }
+
+        struct Incremental_stats stats;
+        phase_begin(phases, "update");
+        CPUTime_T timer = CPUTime_New();
+        CPUTime_Start(timer);
+        Incremental_rotate(image, opts->rotation, opts->sidecar,
+                           opts->output, opts->io_threads, &stats);
+        double time_used = CPUTime_Stop(timer);
+        CPUTime_Free(&timer);
+        phase_end(phases);
+
+        if (fp != NULL) {
+                fprintf(fp, "Rotation finished in %.0f nanoseconds\n",
+                        time_used);
+                fprintf(fp, "Incremental update: %ld of %ld blocks "
+                        "rewritten%s\n", stats.changed, stats.blocks,
+                        stats.full ? " (full rewrite)" : "");
+                fclose(fp);
+        }
+        if (phases_fp != NULL) {
+                Phases_set_string(phases, "input", opts->input_name == NULL
+                                  ? "-" : opts->input_name);
+                Phases_set_string(phases, "method", opts->method_name);
+                Phases_set_number(phases, "rotation", opts->rotation);
+                Phases_set_number(phases, "width", image->width);
+                Phases_set_number(phases, "height", image->height);
+                Phases_set_number(phases, "blocks_rewritten",
+                                  stats.changed);
+                Phases_write(phases, phases_fp, opts->phases_format);
+                fclose(phases_fp);
+        }
+        return EXIT_SUCCESS;
+}
+
+/********************** view_rotate ***********************
+ * Rotates the global image by replacing its pixels with a
+ * lazy view of them (see a2view.h); nothing is copied until
+ * a cell of the view is reached through at().
+ * 
+ * Parameters:
+ *      struct options *opts: Rotation to apply.
  *      FILE *time_file: Optional file for timing info.
- *      int degree: Rotation angle (90, 180, 270).
  * 
  * Returns:
  *      None
  * 
  * Expects:
- *      src_array and rotated_img must not be NULL.
+ *      opts->rotation is 90, 180 or 270.
+ * 
+ * Notes:
+ *      The view owns the original pixels, which are freed with
+ *      it.  The writer reads views without copying tiles.
  *********************************************************/
-void handle_rotate(A2 src_array, A2 rotated_img, A methods, Am *map, FILE *time_file, int degree)
-{       
-        struct closure *new_cl = malloc(sizeof(struct closure)); 
-        assert(new_cl != NULL);
-        new_cl->methods = methods;
-        new_cl->rotated_img = rotated_img;
-
+static void view_rotate(struct options *opts, FILE *time_file)
+{
+        enum A2View_orientation orientation =
+                opts->rotation == 90  ? A2VIEW_ROTATE_90 :
+                opts->rotation == 180 ? A2VIEW_ROTATE_180
+                                      : A2VIEW_ROTATE_270;
         CPUTime_T timer = CPUTime_New();
         CPUTime_Start(timer);
+        image->pixels = A2View_new(image->methods, image->pixels,
+                                   orientation, true);
+        image->methods = uarray2_methods_view;
+        double time_used = CPUTime_Stop(timer);
 
-        /*call map function and roate with apply functions */
-        if (degree == 90) {
-                map(src_array, rotate90, new_cl);
-        } else if (degree == 180) {
-                map(src_array, rotate180, new_cl);
-        } else if (degree == 270) {
-                map(src_array, rotate270, new_cl);
-        } 
-        
-        /*update the image dimensions if rotation is 90 or 270 */
-        if (degree == 90 || degree == 270) {
-                image->height = methods->height(new_cl->rotated_img);
-                image->width = methods->width(new_cl->rotated_img);
+        image->width = uarray2_methods_view->width(image->pixels);
+        image->height = uarray2_methods_view->height(image->pixels);
+        if (time_file != NULL) {
+                fprintf(time_file, "Rotation finished in %.0f nanoseconds\n",
+                        time_used);
         }
+        CPUTime_Free(&timer);
+}
 
-        /*free old image pixels and assign new rotated image */
-        methods->free(&image->pixels);
-        image->pixels = new_cl->rotated_img;
+/********************** angle_rotate **********************
+ * Rotates the global image by opts->angle degrees into a
+ * new array the size of the rotated bounding box, then
+ * frees the source.  Corners left uncovered are black.
+ * 
+ * Parameters:
+ *      struct options *opts: Methods, angle, filter and
+ *                            thread count to use.
+ *      FILE *time_file: Optional file for timing info.
+ *      Phases_T phases: Phase recorder, or NULL.
+ * 
+ * Returns:
+ *      None
+ * 
+ * Notes:
+ *      With -threads the destination tiles are shared out
+ *      over the parallel executor.  Only the resampling is
+ *      timed.
+ *********************************************************/
+static void angle_rotate(struct options *opts, FILE *time_file,
+                         Phases_T phases)
+{
+        A methods = opts->methods;
+        int width, height;
+        AngleRotate_dimensions(image->width, image->height, opts->angle,
+                               &width, &height);
 
+        phase_begin(phases, "allocate");
+        A2 rotated_img = new_pixels(opts, width, height,
+                                    opts->scale_w < 0);
+        phase_end(phases);
+
+        phase_begin(phases, "rotate");
+        CPUTime_T timer = CPUTime_New();
+        CPUTime_Start(timer);
+        AngleRotate_run(methods, image->pixels, rotated_img, opts->angle,
+                        opts->filter, (struct Pnm_rgb){ 0, 0, 0 },
+                        opts->threads > 0);
         double time_used = CPUTime_Stop(timer);
+        CPUTime_Free(&timer);
+        phase_end(phases);
+
+        phase_begin(phases, "free");
+        methods->free(&image->pixels);
+        image->pixels = rotated_img;
+        image->width = width;
+        image->height = height;
+        phase_end(phases);
+
         if (time_file != NULL) {
                 fprintf(time_file, "Rotation finished in %.0f nanoseconds\n",
-                time_used); 
+                        time_used);
         }
-        
+}
+
+/********************** scale_image ***********************
+ * Replaces the global image with a resized copy of it,
+ * rotated by degree on the way (see scale.h), so that the
+ * full-size rotated image is never allocated.
+ * 
+ * Parameters:
+ *      struct options *opts: Methods, -scale size and filter.
+ *      int degree: Rotation to apply first (0, 90, 180, 270).
+ *      FILE *time_file: Optional file for timing info.
+ *      Phases_T phases: Phase recorder, or NULL.
+ * 
+ * Returns:
+ *      None
+ * 
+ * Notes:
+ *      A size of 0 on one side keeps the aspect ratio of the
+ *      rotated image.  Exits on an empty image.
+ *********************************************************/
+static void scale_image(struct options *opts, int degree, FILE *time_file,
+                        Phases_T phases)
+{
+        A methods = opts->methods;
+        bool transposed = degree == 90 || degree == 270;
+        int rotated_w = transposed ? image->height : image->width;
+        int rotated_h = transposed ? image->width : image->height;
+        if (rotated_w == 0 || rotated_h == 0) {
+                fprintf(stderr, "Cannot scale an empty image\n");
+                exit(1);
+        }
+        int width = opts->scale_w, height = opts->scale_h;
+        if (width == 0) {
+                width = lround((double)rotated_w * height / rotated_h);
+                width = width < 1 ? 1 : width;
+        } else if (height == 0) {
+                height = lround((double)rotated_h * width / rotated_w);
+                height = height < 1 ? 1 : height;
+        }
+
+        phase_begin(phases, "allocate");
+        A2 scaled = new_pixels(opts, width, height, true);
+        phase_end(phases);
+
+        phase_begin(phases, "scale");
+        CPUTime_T timer = CPUTime_New();
+        CPUTime_Start(timer);
+        Scale_run(methods, image->pixels, degree, scaled,
+                  opts->scale_filter, image->denominator);
+        double time_used = CPUTime_Stop(timer);
         CPUTime_Free(&timer);
-        free(new_cl);
+        phase_end(phases);
+
+        phase_begin(phases, "free");
+        methods->free(&image->pixels);
+        image->pixels = scaled;
+        image->width = width;
+        image->height = height;
+        phase_end(phases);
+
+        if (time_file != NULL) {
+                fprintf(time_file, "Scale finished in %.0f nanoseconds\n",
+                        time_used);
+        }
 }
 
-/********************** rotate90 *************************
- * Rotates the image by 90 degrees.
+/********************** new_pixels ************************
+ * Allocates the pixels of a new image with opts->methods.
+ * With -shm-out the final image is built straight in the
+ * output segment, which makes writing it free.
  * 
  * Parameters:
- *      int col: Column index.
- *      int row: Row index.
- *      A2 src_array: Source image pixels.
- *      void *el: element (Current pixel).
- *      void *cl: Closure for rotated image and methods.
+ *      struct options *opts: Methods and -shm-out path.
+ *      int width, int height: Size of the new image.
+ *      bool final: The new image is the one written out.
+ * 
+ * Returns:
+ *      A2: The new pixels, all zero.
+ *********************************************************/
+static A2 new_pixels(struct options *opts, int width, int height,
+                     bool final)
+{
+        A2 pixels = NULL;
+        if (final && opts->shm_out != NULL) {
+                pixels = ShmImage_new(opts->shm_out, opts->methods, width,
+                                      height, image->denominator);
+                opts->shm_pixels = pixels;
+        }
+        if (pixels == NULL) {
+                pixels = opts->methods->new(width, height,
+                                            sizeof(struct Pnm_rgb));
+        }
+        assert(pixels != NULL);
+        return pixels;
+}
+
+/********************** write_image ***********************
+ * Writes the global image as PPM (P6, or P3 with -plain),
+ * with -tiled-out in the tiled format, or with -shm-out as
+ * a shared segment (already done if it was built there).
+ *********************************************************/
+static void write_image(FILE *out, struct options *opts)
+{
+        read_only(image->methods, image->pixels);
+        if (opts->shm_out != NULL) {
+                if (image->pixels != opts->shm_pixels) {
+                        ShmImage_write(opts->shm_out, image);
+                }
+        } else if (opts->tiled_out) {
+                Tiled_write(out, image, opts->checksums);
+        } else {
+                PPMIO_write(out, image, opts->plain, opts->io_threads);
+        }
+}
+
+/* from here on pixels are only read: blocks of a compressed
+ * array then leave its cache without being encoded again */
+static void read_only(A methods, A2 pixels)
+{
+        if (methods == uarray2_methods_blocked_compressed) {
+                UArray2b_set_writable(pixels, false);
+        }
+}
+
+/********************** use_methods ***********************
+ * Moves the global image into the representation used by
+ * methods.  Tiled input is always blocked and shared
+ * segments are plain or blocked; either is used in place by
+ * the matching tables and converted (see layout.h) for the
+ * others, as are images read in the -io-layout.
+ *********************************************************/
+static void use_methods(A methods)
+{
+        A from = image->methods;
+        if (methods == from) {
+                return;
+        }
+        if (from == uarray2_methods_blocked &&
+            methods == uarray2_methods_blocked_prefetch) {
+                image->methods = methods;       /* same UArray2b */
+                return;
+        }
+        if (from == uarray2_methods_plain &&
+            methods == uarray2_methods_plain_prefetch) {
+                image->methods = methods;       /* same UArray2 */
+                return;
+        }
+        copy_region(methods, (struct rect){ 0, 0, image->width,
+                                            image->height });
+}
+
+/********************** copy_region ***********************
+ * Replaces the global image with a copy of one rectangle of
+ * it, made with methods.
+ *********************************************************/
+static void copy_region(A methods, struct rect r)
+{
+        A from = image->methods;
+        A2 copy = methods->new(r.w, r.h, sizeof(struct Pnm_rgb));
+        Layout_copy(from, image->pixels, r.x, r.y, methods, copy);
+        from->free(&image->pixels);
+        image->pixels = copy;
+        image->methods = methods;
+        image->width = r.w;
+        image->height = r.h;
+}
+
+/********************** crop_source ***********************
+ * Maps the -crop window, which is given in output (rotated)
+ * coordinates, back onto a width x height source image:
+ * rotating the returned source rectangle gives exactly the
+ * window.
+ * 
+ * Parameters:
+ *      struct options *opts: Window and rotation.
+ *      int width, height: Size of the source image.
+ *      const char *progname: Program name for error messages.
+ * 
+ * Returns:
+ *      struct rect: The source rectangle.
+ * 
+ * Notes:
+ *      Exits with an error if the window is not inside the
+ *      rotated image.
+ *********************************************************/
+static struct rect crop_source(struct options *opts, int width, int height,
+                               const char *progname)
+{
+        struct rect c = opts->crop;
+        int degree = opts->rotation;
+        int out_w = degree == 90 || degree == 270 ? height : width;
+        int out_h = degree == 90 || degree == 270 ? width : height;
+        if (c.x > out_w - c.w || c.y > out_h - c.h) {
+                fprintf(stderr, "%s: crop window %dx%d+%d+%d is outside "
+                        "the %dx%d output\n", progname, c.w, c.h, c.x, c.y,
+                        out_w, out_h);
+                exit(1);
+        }
+        switch (degree) {
+        case 90:                /* out (i, j) is source (j, h - 1 - i) */
+                return (struct rect){ c.y, height - c.x - c.w, c.h, c.w };
+        case 180:
+                return (struct rect){ width - c.x - c.w,
+                                      height - c.y - c.h, c.w, c.h };
+        case 270:               /* out (i, j) is source (w - 1 - j, i) */
+                return (struct rect){ width - c.y - c.h, c.x, c.h, c.w };
+        default:
+                return c;
+        }
+}
+
+/********************** use_prefetch **********************
+ * Switches the selected traversal to its software-prefetching
+ * variant with the requested distance (rows ahead for
+ * -col-major, blocks ahead for -block-major).
+ * 
+ * Parameters:
+ *      struct options *opts: Parsed options; methods and map
+ *                            are replaced.
+ *      const char *progname: Program name for error messages.
  * 
  * Returns:
  *      None
  * 
- * Expects:
- *      src_array and closure must not be NULL.
+ * Notes:
+ *      Exits with an error for traversals that have no
+ *      prefetching variant (row-major is sequential already).
+ *********************************************************/
+static void use_prefetch(struct options *opts, const char *progname)
+{
+        if (opts->methods == uarray2_methods_plain &&
+            opts->map == uarray2_methods_plain->map_col_major) {
+                A2Prefetch_set_row_distance(opts->prefetch);
+                opts->methods = uarray2_methods_plain_prefetch;
+                opts->map = opts->methods->map_col_major;
+        } else if (opts->methods == uarray2_methods_blocked) {
+                A2Prefetch_set_block_distance(opts->prefetch);
+                opts->methods = uarray2_methods_blocked_prefetch;
+                opts->map = opts->methods->map_block_major;
+        } else {
+                fprintf(stderr, "%s: -prefetch needs -col-major or "
+                        "-block-major\n", progname);
+                exit(1);
+        }
+}
+
+/********************** open_report ***********************
+ * Opens an optional report file.
+ * 
+ * Parameters:
+ *      char *file_name: Name of the file, or NULL.
+ *      const char *mode: fopen mode ("w" or "a").
+ * 
+ * Returns:
+ *      FILE *: The opened file, or NULL if file_name is NULL or
+ *              the file cannot be opened.
  *********************************************************/
-void rotate90(int col, int row, A2 src_array, void *el, void *cl)
+static FILE *open_report(char *file_name, const char *mode)
 {
-        struct closure *new_cl = cl;
+        if (file_name == NULL) {
+                return NULL;
+        }
+        return fopen(file_name, mode);
+}
+
+/******************** reports_failed **********************
+ * Checks the report files opened with open_report.
+ * 
+ * Parameters:
+ *      FILE *files[]: The opened files (NULL if not asked for).
+ *      char *names[]: Their names (NULL if not asked for).
+ *      int n: Number of files.
+ * 
+ * Returns:
+ *      int: 0 if every requested file is open; otherwise 1,
+ *           after reporting the failure and closing the ones
+ *           that did open.
+ *********************************************************/
+static int reports_failed(FILE *files[], char *names[], int n)
+{
+        bool failed = false;
+        for (int k = 0; k < n; k++) {
+                failed |= names[k] != NULL && files[k] == NULL;
+        }
+        if (!failed) {
+                return 0;
+        }
+        fprintf(stderr, "Fail to open file.\n");
+        for (int k = 0; k < n; k++) {
+                if (files[k] != NULL) {
+                        fclose(files[k]);
+                }
+        }
+        return 1;
+}
 
-        A2 rotated_img = new_cl->rotated_img;
-        A new_methods = new_cl->methods;
+/* true if path names the file open as fp; writing a shared
+ * segment over the one being read would truncate it first */
+static bool same_file(FILE *fp, const char *path)
+{
+        struct stat a, b;
+        return fstat(fileno(fp), &a) == 0 && stat(path, &b) == 0 &&
+               a.st_dev == b.st_dev && a.st_ino == b.st_ino;
+}
 
-        int height = new_methods->height(src_array);
-        *(struct Pnm_rgb *)new_methods->
-        at(rotated_img, height - row - 1, col) = *(struct Pnm_rgb *)el;
+/********************* use_compressed *********************
+ * Switches -block-major to arrays whose blocks are kept
+ * compressed, with the requested number of blocks cached.
+ * 
+ * Parameters:
+ *      struct options *opts: Parsed options; methods and map
+ *                            are replaced, and I/O is made
+ *                            single-threaded.
+ *      const char *progname: Program name for error messages.
+ * 
+ * Returns:
+ *      None
+ * 
+ * Notes:
+ *      Exits with an error for other traversals.  The block
+ *      cache is not thread-safe, so the image is read and
+ *      written by one thread and -pipeline is ignored.
+ *********************************************************/
+static void use_compressed(struct options *opts, const char *progname)
+{
+        if (opts->methods != uarray2_methods_blocked) {
+                fprintf(stderr, "%s: -compressed needs -block-major "
+                        "(without -prefetch)\n", progname);
+                exit(1);
+        }
+        A2Compressed_set_cache_blocks(opts->compressed);
+        opts->methods = uarray2_methods_blocked_compressed;
+        opts->map = opts->methods->map_block_major;
+        opts->io_threads = 1;
+        opts->pipeline = false;
 }
 
-/********************** rotate180 ************************
- * Rotates the image by 180 degrees.
+/*********************** use_planar ***********************
+ * Switches the selected methods to planar storage with the
+ * same geometry (see a2planar.h): rows for -row-major and
+ * -col-major, blocks for -block-major.
  * 
  * Parameters:
- *      int col: Column index.
- *      int row: Row index.
- *      A2 src_array: Source image pixels.
- *      void *el: element (Current pixel).
- *      void *cl: Closure for rotated image and methods.
+ *      struct options *opts: Parsed options; methods and map
+ *                            are replaced.
+ *      const char *progname: Program name for error messages.
  * 
  * Returns:
  *      None
  * 
- * Expects:
- *      src_array and closure must not be NULL.
+ * Notes:
+ *      Rotation goes through Rotate_bulk, which turns each
+ *      plane on its own; the traversal then only matters to
+ *      the other transforms.  The pipeline needs at() from
+ *      several threads, so it is turned off, and so are the
+ *      I/O threads for -view, whose writer reads through at().
+ *      Exits with an error with -prefetch or -compressed.
+ *********************************************************/
+static void use_planar(struct options *opts, const char *progname)
+{
+        A from = opts->methods;
+        if (from == uarray2_methods_plain) {
+                opts->methods = uarray2_methods_planar;
+                opts->map = opts->map == from->map_col_major
+                          ? opts->methods->map_col_major
+                          : opts->methods->map_row_major;
+        } else if (from == uarray2_methods_blocked) {
+                opts->methods = uarray2_methods_planar_blocked;
+                opts->map = opts->methods->map_block_major;
+        } else {
+                fprintf(stderr, "%s: -planar cannot be combined with "
+                        "-prefetch or -compressed\n", progname);
+                exit(1);
+        }
+        opts->bulk = true;
+        opts->pipeline = false;
+        if (opts->view) {
+                opts->io_threads = 1;
+        }
+}
+
+/********************** use_parallel **********************
+ * Switches the selected traversal to its parallel map (see
+ * a2parallel.h), run by a pool of opts->threads threads.
+ * 
+ * Parameters:
+ *      struct options *opts: Parsed options; map is replaced.
+ *      const char *progname: Program name for error messages.
+ * 
+ * Returns:
+ *      None
+ * 
+ * Notes:
+ *      The rotation apply functions write one distinct
+ *      destination cell each, so they meet the parallel maps'
+ *      contract.  Exits with an error for methods that have no
+ *      parallel maps (-compressed, -planar).  Prefetching maps lose
+ *      their prefetches.
  *********************************************************/
-void rotate180(int col, int row, A2 src_array, void *el, void *cl)
+static void use_parallel(struct options *opts, const char *progname)
 {
-        struct closure *new_cl = cl;
+        A2PMethods_T pmethods = A2Parallel_methods(opts->methods);
+        if (pmethods == NULL) {
+                fprintf(stderr, "%s: -threads is not supported with "
+                        "-compressed or -planar\n", progname);
+                exit(1);
+        }
+        A2Parallel_set_threads(opts->threads);
+        if (opts->map == opts->methods->map_row_major) {
+                opts->map = pmethods->pmap_row_major;
+        } else if (opts->map == opts->methods->map_col_major) {
+                opts->map = pmethods->pmap_col_major;
+        } else {
+                opts->map = pmethods->pmap_block_major;
+        }
+        assert(opts->map != NULL);
+}
 
-        A2 rotated_img = new_cl->rotated_img;
-        A new_methods = new_cl->methods;
+/****************** phase_begin / phase_end ***************
+ * Start and stop a phase on an optional phase recorder;
+ * both do nothing when phases is NULL.
+ *********************************************************/
+static void phase_begin(Phases_T phases, const char *name)
+{
+        if (phases != NULL) {
+                Phases_begin(phases, name);
+        }
+}
 
-        int height = new_methods->height(src_array);
-        int width = new_methods->width(src_array);
-        *(struct Pnm_rgb *)new_methods->at(rotated_img, width - col - 1, 
-                height - row - 1) = *(struct Pnm_rgb *)el;
+static void phase_end(Phases_T phases)
+{
+        if (phases != NULL) {
+                Phases_end(phases);
+        }
 }
 
-/********************** rotate270 ************************
- * Rotates the image by 270 degrees.
+/******************** handle_rotate ***********************
+ * Rotates the image and updates its dimensions.
  * 
  * Parameters:
- *      int col: Column index.
- *      int row: Row index.
  *      A2 src_array: Source image pixels.
- *      void *el: element (Current pixel).
- *      void *cl: Closure for rotated image and methods.
+ *      A2 rotated_img: Destination for rotated image.
+ *      struct options *opts: Methods, map and rotation to use.
+ *      FILE *time_file: Optional file for timing info.
+ *      FILE *counters_file: Optional file for hardware counters.
+ *      FILE *histogram_file: Optional file for the per-block time
+ *                            histogram (HISTOGRAM=1 builds only).
  * 
  * Returns:
  *      None
  * 
  * Expects:
- *      src_array and closure must not be NULL.
+ *      src_array and rotated_img must not be NULL.
+ *      opts->rotation is 90, 180 or 270.
+ *
+ * Notes:
+ *      Only the map (over the source, or over the destination
+ *      with -gather) is timed; the caller frees the source
+ *      afterwards.  Hardware counters bracket the
+ *      interval timed for -time; counts are also reported per
+ *      source pixel.
  *********************************************************/
-void rotate270(int col, int row, A2 src_array, void *el, void *cl)
-{
-        struct closure *new_cl = cl;
+void handle_rotate(A2 src_array, A2 rotated_img, struct options *opts,
+                   FILE *time_file, FILE *counters_file,
+                   FILE *histogram_file)
+{       
+        A methods = opts->methods;
+        int degree = opts->rotation;
 
-        A2 rotated_img = new_cl->rotated_img;
-        A new_methods = new_cl->methods;
+#ifdef UARRAY2B_HISTOGRAM
+        BlockHist_T hist = NULL;
+        if (histogram_file != NULL) {
+                hist = BlockHist_New();
+                UArray2b_set_histogram(hist);
+        }
+#else
+        (void)histogram_file;
+#endif
 
-        int width = new_methods->width(src_array);
-        *(struct Pnm_rgb *)new_methods->
-        at(rotated_img, row, width - col - 1) = *(struct Pnm_rgb *)el;
-}
+        double pixels = (double)methods->width(src_array) *
+                        methods->height(src_array);
+        read_only(methods, src_array);
+        PerfCounters_T counters = NULL;
+        if (counters_file != NULL) {
+                counters = PerfCounters_New();
+                PerfCounters_Start(counters);
+        }
+
+        CPUTime_T timer = CPUTime_New();
+        CPUTime_Start(timer);
+
+        /*call map function and roate with apply functions, or copy
+         * with the bulk kernels when asked and supported */
+        if (opts->gather) {
+                Rotate_gather(opts->map, methods, src_array, rotated_img,
+                              degree);
+        } else if (!opts->bulk || !Rotate_bulk(methods, src_array,
+                                               rotated_img, degree,
+                                               opts->stream)) {
+                Rotate_map(opts->map, methods, src_array, rotated_img,
+                           degree);
+        }
+
+        double time_used = CPUTime_Stop(timer);
+#ifdef UARRAY2B_HISTOGRAM
+        if (hist != NULL) {
+                UArray2b_set_histogram(NULL);
+                fprintf(histogram_file, "Rotation %d block times\n", degree);
+                if (BlockHist_count(hist) == 0) {
+                        fprintf(histogram_file, "no blocks recorded "
+                                "(use -block-major)\n");
+                } else {
+                        BlockHist_print(histogram_file, hist);
+                }
+                BlockHist_Free(&hist);
+        }
+#endif
+        if (counters != NULL) {
+                struct PerfCounters_Sample sample;
+                PerfCounters_Stop(counters, &sample);
+                fprintf(counters_file, "Rotation %d counters "
+                        "(%.0f pixels)\n", degree, pixels);
+                PerfCounters_print(counters_file, &sample, pixels);
+                PerfCounters_Free(&counters);
+        }
+        
+        /*update the image dimensions if rotation is 90 or 270 */
+        if (degree == 90 || degree == 270) {
+                image->height = methods->height(rotated_img);
+                image->width = methods->width(rotated_img);
+        }
 
+        if (time_file != NULL) {
+                fprintf(time_file, "Rotation finished in %.0f nanoseconds\n",
+                time_used); 
+                if (methods == uarray2_methods_blocked_compressed) {
+                        fprintf(time_file, "Compressed storage: %ld bytes "
+                                "(source), %ld bytes (rotated)\n",
+                                UArray2b_footprint(src_array),
+                                UArray2b_footprint(rotated_img));
+                }
+        }
+        
+        CPUTime_Free(&timer);
+}
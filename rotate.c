@@ -0,0 +1,485 @@
+/**************************************************************
+ *
+ *      rotate.c
+ *
+ *      Xiaoyan Xie (xxie05)
+ *      Diwei Chen (dchen22)
+ *
+ *      CS 40 HW03 - locality
+ *
+ *      This file implements the 90, 180 and 270 degree rotations
+ *      as apply functions over the source image (scatter) or over
+ *      the destination (gather), plus the helpers that size the
+ *      destination and drive the map.
+ *
+ **************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "assert.h"
+#include "a2methods.h"
+#include "a2plain.h"
+#include "a2blocked.h"
+#include "a2prefetch.h"
+#include "a2planar.h"
+#include "uarray2ext.h"
+#include "uarray2bext.h"
+#include "pnm.h"
+#include "rotate.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+typedef A2Methods_UArray2 A2;
+typedef A2Methods_T A;
+
+/* side of the square destination tiles used by 90/270 bulk rotation */
+#define TILE 64
+
+/* used when the cache size cannot be queried */
+#define DEFAULT_LLC_BYTES (8L * 1024 * 1024)
+
+/****************** Rotate_dimensions *********************
+ * Computes the dimensions of the image rotated by degree.
+ * 
+ * Parameters:
+ *      A methods: 2D array handling methods.
+ *      A2 src: Source image pixels.
+ *      int degree: Rotation angle (0, 90, 180, 270).
+ *      int *width, int *height: Set to the rotated dimensions.
+ * 
+ * Returns:
+ *      None
+ *********************************************************/
+void Rotate_dimensions(A methods, A2 src, int degree, int *width,
+                       int *height)
+{
+        assert(methods != NULL && src != NULL);
+        assert(width != NULL && height != NULL);
+
+        if (degree == 90 || degree == 270) {
+                *width = methods->height(src);
+                *height = methods->width(src);
+        } else {
+                *width = methods->width(src);
+                *height = methods->height(src);
+        }
+}
+
+/********************** Rotate_map ************************
+ * Rotates src into dst by mapping the matching rotation
+ * over src with the given map function.
+ * 
+ * Parameters:
+ *      A2Methods_mapfun *map: Traversal over src.
+ *      A methods: Methods for both src and dst.
+ *      A2 src: Source image pixels.
+ *      A2 dst: Destination, already sized by Rotate_dimensions.
+ *      int degree: Rotation angle (90, 180, 270).
+ * 
+ * Returns:
+ *      None
+ * 
+ * Expects:
+ *      map, methods, src and dst must not be NULL.
+ *********************************************************/
+void Rotate_map(A2Methods_mapfun *map, A methods, A2 src, A2 dst,
+                int degree)
+{
+        assert(map != NULL && methods != NULL);
+        assert(src != NULL && dst != NULL);
+
+        struct rotate_closure cl = { dst, methods };
+
+        if (degree == 90) {
+                map(src, rotate90, &cl);
+        } else if (degree == 180) {
+                map(src, rotate180, &cl);
+        } else if (degree == 270) {
+                map(src, rotate270, &cl);
+        }
+}
+
+/****************** struct gather_closure *****************
+ * The source image read by the gather apply functions,
+ * which are mapped over the destination, and its size.
+ *********************************************************/
+struct gather_closure {
+        A2 src;
+        A methods;
+        int width, height;
+};
+
+/* destination (col, row) of a 90 degree rotation: source
+ * (row, height - col - 1) */
+static void gather90(int col, int row, A2 dst, void *el, void *cl)
+{
+        struct gather_closure *g = cl;
+        (void)dst;
+        *(struct Pnm_rgb *)el = *(struct Pnm_rgb *)
+                g->methods->at(g->src, row, g->height - col - 1);
+}
+
+/* 180: source (width - col - 1, height - row - 1) */
+static void gather180(int col, int row, A2 dst, void *el, void *cl)
+{
+        struct gather_closure *g = cl;
+        (void)dst;
+        *(struct Pnm_rgb *)el = *(struct Pnm_rgb *)
+                g->methods->at(g->src, g->width - col - 1,
+                               g->height - row - 1);
+}
+
+/* 270: source (width - row - 1, col) */
+static void gather270(int col, int row, A2 dst, void *el, void *cl)
+{
+        struct gather_closure *g = cl;
+        (void)dst;
+        *(struct Pnm_rgb *)el = *(struct Pnm_rgb *)
+                g->methods->at(g->src, g->width - row - 1, col);
+}
+
+/******************** Rotate_gather ***********************
+ * Rotates src into dst by mapping over dst instead of src:
+ * each destination pixel visited reads its source pixel
+ * through at().  The writes then follow the map's order
+ * and the reads are the strided side, the reverse of
+ * Rotate_map.
+ * 
+ * Parameters:
+ *      A2Methods_mapfun *map: Traversal over dst.
+ *      A methods: Methods for both src and dst.
+ *      A2 src: Source image pixels.
+ *      A2 dst: Destination, already sized by Rotate_dimensions.
+ *      int degree: Rotation angle (90, 180, 270).
+ * 
+ * Returns:
+ *      None
+ * 
+ * Expects:
+ *      map, methods, src and dst must not be NULL.
+ * 
+ * Notes:
+ *      Only the destination cell passed in is written, so the
+ *      parallel maps may run it (src is only read).
+ *********************************************************/
+void Rotate_gather(A2Methods_mapfun *map, A methods, A2 src, A2 dst,
+                   int degree)
+{
+        assert(map != NULL && methods != NULL);
+        assert(src != NULL && dst != NULL);
+
+        struct gather_closure cl = { src, methods, methods->width(src),
+                                     methods->height(src) };
+
+        if (degree == 90) {
+                map(dst, gather90, &cl);
+        } else if (degree == 180) {
+                map(dst, gather180, &cl);
+        } else if (degree == 270) {
+                map(dst, gather270, &cl);
+        }
+}
+
+/********************** store_cell ************************
+ * Copies one cell, with non-temporal stores when stream is
+ * set and the hardware supports them (SSE2 movnti, one per
+ * 4-byte word; the write-combining buffers merge them into
+ * full-line writes).
+ *********************************************************/
+static inline void store_cell(char *dst, const char *src, int size,
+                              int stream)
+{
+        if (size % 4 != 0) {
+                memcpy(dst, src, size);
+                return;
+        }
+        for (int k = 0; k < size; k += 4) {
+                int32_t word;
+                memcpy(&word, src + k, 4);
+#ifdef __SSE2__
+                if (stream) {
+                        _mm_stream_si32((int *)(dst + k), word);
+                        continue;
+                }
+#endif
+                memcpy(dst + k, &word, 4);
+        }
+}
+
+/********************* bulk_plain *************************
+ * Bulk rotation between two UArray2 arrays.  180 degrees
+ * reverses each row into its mirror row; 90 and 270 walk the
+ * destination in TILE x TILE tiles, writing each destination
+ * row segment sequentially while reading down TILE cached
+ * source rows.
+ *********************************************************/
+static void bulk_plain(A2 src, A2 dst, int degree, int size, int stream)
+{
+        int w = UArray2_width(src);
+        int h = UArray2_height(src);
+        if (w == 0 || h == 0) {
+                return;
+        }
+
+        if (degree == 180) {
+                for (int j = 0; j < h; j++) {
+                        const char *s = UArray2_row(src, j);
+                        char *d = UArray2_row(dst, h - 1 - j);
+                        for (int i = 0; i < w; i++) {
+                                store_cell(d + (long)i * size,
+                                           s + (long)(w - 1 - i) * size,
+                                           size, stream);
+                        }
+                }
+                return;
+        }
+
+        /* destination is h wide and w tall */
+        const char **rows = malloc(h * sizeof(*rows));
+        assert(rows != NULL);
+        for (int j = 0; j < h; j++) {
+                rows[j] = UArray2_row(src, j);
+        }
+        for (int y0 = 0; y0 < w; y0 += TILE) {
+                int y1 = y0 + TILE < w ? y0 + TILE : w;
+                for (int x0 = 0; x0 < h; x0 += TILE) {
+                        int x1 = x0 + TILE < h ? x0 + TILE : h;
+                        for (int y = y0; y < y1; y++) {
+                                char *d = UArray2_row(dst, y);
+                                for (int x = x0; x < x1; x++) {
+                                        /* 90: src (y, h-1-x);
+                                         * 270: src (w-1-y, x) */
+                                        const char *s = degree == 90
+                                                ? rows[h - 1 - x]
+                                                  + (long)y * size
+                                                : rows[x]
+                                                  + (long)(w - 1 - y) * size;
+                                        store_cell(d + (long)x * size, s,
+                                                   size, stream);
+                                }
+                        }
+                }
+        }
+        free(rows);
+}
+
+/******************** bulk_blocked ************************
+ * Bulk rotation between two UArray2b arrays: every
+ * destination block is filled in its storage order, reading
+ * each source cell through a table of source block addresses.
+ *********************************************************/
+static void bulk_blocked(A2 src, A2 dst, int degree, int size, int stream)
+{
+        int w = UArray2b_width(src), h = UArray2b_height(src);
+        int dw = UArray2b_width(dst), dh = UArray2b_height(dst);
+        int sbs = UArray2b_blocksize(src), dbs = UArray2b_blocksize(dst);
+        int snbw = (w + sbs - 1) / sbs, snbh = (h + sbs - 1) / sbs;
+        int dnbw = (dw + dbs - 1) / dbs, dnbh = (dh + dbs - 1) / dbs;
+        if (w == 0 || h == 0) {
+                return;
+        }
+
+        const char **blocks = malloc((long)snbw * snbh * sizeof(*blocks));
+        assert(blocks != NULL);
+        for (int br = 0; br < snbh; br++) {
+                for (int bc = 0; bc < snbw; bc++) {
+                        blocks[br * snbw + bc] = UArray2b_block(src, bc, br);
+                }
+        }
+
+        for (int br = 0; br < dnbh; br++) {
+                for (int bc = 0; bc < dnbw; bc++) {
+                        char *block = UArray2b_block(dst, bc, br);
+                        for (int ly = 0; ly < dbs; ly++) {
+                                int y = br * dbs + ly;
+                                if (y >= dh) {
+                                        break;
+                                }
+                                for (int lx = 0; lx < dbs; lx++) {
+                                        int x = bc * dbs + lx;
+                                        if (x >= dw) {
+                                                break;
+                                        }
+                                        int sx, sy;
+                                        if (degree == 90) {
+                                                sx = y;
+                                                sy = h - 1 - x;
+                                        } else if (degree == 180) {
+                                                sx = w - 1 - x;
+                                                sy = h - 1 - y;
+                                        } else {
+                                                sx = w - 1 - y;
+                                                sy = x;
+                                        }
+                                        const char *s =
+                                                blocks[(sy / sbs) * snbw
+                                                       + sx / sbs]
+                                                + (long)((sy % sbs) * sbs
+                                                         + sx % sbs) * size;
+                                        store_cell(block + (long)(ly * dbs
+                                                   + lx) * size, s, size,
+                                                   stream);
+                                }
+                        }
+                }
+        }
+        free(blocks);
+}
+
+/**************** Rotate_stream_threshold *****************
+ * Returns the destination size in bytes above which
+ * ROTATE_STREAM_AUTO uses streaming stores: the size of the
+ * last-level cache as reported by sysconf, or 8MB if unknown.
+ *********************************************************/
+long Rotate_stream_threshold(void)
+{
+        long bytes = -1;
+#ifdef _SC_LEVEL3_CACHE_SIZE
+        bytes = sysconf(_SC_LEVEL3_CACHE_SIZE);
+        if (bytes <= 0) {
+                bytes = sysconf(_SC_LEVEL2_CACHE_SIZE);
+        }
+#endif
+        return bytes > 0 ? bytes : DEFAULT_LLC_BYTES;
+}
+
+/********************** Rotate_bulk ***********************
+ * Rotates src into dst with the bulk kernels.
+ * 
+ * Parameters:
+ *      A methods: Methods for both src and dst.
+ *      A2 src: Source image pixels.
+ *      A2 dst: Destination, already sized by Rotate_dimensions.
+ *      int degree: Rotation angle (90, 180, 270).
+ *      enum Rotate_stream stream: Whether to use streaming stores.
+ * 
+ * Returns:
+ *      int: 1 if the rotation was done, 0 if methods is not a
+ *           plain, blocked or planar table (use Rotate_map
+ *           instead).  Planar arrays are rotated one plane at a
+ *           time (see a2planar.h), with ordinary stores.
+ * 
+ * Expects:
+ *      methods, src and dst must not be NULL.
+ *********************************************************/
+int Rotate_bulk(A methods, A2 src, A2 dst, int degree,
+                enum Rotate_stream stream)
+{
+        assert(methods != NULL && src != NULL && dst != NULL);
+        assert(degree == 90 || degree == 180 || degree == 270);
+
+        int size = methods->size(src);
+        int streaming = stream == ROTATE_STREAM_ON;
+        if (stream == ROTATE_STREAM_AUTO) {
+                double bytes = (double)methods->width(dst) *
+                               methods->height(dst) * size;
+                streaming = bytes > Rotate_stream_threshold();
+        }
+
+        if (methods == uarray2_methods_plain ||
+            methods == uarray2_methods_plain_prefetch) {
+                bulk_plain(src, dst, degree, size, streaming);
+        } else if (methods == uarray2_methods_blocked ||
+                   methods == uarray2_methods_blocked_prefetch) {
+                bulk_blocked(src, dst, degree, size, streaming);
+        } else if (A2Planar_is(methods)) {
+                A2Planar_rotate(src, dst, degree);      /* never streams */
+                return 1;
+        } else {
+                return 0;
+        }
+#ifdef __SSE2__
+        if (streaming) {
+                _mm_sfence();   /* order streamed stores before reuse */
+        }
+#endif
+        return 1;
+}
+
+/********************** rotate90 *************************
+ * Rotates the image by 90 degrees.
+ * 
+ * Parameters:
+ *      int col: Column index.
+ *      int row: Row index.
+ *      A2 src_array: Source image pixels.
+ *      void *el: element (Current pixel).
+ *      void *cl: Closure for rotated image and methods.
+ * 
+ * Returns:
+ *      None
+ * 
+ * Expects:
+ *      src_array and closure must not be NULL.
+ *********************************************************/
+void rotate90(int col, int row, A2 src_array, void *el, void *cl)
+{
+        struct rotate_closure *new_cl = cl;
+
+        A2 rotated_img = new_cl->rotated_img;
+        A new_methods = new_cl->methods;
+
+        int height = new_methods->height(src_array);
+        *(struct Pnm_rgb *)new_methods->
+        at(rotated_img, height - row - 1, col) = *(struct Pnm_rgb *)el;
+}
+
+/********************** rotate180 ************************
+ * Rotates the image by 180 degrees.
+ * 
+ * Parameters:
+ *      int col: Column index.
+ *      int row: Row index.
+ *      A2 src_array: Source image pixels.
+ *      void *el: element (Current pixel).
+ *      void *cl: Closure for rotated image and methods.
+ * 
+ * Returns:
+ *      None
+ * 
+ * Expects:
+ *      src_array and closure must not be NULL.
+ *********************************************************/
+void rotate180(int col, int row, A2 src_array, void *el, void *cl)
+{
+        struct rotate_closure *new_cl = cl;
+
+        A2 rotated_img = new_cl->rotated_img;
+        A new_methods = new_cl->methods;
+
+        int height = new_methods->height(src_array);
+        int width = new_methods->width(src_array);
+        *(struct Pnm_rgb *)new_methods->at(rotated_img, width - col - 1, 
+                height - row - 1) = *(struct Pnm_rgb *)el;
+}
+
+/********************** rotate270 ************************
+ * Rotates the image by 270 degrees.
+ * 
+ * Parameters:
+ *      int col: Column index.
+ *      int row: Row index.
+ *      A2 src_array: Source image pixels.
+ *      void *el: element (Current pixel).
+ *      void *cl: Closure for rotated image and methods.
+ * 
+ * Returns:
+ *      None
+ * 
+ * Expects:
+ *      src_array and closure must not be NULL.
+ *********************************************************/
+void rotate270(int col, int row, A2 src_array, void *el, void *cl)
+{
+        struct rotate_closure *new_cl = cl;
+
+        A2 rotated_img = new_cl->rotated_img;
+        A new_methods = new_cl->methods;
+
+        int width = new_methods->width(src_array);
+        *(struct Pnm_rgb *)new_methods->
+        at(rotated_img, row, width - col - 1) = *(struct Pnm_rgb *)el;
+}
+
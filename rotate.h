@@ -0,0 +1,75 @@
+#ifndef ROTATE_INCLUDED
+#define ROTATE_INCLUDED
+/**************************************************************
+ *
+ *      rotate.h
+ *
+ *      Xiaoyan Xie (xxie05)
+ *      Diwei Chen (dchen22)
+ *
+ *      CS 40 HW03 - locality
+ *
+ *      Interface to the image rotations shared by ppmtrans and
+ *      the benchmark harness.  Rotations are apply functions for
+ *      an A2Methods map over the source image; each one writes
+ *      the visited pixel to its rotated position in a destination
+ *      array of struct Pnm_rgb cells.  Rotate_gather maps over
+ *      the destination instead and reads each pixel's source, so
+ *      the caller can choose which side is walked in order.
+ *
+ *      Rotate_bulk is the faster alternative for the plain and
+ *      blocked arrays: it writes the destination in order through
+ *      raw row/block pointers instead of one at() call per pixel,
+ *      walking 90/270 rotations in tiles so the source rows being
+ *      read stay in cache.  Its stores can be non-temporal
+ *      (streaming): destination lines go straight to memory
+ *      without first being read for ownership, and do not evict
+ *      the source from the cache.  That only pays off once the
+ *      image no longer fits in the last-level cache, so by default
+ *      (ROTATE_STREAM_AUTO) streaming is used only for destinations
+ *      larger than Rotate_stream_threshold() bytes.  Planar
+ *      arrays (a2planar.h) are rotated one channel plane at a
+ *      time.
+ *
+ **************************************************************/
+
+#include "a2methods.h"
+
+/******************* struct rotate_closure ****************
+ * Stores the rotated image and methods for mapping over
+ * arrays during image rotation.
+ * Used to pass necessary data during the rotation process.
+ *********************************************************/
+struct rotate_closure {
+        A2Methods_UArray2 rotated_img;
+        A2Methods_T methods;
+};
+
+extern void rotate90(int col, int row, A2Methods_UArray2 src_array,
+                     void *el, void *cl);
+extern void rotate180(int col, int row, A2Methods_UArray2 src_array,
+                      void *el, void *cl);
+extern void rotate270(int col, int row, A2Methods_UArray2 src_array,
+                      void *el, void *cl);
+
+extern void Rotate_dimensions(A2Methods_T methods, A2Methods_UArray2 src,
+                              int degree, int *width, int *height);
+extern void Rotate_map(A2Methods_mapfun *map, A2Methods_T methods,
+                       A2Methods_UArray2 src, A2Methods_UArray2 dst,
+                       int degree);
+extern void Rotate_gather(A2Methods_mapfun *map, A2Methods_T methods,
+                          A2Methods_UArray2 src, A2Methods_UArray2 dst,
+                          int degree);
+
+enum Rotate_stream {
+        ROTATE_STREAM_AUTO,     /* stream when larger than the LLC */
+        ROTATE_STREAM_ON,
+        ROTATE_STREAM_OFF
+};
+
+extern int  Rotate_bulk(A2Methods_T methods, A2Methods_UArray2 src,
+                        A2Methods_UArray2 dst, int degree,
+                        enum Rotate_stream stream);
+extern long Rotate_stream_threshold(void);
+
+#endif
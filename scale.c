@@ -0,0 +1,364 @@
+/**************************************************************
+ *
+ *      scale.c
+ *
+ *      Xiaoyan Xie (xxie05)
+ *      Diwei Chen (dchen22)
+ *
+ *      CS 40 HW03 - locality
+ *
+ *      This file implements the separable resize (see scale.h).
+ *      "R" below is the source as seen after the rotation: R's
+ *      cell (x, y) is the source cell that rotates onto (x, y).
+ *      Output rows are made in bands of BAND rows; the R rows a
+ *      band needs are resampled horizontally into the ring, and
+ *      rows shared with the next band stay there, so each R row
+ *      is resampled once.
+ *
+ **************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include "assert.h"
+#include "a2methods.h"
+#include "pnm.h"
+#include "scale.h"
+
+typedef A2Methods_UArray2 A2;
+typedef A2Methods_T A;
+
+/* output rows per vertical pass */
+#define BAND 16
+
+/* R columns read per horizontal patch, before the filter margin */
+#define PATCH 128
+
+/* the weights that take one axis from in to out positions */
+struct axis {
+        int taps;               /* weights stored per position */
+        int *start;             /* first input index */
+        int *count;             /* inputs used, at most taps */
+        float *weights;         /* taps per position */
+};
+
+struct job {
+        A methods;
+        A2 src, dst;
+        int degree;
+        int src_width, src_height;
+        int out_width;
+        unsigned maxval;
+        struct axis ax, ay;
+        int chunk;              /* output columns per patch */
+        int patch_width;
+        struct Pnm_rgb *patch;  /* cap R rows x patch_width */
+        int cap;                /* rows in the ring */
+        float *ring;            /* cap rows of out_width * 3 */
+        float *acc;             /* one output row */
+};
+
+static double support(enum Scale_filter filter)
+{
+        return filter == SCALE_BOX ? 0.5 : filter == SCALE_BILINEAR ? 1 : 3;
+}
+
+static double sinc(double x)
+{
+        if (x == 0) {
+                return 1;
+        }
+        x *= M_PI;
+        return sin(x) / x;
+}
+
+static double kernel(enum Scale_filter filter, double x)
+{
+        switch (filter) {
+        case SCALE_BOX:
+                return x > -0.5 && x <= 0.5;
+        case SCALE_BILINEAR:
+                x = fabs(x);
+                return x < 1 ? 1 - x : 0;
+        default:
+                return fabs(x) < 3 ? sinc(x) * sinc(x / 3) : 0;
+        }
+}
+
+/*********************** axis_init ************************
+ * Computes, for each of out positions, the input range and
+ * normalized weights of the filter centred on it.  When
+ * shrinking, the filter is stretched by in / out.
+ *********************************************************/
+static void axis_init(struct axis *a, int in, int out,
+                      enum Scale_filter filter)
+{
+        double ratio = (double)in / out;
+        double stretch = ratio > 1 ? ratio : 1;
+        double reach = support(filter) * stretch;
+
+        a->taps = 2 * (int)ceil(reach) + 1;
+        a->start = malloc(out * sizeof(*a->start));
+        a->count = malloc(out * sizeof(*a->count));
+        a->weights = calloc((long)out * a->taps, sizeof(*a->weights));
+        assert(a->start != NULL && a->count != NULL && a->weights != NULL);
+
+        for (int o = 0; o < out; o++) {
+                double center = (o + 0.5) * ratio;
+                int lo = (int)floor(center - reach + 0.5);
+                int hi = (int)floor(center + reach + 0.5);
+                lo = lo < 0 ? 0 : lo;
+                hi = hi > in ? in : hi;
+                hi = hi - lo > a->taps ? lo + a->taps : hi;
+
+                float *w = a->weights + (long)o * a->taps;
+                double total = 0;
+                for (int k = lo; k < hi; k++) {
+                        w[k - lo] = kernel(filter, (k + 0.5 - center) /
+                                                   stretch);
+                        total += w[k - lo];
+                }
+                if (total == 0) {       /* nothing in reach: nearest */
+                        lo = (int)center < in ? (int)center : in - 1;
+                        hi = lo + 1;
+                        w[0] = 1;
+                        total = 1;
+                }
+                for (int k = 0; k < hi - lo; k++) {
+                        w[k] /= total;
+                }
+                a->start[o] = lo;
+                a->count[o] = hi - lo;
+        }
+}
+
+static void axis_free(struct axis *a)
+{
+        free(a->start);
+        free(a->count);
+        free(a->weights);
+}
+
+/* one past the last input used by positions first .. last-1 */
+static int axis_end(const struct axis *a, int first, int last)
+{
+        int end = 0;
+        for (int o = first; o < last; o++) {
+                if (a->start[o] + a->count[o] > end) {
+                        end = a->start[o] + a->count[o];
+                }
+        }
+        return end;
+}
+
+/* R's cell (x, y) */
+static inline struct Pnm_rgb *rotated_at(const struct job *job, int x,
+                                         int y)
+{
+        A2 src = job->src;
+        switch (job->degree) {
+        case 90:
+                return job->methods->at(src, y, job->src_height - 1 - x);
+        case 180:
+                return job->methods->at(src, job->src_width - 1 - x,
+                                        job->src_height - 1 - y);
+        case 270:
+                return job->methods->at(src, job->src_width - 1 - y, x);
+        default:
+                return job->methods->at(src, x, y);
+        }
+}
+
+static inline float *ring_row(const struct job *job, int r)
+{
+        return job->ring + (long)(r % job->cap) * job->out_width * 3;
+}
+
+/********************** horizontal ************************
+ * Resamples R rows [r0, r1) to out_width columns into the
+ * ring.  The rows are done one column patch at a time: the
+ * patch is copied out of the source in the source's own row
+ * order, then filtered from the copy.
+ *********************************************************/
+static void horizontal(struct job *job, int r0, int r1)
+{
+        const struct axis *ax = &job->ax;
+        bool transposed = job->degree == 90 || job->degree == 270;
+
+        for (int o0 = 0; o0 < job->out_width; o0 += job->chunk) {
+                int o1 = o0 + job->chunk < job->out_width
+                       ? o0 + job->chunk : job->out_width;
+                int xa = ax->start[o0];
+                int xb = axis_end(ax, o0, o1);
+                int pw = job->patch_width;
+
+                /* R rows are source columns when transposed */
+                if (transposed) {
+                        for (int x = xa; x < xb; x++) {
+                                for (int r = r0; r < r1; r++) {
+                                        job->patch[(r - r0) * pw + x - xa] =
+                                                *rotated_at(job, x, r);
+                                }
+                        }
+                } else {
+                        for (int r = r0; r < r1; r++) {
+                                for (int x = xa; x < xb; x++) {
+                                        job->patch[(r - r0) * pw + x - xa] =
+                                                *rotated_at(job, x, r);
+                                }
+                        }
+                }
+
+                for (int r = r0; r < r1; r++) {
+                        const struct Pnm_rgb *in = job->patch + (r - r0) * pw;
+                        float *out = ring_row(job, r);
+                        for (int o = o0; o < o1; o++) {
+                                const float *w = ax->weights +
+                                                 (long)o * ax->taps;
+                                const struct Pnm_rgb *p = in + ax->start[o]
+                                                        - xa;
+                                float red = 0, green = 0, blue = 0;
+                                for (int k = 0; k < ax->count[o]; k++) {
+                                        red += w[k] * p[k].red;
+                                        green += w[k] * p[k].green;
+                                        blue += w[k] * p[k].blue;
+                                }
+                                out[3 * o] = red;
+                                out[3 * o + 1] = green;
+                                out[3 * o + 2] = blue;
+                        }
+                }
+        }
+}
+
+static inline unsigned quantize(float v, unsigned maxval)
+{
+        v += 0.5f;
+        return v <= 0 ? 0 : v >= maxval ? maxval : (unsigned)v;
+}
+
+/*********************** vertical *************************
+ * Makes output row oy from the ring rows it covers, adding
+ * whole rows so the inner loop runs over contiguous floats.
+ *********************************************************/
+static void vertical(struct job *job, int oy)
+{
+        const struct axis *ay = &job->ay;
+        const float *w = ay->weights + (long)oy * ay->taps;
+        int n = job->out_width * 3;
+        float *acc = job->acc;
+
+        memset(acc, 0, n * sizeof(*acc));
+        for (int k = 0; k < ay->count[oy]; k++) {
+                const float *row = ring_row(job, ay->start[oy] + k);
+                float wk = w[k];
+                for (int i = 0; i < n; i++) {
+                        acc[i] += wk * row[i];
+                }
+        }
+        for (int ox = 0; ox < job->out_width; ox++) {
+                struct Pnm_rgb *cell = job->methods->at(job->dst, ox, oy);
+                cell->red = quantize(acc[3 * ox], job->maxval);
+                cell->green = quantize(acc[3 * ox + 1], job->maxval);
+                cell->blue = quantize(acc[3 * ox + 2], job->maxval);
+        }
+}
+
+/*********************** Scale_run ************************
+ * Resizes src, rotated by degree, into dst.
+ *
+ * Parameters:
+ *      A methods: Methods for both src and dst.
+ *      A2 src: Source image pixels.
+ *      int degree: Rotation applied first (0, 90, 180, 270).
+ *      A2 dst: Destination; its dimensions are the new size.
+ *      enum Scale_filter filter: Box, bilinear or Lanczos-3.
+ *      unsigned maxval: Largest channel value; Lanczos
+ *                       overshoot is clamped to 0 .. maxval.
+ *
+ * Returns:
+ *      None
+ *
+ * Expects:
+ *      methods, src and dst must not be NULL, both arrays must
+ *      hold struct Pnm_rgb and have at least one cell.
+ *
+ * Notes:
+ *      Scaling to the rotated size with the box filter is an
+ *      exact rotation.  Will CRE if memory allocation fails.
+ *********************************************************/
+void Scale_run(A methods, A2 src, int degree, A2 dst,
+               enum Scale_filter filter, unsigned maxval)
+{
+        assert(methods != NULL && src != NULL && dst != NULL);
+        assert(degree == 0 || degree == 90 || degree == 180 ||
+               degree == 270);
+        assert(methods->size(src) == sizeof(struct Pnm_rgb));
+        assert(methods->size(dst) == sizeof(struct Pnm_rgb));
+
+        struct job job;
+        job.methods = methods;
+        job.src = src;
+        job.dst = dst;
+        job.degree = degree;
+        job.src_width = methods->width(src);
+        job.src_height = methods->height(src);
+        job.out_width = methods->width(dst);
+        job.maxval = maxval;
+        int out_height = methods->height(dst);
+        bool transposed = degree == 90 || degree == 270;
+        int rw = transposed ? job.src_height : job.src_width;
+        int rh = transposed ? job.src_width : job.src_height;
+        assert(rw > 0 && rh > 0 && job.out_width > 0 && out_height > 0);
+
+        axis_init(&job.ax, rw, job.out_width, filter);
+        axis_init(&job.ay, rh, out_height, filter);
+
+        /* about PATCH R columns per patch, and room for the widest */
+        job.chunk = (int)((long)PATCH * job.out_width / rw);
+        job.chunk = job.chunk < 1 ? 1 : job.chunk;
+        job.patch_width = 0;
+        for (int o0 = 0; o0 < job.out_width; o0 += job.chunk) {
+                int o1 = o0 + job.chunk < job.out_width ? o0 + job.chunk
+                                                         : job.out_width;
+                int span = axis_end(&job.ax, o0, o1) - job.ax.start[o0];
+                if (span > job.patch_width) {
+                        job.patch_width = span;
+                }
+        }
+        job.cap = 0;
+        for (int y0 = 0; y0 < out_height; y0 += BAND) {
+                int y1 = y0 + BAND < out_height ? y0 + BAND : out_height;
+                int span = axis_end(&job.ay, y0, y1) - job.ay.start[y0];
+                if (span > job.cap) {
+                        job.cap = span;
+                }
+        }
+
+        job.patch = malloc((long)job.cap * job.patch_width *
+                           sizeof(*job.patch));
+        job.ring = malloc((long)job.cap * job.out_width * 3 *
+                          sizeof(*job.ring));
+        job.acc = malloc((long)job.out_width * 3 * sizeof(*job.acc));
+        assert(job.patch != NULL && job.ring != NULL && job.acc != NULL);
+
+        int have = 0;                   /* R rows resampled so far */
+        for (int y0 = 0; y0 < out_height; y0 += BAND) {
+                int y1 = y0 + BAND < out_height ? y0 + BAND : out_height;
+                int lo = job.ay.start[y0];
+                int hi = axis_end(&job.ay, y0, y1);
+                if (hi > have) {
+                        horizontal(&job, have > lo ? have : lo, hi);
+                        have = hi;
+                }
+                for (int oy = y0; oy < y1; oy++) {
+                        vertical(&job, oy);
+                }
+        }
+
+        free(job.patch);
+        free(job.ring);
+        free(job.acc);
+        axis_free(&job.ax);
+        axis_free(&job.ay);
+}
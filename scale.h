@@ -0,0 +1,39 @@
+#ifndef SCALE_INCLUDED
+#define SCALE_INCLUDED
+/**************************************************************
+ *
+ *      scale.h
+ *
+ *      Xiaoyan Xie (xxie05)
+ *      Diwei Chen (dchen22)
+ *
+ *      CS 40 HW03 - locality
+ *
+ *      Resizes an image, optionally rotated by 90, 180 or 270
+ *      degrees on the way, with a box, bilinear (triangle) or
+ *      Lanczos-3 filter.  The filter is widened when shrinking so
+ *      every source pixel contributes, which makes large
+ *      reductions (thumbnails) alias-free.
+ *
+ *      The resize is two separable passes.  The horizontal pass
+ *      reads the source in patches a few hundred pixels on a side
+ *      and leaves narrow float rows in a ring buffer; the vertical
+ *      pass turns a band of those rows into output rows.  Reads go
+ *      through the rotation's coordinate map, so the full-size
+ *      rotated image is never built.
+ *
+ **************************************************************/
+
+#include "a2methods.h"
+
+enum Scale_filter {
+        SCALE_BOX,
+        SCALE_BILINEAR,
+        SCALE_LANCZOS
+};
+
+extern void Scale_run(A2Methods_T methods, A2Methods_UArray2 src,
+                      int degree, A2Methods_UArray2 dst,
+                      enum Scale_filter filter, unsigned maxval);
+
+#endif
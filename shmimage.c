@@ -0,0 +1,416 @@
+/**************************************************************
+ *
+ *      shmimage.c
+ *
+ *      Xiaoyan Xie (xxie05)
+ *      Diwei Chen (dchen22)
+ *
+ *      CS 40 HW03 - locality
+ *
+ *      This file implements shared memory images (see shmimage.h).
+ *      Reading maps the segment privately and wraps its cells with
+ *      UArray2_new_from_buffer or UArray2b_new_from_buffer; streams
+ *      that cannot be mapped are read into one aligned buffer used
+ *      the same way.  Writing sizes the segment, maps it shared
+ *      and returns an array over its cells, so whatever is stored
+ *      into that array is the output.
+ *
+ **************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "assert.h"
+#include "except.h"
+#include "mem.h"
+#include "a2methods.h"
+#include "a2plain.h"
+#include "a2blocked.h"
+#include "a2prefetch.h"
+#include "uarray2ext.h"
+#include "uarray2bext.h"
+#include "pnm.h"
+#include "shmimage.h"
+
+#define MAGIC "A2SHMIM\n"
+#define BYTE_ORDER_MARK 0x01020304u
+#define CELLS_OFFSET 4096
+
+/******************** struct shm_header *******************
+ * The 64 bytes at the start of every segment.
+ *********************************************************/
+struct shm_header {
+        char magic[8];
+        uint32_t byte_order;
+        uint32_t layout;
+        uint32_t width, height;
+        uint32_t cell_size, blocksize;
+        uint32_t maxval;
+        uint32_t reserved;
+        uint64_t cells_offset;
+        uint64_t cells_bytes;
+        uint64_t reserved2;
+};
+
+/* storage behind an image */
+struct mapping {
+        void *base;
+        size_t length;
+        bool mapped;            /* munmap, rather than free, base */
+        bool input;             /* a segment mapped by ShmImage_read */
+        dev_t dev;              /* its file, if input */
+        ino_t ino;
+        struct mapping *next;   /* in live_inputs, if input */
+};
+
+/* segments currently mapped by ShmImage_read; ShmImage_new
+ * must not truncate one of them under its reader */
+static struct mapping *live_inputs = NULL;
+
+static void release_mapping(void *cells, void *cl)
+{
+        struct mapping *m = cl;
+        (void)cells;
+        if (m->input) {
+                struct mapping **p = &live_inputs;
+                while (*p != m) {
+                        p = &(*p)->next;
+                }
+                *p = m->next;
+        }
+        if (m->mapped) {
+                munmap(m->base, m->length);
+        } else {
+                free(m->base);
+        }
+        free(m);
+}
+
+/* true if st is the file of a segment being read */
+static bool is_live_input(const struct stat *st)
+{
+        for (struct mapping *m = live_inputs; m != NULL; m = m->next) {
+                if (m->dev == st->st_dev && m->ino == st->st_ino) {
+                        return true;
+                }
+        }
+        return false;
+}
+
+/* bytes of cells for a layout; 0 if the sizes overflow (or the
+ * image is empty) */
+static uint64_t cells_bytes(uint32_t layout, uint64_t width,
+                            uint64_t height, uint64_t blocksize)
+{
+        uint64_t size = sizeof(struct Pnm_rgb);
+        if (width == 0 || height == 0) {
+                return 0;
+        }
+        if (layout == SHMIMAGE_BLOCKS) {
+                if (width > UINT64_MAX - blocksize + 1 ||
+                    height > UINT64_MAX - blocksize + 1) {
+                        return 0;
+                }
+                width = (width + blocksize - 1) / blocksize * blocksize;
+                height = (height + blocksize - 1) / blocksize * blocksize;
+        }
+        if (width > UINT64_MAX / size / height) {
+                return 0;
+        }
+        return width * height * size;
+}
+
+/********************** valid_header **********************
+ * Checks that a header is self-consistent and that the
+ * segment of `length` bytes holds every cell it describes.
+ *********************************************************/
+static bool valid_header(const struct shm_header *h, uint64_t length)
+{
+        if (memcmp(h->magic, MAGIC, 8) != 0 ||
+            h->byte_order != BYTE_ORDER_MARK ||
+            h->cell_size != sizeof(struct Pnm_rgb) ||
+            h->maxval == 0 || h->maxval > 65535 ||
+            h->width > INT_MAX || h->height > INT_MAX ||
+            h->cells_offset < sizeof(*h) || h->cells_offset % 64 != 0) {
+                return false;
+        }
+        if (h->layout == SHMIMAGE_ROWS) {
+                if (h->blocksize != 0) {
+                        return false;
+                }
+        } else if (h->layout != SHMIMAGE_BLOCKS || h->blocksize == 0 ||
+                   h->blocksize > 65536) {
+                return false;
+        }
+        bool empty = h->width == 0 || h->height == 0;
+        return h->cells_bytes == cells_bytes(h->layout, h->width,
+                                             h->height, h->blocksize) &&
+               (h->cells_bytes != 0 || empty) &&
+               h->cells_bytes <= UINT64_MAX - h->cells_offset &&
+               length >= h->cells_offset + h->cells_bytes;
+}
+
+/************************ load ****************************
+ * Maps fp's segment, or reads the stream into an aligned
+ * buffer, and returns the storage.  Returns NULL if the
+ * header is missing or malformed.
+ *********************************************************/
+static struct mapping *load(FILE *fp)
+{
+        struct mapping *m = malloc(sizeof(*m));
+        assert(m != NULL);
+        m->input = false;
+        m->next = NULL;
+        struct shm_header h;
+        struct stat st;
+        int fd = fileno(fp);
+
+        if (fd >= 0 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode) &&
+            (size_t)st.st_size >= sizeof(h)) {
+                m->length = st.st_size;
+                m->base = mmap(NULL, m->length, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE, fd, 0);
+                m->mapped = m->base != MAP_FAILED;
+                if (m->mapped) {
+                        memcpy(&h, m->base, sizeof(h));
+                        if (valid_header(&h, m->length)) {
+                                m->input = true;
+                                m->dev = st.st_dev;
+                                m->ino = st.st_ino;
+                                m->next = live_inputs;
+                                live_inputs = m;
+                                return m;
+                        }
+                        munmap(m->base, m->length);
+                        free(m);
+                        return NULL;
+                }
+        }
+
+        /* not mappable: read the header, then everything it names */
+        if (fread(&h, sizeof(h), 1, fp) != 1 ||
+            !valid_header(&h, UINT64_MAX)) {
+                free(m);
+                return NULL;
+        }
+        m->length = h.cells_offset + h.cells_bytes;
+        m->mapped = false;
+        if (posix_memalign(&m->base, CELLS_OFFSET, m->length) != 0) {
+                m->base = NULL;
+        }
+        assert(m->base != NULL);
+        memcpy(m->base, &h, sizeof(h));
+        size_t rest = m->length - sizeof(h);
+        if (fread((char *)m->base + sizeof(h), 1, rest, fp) != rest) {
+                free(m->base);
+                free(m);
+                return NULL;
+        }
+        return m;
+}
+
+/* the array over a segment's cells, freeing the storage with it */
+static A2Methods_UArray2 wrap(const struct shm_header *h, void *cells,
+                              struct mapping *m)
+{
+        if (h->layout == SHMIMAGE_ROWS) {
+                return UArray2_new_from_buffer(h->width, h->height,
+                                               h->cell_size, cells,
+                                               release_mapping, m);
+        }
+        return UArray2b_new_from_buffer(h->width, h->height, h->cell_size,
+                                        h->blocksize, cells,
+                                        release_mapping, m);
+}
+
+/********************* ShmImage_read **********************
+ * Loads an image from a shared memory segment.
+ *
+ * Parameters:
+ *      FILE *fp: The segment (read from its start when it can
+ *                be mapped, from the current position otherwise).
+ *
+ * Returns:
+ *      Pnm_ppm: The image, using uarray2_methods_plain for
+ *               SHMIMAGE_ROWS and uarray2_methods_blocked for
+ *               SHMIMAGE_BLOCKS.
+ *
+ * Expects:
+ *      fp must not be NULL.
+ *
+ * Notes:
+ *      Raises Pnm_Badformat for a malformed or truncated
+ *      segment.  Will CRE if memory allocation fails.
+ *********************************************************/
+Pnm_ppm ShmImage_read(FILE *fp)
+{
+        assert(fp != NULL);
+        struct mapping *m = load(fp);
+        if (m == NULL) {
+                RAISE(Pnm_Badformat);
+        }
+        struct shm_header h;
+        memcpy(&h, m->base, sizeof(h));
+
+        Pnm_ppm ppm;
+        NEW(ppm);
+        assert(ppm != NULL);
+        ppm->width = h.width;
+        ppm->height = h.height;
+        ppm->denominator = h.maxval;
+        ppm->methods = h.layout == SHMIMAGE_ROWS ? uarray2_methods_plain
+                                                 : uarray2_methods_blocked;
+        ppm->pixels = wrap(&h, (char *)m->base + h.cells_offset, m);
+        return ppm;
+}
+
+/********************** ShmImage_new **********************
+ * Creates a segment at path and returns an array over its
+ * cells.  Cells stored into the array are the segment's
+ * pixels; nothing else needs to be written.
+ *
+ * Parameters:
+ *      const char *path: Where to create the segment; an
+ *                        existing file is truncated.
+ *      A2Methods_T methods: The plain or blocked table, with
+ *                           or without prefetch.
+ *      int width, int height: Size of the image.
+ *      unsigned maxval: The image's maxval.
+ *
+ * Returns:
+ *      A2Methods_UArray2: An array for methods, all cells zero,
+ *                         or NULL if methods keeps its cells in
+ *                         some other form (compressed, views).
+ *
+ * Expects:
+ *      path and methods must not be NULL, width and height
+ *      non-negative and maxval in 1 .. 65535.
+ *
+ * Notes:
+ *      Blocked arrays get the blocksize UArray2b_new_64K_block
+ *      would choose.  The segment stays after the array is
+ *      freed.  Will CRE if the segment cannot be created or
+ *      mapped, or if path is a segment still mapped by
+ *      ShmImage_read (truncating it would wipe the input).
+ *********************************************************/
+A2Methods_UArray2 ShmImage_new(const char *path, A2Methods_T methods,
+                               int width, int height, unsigned maxval)
+{
+        assert(path != NULL && methods != NULL);
+        assert(width >= 0 && height >= 0);
+        assert(maxval >= 1 && maxval <= 65535);
+        int size = sizeof(struct Pnm_rgb);
+        struct shm_header h;
+        memset(&h, 0, sizeof(h));
+        if (methods == uarray2_methods_plain ||
+            methods == uarray2_methods_plain_prefetch) {
+                h.layout = SHMIMAGE_ROWS;
+        } else if (methods == uarray2_methods_blocked ||
+                   methods == uarray2_methods_blocked_prefetch) {
+                h.layout = SHMIMAGE_BLOCKS;
+                h.blocksize = (int)floor(sqrt(64 * 1024 / size));
+        } else {
+                return NULL;
+        }
+        memcpy(h.magic, MAGIC, 8);
+        h.byte_order = BYTE_ORDER_MARK;
+        h.width = width;
+        h.height = height;
+        h.cell_size = size;
+        h.maxval = maxval;
+        h.cells_offset = CELLS_OFFSET;
+        h.cells_bytes = cells_bytes(h.layout, width, height, h.blocksize);
+
+        struct mapping *m = malloc(sizeof(*m));
+        assert(m != NULL);
+        m->length = h.cells_offset + h.cells_bytes;
+        m->mapped = true;
+        m->input = false;
+        m->next = NULL;
+        int fd = open(path, O_RDWR | O_CREAT, 0644);
+        assert(fd >= 0);
+        struct stat st;
+        int failed = fstat(fd, &st);
+        assert(failed == 0 && !is_live_input(&st));
+        int sized = ftruncate(fd, 0);           /* all cells zero */
+        sized |= ftruncate(fd, m->length);
+        assert(sized == 0);
+        m->base = mmap(NULL, m->length, PROT_READ | PROT_WRITE, MAP_SHARED,
+                       fd, 0);
+        assert(m->base != MAP_FAILED);
+        close(fd);
+        memcpy(m->base, &h, sizeof(h));
+        return wrap(&h, (char *)m->base + h.cells_offset, m);
+}
+
+static void copy_cell(int col, int row, A2Methods_UArray2 array, void *elem,
+                      void *cl)
+{
+        Pnm_ppm ppm = cl;
+        (void)array;
+        *(struct Pnm_rgb *)elem = *(struct Pnm_rgb *)
+                                  ppm->methods->at(ppm->pixels, col, row);
+}
+
+/********************* ShmImage_write *********************
+ * Writes a copy of ppm as a segment at path, for images not
+ * already built in one with ShmImage_new.
+ *
+ * Parameters:
+ *      const char *path: Where to create the segment.
+ *      Pnm_ppm ppm: Image in any A2 representation.
+ *
+ * Expects:
+ *      path and ppm must not be NULL.
+ *
+ * Notes:
+ *      Plain and blocked images keep their layout, row by row
+ *      or block by block; others are stored as rows.  Will CRE
+ *      if the segment cannot be created.
+ *********************************************************/
+void ShmImage_write(const char *path, Pnm_ppm ppm)
+{
+        assert(path != NULL && ppm != NULL);
+        A2Methods_T methods = ppm->methods;
+        A2Methods_UArray2 out = ShmImage_new(path, methods, ppm->width,
+                                             ppm->height, ppm->denominator);
+        if (out == NULL) {
+                methods = uarray2_methods_plain;
+                out = ShmImage_new(path, methods, ppm->width, ppm->height,
+                                   ppm->denominator);
+                methods->map_row_major(out, copy_cell, ppm);
+        } else if (methods == uarray2_methods_blocked ||
+                   methods == uarray2_methods_blocked_prefetch) {
+                int bs = methods->blocksize(ppm->pixels);
+                if (bs == methods->blocksize(out)) {
+                        size_t bytes = (size_t)bs * bs *
+                                       sizeof(struct Pnm_rgb);
+                        for (int r = 0; r * bs < (int)ppm->height; r++) {
+                                for (int c = 0; c * bs < (int)ppm->width;
+                                     c++) {
+                                        memcpy(UArray2b_block(out, c, r),
+                                               UArray2b_block(ppm->pixels,
+                                                              c, r),
+                                               bytes);
+                                }
+                        }
+                } else {
+                        methods->map_block_major(out, copy_cell, ppm);
+                }
+        } else {
+                size_t bytes = (size_t)ppm->width * sizeof(struct Pnm_rgb);
+                for (int row = 0; row < (int)ppm->height && bytes > 0;
+                     row++) {
+                        memcpy(UArray2_row(out, row),
+                               UArray2_row(ppm->pixels, row), bytes);
+                }
+        }
+        methods->free(&out);
+}
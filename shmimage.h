@@ -0,0 +1,49 @@
+#ifndef SHMIMAGE_INCLUDED
+#define SHMIMAGE_INCLUDED
+/**************************************************************
+ *
+ *      shmimage.h
+ *
+ *      Xiaoyan Xie (xxie05)
+ *      Diwei Chen (dchen22)
+ *
+ *      CS 40 HW03 - locality
+ *
+ *      Images handed between processes as shared memory segments
+ *      (a file in /dev/shm, or a memfd reached as /dev/fd/N) that
+ *      hold a small header and the raw cells of a UArray2 or a
+ *      UArray2b.  A writer allocates its result directly in the
+ *      segment and a reader maps the segment as its A2, so a
+ *      chain of stages passes pixels with no copy and no parsing.
+ *
+ *      Layout (native byte order, checked on load):
+ *
+ *        0     64-byte header: magic "A2SHMIM\n", byte-order mark,
+ *              layout, width, height, cell size, blocksize (0 for
+ *              rows), maxval, offset and length of the cells
+ *        4096  the cells: SHMIMAGE_ROWS holds height rows of width
+ *              struct Pnm_rgb, one after another; SHMIMAGE_BLOCKS
+ *              holds the blocks in row-major block order, each
+ *              blocksize * blocksize cells in row-major order
+ *
+ *      Images read here are mapped privately, so changing their
+ *      cells does not change the segment.
+ *
+ **************************************************************/
+
+#include <stdio.h>
+#include "a2methods.h"
+#include "pnm.h"
+
+enum ShmImage_layout {
+        SHMIMAGE_ROWS = 1,
+        SHMIMAGE_BLOCKS = 2
+};
+
+extern Pnm_ppm ShmImage_read(FILE *fp);
+extern A2Methods_UArray2 ShmImage_new(const char *path, A2Methods_T methods,
+                                      int width, int height,
+                                      unsigned maxval);
+extern void ShmImage_write(const char *path, Pnm_ppm ppm);
+
+#endif
@@ -0,0 +1,282 @@
+/**************************************************************
+ *
+ *      simrotate.c
+ *
+ *      Xiaoyan Xie (xxie05)
+ *      Diwei Chen (dchen22)
+ *
+ *      CS 40 HW03 - locality
+ *
+ *      Replays a ppmtrans rotation against the cache simulator.
+ *      The program is linked with the -DCACHESIM builds of
+ *      uarray2.c and uarray2b.c, so every access the rotation
+ *      makes through the A2 implementations is fed to a CacheSim_T
+ *      with the requested geometry.  For each traversal it prints
+ *      hits and misses per level and an estimated cost from
+ *      per-level latencies, then names the traversal the model
+ *      predicts will win on that geometry.
+ *
+ *      The image is either a PPM file or, with -size, a synthetic
+ *      image of the given shape; only the shape matters to the
+ *      model, so no real image is needed to explore a target.
+ *
+ **************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "assert.h"
+#include "a2methods.h"
+#include "a2plain.h"
+#include "a2blocked.h"
+#include "pnm.h"
+#include "rotate.h"
+#include "cachesim.h"
+
+typedef A2Methods_UArray2 A2;
+typedef A2Methods_T A;
+
+#define MAX_LATENCIES (CACHESIM_MAX_LEVELS + 1)
+
+struct traversal {
+        const char *name;
+        A methods;
+        A2Methods_mapfun *map;
+};
+
+struct settings {
+        int rotation;
+        int width, height;              /* synthetic shape, or 0 */
+        int blocksize;                  /* 0: 64KB default */
+        const char *caches, *tlb;
+        double latencies[MAX_LATENCIES];
+        int num_latencies;
+        double tlb_penalty;
+        const char *file;
+        int only;                       /* traversal index, or -1 */
+};
+
+static void usage(const char *progname)
+{
+        fprintf(stderr, "Usage: %s [-rotate <angle>] "
+                        "[-{row,col,block}-major] [-blocksize n] "
+                        "[-caches spec] [-tlb spec] "
+                        "[-latency l1,l2,...,memory] [-tlb-penalty n] "
+                        "{-size WxH | filename}\n"
+                        "  default caches %s, tlb %s\n",
+                        progname, CACHESIM_DEFAULT_CACHES,
+                        CACHESIM_DEFAULT_TLB);
+        exit(1);
+}
+
+static void fill_pixel(void *elem, void *cl)
+{
+        unsigned *counter = cl;
+        struct Pnm_rgb *px = elem;
+        px->red = px->green = px->blue = (*counter)++ & 0xff;
+}
+
+/********************** load_source ***********************
+ * Creates the source image for one traversal: read from
+ * the file, or synthesized with the requested shape.
+ *********************************************************/
+static A2 load_source(struct settings *s, A methods)
+{
+        int size = sizeof(struct Pnm_rgb);
+        if (s->file == NULL) {
+                A2 src = s->blocksize > 0
+                        ? methods->new_with_blocksize(s->width, s->height,
+                                                      size, s->blocksize)
+                        : methods->new(s->width, s->height, size);
+                unsigned counter = 0;
+                methods->small_map_default(src, fill_pixel, &counter);
+                return src;
+        }
+
+        FILE *fp = fopen(s->file, "r");
+        if (fp == NULL) {
+                fprintf(stderr, "Fail to open file.\n");
+                exit(1);
+        }
+        Pnm_ppm image = Pnm_ppmread(fp, methods);
+        fclose(fp);
+        A2 src = image->pixels;
+        if (s->blocksize > 0) {
+                /* re-block at the requested size */
+                int w = methods->width(src), h = methods->height(src);
+                A2 copy = methods->new_with_blocksize(w, h, size,
+                                                      s->blocksize);
+                for (int j = 0; j < h; j++) {
+                        for (int i = 0; i < w; i++) {
+                                *(struct Pnm_rgb *)methods->at(copy, i, j) =
+                                        *(struct Pnm_rgb *)methods->at(src,
+                                                                       i, j);
+                        }
+                }
+                methods->free(&src);
+                src = copy;
+        }
+        image->pixels = NULL;
+        free(image);
+        return src;
+}
+
+/********************** simulate **************************
+ * Runs one traversal under the simulator, prints its
+ * report and returns the estimated cycles per pixel.
+ *********************************************************/
+static double simulate(struct settings *s, struct traversal *t,
+                       CacheSim_T sim)
+{
+        A methods = t->methods;
+        A2 src = load_source(s, methods);
+        int width, height;
+        Rotate_dimensions(methods, src, s->rotation, &width, &height);
+        A2 dst = s->blocksize > 0 && methods == uarray2_methods_blocked
+                ? methods->new_with_blocksize(width, height,
+                                              methods->size(src),
+                                              s->blocksize)
+                : methods->new(width, height, methods->size(src));
+        double pixels = (double)methods->width(src) * methods->height(src);
+
+        CacheSim_reset(sim);
+        CacheSim_current = sim;
+        Rotate_map(t->map, methods, src, dst, s->rotation);
+        CacheSim_current = NULL;
+
+        /* hits at level i cost latency i; misses out of the last
+         * level cost the memory latency */
+        double cycles = 0;
+        int levels = CacheSim_levels(sim);
+        for (int i = 0; i < levels; i++) {
+                struct CacheSim_stats st = CacheSim_level(sim, i);
+                cycles += st.hits * s->latencies[i];
+                if (i == levels - 1) {
+                        cycles += st.misses * s->latencies[levels];
+                }
+        }
+        cycles += CacheSim_tlb(sim).misses * s->tlb_penalty;
+
+        printf("%s, rotate %d, %dx%d, blocksize %d: %llu references\n",
+               t->name, s->rotation, methods->width(src),
+               methods->height(src), methods->blocksize(src),
+               (unsigned long long)CacheSim_references(sim));
+        CacheSim_print(stdout, sim, pixels);
+        printf("estimated %.2f cycles per pixel\n\n", cycles / pixels);
+
+        methods->free(&dst);
+        methods->free(&src);
+        return cycles / pixels;
+}
+
+/************************ main ****************************
+ * Parses the settings, builds the simulator and replays
+ * the rotation with each selected traversal.
+ *********************************************************/
+int main(int argc, char *argv[])
+{
+        struct settings s = {
+                .rotation = 90,
+                .width = 0, .height = 0,
+                .blocksize = 0,
+                .caches = NULL, .tlb = NULL,
+                .latencies = { 4, 14, 50, 200 },
+                .num_latencies = 4,
+                .tlb_penalty = 30,
+                .file = NULL,
+                .only = -1,
+        };
+        struct traversal traversals[] = {
+                { "row-major", uarray2_methods_plain,
+                  uarray2_methods_plain->map_row_major },
+                { "col-major", uarray2_methods_plain,
+                  uarray2_methods_plain->map_col_major },
+                { "block-major", uarray2_methods_blocked,
+                  uarray2_methods_blocked->map_block_major },
+        };
+        int num_traversals = sizeof(traversals) / sizeof(traversals[0]);
+
+        for (int i = 1; i < argc; i++) {
+                int has_arg = i + 1 < argc;
+                if (strcmp(argv[i], "-row-major") == 0) {
+                        s.only = 0;
+                } else if (strcmp(argv[i], "-col-major") == 0) {
+                        s.only = 1;
+                } else if (strcmp(argv[i], "-block-major") == 0) {
+                        s.only = 2;
+                } else if (strcmp(argv[i], "-rotate") == 0 && has_arg) {
+                        s.rotation = atoi(argv[++i]);
+                        if (s.rotation != 90 && s.rotation != 180 &&
+                            s.rotation != 270) {
+                                fprintf(stderr, "Rotation must be 90, "
+                                        "180 or 270\n");
+                                usage(argv[0]);
+                        }
+                } else if (strcmp(argv[i], "-size") == 0 && has_arg) {
+                        if (sscanf(argv[++i], "%dx%d", &s.width,
+                                   &s.height) != 2 ||
+                            s.width <= 0 || s.height <= 0) {
+                                usage(argv[0]);
+                        }
+                } else if (strcmp(argv[i], "-blocksize") == 0 && has_arg) {
+                        s.blocksize = atoi(argv[++i]);
+                        if (s.blocksize <= 0) {
+                                usage(argv[0]);
+                        }
+                } else if (strcmp(argv[i], "-caches") == 0 && has_arg) {
+                        s.caches = argv[++i];
+                } else if (strcmp(argv[i], "-tlb") == 0 && has_arg) {
+                        s.tlb = argv[++i];
+                } else if (strcmp(argv[i], "-tlb-penalty") == 0 &&
+                           has_arg) {
+                        s.tlb_penalty = atof(argv[++i]);
+                } else if (strcmp(argv[i], "-latency") == 0 && has_arg) {
+                        char *p = argv[++i];
+                        s.num_latencies = 0;
+                        while (*p != '\0' && s.num_latencies < MAX_LATENCIES) {
+                                s.latencies[s.num_latencies++] =
+                                        strtod(p, &p);
+                                if (*p == ',') {
+                                        p++;
+                                }
+                        }
+                } else if (*argv[i] == '-' || s.file != NULL) {
+                        usage(argv[0]);
+                } else {
+                        s.file = argv[i];
+                }
+        }
+        if ((s.file == NULL) == (s.width == 0)) {
+                usage(argv[0]);
+        }
+
+        CacheSim_T sim = CacheSim_new(s.caches, s.tlb);
+        if (sim == NULL) {
+                fprintf(stderr, "%s: bad cache or TLB geometry\n", argv[0]);
+                usage(argv[0]);
+        }
+        if (s.num_latencies != CacheSim_levels(sim) + 1) {
+                fprintf(stderr, "%s: -latency needs one value per cache "
+                        "level plus one for memory\n", argv[0]);
+                exit(1);
+        }
+
+        int best = -1;
+        double best_cost = 0;
+        for (int t = 0; t < num_traversals; t++) {
+                if (s.only >= 0 && s.only != t) {
+                        continue;
+                }
+                double cost = simulate(&s, &traversals[t], sim);
+                if (best < 0 || cost < best_cost) {
+                        best = t;
+                        best_cost = cost;
+                }
+        }
+        if (s.only < 0) {
+                printf("predicted fastest: %s (%.2f cycles per pixel)\n",
+                       traversals[best].name, best_cost);
+        }
+
+        CacheSim_free(&sim);
+        return EXIT_SUCCESS;
+}
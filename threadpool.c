@@ -0,0 +1,189 @@
+/**************************************************************
+ *
+ *      threadpool.c
+ *
+ *      Xiaoyan Xie (xxie05)
+ *      Diwei Chen (dchen22)
+ *
+ *      CS 40 HW03 - locality
+ *
+ *      This file implements the persistent thread pool (see
+ *      threadpool.h).  The current job lives in the pool under its
+ *      mutex: workers sleep on `work` until a job has unclaimed
+ *      tasks, claim them by bumping `next`, and the last task to
+ *      finish wakes the caller through `done`.
+ *
+ **************************************************************/
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "assert.h"
+#include "threadpool.h"
+
+#define T ThreadPool_T
+
+struct T {
+        int size;                       /* workers + the caller */
+        pthread_t *workers;
+        pthread_mutex_t lock;
+        pthread_cond_t work, done;
+        pthread_mutex_t job_lock;       /* one job at a time */
+        bool quit;
+
+        /* the current job */
+        void (*task)(int k, void *cl);
+        void *cl;
+        int tasks, next, finished;
+};
+
+/*********************** run_tasks ************************
+ * Claims and runs tasks of the current job until none is
+ * left.  Called, and returns, with the pool locked.
+ *********************************************************/
+static void run_tasks(T pool)
+{
+        while (pool->next < pool->tasks) {
+                int k = pool->next++;
+                pthread_mutex_unlock(&pool->lock);
+                pool->task(k, pool->cl);
+                pthread_mutex_lock(&pool->lock);
+                if (++pool->finished == pool->tasks) {
+                        pthread_cond_signal(&pool->done);
+                }
+        }
+}
+
+static void *worker(void *cl)
+{
+        T pool = cl;
+        pthread_mutex_lock(&pool->lock);
+        while (!pool->quit) {
+                if (pool->next < pool->tasks) {
+                        run_tasks(pool);
+                } else {
+                        pthread_cond_wait(&pool->work, &pool->lock);
+                }
+        }
+        pthread_mutex_unlock(&pool->lock);
+        return NULL;
+}
+
+/********************* ThreadPool_new *********************
+ * Creates a pool.
+ *
+ * Parameters:
+ *      int threads: Threads that run a job, counting the
+ *                   caller of ThreadPool_run (so threads - 1
+ *                   workers are started).
+ *
+ * Returns:
+ *      ThreadPool_T: The pool.
+ *
+ * Expects:
+ *      threads must be at least 1.
+ *
+ * Notes:
+ *      If some workers cannot be started the pool is smaller.
+ *      Will CRE if memory allocation fails.
+ *********************************************************/
+T ThreadPool_new(int threads)
+{
+        assert(threads >= 1);
+        T pool = malloc(sizeof(*pool));
+        assert(pool != NULL);
+        pool->workers = malloc(threads * sizeof(*pool->workers));
+        assert(pool->workers != NULL);
+        pthread_mutex_init(&pool->lock, NULL);
+        pthread_mutex_init(&pool->job_lock, NULL);
+        pthread_cond_init(&pool->work, NULL);
+        pthread_cond_init(&pool->done, NULL);
+        pool->quit = false;
+        pool->task = NULL;
+        pool->cl = NULL;
+        pool->tasks = pool->next = pool->finished = 0;
+
+        pool->size = 1;
+        for (int k = 0; k < threads - 1; k++) {
+                if (pthread_create(&pool->workers[pool->size - 1], NULL,
+                                   worker, pool) != 0) {
+                        break;
+                }
+                pool->size++;
+        }
+        return pool;
+}
+
+/******************** ThreadPool_free *********************
+ * Stops the workers, once they are idle, and frees the pool.
+ *********************************************************/
+void ThreadPool_free(T *pool)
+{
+        assert(pool != NULL && *pool != NULL);
+        T p = *pool;
+        pthread_mutex_lock(&p->lock);
+        p->quit = true;
+        pthread_cond_broadcast(&p->work);
+        pthread_mutex_unlock(&p->lock);
+        for (int k = 0; k < p->size - 1; k++) {
+                pthread_join(p->workers[k], NULL);
+        }
+        pthread_mutex_destroy(&p->lock);
+        pthread_mutex_destroy(&p->job_lock);
+        pthread_cond_destroy(&p->work);
+        pthread_cond_destroy(&p->done);
+        free(p->workers);
+        free(p);
+        *pool = NULL;
+}
+
+/******************** ThreadPool_size *********************
+ * Returns the number of threads that run a job, including
+ * the caller.
+ *********************************************************/
+int ThreadPool_size(T pool)
+{
+        assert(pool != NULL);
+        return pool->size;
+}
+
+/********************* ThreadPool_run *********************
+ * Runs task(k, cl) for every k in 0 .. tasks-1 on the pool
+ * and the calling thread, and waits for all of them.
+ *
+ * Parameters:
+ *      ThreadPool_T pool: The pool.
+ *      int tasks: Number of tasks; 0 does nothing.
+ *      void task(int k, void *cl): Run once per task, possibly
+ *                                  on several threads at once.
+ *      void *cl: Closure passed to every task.
+ *
+ * Expects:
+ *      pool must not be NULL and tasks must be non-negative.
+ *
+ * Notes:
+ *      Tasks are claimed in increasing order but may finish in
+ *      any order.
+ *********************************************************/
+void ThreadPool_run(T pool, int tasks, void task(int k, void *cl), void *cl)
+{
+        assert(pool != NULL && task != NULL && tasks >= 0);
+        if (tasks == 0) {
+                return;
+        }
+        pthread_mutex_lock(&pool->job_lock);
+        pthread_mutex_lock(&pool->lock);
+        pool->task = task;
+        pool->cl = cl;
+        pool->tasks = tasks;
+        pool->next = 0;
+        pool->finished = 0;
+        pthread_cond_broadcast(&pool->work);
+
+        run_tasks(pool);
+        while (pool->finished < pool->tasks) {
+                pthread_cond_wait(&pool->done, &pool->lock);
+        }
+        pool->tasks = pool->next = 0;
+        pthread_mutex_unlock(&pool->lock);
+        pthread_mutex_unlock(&pool->job_lock);
+}
@@ -0,0 +1,34 @@
+#ifndef THREADPOOL_INCLUDED
+#define THREADPOOL_INCLUDED
+/**************************************************************
+ *
+ *      threadpool.h
+ *
+ *      Xiaoyan Xie (xxie05)
+ *      Diwei Chen (dchen22)
+ *
+ *      CS 40 HW03 - locality
+ *
+ *      A fixed set of worker threads that is created once and
+ *      reused.  ThreadPool_run hands out the tasks 0 .. n-1 of a
+ *      job one at a time to the workers and to the calling thread,
+ *      and returns when all of them have finished, so a job costs
+ *      a wakeup rather than a thread creation.
+ *
+ *      One job runs at a time; concurrent ThreadPool_run calls
+ *      wait their turn.  A task must not start another job on the
+ *      same pool.
+ *
+ **************************************************************/
+
+#define T ThreadPool_T
+typedef struct T *T;
+
+extern T    ThreadPool_new(int threads);
+extern void ThreadPool_free(T *pool);
+extern int  ThreadPool_size(T pool);
+extern void ThreadPool_run(T pool, int tasks,
+                           void task(int k, void *cl), void *cl);
+
+#undef T
+#endif
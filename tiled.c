@@ -0,0 +1,355 @@
+/**************************************************************
+ *
+ *      tiled.c
+ *
+ *      Xiaoyan Xie (xxie05)
+ *      Diwei Chen (dchen22)
+ *
+ *      CS 40 HW03 - locality
+ *
+ *      This file implements the tiled image format (see tiled.h).
+ *      Regular files are mapped with mmap and the blocks are used
+ *      in place through UArray2b_new_from_buffer; other streams
+ *      are read into one aligned buffer used the same way.
+ *      Writing goes block by block: straight from the blocks of a
+ *      blocked image, or gathered through at() from any other
+ *      representation.
+ *
+ **************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "assert.h"
+#include "except.h"
+#include "mem.h"
+#include "a2methods.h"
+#include "a2blocked.h"
+#include "a2prefetch.h"
+#include "uarray2bext.h"
+#include "pnm.h"
+#include "tiled.h"
+
+#define MAGIC "A2TILED\n"
+#define BYTE_ORDER_MARK 0x01020304u
+#define BLOCKS_ALIGN 4096
+
+/******************* struct tiled_header *******************
+ * The 64 bytes at the start of every tiled file.
+ *********************************************************/
+struct tiled_header {
+        char magic[8];
+        uint32_t byte_order;
+        uint32_t width, height;
+        uint32_t cell_size, blocksize;
+        uint32_t maxval;
+        uint32_t flags;
+        uint32_t reserved;
+        uint64_t blocks_offset;
+        uint64_t block_bytes;
+        uint64_t num_blocks;
+};
+
+/* storage behind an image read from a file */
+struct mapping {
+        void *base;
+        size_t length;
+        bool mapped;            /* munmap, rather than free, base */
+};
+
+static uint32_t crc_table[256];
+
+/*********************** crc32 ****************************
+ * CRC-32 (IEEE 802.3 polynomial) of n bytes, table driven.
+ *********************************************************/
+static uint32_t crc32(const unsigned char *p, size_t n)
+{
+        if (crc_table[1] == 0) {
+                for (uint32_t i = 0; i < 256; i++) {
+                        uint32_t c = i;
+                        for (int k = 0; k < 8; k++) {
+                                c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                        }
+                        crc_table[i] = c;
+                }
+        }
+        uint32_t c = 0xFFFFFFFFu;
+        while (n-- > 0) {
+                c = crc_table[(c ^ *p++) & 0xff] ^ (c >> 8);
+        }
+        return c ^ 0xFFFFFFFFu;
+}
+
+static void release_mapping(void *cells, void *cl)
+{
+        struct mapping *m = cl;
+        (void)cells;
+        if (m->mapped) {
+                munmap(m->base, m->length);
+        } else {
+                free(m->base);
+        }
+        free(m);
+}
+
+/********************** valid_header **********************
+ * Checks that a header is self-consistent and that the
+ * file of `length` bytes holds every block it describes.
+ *********************************************************/
+static bool valid_header(const struct tiled_header *h, uint64_t length)
+{
+        if (memcmp(h->magic, MAGIC, 8) != 0 ||
+            h->byte_order != BYTE_ORDER_MARK ||
+            h->cell_size != sizeof(struct Pnm_rgb) ||
+            h->blocksize == 0 || h->maxval == 0 || h->maxval > 65535 ||
+            h->width > INT_MAX || h->height > INT_MAX ||
+            h->blocks_offset % 64 != 0) {
+                return false;
+        }
+        uint64_t bs = h->blocksize;
+        uint64_t blocks = ((h->width + bs - 1) / bs) *
+                          ((h->height + bs - 1) / bs);
+        uint64_t table = h->flags & TILED_CHECKSUMS ? blocks * 4 : 0;
+        if (h->num_blocks != blocks ||
+            h->block_bytes != bs * bs * h->cell_size ||
+            h->block_bytes > INT_MAX ||
+            h->blocks_offset < sizeof(*h) + table) {
+                return false;
+        }
+        return blocks <= (UINT64_MAX - h->blocks_offset) / h->block_bytes &&
+               length >= h->blocks_offset + blocks * h->block_bytes;
+}
+
+/************************ load ****************************
+ * Maps fp's file, or reads the stream into an aligned
+ * buffer, and returns the storage.  Returns NULL if the
+ * header is missing or malformed.
+ *********************************************************/
+static struct mapping *load(FILE *fp)
+{
+        struct mapping *m = malloc(sizeof(*m));
+        assert(m != NULL);
+        struct tiled_header h;
+        struct stat st;
+        int fd = fileno(fp);
+
+        if (fd >= 0 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode) &&
+            (size_t)st.st_size >= sizeof(h)) {
+                m->length = st.st_size;
+                m->base = mmap(NULL, m->length, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE, fd, 0);
+                m->mapped = m->base != MAP_FAILED;
+                if (m->mapped) {
+                        memcpy(&h, m->base, sizeof(h));
+                        if (valid_header(&h, m->length)) {
+                                return m;
+                        }
+                        munmap(m->base, m->length);
+                        free(m);
+                        return NULL;
+                }
+        }
+
+        /* not mappable: read the header, then everything it names */
+        if (fread(&h, sizeof(h), 1, fp) != 1 ||
+            !valid_header(&h, UINT64_MAX - 1)) {
+                free(m);
+                return NULL;
+        }
+        m->length = h.blocks_offset + h.num_blocks * h.block_bytes;
+        m->mapped = false;
+        if (posix_memalign(&m->base, BLOCKS_ALIGN, m->length) != 0) {
+                m->base = NULL;
+        }
+        assert(m->base != NULL);
+        memcpy(m->base, &h, sizeof(h));
+        size_t rest = m->length - sizeof(h);
+        if (fread((char *)m->base + sizeof(h), 1, rest, fp) != rest) {
+                free(m->base);
+                free(m);
+                return NULL;
+        }
+        return m;
+}
+
+/*********************** Tiled_read ***********************
+ * Loads a tiled image.
+ *
+ * Parameters:
+ *      FILE *fp: The file (read from its start when it can be
+ *                mapped, from the current position otherwise).
+ *      bool verify: Check the per-block checksums, which the
+ *                   file must then have.
+ *
+ * Returns:
+ *      Pnm_ppm: The image, using uarray2_methods_blocked.
+ *
+ * Expects:
+ *      fp must not be NULL.
+ *
+ * Notes:
+ *      Raises Pnm_Badformat for a malformed or truncated file,
+ *      a checksum mismatch, or verify on a file written
+ *      without checksums (which has nothing to verify).
+ *      Verifying reads every block, so it gives up the lazy
+ *      paging-in of the mapping.  Will CRE if memory
+ *      allocation fails.
+ *********************************************************/
+Pnm_ppm Tiled_read(FILE *fp, bool verify)
+{
+        assert(fp != NULL);
+        struct mapping *m = load(fp);
+        if (m == NULL) {
+                RAISE(Pnm_Badformat);
+        }
+        struct tiled_header h;
+        memcpy(&h, m->base, sizeof(h));
+        char *cells = (char *)m->base + h.blocks_offset;
+
+        if (verify && !(h.flags & TILED_CHECKSUMS)) {
+                release_mapping(cells, m);
+                RAISE(Pnm_Badformat);
+        }
+        if (verify) {
+                const uint32_t *sums = (const uint32_t *)
+                                       ((char *)m->base + sizeof(h));
+                for (uint64_t k = 0; k < h.num_blocks; k++) {
+                        if (crc32((unsigned char *)cells +
+                                  k * h.block_bytes, h.block_bytes) !=
+                            sums[k]) {
+                                release_mapping(cells, m);
+                                RAISE(Pnm_Badformat);
+                        }
+                }
+        }
+
+        Pnm_ppm ppm;
+        NEW(ppm);
+        assert(ppm != NULL);
+        ppm->width = h.width;
+        ppm->height = h.height;
+        ppm->denominator = h.maxval;
+        ppm->methods = uarray2_methods_blocked;
+        ppm->pixels = UArray2b_new_from_buffer(h.width, h.height,
+                                               h.cell_size, h.blocksize,
+                                               cells, release_mapping, m);
+        return ppm;
+}
+
+/********************** block_data ************************
+ * Returns the cells of one block in file order: the block
+ * itself for blocked images, otherwise a copy gathered into
+ * scratch with at() (cells past the image are zero).
+ *********************************************************/
+static const void *block_data(Pnm_ppm ppm, bool blocked, int bs,
+                              int b_col, int b_row, char *scratch)
+{
+        if (blocked) {
+                return UArray2b_block(ppm->pixels, b_col, b_row);
+        }
+        int size = sizeof(struct Pnm_rgb);
+        memset(scratch, 0, (size_t)bs * bs * size);
+        for (int ly = 0; ly < bs; ly++) {
+                int y = b_row * bs + ly;
+                for (int lx = 0; lx < bs && y < (int)ppm->height; lx++) {
+                        int x = b_col * bs + lx;
+                        if (x >= (int)ppm->width) {
+                                break;
+                        }
+                        memcpy(scratch + ((size_t)ly * bs + lx) * size,
+                               ppm->methods->at(ppm->pixels, x, y), size);
+                }
+        }
+        return scratch;
+}
+
+static void put(FILE *fp, const void *p, size_t n)
+{
+        size_t written = n > 0 ? fwrite(p, n, 1, fp) : 1;
+        assert(written == 1);
+}
+
+/********************** Tiled_write ***********************
+ * Writes an image in the tiled format.
+ *
+ * Parameters:
+ *      FILE *fp: Output stream.
+ *      Pnm_ppm ppm: Image in any A2 representation.
+ *      bool checksums: Include a CRC-32 for every block.
+ *
+ * Expects:
+ *      fp and ppm must not be NULL.
+ *
+ * Notes:
+ *      Blocked images keep their blocksize and are written
+ *      straight from their blocks; others are re-blocked with
+ *      the largest blocks of at most 64KB, as
+ *      UArray2b_new_64K_block would choose.  Will CRE if a
+ *      write or memory allocation fails.
+ *********************************************************/
+void Tiled_write(FILE *fp, Pnm_ppm ppm, bool checksums)
+{
+        assert(fp != NULL && ppm != NULL);
+        A2Methods_T methods = ppm->methods;
+        bool blocked = methods == uarray2_methods_blocked ||
+                       methods == uarray2_methods_blocked_prefetch;
+        int size = sizeof(struct Pnm_rgb);
+        int bs = blocked ? methods->blocksize(ppm->pixels)
+                         : (int)floor(sqrt(64 * 1024 / size));
+        assert(methods->size(ppm->pixels) == size);
+
+        int blocks_wide = (ppm->width + bs - 1) / bs;
+        int blocks_high = (ppm->height + bs - 1) / bs;
+        struct tiled_header h;
+        memset(&h, 0, sizeof(h));
+        memcpy(h.magic, MAGIC, 8);
+        h.byte_order = BYTE_ORDER_MARK;
+        h.width = ppm->width;
+        h.height = ppm->height;
+        h.cell_size = size;
+        h.blocksize = bs;
+        h.maxval = ppm->denominator;
+        h.flags = checksums ? TILED_CHECKSUMS : 0;
+        h.block_bytes = (uint64_t)bs * bs * size;
+        h.num_blocks = (uint64_t)blocks_wide * blocks_high;
+        uint64_t table = checksums ? h.num_blocks * 4 : 0;
+        h.blocks_offset = (sizeof(h) + table + BLOCKS_ALIGN - 1) /
+                          BLOCKS_ALIGN * BLOCKS_ALIGN;
+
+        char *scratch = blocked ? NULL : malloc(h.block_bytes);
+        assert(blocked || scratch != NULL);
+        uint32_t *sums = NULL;
+        if (checksums) {
+                sums = malloc(table + 1);
+                assert(sums != NULL);
+                for (int b_row = 0; b_row < blocks_high; b_row++) {
+                        for (int b_col = 0; b_col < blocks_wide; b_col++) {
+                                sums[b_row * blocks_wide + b_col] = crc32(
+                                        block_data(ppm, blocked, bs, b_col,
+                                                   b_row, scratch),
+                                        h.block_bytes);
+                        }
+                }
+        }
+
+        static const char zeros[BLOCKS_ALIGN];
+        size_t pad = h.blocks_offset - sizeof(h) - table;
+        put(fp, &h, sizeof(h));
+        put(fp, sums, table);
+        put(fp, zeros, pad);
+        for (int b_row = 0; b_row < blocks_high; b_row++) {
+                for (int b_col = 0; b_col < blocks_wide; b_col++) {
+                        const void *data = block_data(ppm, blocked, bs,
+                                                      b_col, b_row,
+                                                      scratch);
+                        put(fp, data, h.block_bytes);
+                }
+        }
+        free(sums);
+        free(scratch);
+}
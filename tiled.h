@@ -0,0 +1,45 @@
+#ifndef TILED_INCLUDED
+#define TILED_INCLUDED
+/**************************************************************
+ *
+ *      tiled.h
+ *
+ *      Xiaoyan Xie (xxie05)
+ *      Diwei Chen (dchen22)
+ *
+ *      CS 40 HW03 - locality
+ *
+ *      A binary image format whose pixel data is laid out exactly
+ *      as UArray2b stores it, so that an image can be loaded by
+ *      mapping the file and wrapping it in a blocked A2, with no
+ *      parsing and no re-blocking.
+ *
+ *      Layout (native byte order, checked on load):
+ *
+ *        0     64-byte header: magic "A2TILED\n", byte-order mark,
+ *              width, height, cell size, blocksize, maxval,
+ *              flags, offset of the first block, bytes per block
+ *              and number of blocks
+ *        64    with TILED_CHECKSUMS, one CRC-32 per block
+ *        ...   zero padding to a 4096-byte boundary
+ *        off   the blocks in row-major block order, each holding
+ *              blocksize * blocksize struct Pnm_rgb cells in
+ *              row-major order (edge cells past the image are
+ *              zero)
+ *
+ *      Images read here use uarray2_methods_blocked and are freed
+ *      with Pnm_ppmfree, which also unmaps the file.  Cells may be
+ *      modified; the mapping is private, so the file is not.
+ *
+ **************************************************************/
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "pnm.h"
+
+#define TILED_CHECKSUMS 1       /* header flag: per-block CRC-32s */
+
+extern Pnm_ppm Tiled_read(FILE *fp, bool verify);
+extern void Tiled_write(FILE *fp, Pnm_ppm ppm, bool checksums);
+
+#endif
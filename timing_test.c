@@ -33,5 +33,22 @@ main(int argc, char *argv[])
 
         CPUTime_Free(&timer);
 
+        /* same loops with the stack-allocated fast timer */
+        CPUTime_Fast fast;
+        CPUTime_FastInit();
+        printf("Fast timer backend: %s\n", CPUTime_FastBackend());
+        innerlimit = 1;
+        for (outerct = 0; outerct < outerlooptimes; outerct++) {
+                sum = 0.0;
+                CPUTime_FastStart(&fast);
+                for (i = 0; i < innerlimit; i++) {
+                        sum += i;
+                }
+                time_used = CPUTime_FastStop(&fast);
+                printf ("Sum %.0f was computed in %.0f nanoseconds "
+                        "(fast timer)\n", sum, time_used);
+                innerlimit *= 10;
+        }
+
         return EXIT_SUCCESS;
 }
@@ -1,70 +1,109 @@
 #include <stdlib.h>
+#include <stdbool.h>
 #include "assert.h"
 #include "mem.h"
-#include "uarray.h"
 #include "uarray2.h"
+#include "uarray2ext.h"
+#include "cachesim.h"
 
 #define T UArray2_T
 
 /* 
- * Element (i, j) in the world of ideas maps to
- * rows[j][i] where the square brackets stand for access
- * to a Hanson UArray_T
+ * Element (i, j) in the world of ideas maps to the cell at
+ * cells + ((long)j * width + i) * size: the rows are stored one
+ * after another in a single block of memory, which may belong to
+ * someone else (UArray2_new_from_buffer)
  */
 struct T {
         int width, height;
         int size;
-        UArray_T rows; /* UArray_T of 'height' UArray_Ts,
-                          each of length 'width' and size 'size' */
+        char *cells;
+        void (*release)(void *cells, void *cl); /* NULL: not ours */
+        void *release_cl;
+        bool owned;                             /* cells from CALLOC */
 };
 
-static inline UArray_T row(T a, int j)
+static inline char *row(T a, int j)
 {
-        UArray_T *prow = UArray_at(a->rows, j);   /* Ramsey idiom */
-        return *prow;
+        return a->cells + (long)j * a->width * a->size;
+}
+
+static inline void *cell(T a, int i, int j)
+{
+        return row(a, j) + (long)i * a->size;
 }
 
 static int is_ok(T a)
 {
-        return a && UArray_length(a->rows) == a->height &&
-               UArray_size(a->rows) == sizeof(UArray_T) &&
-               (a->height == 0 || (UArray_length(row(a, 0)) == a->width
-                                   && UArray_size  (row(a, 0)) == a->size));
+        return a && a->width >= 0 && a->height >= 0 && a->size >= 0 &&
+               (a->cells != NULL || (long)a->width * a->height == 0);
 }
 
 T UArray2_new(int width, int height, int size)
 {
-        int i;  /* interates over row number */
         T array;
+        assert(width >= 0 && height >= 0 && size > 0);
         NEW(array);
         array->width  = width;
         array->height = height;
         array->size   = size;
-        array->rows   = UArray_new(height, sizeof(UArray_T));
-        for (i = 0; i < height; i++) {
-                UArray_T *rowp = UArray_at(array->rows, i);
-                *rowp = UArray_new(width, size);
+        array->cells  = NULL;
+        if ((long)width * height > 0) {
+                array->cells = CALLOC((long)width * height, size);
+                assert(array->cells != NULL);
         }
+        array->release = NULL;
+        array->release_cl = NULL;
+        array->owned = true;
+        assert(is_ok(array));
+        return array;
+}
+
+/*
+ * A 2D array over cells, which must hold height rows of width
+ * cells one after another (the layout of UArray2_new), such as a
+ * shared memory segment.  release(cells, cl) is called by
+ * UArray2_free unless it is NULL, in which case the caller keeps
+ * ownership of cells.
+ */
+T UArray2_new_from_buffer(int width, int height, int size, void *cells,
+                          void release(void *cells, void *cl), void *cl)
+{
+        T array;
+        assert(width >= 0 && height >= 0 && size > 0);
+        assert(cells != NULL);
+        NEW(array);
+        array->width  = width;
+        array->height = height;
+        array->size   = size;
+        array->cells  = cells;
+        array->release = release;
+        array->release_cl = cl;
+        array->owned = false;
         assert(is_ok(array));
         return array;
 }
 
 void UArray2_free(T *array2)
 {
-        int i;
         assert(array2 != NULL && *array2 != NULL);
-        for (i = 0; i < (*array2)->height; i++) {
-                UArray_T p = row(*array2, i);
-                UArray_free(&p);
+        T a = *array2;
+        if (a->owned) {
+                FREE(a->cells);
+        } else if (a->release != NULL) {
+                a->release(a->cells, a->release_cl);
         }
-        UArray_free(&(*array2)->rows);
         FREE(*array2);
 }
 
 void *UArray2_at(T array2, int i, int j)
 {
         assert(array2 != NULL);
-        return UArray_at(row(array2, j), i);
+        assert(i >= 0 && i < array2->width);
+        assert(j >= 0 && j < array2->height);
+        void *elem = cell(array2, i, j);
+        CACHESIM_TOUCH(elem, array2->size);
+        return elem;
 }
 
 int UArray2_height(T array2)
@@ -94,10 +133,13 @@ void UArray2_map_row_major(T array2,
         int h = array2->height;  /* keeping height and width in registers */
         int w = array2->width;   /* avoids extra memory traffic           */
         for (int j = 0; j < h; j++) {
-                /* don't want row/UArray_at in inner loop */
-                UArray_T thisrow = row(array2, j); 
-                for (int i = 0; i < w; i++)
-                        apply(i, j, array2, UArray_at(thisrow, i), cl);
+                /* don't want row() in inner loop */
+                char *thisrow = row(array2, j);
+                for (int i = 0; i < w; i++) {
+                        void *elem = thisrow + (long)i * array2->size;
+                        CACHESIM_TOUCH(elem, array2->size);
+                        apply(i, j, array2, elem, cl);
+                }
         }
 }
 
@@ -110,6 +152,53 @@ void UArray2_map_col_major(T array2,
         int h = array2->height;  /* keeping height and width in registers */
         int w = array2->width;   /* avoids extra memory traffic           */
         for (int i = 0; i < w; i++)
-                for (int j = 0; j < h; j++)
-                        apply(i, j, array2, UArray_at(row(array2, j), i), cl);
+                for (int j = 0; j < h; j++) {
+                        void *elem = cell(array2, i, j);
+                        CACHESIM_TOUCH(elem, array2->size);
+                        apply(i, j, array2, elem, cl);
+                }
+}
+
+/*
+ * Same visiting order as UArray2_map_col_major.  Consecutive
+ * cells of a column are a whole row apart, which the hardware
+ * prefetcher does not follow, so the cell `distance` rows further
+ * down the column (wrapping to the top of the next column) is
+ * prefetched before each visit.  distance 0 disables prefetching.
+ */
+void UArray2_map_col_major_prefetch(T array2,
+                                    void apply(int i, int j, T array2,
+                                               void *elem, void *cl),
+                                    void *cl, int distance)
+{
+        assert(array2 != NULL);
+        assert(distance >= 0);
+        int h = array2->height;
+        int w = array2->width;
+        for (int i = 0; i < w; i++)
+                for (int j = 0; j < h; j++) {
+                        int pi = i, pj = j + distance;
+                        if (pj >= h) {          /* top of next column */
+                                pj -= h;
+                                pi++;
+                        }
+                        if (distance > 0 && pi < w && pj < h)
+                                __builtin_prefetch(cell(array2, pi, pj));
+                        void *elem = cell(array2, i, j);
+                        CACHESIM_TOUCH(elem, array2->size);
+                        apply(i, j, array2, elem, cl);
+                }
+}
+
+/*
+ * Address of the first cell of row j; the row's cells follow it
+ * contiguously.  NULL for an array of width 0.
+ */
+void *UArray2_row(T array2, int j)
+{
+        assert(array2 != NULL);
+        assert(j >= 0 && j < array2->height);
+        if (array2->width == 0)
+                return NULL;
+        return row(array2, j);
 }
@@ -18,25 +18,125 @@
  *
  **************************************************************/
 #include <stdlib.h>
+#include <stdbool.h>
 #include "assert.h"
 #include "uarray.h"
 #include "uarray2b.h"
 #include <string.h>
 #include "uarray2.h"
+#include "uarray2bext.h"
+#include "cachesim.h"
 #include <math.h>
+#ifdef UARRAY2B_HISTOGRAM
+#include "blockhist.h"
+#include "cputiming.h"
+#endif
 
 
 #define T UArray2b_T
 
+/* bytes covered by one software prefetch */
+#define PREFETCH_LINE 64
+
+/* most cells one run-length token can cover */
+#define RLE_MAX 0x8000
+
+#ifdef UARRAY2B_HISTOGRAM
+/* histogram filled by UArray2b_map, or NULL when not recording */
+static BlockHist_T block_histogram = NULL;
+
+/***************** UArray2b_set_histogram *****************
+ * Sets the histogram that UArray2b_map records per-block
+ * processing times into; NULL stops recording.
+ *********************************************************/
+extern void UArray2b_set_histogram(BlockHist_T hist)
+{
+        block_histogram = hist;
+}
+#endif
+
+/********************** struct packed *********************
+ * Block storage of a compressed array: every block is kept
+ * run-length encoded (data[k] of length[k] bytes, NULL for a
+ * block that has never been stored, which is all zeros), and
+ * the blocks in use are decoded into a small cache of slots.
+ * Cached blocks are encoded again when they are evicted,
+ * unless they are clean: reached only while the array was
+ * not writable (UArray2b_set_writable), so the stored form
+ * still holds their cells.
+ *********************************************************/
+struct slot {
+        int block;                      /* block held, -1 if none */
+        unsigned long used;             /* LRU stamp */
+        bool dirty;                     /* may differ from data */
+        char *cells;
+};
+
+struct packed {
+        int blocks_wide;
+        int num_blocks;
+        long block_bytes;
+        unsigned char **data;
+        long *length;
+        int num_slots;
+        struct slot *slots;
+        int mru;                        /* most recently used slot */
+        unsigned long clock;
+        bool writable;                  /* reached slots become dirty */
+        unsigned char *scratch;         /* encoder output */
+};
+
 /*********************** struct T ***********************
- * Defines the structure for a blocked 2D array.
+ * Defines the structure for a blocked 2D array.  Blocks are
+ * either separate UArrays (blocks), consecutive blocksize *
+ * blocksize runs of cells in one caller-supplied buffer
+ * (cells, for UArray2b_new_from_buffer) or compressed
+ * (packed, for UArray2b_new_compressed).
  *********************************************************/
 struct T {
         int width, height;
         int size, blocksize;
         UArray2_T blocks;
+        char *cells;
+        void (*release)(void *cells, void *cl);
+        void *release_cl;
+        struct packed *packed;
 };
 
+static char *load_block(T array2b, int block);
+
+static inline int num_blocks(T array2b)
+{
+        int blocksize = array2b->blocksize;
+        return ((array2b->width + blocksize - 1) / blocksize) *
+               ((array2b->height + blocksize - 1) / blocksize);
+}
+
+/*********************** block_at *************************
+ * Returns the address of the first cell of a block, for
+ * either kind of block storage.
+ *********************************************************/
+static inline char *block_at(T array2b, int b_col, int b_row)
+{
+        if (array2b->packed != NULL) {
+                return load_block(array2b,
+                                  b_row * array2b->packed->blocks_wide +
+                                  b_col);
+        }
+        if (array2b->cells != NULL) {
+                int blocksize = array2b->blocksize;
+                long blocks_wide = (array2b->width + blocksize - 1) /
+                                   blocksize;
+                long block_bytes = (long)blocksize * blocksize *
+                                   array2b->size;
+                return array2b->cells +
+                       (b_row * blocks_wide + b_col) * block_bytes;
+        }
+        UArray_T *block_p = UArray2_at(array2b->blocks, b_col, b_row);
+        assert(block_p != NULL && *block_p != NULL);
+        return UArray_at(*block_p, 0);
+}
+
 /********************** UArray2b_new **********************
  * Creates a new blocked 2D array.
  * 
@@ -73,6 +173,10 @@ extern T UArray2b_new (int width, int height, int size, int blocksize)
         uarray2_b->height = height;
         uarray2_b->size = size;
         uarray2_b->blocksize = blocksize;
+        uarray2_b->cells = NULL;
+        uarray2_b->release = NULL;
+        uarray2_b->release_cl = NULL;
+        uarray2_b->packed = NULL;
 
         uarray2_b->blocks = UArray2_new(num_blocks_width, num_blocks_height, 
                                             sizeof(UArray_T));
@@ -127,6 +231,351 @@ extern T UArray2b_new_64K_block(int width, int height, int size)
         return UArray2b_new(width, height, size, blocksize);
 }
 
+/**************** UArray2b_new_from_buffer ****************
+ * Creates a blocked 2D array over existing cell storage, such
+ * as a memory-mapped file, without copying it.
+ * 
+ * Parameters:
+ *      - int width, height, size, blocksize: As for UArray2b_new.
+ *      - void *cells: Storage for all blocks, in row-major block
+ *                     order, each block's blocksize * blocksize
+ *                     cells in row-major order (the layout that
+ *                     UArray2b_block exposes).
+ *      - void release(void *cells, void *cl): Called with cells
+ *                     and cl by UArray2b_free, or NULL if the
+ *                     caller keeps ownership of cells.
+ *      - void *cl: Closure for release.
+ * 
+ * Returns:
+ *      - UArray2b_T: A new blocked 2D array using cells.
+ * 
+ * Expects:
+ *      - width, height and size must be non-negative.
+ *      - blocksize must be greater than 0.
+ *      - cells must not be NULL and must hold every block.
+ * 
+ * Notes:
+ *      - Will CRE if memory allocation fails.
+ *********************************************************/
+extern T UArray2b_new_from_buffer(int width, int height, int size,
+                                  int blocksize, void *cells,
+                                  void release(void *cells, void *cl),
+                                  void *cl)
+{
+        assert(width >= 0);
+        assert(height >= 0);
+        assert(size >= 0);
+        assert(blocksize > 0);
+        assert(cells != NULL);
+
+        T uarray2_b = (T)malloc(sizeof(struct T));
+        assert(uarray2_b != NULL);
+        uarray2_b->width = width;
+        uarray2_b->height = height;
+        uarray2_b->size = size;
+        uarray2_b->blocksize = blocksize;
+        uarray2_b->blocks = NULL;
+        uarray2_b->cells = cells;
+        uarray2_b->release = release;
+        uarray2_b->release_cl = cl;
+        uarray2_b->packed = NULL;
+        return uarray2_b;
+}
+
+/*************** UArray2b_new_compressed ******************
+ * Creates a blocked 2D array whose blocks are kept
+ * compressed, for images with large flat regions.
+ * 
+ * Parameters:
+ *      - int width, height, size, blocksize: As for UArray2b_new.
+ *      - int cache_blocks: Number of blocks kept decoded at once.
+ * 
+ * Returns:
+ *      - UArray2b_T: A new blocked 2D array, all cells zero.
+ * 
+ * Expects:
+ *      - width, height and size must be non-negative.
+ *      - blocksize must be greater than 0.
+ *      - cache_blocks must be at least 2.
+ * 
+ * Notes:
+ *      - Each block is stored as runs of identical cells (or
+ *        raw, when that is smaller) and decoded into an LRU
+ *        cache of cache_blocks blocks when a cell in it is
+ *        reached with UArray2b_at, UArray2b_map or
+ *        UArray2b_block.  A block leaving the cache is encoded
+ *        again, so cells may be written through the returned
+ *        pointers; see UArray2b_set_writable for skipping that
+ *        when they are only read.
+ *      - A pointer into a block stays valid until cache_blocks
+ *        other blocks have been reached since.  The cache is
+ *        not thread-safe.
+ *      - Will CRE if memory allocation fails.
+ *********************************************************/
+extern T UArray2b_new_compressed(int width, int height, int size,
+                                 int blocksize, int cache_blocks)
+{
+        assert(width >= 0);
+        assert(height >= 0);
+        assert(size >= 0);
+        assert(blocksize > 0);
+        assert(cache_blocks >= 2);
+
+        struct packed *p = malloc(sizeof(*p));
+        assert(p != NULL);
+        p->blocks_wide = (width + blocksize - 1) / blocksize;
+        p->num_blocks = p->blocks_wide *
+                        ((height + blocksize - 1) / blocksize);
+        p->block_bytes = (long)blocksize * blocksize * size;
+        p->data = calloc(p->num_blocks + 1, sizeof(*p->data));
+        p->length = calloc(p->num_blocks + 1, sizeof(*p->length));
+        p->num_slots = cache_blocks;
+        p->slots = malloc(cache_blocks * sizeof(*p->slots));
+        p->mru = 0;
+        p->clock = 0;
+        p->writable = true;
+        p->scratch = malloc((long)blocksize * blocksize * (size + 2) + 1);
+        assert(p->data != NULL && p->length != NULL);
+        assert(p->slots != NULL && p->scratch != NULL);
+        for (int k = 0; k < cache_blocks; k++) {
+                p->slots[k].block = -1;
+                p->slots[k].used = 0;
+                p->slots[k].dirty = false;
+                p->slots[k].cells = malloc(p->block_bytes + 1);
+                assert(p->slots[k].cells != NULL);
+        }
+
+        T uarray2_b = (T)malloc(sizeof(struct T));
+        assert(uarray2_b != NULL);
+        uarray2_b->width = width;
+        uarray2_b->height = height;
+        uarray2_b->size = size;
+        uarray2_b->blocksize = blocksize;
+        uarray2_b->blocks = NULL;
+        uarray2_b->cells = NULL;
+        uarray2_b->release = NULL;
+        uarray2_b->release_cl = NULL;
+        uarray2_b->packed = p;
+        return uarray2_b;
+}
+
+/* writes a literal token for cells [from, to), if any */
+static unsigned char *put_literals(unsigned char *out, const char *cells,
+                                   int from, int to, int size)
+{
+        if (to > from) {
+                int count = to - from;
+                out[0] = (count - 1) & 0xff;
+                out[1] = (count - 1) >> 8;
+                memcpy(out + 2, cells + (long)from * size,
+                       (long)count * size);
+                out += 2 + (long)count * size;
+        }
+        return out;
+}
+
+/********************** rle_encode ************************
+ * Encodes n cells of size bytes into out, which must hold
+ * n * (size + 2) bytes, and returns the encoded length.
+ * Each token is a little-endian 16-bit header followed by
+ * cells: with the top bit set, one cell repeated (low bits
+ * + 1) times; otherwise (header + 1) literal cells.
+ *********************************************************/
+static long rle_encode(const char *cells, int n, int size,
+                       unsigned char *out)
+{
+        unsigned char *o = out;
+        int literal = 0;                /* first cell not yet encoded */
+        int i = 0;
+        while (i < n) {
+                const char *cell = cells + (long)i * size;
+                int run = 1;
+                while (i + run < n && run < RLE_MAX &&
+                       memcmp(cell + (long)run * size, cell, size) == 0) {
+                        run++;
+                }
+                if (run >= 2) {
+                        o = put_literals(o, cells, literal, i, size);
+                        o[0] = (run - 1) & 0xff;
+                        o[1] = 0x80 | (run - 1) >> 8;
+                        memcpy(o + 2, cell, size);
+                        o += 2 + size;
+                        i += run;
+                        literal = i;
+                } else if (++i - literal == RLE_MAX) {
+                        o = put_literals(o, cells, literal, i, size);
+                        literal = i;
+                }
+        }
+        o = put_literals(o, cells, literal, n, size);
+        return o - out;
+}
+
+/********************** rle_decode ************************
+ * Decodes length bytes written by rle_encode back into n
+ * cells.
+ *********************************************************/
+static void rle_decode(const unsigned char *in, long length, int n,
+                       int size, char *cells)
+{
+        const unsigned char *end = in + length;
+        int i = 0;
+        while (in < end) {
+                int header = in[0] | in[1] << 8;
+                int count = (header & 0x7fff) + 1;
+                in += 2;
+                assert(i + count <= n);
+                if (header & 0x8000) {
+                        for (int k = 0; k < count; k++) {
+                                memcpy(cells + (long)(i + k) * size, in,
+                                       size);
+                        }
+                        in += size;
+                } else {
+                        memcpy(cells + (long)i * size, in,
+                               (long)count * size);
+                        in += (long)count * size;
+                }
+                i += count;
+        }
+        assert(i == n);
+}
+
+/********************** store_block ***********************
+ * Replaces the stored form of a block with the encoding of
+ * cells, or a raw copy when encoding does not save space.
+ *********************************************************/
+static void store_block(T array2b, int block, const char *cells)
+{
+        struct packed *p = array2b->packed;
+        int n = array2b->blocksize * array2b->blocksize;
+        long length = rle_encode(cells, n, array2b->size, p->scratch);
+        const void *src = p->scratch;
+        if (length >= p->block_bytes) {
+                length = p->block_bytes;
+                src = cells;
+        }
+        if (length != p->length[block] || p->data[block] == NULL) {
+                free(p->data[block]);
+                p->data[block] = malloc(length + 1);
+                assert(p->data[block] != NULL);
+                p->length[block] = length;
+        }
+        memcpy(p->data[block], src, length);
+}
+
+/********************** load_block ************************
+ * Returns the decoded cells of a block of a compressed
+ * array, decoding it into the least recently used slot
+ * (after storing that slot's block, if dirty) if it is not
+ * cached.  The slot is marked dirty if the array is
+ * writable.
+ *********************************************************/
+static char *load_block(T array2b, int block)
+{
+        struct packed *p = array2b->packed;
+        struct slot *slot = &p->slots[p->mru];
+        if (slot->block == block) {
+                slot->dirty |= p->writable;
+                return slot->cells;
+        }
+
+        int victim = 0;
+        for (int k = 0; k < p->num_slots; k++) {
+                if (p->slots[k].block == block) {
+                        victim = k;
+                        break;
+                }
+                if (p->slots[k].used < p->slots[victim].used) {
+                        victim = k;
+                }
+        }
+        slot = &p->slots[victim];
+        if (slot->block != block) {
+                if (slot->block >= 0 && slot->dirty) {
+                        store_block(array2b, slot->block, slot->cells);
+                }
+                if (p->data[block] == NULL) {
+                        memset(slot->cells, 0, p->block_bytes);
+                } else if (p->length[block] == p->block_bytes) {
+                        memcpy(slot->cells, p->data[block], p->block_bytes);
+                } else {
+                        rle_decode(p->data[block], p->length[block],
+                                   array2b->blocksize * array2b->blocksize,
+                                   array2b->size, slot->cells);
+                }
+                slot->block = block;
+                slot->dirty = false;
+        }
+        slot->dirty |= p->writable;
+        slot->used = ++p->clock;
+        p->mru = victim;
+        return slot->cells;
+}
+
+/***************** UArray2b_set_writable ******************
+ * Says whether cells of a compressed array may be written
+ * through the pointers handed out from now on.
+ * 
+ * Parameters:
+ *      UArray2b_T array2b: Blocked 2D array.
+ *      bool writable: false once the caller only reads.
+ * 
+ * Returns:
+ *      None
+ * 
+ * Expects:
+ *      array2b must not be NULL.
+ * 
+ * Notes:
+ *      Blocks reached only while the array is not writable
+ *      are dropped from the cache without being encoded
+ *      again; writing them loses the change.  Blocks already
+ *      dirty stay so.  Arrays are created writable, and the
+ *      setting has no effect on other kinds of block storage.
+ *********************************************************/
+extern void UArray2b_set_writable(T array2b, bool writable)
+{
+        assert(array2b != NULL);
+        if (array2b->packed != NULL) {
+                array2b->packed->writable = writable;
+        }
+}
+
+/****************** UArray2b_footprint ********************
+ * Returns the bytes of cell storage an array holds: every
+ * block for ordinary arrays; the encoded blocks plus the
+ * cache for compressed ones.
+ * 
+ * Parameters:
+ *      UArray2b_T array2b: Blocked 2D array.
+ * 
+ * Returns:
+ *      long: Bytes of cell storage.
+ * 
+ * Expects:
+ *      array2b must not be NULL.
+ *********************************************************/
+extern long UArray2b_footprint(T array2b)
+{
+        assert(array2b != NULL);
+        int blocksize = array2b->blocksize;
+        long block_bytes = (long)blocksize * blocksize * array2b->size;
+        struct packed *p = array2b->packed;
+        if (p == NULL) {
+                long blocks = (long)((array2b->width + blocksize - 1) /
+                                     blocksize) *
+                              ((array2b->height + blocksize - 1) /
+                               blocksize);
+                return blocks * block_bytes;
+        }
+        long bytes = (long)p->num_slots * block_bytes;
+        for (int k = 0; k < p->num_blocks; k++) {
+                bytes += p->length[k];
+        }
+        return bytes;
+}
+
 /******************** UArray2b_free ***********************
  * Frees all memory associated with a blocked 2D array.
  * 
@@ -147,6 +596,34 @@ extern void UArray2b_free(T *array2b)
         assert(array2b != NULL);
         assert(*array2b != NULL);
 
+        struct packed *p = (*array2b)->packed;
+        if (p != NULL) {
+                for (int k = 0; k < p->num_blocks; k++) {
+                        free(p->data[k]);
+                }
+                for (int k = 0; k < p->num_slots; k++) {
+                        free(p->slots[k].cells);
+                }
+                free(p->data);
+                free(p->length);
+                free(p->slots);
+                free(p->scratch);
+                free(p);
+                free(*array2b);
+                *array2b = NULL;
+                return;
+        }
+
+        if ((*array2b)->cells != NULL) {
+                if ((*array2b)->release != NULL) {
+                        (*array2b)->release((*array2b)->cells,
+                                            (*array2b)->release_cl);
+                }
+                free(*array2b);
+                *array2b = NULL;
+                return;
+        }
+
         int num_blocks_width = UArray2_width((*array2b)->blocks);
         int num_blocks_height = UArray2_height((*array2b)->blocks);
 
@@ -280,18 +757,110 @@ extern void *UArray2b_at(T array2b, int column, int row)
         int b_row = row / blocksize;
         int b_col = column / blocksize;
 
-        UArray_T linear_array = *(UArray_T *)UArray2_at
-                                (array2b->blocks, b_col, b_row);
-        assert(linear_array != NULL);
+        char *block = block_at(array2b, b_col, b_row);
 
         int local_row = row % blocksize;
         int local_col = column % blocksize;
         int b_index = blocksize * local_row + local_col;
 
-        void *pixel_p = UArray_at(linear_array, b_index);
+        void *pixel_p = block + (long)b_index * array2b->size;
+        CACHESIM_TOUCH(pixel_p, array2b->size);
         return pixel_p;
 }
 
+/********************** map_blocks ************************
+ * Shared body of UArray2b_map, UArray2b_map_prefetch and
+ * UArray2b_map_range: visits blocks [first, last) in
+ * row-major block order, and every cell of a block in
+ * row-major order within the block.  With distance > 0 the
+ * block that many positions ahead is prefetched while the
+ * current one is visited.  Per-block times are recorded only
+ * if record is set (the histogram is not thread-safe).
+ *********************************************************/
+static void map_blocks(T array2b, void apply(int col, int row, T array2b,
+                                           void *elem, void *cl),
+                       void *cl, int distance, int first, int last,
+                       bool record)
+{
+        assert(array2b != NULL);
+
+        int width = UArray2b_width(array2b);
+        int height = UArray2b_height(array2b);
+        int blocksize = UArray2b_blocksize(array2b);
+
+        int num_blocks_width = (width + blocksize - 1) / blocksize;
+        int num_blocks_height = (height + blocksize - 1) / blocksize;
+        int block_bytes = blocksize * blocksize * array2b->size;
+
+        assert(0 <= first && first <= last &&
+               last <= num_blocks_width * num_blocks_height);
+#ifndef UARRAY2B_HISTOGRAM
+        (void)record;
+#endif
+        for (int b = first; b < last; b++) {
+                int b_row = b / num_blocks_width;
+                int b_col = b % num_blocks_width;
+                /*get the block */
+                char *block = block_at(array2b, b_col, b_row);
+
+                /*find the block to prefetch, if any */
+                char *next = NULL;
+                int next_offset = 0;
+                int ahead = b + distance;
+                if (distance > 0 && ahead < last) {
+                        next = block_at(array2b,
+                                        ahead % num_blocks_width,
+                                        ahead / num_blocks_width);
+                }
+
+#ifdef UARRAY2B_HISTOGRAM
+                CPUTime_Fast block_timer = { 0 };  /* started only if recording */
+                if (record && block_histogram != NULL) {
+                        CPUTime_FastStart(&block_timer);
+                }
+#endif
+                /*iterate over the block */
+                int b_length = blocksize * blocksize;
+                for (int index = 0; index < b_length; index++) {
+
+                        while (next != NULL && next_offset <
+                               (index + 1) * array2b->size &&
+                               next_offset < block_bytes) {
+                                __builtin_prefetch(next + next_offset);
+                                next_offset += PREFETCH_LINE;
+                        }
+
+                        int global_col = b_col * blocksize + 
+                                        (index % blocksize);
+                        int global_row = b_row * blocksize + 
+                                        (index / blocksize);
+
+
+                        if (global_col < array2b->width && 
+                                global_row < array2b->height) {
+                                void *elem = block + (long)index *
+                                             array2b->size;
+                                CACHESIM_TOUCH(elem, array2b->size);
+                                apply(global_col, global_row, 
+                                          array2b, elem, cl); 
+                        }
+                }
+#ifdef UARRAY2B_HISTOGRAM
+                if (record && block_histogram != NULL) {
+                        uint64_t ticks =
+                                CPUTime_FastStopTicks(&block_timer);
+                        int is_edge =
+                                (b_col + 1) * blocksize > width ||
+                                (b_row + 1) * blocksize > height;
+                        BlockHist_record(block_histogram,
+                                CPUTime_FastTicksToNs(ticks),
+                                b_col, b_row, is_edge);
+                }
+#endif
+        }
+}
+        
+
 /********************* UArray2b_map ***********************
  * Applies a function to each element of the blocked 2D array. 
  * Visits all cells in one block before moving to another block.
@@ -316,41 +885,107 @@ extern void  UArray2b_map(T array2b, void apply(int col, int row, T array2b,
                                      void *elem, void *cl), void *cl)
 {
         assert(array2b != NULL);
+        map_blocks(array2b, apply, cl, 0, 0, num_blocks(array2b), true);
+}
 
-        int width = UArray2b_width(array2b);
-        int height = UArray2b_height(array2b);
-        int blocksize = UArray2b_blocksize(array2b);
-
-        int num_blocks_width = (width + blocksize - 1) / blocksize;
-        int num_blocks_height = (height + blocksize - 1) / blocksize;
-
-        for (int b_row = 0; b_row < num_blocks_height; b_row++) {
-                for (int b_col = 0; b_col < num_blocks_width; b_col++) {
-
-                        /*get the block */
-                        UArray_T *block_p = UArray2_at(array2b->blocks, 
-                                                        b_col, b_row);
-                        UArray_T block = *block_p;
-                        assert(block != NULL);
-
-                        /*iterate over the block */
-                        int b_length = UArray_length(block);
-                        for (int index = 0; index < b_length; index++) {
+/***************** UArray2b_map_prefetch ******************
+ * Same as UArray2b_map, but while visiting one block it
+ * issues software prefetches for the block `distance` blocks
+ * further along in the visiting order.
+ * 
+ * Parameters:
+ *      UArray2b_T array2b: Blocked 2D array.
+ *      apply, cl: As for UArray2b_map.
+ *      int distance: How many blocks ahead to prefetch; 0 turns
+ *                    prefetching off.
+ * 
+ * Returns:
+ *      None
+ * 
+ * Expects:
+ *      array2b must not be NULL, distance must be non-negative.
+ * 
+ * Notes:
+ *      Blocks are separate heap objects, so the hardware
+ *      prefetcher cannot follow a jump from one to the next.
+ *      The prefetches for the upcoming block are spread evenly
+ *      over the cells of the current one, one per cache line.
+ *********************************************************/
+extern void UArray2b_map_prefetch(T array2b,
+                                  void apply(int col, int row, T array2b,
+                                             void *elem, void *cl),
+                                  void *cl, int distance)
+{
+        assert(array2b != NULL);
+        assert(distance >= 0);
+        map_blocks(array2b, apply, cl, distance, 0, num_blocks(array2b),
+                   true);
+}
 
-                                int global_col = b_col * blocksize + 
-                                                (index % blocksize);
-                                int global_row = b_row * blocksize + 
-                                                (index / blocksize);
+/****************** UArray2b_map_range ********************
+ * Same as UArray2b_map, but visits only blocks [first,
+ * last) of the row-major block order, so that several
+ * threads can each map a different range of one array.
+ * 
+ * Parameters:
+ *      UArray2b_T array2b: Blocked 2D array.
+ *      apply, cl: As for UArray2b_map.
+ *      int first, last: Range of block numbers, where block
+ *                       (b_col, b_row) is number
+ *                       b_row * blocks across + b_col.
+ * 
+ * Returns:
+ *      None
+ * 
+ * Expects:
+ *      array2b must not be NULL; 0 <= first <= last <= the
+ *      number of blocks.
+ * 
+ * Notes:
+ *      Does not record the -block-histogram times.  Arrays
+ *      with compressed blocks must not be mapped concurrently.
+ *********************************************************/
+extern void UArray2b_map_range(T array2b,
+                               void apply(int col, int row, T array2b,
+                                          void *elem, void *cl),
+                               void *cl, int first, int last)
+{
+        assert(array2b != NULL);
+        map_blocks(array2b, apply, cl, 0, first, last, false);
+}
 
+/******************* UArray2b_num_blocks ******************
+ * Returns the number of blocks of an array.
+ *********************************************************/
+extern int UArray2b_num_blocks(T array2b)
+{
+        assert(array2b != NULL);
+        return num_blocks(array2b);
+}
 
-                                if (global_col < array2b->width && 
-                                        global_row < array2b->height) {
-                                        void *elem = UArray_at(block, index);
-                                        apply(global_col, global_row, 
-                                                  array2b, elem, cl); 
-                                }
-                        }
-                }
-        }
+/********************* UArray2b_block *********************
+ * Returns the address of the first cell of a block.  The
+ * block's blocksize * blocksize cells follow it contiguously,
+ * in row-major order within the block; cells of an edge
+ * block that fall outside the array are allocated but unused.
+ * 
+ * Parameters:
+ *      UArray2b_T array2b: Blocked 2D array.
+ *      int b_col, b_row: Position of the block in the block grid.
+ * 
+ * Returns:
+ *      Pointer to the block's first cell.
+ * 
+ * Expects:
+ *      array2b must not be NULL and the block must exist.
+ * 
+ * Notes:
+ *      Will CRE if the block position is out of bounds.
+ *********************************************************/
+extern void *UArray2b_block(T array2b, int b_col, int b_row)
+{
+        assert(array2b != NULL);
+        assert(b_col >= 0 && b_col * array2b->blocksize < array2b->width);
+        assert(b_row >= 0 && b_row * array2b->blocksize < array2b->height);
+        return block_at(array2b, b_col, b_row);
 }
-        
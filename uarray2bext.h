@@ -0,0 +1,47 @@
+#ifndef UARRAY2BEXT_INCLUDED
+#define UARRAY2BEXT_INCLUDED
+/**************************************************************
+ *
+ *      uarray2bext.h
+ *
+ *      Xiaoyan Xie (xxie05)
+ *      Diwei Chen (dchen22)
+ *
+ *      CS 40 HW03 - locality
+ *
+ *      Functions implemented in uarray2b.c beyond the UArray2b
+ *      interface in uarray2b.h.
+ *
+ **************************************************************/
+
+#include <stdbool.h>
+#include "uarray2b.h"
+
+#define T UArray2b_T
+
+extern void UArray2b_map_prefetch(T array2b,
+                                  void apply(int col, int row, T array2b,
+                                             void *elem, void *cl),
+                                  void *cl, int distance);
+
+extern void UArray2b_map_range(T array2b,
+                               void apply(int col, int row, T array2b,
+                                          void *elem, void *cl),
+                               void *cl, int first, int last);
+extern int UArray2b_num_blocks(T array2b);
+
+extern void *UArray2b_block(T array2b, int b_col, int b_row);
+
+extern T UArray2b_new_from_buffer(int width, int height, int size,
+                                  int blocksize, void *cells,
+                                  void release(void *cells, void *cl),
+                                  void *cl);
+
+extern T UArray2b_new_compressed(int width, int height, int size,
+                                 int blocksize, int cache_blocks);
+
+extern long UArray2b_footprint(T array2b);
+extern void UArray2b_set_writable(T array2b, bool writable);
+
+#undef T
+#endif
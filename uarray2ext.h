@@ -0,0 +1,36 @@
+#ifndef UARRAY2EXT_INCLUDED
+#define UARRAY2EXT_INCLUDED
+/**************************************************************
+ *
+ *      uarray2ext.h
+ *
+ *      Xiaoyan Xie (xxie05)
+ *      Diwei Chen (dchen22)
+ *
+ *      CS 40 HW03 - locality
+ *
+ *      Functions implemented in uarray2.c beyond the UArray2
+ *      interface in uarray2.h.
+ *
+ **************************************************************/
+
+#include "uarray2.h"
+
+#define T UArray2_T
+
+extern void UArray2_map_col_major_prefetch(T array2,
+                                           void apply(int i, int j,
+                                                      T array2,
+                                                      void *elem,
+                                                      void *cl),
+                                           void *cl, int distance);
+
+extern void *UArray2_row(T array2, int j);
+
+extern T UArray2_new_from_buffer(int width, int height, int size,
+                                 void *cells,
+                                 void release(void *cells, void *cl),
+                                 void *cl);
+
+#undef T
+#endif